@@ -38,7 +38,7 @@ void ExportAnimation( FbxNode* pNode, apemode::Node& n ) {
         }
     }
 
-    std::vector< std::tuple< apemodefb::EAnimCurveProperty, apemodefb::EAnimCurveChannel, FbxAnimCurve*, FbxAnimLayer*, FbxAnimStack* > > animCurves;
+    std::vector< std::tuple< apemodefb::EAnimCurveProperty, apemodefb::EAnimCurveChannel, FbxAnimCurve*, FbxAnimLayer*, FbxAnimStack*, uint32_t > > animCurves;
     animCurves.reserve( animLayers.size( ) * ( apemodefb::EAnimCurveChannel_MAX + 1 ) * ( apemodefb::EAnimCurveProperty_MAX + 1 ) );
 
     for ( auto pAnimLayerTuple : animLayers ) {
@@ -47,7 +47,7 @@ void ExportAnimation( FbxNode* pNode, apemode::Node& n ) {
 
 #pragma region
 #define EmplaceBackChannel( _P, _eC, _C ) \
-    animCurves.emplace_back( apemodefb::EAnimCurveProperty_##_P, _eC, pNode->_P.GetCurve( pAnimLayer, _C ), pAnimLayer, pAnimStack );
+    animCurves.emplace_back( apemodefb::EAnimCurveProperty_##_P, _eC, pNode->_P.GetCurve( pAnimLayer, _C ), pAnimLayer, pAnimStack, 0u );
     // animCurves.emplace_back( apemodefb::EAnimCurveProperty_##_P, _eC, pNode->##_P.GetCurve( pAnimLayer, _C ), pAnimLayer, pAnimStack );
 
 #define EmplaceBack( _P )                                                                   \
@@ -74,6 +74,26 @@ void ExportAnimation( FbxNode* pNode, apemode::Node& n ) {
 #undef EmplaceBack
 #pragma endregion
 
+        /* The blend shape channels of all the deformers are numbered in order (see ExportBlendShapes).
+           The channel weight curve is X, the Y and Z curves are empty (the curves are processed as properties). */
+
+        if ( auto pMesh = pNode->GetMesh( ) ) {
+            uint32_t blendShapeChannelId = 0;
+            for ( int b = 0; b < pMesh->GetDeformerCount( FbxDeformer::eBlendShape ); ++b ) {
+                auto pBlendShape = FbxCast< FbxBlendShape >( pMesh->GetDeformer( b, FbxDeformer::eBlendShape ) );
+                for ( int c = 0; c < pBlendShape->GetBlendShapeChannelCount( ); ++c ) {
+                    animCurves.emplace_back( apemodefb::EAnimCurveProperty_BlendShapeWeight,
+                                             apemodefb::EAnimCurveChannel_X,
+                                             pMesh->GetShapeChannel( b, c, pAnimLayer ),
+                                             pAnimLayer,
+                                             pAnimStack,
+                                             blendShapeChannelId );
+                    animCurves.emplace_back( apemodefb::EAnimCurveProperty_BlendShapeWeight, apemodefb::EAnimCurveChannel_Y, nullptr, pAnimLayer, pAnimStack, blendShapeChannelId );
+                    animCurves.emplace_back( apemodefb::EAnimCurveProperty_BlendShapeWeight, apemodefb::EAnimCurveChannel_Z, nullptr, pAnimLayer, pAnimStack, blendShapeChannelId );
+                    ++blendShapeChannelId;
+                }
+            }
+        }
     }
 
     /* Ensure each curve has a name */
@@ -101,6 +121,7 @@ void ExportAnimation( FbxNode* pNode, apemode::Node& n ) {
             case apemodefb::EAnimCurveProperty_GeometricTranslation:    ss << "GeometricTranslation"; break;
             case apemodefb::EAnimCurveProperty_GeometricRotation:       ss << "GeometricRotation"; break;
             case apemodefb::EAnimCurveProperty_GeometricScaling:        ss << "GeometricScaling"; break;
+            case apemodefb::EAnimCurveProperty_BlendShapeWeight:        ss << "BlendShapeWeight " << std::get< uint32_t >( pAnimCurve ); break;
             }
 
             ss << " ";
@@ -307,6 +328,7 @@ void ExportAnimation( FbxNode* pNode, apemode::Node& n ) {
             curve.nameId      = s.PushName( pAnimCurve->GetName( ) );
             curve.property    = std::get< apemodefb::EAnimCurveProperty >( pAnimCurveTuple );
             curve.channel     = std::get< apemodefb::EAnimCurveChannel >( pAnimCurveTuple );
+            curve.blendShapeChannelId = std::get< uint32_t >( pAnimCurveTuple );
             curve.animStackId = s.animStackDict[ pAnimStack->GetUniqueID( ) ];
             curve.animLayerId = s.animLayerDict[ pAnimLayer->GetUniqueID( ) ];
             curve.nodeId      = n.id;
@@ -0,0 +1,218 @@
+#include <fbxppch.h>
+#include <fbxpstate.h>
+
+/**
+ * Export of the blend shapes (morph targets).
+ * The blend shape channels of all the blend shape deformers of the mesh are exported in order, every target shape of
+ * the channel is stored as the sparse deltas of the vertices, that move in the target shape. The deltas are quantized
+ * relative to the delta bounds of the channel (16 bits per position component, 8 bits per normal component).
+ * The channel weights are animated with the curves of the node (see ExportAnimation).
+ **/
+
+//
+// See implementation in fbxptangents.cpp.
+//
+
+void GenerateNormals( const float*    controlPoints,
+                      uint32_t        controlPointCount,
+                      const uint32_t* cornerControlPoints,
+                      uint32_t        cornerCount,
+                      float*          normals );
+
+/**
+ * Generates the smooth normals of the control points.
+ * The normal layers of the target shapes are often missing, so the deltas of the generated normals are exported
+ * (the hard edges of the base mesh get the smooth normal deltas).
+ **/
+void GenerateControlPointNormals( const std::vector< float >&    controlPoints,
+                                  const std::vector< uint32_t >& cornerControlPoints,
+                                  std::vector< mathfu::vec3 >&   normals ) {
+    const uint32_t controlPointCount = (uint32_t) ( controlPoints.size( ) / 3 );
+    const uint32_t cornerCount       = (uint32_t) cornerControlPoints.size( );
+
+    std::vector< float > cornerNormals( cornerCount * 3 );
+    GenerateNormals( controlPoints.data( ), controlPointCount, cornerControlPoints.data( ), cornerCount, cornerNormals.data( ) );
+
+    /* The generated normals are the same for all the corners of the control point. */
+    normals.assign( controlPointCount, mathfu::vec3( 0.0f, 0.0f, 1.0f ) );
+    for ( uint32_t c = 0; c < cornerCount; ++c ) {
+        normals[ cornerControlPoints[ c ] ] = mathfu::vec3( cornerNormals.data( ) + c * 3 );
+    }
+}
+
+/**
+ * Quantizes the value to the unorm relative to the bounds.
+ **/
+inline uint32_t QuantizeDelta( float value, float offset, float scale, uint32_t maxValue ) {
+    if ( scale <= 0.0f )
+        return 0;
+
+    const float q = ( value - offset ) / scale * (float) maxValue + 0.5f;
+    return (uint32_t) std::max( 0.0f, std::min( (float) maxValue, q ) );
+}
+
+/**
+ * Exports the blend shape channels of the mesh.
+ * @param pShapeMesh The mesh with the blend shape deformers (the source mesh of the triangulated one).
+ * @param cornerControlPoints The control points of the mesh corners (3 corners per triangle).
+ * @param vertexControlPoints The control points of the final vertices.
+ **/
+void ExportBlendShapes( apemode::Mesh&                 m,
+                        FbxMesh*                       pShapeMesh,
+                        const char*                    meshName,
+                        const std::vector< uint32_t >& cornerControlPoints,
+                        const std::vector< uint32_t >& vertexControlPoints ) {
+    auto& s = apemode::Get( );
+
+    const int blendShapeCount = pShapeMesh->GetDeformerCount( FbxDeformer::eBlendShape );
+    if ( 0 == blendShapeCount || vertexControlPoints.empty( ) )
+        return;
+
+    const uint32_t    controlPointCount = (uint32_t) pShapeMesh->GetControlPointsCount( );
+    const uint32_t    vertexCount       = (uint32_t) vertexControlPoints.size( );
+    const FbxVector4* pControlPoints    = pShapeMesh->GetControlPoints( );
+
+    std::vector< float > baseControlPoints( controlPointCount * 3 );
+    for ( uint32_t ci = 0; ci < controlPointCount; ++ci ) {
+        baseControlPoints[ ci * 3 + 0 ] = (float) pControlPoints[ ci ][ 0 ];
+        baseControlPoints[ ci * 3 + 1 ] = (float) pControlPoints[ ci ][ 1 ];
+        baseControlPoints[ ci * 3 + 2 ] = (float) pControlPoints[ ci ][ 2 ];
+    }
+
+    std::vector< mathfu::vec3 > baseNormals;
+    GenerateControlPointNormals( baseControlPoints, cornerControlPoints, baseNormals );
+
+    /* The vertices move, if their deltas exceed the thresholds (the position one is relative to the mesh size). */
+
+    const mathfu::vec3 positionMin( m.positionMin.x( ), m.positionMin.y( ), m.positionMin.z( ) );
+    const mathfu::vec3 positionMax( m.positionMax.x( ), m.positionMax.y( ), m.positionMax.z( ) );
+    const float        minPositionDelta = std::max( ( positionMax - positionMin ).Length( ) * 1e-5f, 1e-7f );
+    const float        minNormalDelta   = 1e-3f;
+
+    auto isMoving = [&]( const mathfu::vec3& positionDelta, const mathfu::vec3& normalDelta ) {
+        return std::max( fabsf( positionDelta.x ), std::max( fabsf( positionDelta.y ), fabsf( positionDelta.z ) ) ) > minPositionDelta ||
+               std::max( fabsf( normalDelta.x ), std::max( fabsf( normalDelta.y ), fabsf( normalDelta.z ) ) ) > minNormalDelta;
+    };
+
+    std::vector< float >        shapeControlPoints;
+    std::vector< mathfu::vec3 > shapeNormals;
+    std::vector< uint32_t >     movingVertices;
+    std::vector< mathfu::vec3 > positionDeltas;
+    std::vector< mathfu::vec3 > normalDeltas;
+    std::vector< uint32_t >     targetDeltaCounts;
+
+    uint32_t movingVertexCount = 0;
+    for ( int b = 0; b < blendShapeCount; ++b ) {
+        auto pBlendShape = FbxCast< FbxBlendShape >( pShapeMesh->GetDeformer( b, FbxDeformer::eBlendShape ) );
+        for ( int c = 0; c < pBlendShape->GetBlendShapeChannelCount( ); ++c ) {
+            FbxBlendShapeChannel* pChannel = pBlendShape->GetBlendShapeChannel( c );
+
+            /* Every channel is exported (the curves reference the channels by their indices). */
+            m.blendShapeChannels.emplace_back( );
+            auto& channel         = m.blendShapeChannels.back( );
+            channel.nameId        = s.PushName( pChannel->GetName( ) );
+            channel.defaultWeight = (float) pChannel->DeformPercent.Get( );
+
+            const int     targetCount = pChannel->GetTargetShapeCount( );
+            const double* fullWeights = pChannel->GetTargetShapeFullWeights( );
+
+            movingVertices.clear( );
+            positionDeltas.clear( );
+            normalDeltas.clear( );
+            targetDeltaCounts.clear( );
+
+            mathfu::vec3 positionDeltaMin( std::numeric_limits< float >::max( ) );
+            mathfu::vec3 positionDeltaMax( -std::numeric_limits< float >::max( ) );
+            mathfu::vec3 normalDeltaMin( std::numeric_limits< float >::max( ) );
+            mathfu::vec3 normalDeltaMax( -std::numeric_limits< float >::max( ) );
+
+            for ( int t = 0; t < targetCount; ++t ) {
+                FbxShape* pShape = pChannel->GetTargetShape( t );
+
+                /* The target shapes can omit the trailing control points (they do not move). */
+                const uint32_t    shapeControlPointCount = std::min( controlPointCount, (uint32_t) pShape->GetControlPointsCount( ) );
+                const FbxVector4* pShapeControlPoints    = pShape->GetControlPoints( );
+
+                shapeControlPoints = baseControlPoints;
+                for ( uint32_t ci = 0; ci < shapeControlPointCount; ++ci ) {
+                    shapeControlPoints[ ci * 3 + 0 ] = (float) pShapeControlPoints[ ci ][ 0 ];
+                    shapeControlPoints[ ci * 3 + 1 ] = (float) pShapeControlPoints[ ci ][ 1 ];
+                    shapeControlPoints[ ci * 3 + 2 ] = (float) pShapeControlPoints[ ci ][ 2 ];
+                }
+
+                GenerateControlPointNormals( shapeControlPoints, cornerControlPoints, shapeNormals );
+
+                const size_t targetBaseDelta = movingVertices.size( );
+                for ( uint32_t v = 0; v < vertexCount; ++v ) {
+                    const uint32_t     ci = vertexControlPoints[ v ];
+                    const mathfu::vec3 positionDelta =
+                        mathfu::vec3( shapeControlPoints.data( ) + ci * 3 ) - mathfu::vec3( baseControlPoints.data( ) + ci * 3 );
+                    const mathfu::vec3 normalDelta = shapeNormals[ ci ] - baseNormals[ ci ];
+
+                    if ( isMoving( positionDelta, normalDelta ) ) {
+                        movingVertices.push_back( v );
+                        positionDeltas.push_back( positionDelta );
+                        normalDeltas.push_back( normalDelta );
+
+                        positionDeltaMin = mathfu::vec3::Min( positionDeltaMin, positionDelta );
+                        positionDeltaMax = mathfu::vec3::Max( positionDeltaMax, positionDelta );
+                        normalDeltaMin   = mathfu::vec3::Min( normalDeltaMin, normalDelta );
+                        normalDeltaMax   = mathfu::vec3::Max( normalDeltaMax, normalDelta );
+                    }
+                }
+
+                targetDeltaCounts.push_back( (uint32_t) ( movingVertices.size( ) - targetBaseDelta ) );
+            }
+
+            if ( movingVertices.empty( ) ) {
+                positionDeltaMin = positionDeltaMax = mathfu::vec3( 0.0f );
+                normalDeltaMin = normalDeltaMax = mathfu::vec3( 0.0f );
+            }
+
+            const mathfu::vec3 positionDeltaScale = positionDeltaMax - positionDeltaMin;
+            const mathfu::vec3 normalDeltaScale   = normalDeltaMax - normalDeltaMin;
+
+            channel.positionOffset = apemodefb::vec3( positionDeltaMin.x, positionDeltaMin.y, positionDeltaMin.z );
+            channel.positionScale  = apemodefb::vec3( positionDeltaScale.x, positionDeltaScale.y, positionDeltaScale.z );
+            channel.normalOffset   = apemodefb::vec3( normalDeltaMin.x, normalDeltaMin.y, normalDeltaMin.z );
+            channel.normalScale    = apemodefb::vec3( normalDeltaScale.x, normalDeltaScale.y, normalDeltaScale.z );
+
+            /* The deltas of the targets go one after another. */
+
+            size_t delta = 0;
+            channel.targets.resize( targetCount );
+            for ( int t = 0; t < targetCount; ++t ) {
+                auto& target      = channel.targets[ t ];
+                target.fullWeight = nullptr != fullWeights ? (float) fullWeights[ t ] : 100.0f;
+                target.deltas.reserve( targetDeltaCounts[ t ] );
+
+                for ( const size_t targetEndDelta = delta + targetDeltaCounts[ t ]; delta < targetEndDelta; ++delta ) {
+                    const mathfu::vec3& p = positionDeltas[ delta ];
+                    const mathfu::vec3& n = normalDeltas[ delta ];
+                    target.deltas.emplace_back( movingVertices[ delta ],
+                                                (uint16_t) QuantizeDelta( p.x, positionDeltaMin.x, positionDeltaScale.x, 0xffff ),
+                                                (uint16_t) QuantizeDelta( p.y, positionDeltaMin.y, positionDeltaScale.y, 0xffff ),
+                                                (uint16_t) QuantizeDelta( p.z, positionDeltaMin.z, positionDeltaScale.z, 0xffff ),
+                                                (uint8_t) QuantizeDelta( n.x, normalDeltaMin.x, normalDeltaScale.x, 0xff ),
+                                                (uint8_t) QuantizeDelta( n.y, normalDeltaMin.y, normalDeltaScale.y, 0xff ),
+                                                (uint8_t) QuantizeDelta( n.z, normalDeltaMin.z, normalDeltaScale.z, 0xff ) );
+                }
+            }
+
+            movingVertexCount += (uint32_t) movingVertices.size( );
+            s.console->info( "Mesh \"{}\" blend shape channel \"{}\" has {} target(s), {} moving vertices ({} vertices).",
+                             meshName,
+                             pChannel->GetName( ),
+                             targetCount,
+                             movingVertices.size( ),
+                             vertexCount );
+        }
+    }
+
+    s.console->info( "Mesh \"{}\" has {} blend shape channels, {} deltas ({} bytes, {} bytes dense).",
+                     meshName,
+                     m.blendShapeChannels.size( ),
+                     movingVertexCount,
+                     movingVertexCount * sizeof( apemodefb::BlendShapeDeltaFb ),
+                     size_t( vertexCount ) * m.blendShapeChannels.size( ) * sizeof( apemodefb::vec3 ) * 2 );
+}
@@ -0,0 +1,329 @@
+#include <fbxppch.h>
+#include <fbxpstate.h>
+#include <fbxpbvh.h>
+#include <chrono>
+#include <random>
+
+/**
+ * Triangle BVH builder (--bvh option, see fbxpbvh.h for the layout and the reference traversal).
+ * The BVH is built top-down with the surface area heuristic evaluated in the centroid bins of every axis.
+ * The node is split, if the split is cheaper than the leaf (or the leaf is too large), the depth is limited by the
+ * traversal stack. With --bvh-benchmark the throughput of the reference traversal is measured on the random rays
+ * after the build, and the hits of some of the rays are compared with the brute force intersection.
+ **/
+
+static const uint32_t kBvhBinCount         = 16;
+static const uint32_t kBvhMaxLeafTriangles = 4;
+static const uint32_t kBvhBenchmarkRays    = 1 << 16;
+static const uint32_t kBvhVerifiedRays     = 256;
+static const float    kBvhTraversalCost    = 1.0f; // Relative to the triangle intersection cost.
+
+struct BvhBounds {
+    mathfu::vec3 bboxMin = mathfu::vec3( std::numeric_limits< float >::max( ) );
+    mathfu::vec3 bboxMax = mathfu::vec3( -std::numeric_limits< float >::max( ) );
+
+    void Grow( const mathfu::vec3& p ) {
+        bboxMin = mathfu::vec3::Min( bboxMin, p );
+        bboxMax = mathfu::vec3::Max( bboxMax, p );
+    }
+
+    void Grow( const BvhBounds& b ) {
+        bboxMin = mathfu::vec3::Min( bboxMin, b.bboxMin );
+        bboxMax = mathfu::vec3::Max( bboxMax, b.bboxMax );
+    }
+
+    float GetHalfArea( ) const {
+        const mathfu::vec3 d = bboxMax - bboxMin;
+        return d.x < 0.0f ? 0.0f : d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+};
+
+struct BvhBuildTriangle {
+    BvhBounds    bounds;
+    mathfu::vec3 centroid;
+    uint32_t     triangle;
+};
+
+struct BvhBuilder {
+    std::vector< BvhBuildTriangle >&     items;
+    std::vector< apemodefb::BvhNodeFb >& nodes;
+    uint32_t                             maxDepth  = 0;
+    uint32_t                             leafCount = 0;
+
+    /**
+     * Builds the subtree of the triangle range.
+     * @return The index of the subtree root node.
+     **/
+    uint32_t Build( uint32_t begin, uint32_t end, uint32_t depth ) {
+        BvhBounds bounds;
+        BvhBounds centroidBounds;
+        for ( uint32_t i = begin; i < end; ++i ) {
+            bounds.Grow( items[ i ].bounds );
+            centroidBounds.Grow( items[ i ].centroid );
+        }
+
+        const uint32_t nodeIndex = (uint32_t) nodes.size( );
+        const uint32_t count     = end - begin;
+        nodes.emplace_back( );
+        maxDepth = std::max( maxDepth, depth );
+
+        /* The best split of the centroid bins (the leaf cost is the triangle count). */
+
+        uint32_t splitAxis = 3;
+        uint32_t splitBin  = 0;
+        float    splitCost = std::numeric_limits< float >::max( );
+
+        const mathfu::vec3 centroidExtent = centroidBounds.bboxMax - centroidBounds.bboxMin;
+        for ( uint32_t axis = 0; axis < 3 && count > 1; ++axis ) {
+            if ( centroidExtent[ axis ] <= 0.0f )
+                continue;
+
+            BvhBounds binBounds[ kBvhBinCount ];
+            uint32_t  binCounts[ kBvhBinCount ] = {};
+            for ( uint32_t i = begin; i < end; ++i ) {
+                const uint32_t bin = GetBin( items[ i ].centroid, centroidBounds, axis );
+                binBounds[ bin ].Grow( items[ i ].bounds );
+                ++binCounts[ bin ];
+            }
+
+            /* The right side costs are accumulated from the last bin. */
+
+            float     rightCosts[ kBvhBinCount ];
+            BvhBounds rightBounds;
+            uint32_t  rightCount = 0;
+            for ( uint32_t b = kBvhBinCount - 1; b > 0; --b ) {
+                rightBounds.Grow( binBounds[ b ] );
+                rightCount += binCounts[ b ];
+                rightCosts[ b ] = rightBounds.GetHalfArea( ) * rightCount;
+            }
+
+            BvhBounds leftBounds;
+            uint32_t  leftCount = 0;
+            for ( uint32_t b = 0; b + 1 < kBvhBinCount; ++b ) {
+                leftBounds.Grow( binBounds[ b ] );
+                leftCount += binCounts[ b ];
+
+                const float cost = leftBounds.GetHalfArea( ) * leftCount + rightCosts[ b + 1 ];
+                if ( leftCount && leftCount < count && cost < splitCost ) {
+                    splitAxis = axis;
+                    splitBin  = b;
+                    splitCost = cost;
+                }
+            }
+        }
+
+        const float leafCost  = bounds.GetHalfArea( ) * count;
+        const float innerCost = bounds.GetHalfArea( ) * kBvhTraversalCost + splitCost;
+        const bool  mustSplit = count > kBvhMaxLeafTriangles;
+
+        uint32_t middle = begin;
+        if ( depth + 1 < apemode::kBvhMaxDepth && count > 1 && ( mustSplit || innerCost < leafCost ) ) {
+            if ( splitAxis < 3 ) {
+                middle = uint32_t( std::partition( items.data( ) + begin, items.data( ) + end, [&]( const BvhBuildTriangle& item ) {
+                                       return GetBin( item.centroid, centroidBounds, splitAxis ) <= splitBin;
+                                   } ) - items.data( ) );
+            } else if ( mustSplit ) {
+                /* The centroids are the same, the triangles are halved. */
+                middle = begin + count / 2;
+            }
+        }
+
+        if ( middle == begin || middle == end ) {
+            ++leafCount;
+            nodes[ nodeIndex ] = apemodefb::BvhNodeFb( apemodefb::vec3( bounds.bboxMin.x, bounds.bboxMin.y, bounds.bboxMin.z ),
+                                                       apemodefb::vec3( bounds.bboxMax.x, bounds.bboxMax.y, bounds.bboxMax.z ),
+                                                       begin,
+                                                       count );
+            return nodeIndex;
+        }
+
+        /* The first child follows the node. */
+        Build( begin, middle, depth + 1 );
+        const uint32_t secondChild = Build( middle, end, depth + 1 );
+
+        nodes[ nodeIndex ] = apemodefb::BvhNodeFb( apemodefb::vec3( bounds.bboxMin.x, bounds.bboxMin.y, bounds.bboxMin.z ),
+                                                   apemodefb::vec3( bounds.bboxMax.x, bounds.bboxMax.y, bounds.bboxMax.z ),
+                                                   secondChild,
+                                                   0 );
+        return nodeIndex;
+    }
+
+    static uint32_t GetBin( const mathfu::vec3& centroid, const BvhBounds& centroidBounds, uint32_t axis ) {
+        const float extent = centroidBounds.bboxMax[ axis ] - centroidBounds.bboxMin[ axis ];
+        const float bin    = ( centroid[ axis ] - centroidBounds.bboxMin[ axis ] ) / extent * kBvhBinCount;
+        return std::min( (uint32_t) std::max( bin, 0.0f ), kBvhBinCount - 1 );
+    }
+};
+
+/**
+ * Measures the closest and any hit throughput of the reference traversal on the random rays (--bvh-benchmark).
+ * The hits of some of the rays are compared with the brute force intersection, the BVH is cleared on mismatch.
+ **/
+void BenchmarkBvh( apemode::Mesh&                     m,
+                   const char*                        meshName,
+                   const std::vector< mathfu::vec3 >& positions,
+                   const std::vector< uint32_t >&     triangleVertices ) {
+    auto& s = apemode::Get( );
+
+    const uint32_t triangleCount = uint32_t( triangleVertices.size( ) / 3 );
+
+    /* Random rays through the mesh box (about half of them miss the triangles). */
+
+    const mathfu::vec3 bboxMin( m.bvhNodes[ 0 ].bbox_min( ).x( ), m.bvhNodes[ 0 ].bbox_min( ).y( ), m.bvhNodes[ 0 ].bbox_min( ).z( ) );
+    const mathfu::vec3 bboxMax( m.bvhNodes[ 0 ].bbox_max( ).x( ), m.bvhNodes[ 0 ].bbox_max( ).y( ), m.bvhNodes[ 0 ].bbox_max( ).z( ) );
+    const mathfu::vec3 bboxExtent = bboxMax - bboxMin;
+
+    std::mt19937                            rng( 0 );
+    std::uniform_real_distribution< float > unorm( 0.0f, 1.0f );
+    auto getRandomPoint = [&]( float scale ) {
+        return bboxMin + bboxExtent * 0.5f + mathfu::vec3( unorm( rng ) - 0.5f, unorm( rng ) - 0.5f, unorm( rng ) - 0.5f ) * bboxExtent * scale;
+    };
+
+    std::vector< apemode::BvhRay > rays( std::min( kBvhBenchmarkRays, std::max( 1024u, triangleCount * 4 ) ) );
+    for ( auto& ray : rays ) {
+        const mathfu::vec3 origin    = getRandomPoint( 3.0f );
+        const mathfu::vec3 direction = getRandomPoint( 1.0f ) - origin;
+        ray.origin[ 0 ]              = origin.x;
+        ray.origin[ 1 ]              = origin.y;
+        ray.origin[ 2 ]              = origin.z;
+        ray.direction[ 0 ]           = direction.x;
+        ray.direction[ 1 ]           = direction.y;
+        ray.direction[ 2 ]           = direction.z;
+        ray.tmin                     = 0.0f;
+        ray.tmax                     = std::numeric_limits< float >::max( );
+    }
+
+    auto fetchTriangle = [&]( uint32_t triangle, float corners[ 9 ] ) {
+        for ( uint32_t k = 0; k < 3; ++k ) {
+            const mathfu::vec3& p = positions[ triangleVertices[ triangle * 3 + k ] ];
+            corners[ k * 3 + 0 ]  = p.x;
+            corners[ k * 3 + 1 ]  = p.y;
+            corners[ k * 3 + 2 ]  = p.z;
+        }
+    };
+
+    const auto nodes = reinterpret_cast< const apemode::BvhNode* >( m.bvhNodes.data( ) );
+
+    /* The closest hits are compared with the brute force ones (the same intersection test, so the distances match). */
+
+    const uint32_t verifiedRayCount = std::min( kBvhVerifiedRays, std::max( 1u, ( 1u << 24 ) / triangleCount ) );
+    for ( uint32_t r = 0; r < verifiedRayCount; ++r ) {
+        apemode::BvhHit hit;
+        const bool      found = apemode::IntersectBvh( nodes, m.bvhTriangles.data( ), rays[ r ], fetchTriangle, hit );
+
+        float closest      = rays[ r ].tmax;
+        bool  foundClosest = false;
+        for ( uint32_t t = 0; t < triangleCount; ++t ) {
+            float corners[ 9 ], tt, u, v;
+            fetchTriangle( t, corners );
+            if ( apemode::details::IntersectBvhTriangle( corners, rays[ r ], closest, tt, u, v ) ) {
+                closest      = tt;
+                foundClosest = true;
+            }
+        }
+
+        if ( found != foundClosest || ( found && hit.t != closest ) ) {
+            s.console->error( "Mesh \"{}\" BVH verification failed (ray #{}), BVH skipped.", meshName, r );
+            m.bvhNodes.clear( );
+            m.bvhTriangles.clear( );
+            return;
+        }
+    }
+
+    /* Throughput of the reference traversal (closest and any hit). */
+
+    uint32_t hitCount    = 0;
+    uint32_t anyHitCount = 0;
+
+    const auto closestStart = std::chrono::high_resolution_clock::now( );
+    for ( const auto& ray : rays ) {
+        apemode::BvhHit hit;
+        hitCount += apemode::IntersectBvh( nodes, m.bvhTriangles.data( ), ray, fetchTriangle, hit ) ? 1 : 0;
+    }
+
+    const auto anyStart = std::chrono::high_resolution_clock::now( );
+    for ( const auto& ray : rays ) {
+        apemode::BvhHit hit;
+        anyHitCount += apemode::IntersectBvh( nodes, m.bvhTriangles.data( ), ray, fetchTriangle, hit, true ) ? 1 : 0;
+    }
+
+    const auto   anyEnd         = std::chrono::high_resolution_clock::now( );
+    const double closestSeconds = std::max( 1e-9, std::chrono::duration< double >( anyStart - closestStart ).count( ) );
+    const double anySeconds     = std::max( 1e-9, std::chrono::duration< double >( anyEnd - anyStart ).count( ) );
+
+    s.console->info( "Mesh \"{}\" BVH: {:.2f} Mrays/s closest hit, {:.2f} Mrays/s any hit ({} rays, {} hits, {} verified).",
+                     meshName,
+                     rays.size( ) / closestSeconds * 1e-6,
+                     rays.size( ) / anySeconds * 1e-6,
+                     rays.size( ),
+                     hitCount,
+                     verifiedRayCount );
+
+    assert( hitCount == anyHitCount );
+}
+
+/**
+ * Builds the BVH over the triangles of the original mesh (the LOD triangles are not included).
+ * @param indices The final mesh indices (relative to the submesh base vertices).
+ * @param indexCount The index count of the original mesh (the LOD indices are appended after).
+ * @param positions The unpacked vertex positions.
+ * @param padding The position packing error per axis (the triangle boxes are extended by it).
+ **/
+void BuildBvh( apemode::Mesh&                     m,
+               const char*                        meshName,
+               const std::vector< uint32_t >&     indices,
+               uint32_t                           indexCount,
+               const std::vector< mathfu::vec3 >& positions,
+               const mathfu::vec3&                padding ) {
+    auto& s = apemode::Get( );
+
+    m.bvhNodes.clear( );
+    m.bvhTriangles.clear( );
+
+    /* The vertices of the triangles (the split submeshes have their own base vertices). */
+
+    const uint32_t          triangleCount = indexCount / 3;
+    std::vector< uint32_t > triangleVertices( triangleCount * 3 );
+    for ( const auto& submesh : m.submeshes ) {
+        const uint32_t endIndex = std::min( submesh.base_index( ) + submesh.index_count( ), triangleCount * 3 );
+        for ( uint32_t i = submesh.base_index( ); i < endIndex; ++i ) {
+            triangleVertices[ i ] = submesh.base_vertex( ) + indices[ i ];
+        }
+    }
+
+    if ( 0 == triangleCount )
+        return;
+
+    std::vector< BvhBuildTriangle > items( triangleCount );
+    for ( uint32_t t = 0; t < triangleCount; ++t ) {
+        auto& item = items[ t ];
+        for ( uint32_t k = 0; k < 3; ++k ) {
+            item.bounds.Grow( positions[ triangleVertices[ t * 3 + k ] ] );
+        }
+
+        item.bounds.bboxMin -= padding;
+        item.bounds.bboxMax += padding;
+        item.centroid = ( item.bounds.bboxMin + item.bounds.bboxMax ) * 0.5f;
+        item.triangle = t;
+    }
+
+    BvhBuilder builder{items, m.bvhNodes};
+    m.bvhNodes.reserve( triangleCount * 2 / kBvhMaxLeafTriangles + 1 );
+    builder.Build( 0, triangleCount, 0 );
+
+    m.bvhTriangles.reserve( triangleCount );
+    for ( const auto& item : items ) {
+        m.bvhTriangles.push_back( item.triangle );
+    }
+
+    s.console->info( "Mesh \"{}\" BVH: {} nodes ({} leaves, depth {}, {} bytes) for {} triangles.",
+                     meshName,
+                     m.bvhNodes.size( ),
+                     builder.leafCount,
+                     builder.maxDepth,
+                     m.bvhNodes.size( ) * sizeof( apemodefb::BvhNodeFb ) + m.bvhTriangles.size( ) * sizeof( uint32_t ),
+                     triangleCount );
+
+    if ( s.benchmarkBvh )
+        BenchmarkBvh( m, meshName, positions, triangleVertices );
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Triangle BVH of the mesh (MeshFb.bvh_nodes and MeshFb.bvh_triangles) for the CPU raycasting and picking.
+ * The header has no dependencies, so it can be used in the loaders as is (the builder is in fbxpbvh.cpp).
+ *
+ * Layout:
+ *  - The nodes are 32 bytes (BvhNodeFb, aligned to 32 bytes in the buffer, so a node never crosses a cache line).
+ *    The root is the first node, the nodes are stored in the depth-first order (the first child follows its parent).
+ *  - Inner node: count is 0, offset is the index of the second child.
+ *  - Leaf node: count is the triangle count, offset is the first triangle in MeshFb.bvh_triangles.
+ *  - MeshFb.bvh_triangles are the triangle indices in MeshFb.indices (the triangle t is the indices 3t, 3t+1 and 3t+2
+ *    relative to the base vertex of its submesh), the LOD submeshes are not included.
+ *  - The node boxes are in mesh units and include the position packing error, so the triangles of the decoded packed
+ *    positions are inside the boxes.
+ **/
+
+namespace apemode {
+
+    struct BvhNode {
+        float    bboxMin[ 3 ];
+        float    bboxMax[ 3 ];
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    static_assert( sizeof( BvhNode ) == 32, "Must match BvhNodeFb" );
+
+    /* The builder limits the depth, so the traversal stack is fixed. */
+    static const uint32_t kBvhMaxDepth = 64;
+
+    struct BvhRay {
+        float origin[ 3 ];
+        float direction[ 3 ]; // Not normalized, the distances are in the direction lengths.
+        float tmin;
+        float tmax;
+    };
+
+    struct BvhHit {
+        uint32_t triangle; // Triangle index in MeshFb.indices.
+        float    t;
+        float    u; // Barycentrics of the second and third triangle corners.
+        float    v;
+    };
+
+    namespace details {
+        inline bool IntersectBvhBox( const BvhNode& node, const BvhRay& ray, const float invDirection[ 3 ], float tmax, float& tnear ) {
+            float tmin = ray.tmin;
+            for ( int k = 0; k < 3; ++k ) {
+                float t0 = ( node.bboxMin[ k ] - ray.origin[ k ] ) * invDirection[ k ];
+                float t1 = ( node.bboxMax[ k ] - ray.origin[ k ] ) * invDirection[ k ];
+                if ( t0 > t1 ) {
+                    const float t = t0;
+                    t0            = t1;
+                    t1            = t;
+                }
+
+                tmin = t0 > tmin ? t0 : tmin;
+                tmax = t1 < tmax ? t1 : tmax;
+            }
+
+            tnear = tmin;
+            return tmin <= tmax;
+        }
+
+        inline void SubtractBvhVector( const float* a, const float* b, float* c ) {
+            c[ 0 ] = a[ 0 ] - b[ 0 ];
+            c[ 1 ] = a[ 1 ] - b[ 1 ];
+            c[ 2 ] = a[ 2 ] - b[ 2 ];
+        }
+
+        inline void CrossBvhVector( const float* a, const float* b, float* c ) {
+            c[ 0 ] = a[ 1 ] * b[ 2 ] - a[ 2 ] * b[ 1 ];
+            c[ 1 ] = a[ 2 ] * b[ 0 ] - a[ 0 ] * b[ 2 ];
+            c[ 2 ] = a[ 0 ] * b[ 1 ] - a[ 1 ] * b[ 0 ];
+        }
+
+        inline float DotBvhVector( const float* a, const float* b ) {
+            return a[ 0 ] * b[ 0 ] + a[ 1 ] * b[ 1 ] + a[ 2 ] * b[ 2 ];
+        }
+
+        /**
+         * Two-sided ray-triangle intersection (Moller-Trumbore).
+         **/
+        inline bool IntersectBvhTriangle( const float corners[ 9 ], const BvhRay& ray, float tmax, float& t, float& u, float& v ) {
+            float e1[ 3 ], e2[ 3 ], p[ 3 ], q[ 3 ], o[ 3 ];
+            SubtractBvhVector( corners + 3, corners, e1 );
+            SubtractBvhVector( corners + 6, corners, e2 );
+            CrossBvhVector( ray.direction, e2, p );
+
+            const float det = DotBvhVector( e1, p );
+            if ( det == 0.0f )
+                return false;
+
+            const float invDet = 1.0f / det;
+            SubtractBvhVector( ray.origin, corners, o );
+            u = DotBvhVector( o, p ) * invDet;
+            if ( u < 0.0f || u > 1.0f )
+                return false;
+
+            CrossBvhVector( o, e1, q );
+            v = DotBvhVector( ray.direction, q ) * invDet;
+            if ( v < 0.0f || u + v > 1.0f )
+                return false;
+
+            t = DotBvhVector( e2, q ) * invDet;
+            return t >= ray.tmin && t < tmax;
+        }
+    } // namespace details
+
+    /**
+     * Fetches the triangle corners from the unpacked vertices (the static vertex formats or the position stream,
+     * the position is 3 floats at the beginning of the vertex) of the mesh without the submesh base vertices.
+     **/
+    template < typename TIndex >
+    struct BvhTriangleFetch {
+        const TIndex*  indices;
+        const uint8_t* vertices;
+        uint32_t       vertexStride;
+
+        void operator( )( uint32_t triangle, float corners[ 9 ] ) const {
+            for ( uint32_t k = 0; k < 3; ++k ) {
+                memcpy( corners + k * 3, vertices + size_t( indices[ triangle * 3 + k ] ) * vertexStride, sizeof( float ) * 3 );
+            }
+        }
+    };
+
+    /**
+     * Reference traversal: finds the closest hit of the ray (or any hit for the line of sight tests).
+     * The children are visited in the order of their entry distances, the farther ones are skipped after the closer hits.
+     * @param fetchTriangle The functor that fills the triangle corners: void( uint32_t triangle, float corners[ 9 ] ).
+     * @param anyHit Stop at the first hit (the hit is not the closest one).
+     * @return True if the ray hits the mesh.
+     **/
+    template < typename TFetchTriangle >
+    bool IntersectBvh( const BvhNode*        nodes,
+                       const uint32_t*       triangles,
+                       const BvhRay&         ray,
+                       const TFetchTriangle& fetchTriangle,
+                       BvhHit&               hit,
+                       bool                  anyHit = false ) {
+        if ( nullptr == nodes )
+            return false;
+
+        const float invDirection[ 3 ] = {1.0f / ray.direction[ 0 ], 1.0f / ray.direction[ 1 ], 1.0f / ray.direction[ 2 ]};
+
+        uint32_t stackNodes[ kBvhMaxDepth ];
+        float    stackDistances[ kBvhMaxDepth ];
+        uint32_t stackSize = 0;
+
+        float closest = ray.tmax;
+        bool  found   = false;
+        float tnear   = 0.0f;
+        if ( false == details::IntersectBvhBox( nodes[ 0 ], ray, invDirection, closest, tnear ) )
+            return false;
+
+        uint32_t nodeIndex = 0;
+        for ( ;; ) {
+            const BvhNode& node = nodes[ nodeIndex ];
+            if ( node.count ) {
+                float corners[ 9 ];
+                for ( uint32_t i = node.offset; i < node.offset + node.count; ++i ) {
+                    float t, u, v;
+                    fetchTriangle( triangles[ i ], corners );
+                    if ( details::IntersectBvhTriangle( corners, ray, closest, t, u, v ) ) {
+                        closest      = t;
+                        found        = true;
+                        hit.triangle = triangles[ i ];
+                        hit.t        = t;
+                        hit.u        = u;
+                        hit.v        = v;
+                        if ( anyHit )
+                            return true;
+                    }
+                }
+            } else {
+                uint32_t firstChild  = nodeIndex + 1;
+                uint32_t secondChild = node.offset;
+                float    tFirst, tSecond;
+
+                const bool hitFirst  = details::IntersectBvhBox( nodes[ firstChild ], ray, invDirection, closest, tFirst );
+                const bool hitSecond = details::IntersectBvhBox( nodes[ secondChild ], ray, invDirection, closest, tSecond );
+                if ( hitFirst && hitSecond ) {
+                    if ( tSecond < tFirst ) {
+                        const uint32_t n = firstChild;
+                        const float    t = tFirst;
+                        firstChild       = secondChild;
+                        secondChild      = n;
+                        tFirst           = tSecond;
+                        tSecond          = t;
+                    }
+
+                    stackNodes[ stackSize ]       = secondChild;
+                    stackDistances[ stackSize++ ] = tSecond;
+                    nodeIndex                     = firstChild;
+                    continue;
+                }
+
+                if ( hitFirst || hitSecond ) {
+                    nodeIndex = hitFirst ? firstChild : secondChild;
+                    continue;
+                }
+            }
+
+            /* The nodes behind the closest hit are skipped. */
+            do {
+                if ( 0 == stackSize )
+                    return found;
+                nodeIndex = stackNodes[ --stackSize ];
+            } while ( stackDistances[ stackSize ] > closest );
+        }
+    }
+
+} // namespace apemode
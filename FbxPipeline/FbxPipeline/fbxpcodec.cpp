@@ -0,0 +1,184 @@
+#include <fbxppch.h>
+#include <fbxpstate.h>
+#include <fbxpcodec.h>
+
+/**
+ * Mesh buffer encoder, see the stream layout and the decoder in fbxpcodec.h.
+ **/
+
+inline uint8_t ZigzagEncode( uint8_t v ) {
+    return uint8_t( ( v << 1 ) ^ ( 0 - ( v >> 7 ) ) );
+}
+
+inline uint32_t ZigzagEncode( int32_t v ) {
+    return ( uint32_t( v ) << 1 ) ^ uint32_t( v >> 31 );
+}
+
+/**
+ * Chooses the smallest bit width code (0, 2, 4 or 8 bits per byte) for the group.
+ **/
+uint32_t GetCodecGroupCode( const uint8_t* group ) {
+    uint8_t maxValue = 0;
+    for ( uint32_t i = 0; i < apemode::kCodecGroupSize; ++i ) {
+        maxValue = std::max( maxValue, group[ i ] );
+    }
+
+    return 0 == maxValue ? 0 : maxValue < 4 ? 1 : maxValue < 16 ? 2 : 3;
+}
+
+void EncodeCodecGroup( const uint8_t* group, uint32_t code, std::vector< uint8_t >& encoded ) {
+    const uint32_t bitCount = code ? 1u << code : 0u;
+    const size_t   offset   = encoded.size( );
+    encoded.resize( offset + ( code ? 2u << code : 0u ), 0 );
+
+    for ( uint32_t i = 0; i < apemode::kCodecGroupSize && bitCount; ++i ) {
+        const uint32_t bitOffset = i * bitCount;
+        encoded[ offset + ( bitOffset >> 3 ) ] |= uint8_t( group[ i ] << ( bitOffset & 7 ) );
+    }
+}
+
+/**
+ * Transforms the indices to the zigzag encoded differences of the consecutive indices.
+ **/
+template < typename TIndex >
+void EncodeIndexDeltas( const uint8_t* src, uint32_t elementCount, uint8_t* dst ) {
+    TIndex previous = 0;
+    for ( uint32_t i = 0; i < elementCount; ++i ) {
+        TIndex index;
+        memcpy( &index, src + i * sizeof( TIndex ), sizeof( TIndex ) );
+
+        /* The difference wraps around the index type (like the decoder sum does). */
+        const int32_t delta   = std::is_same< TIndex, uint16_t >::value ? int32_t( int16_t( index - previous ) ) : int32_t( index - previous );
+        const TIndex  encoded = TIndex( ZigzagEncode( delta ) );
+        memcpy( dst + i * sizeof( TIndex ), &encoded, sizeof( TIndex ) );
+        previous = index;
+    }
+}
+
+/**
+ * Encodes the buffer of elementCount * elementSize bytes.
+ * @param flags eCodecFlag_ByteDelta for the vertices, eCodecFlag_IndexDelta for the indices.
+ **/
+void EncodeMeshBuffer( const uint8_t*          src,
+                       uint32_t                elementCount,
+                       uint32_t                elementSize,
+                       uint8_t                 flags,
+                       std::vector< uint8_t >& encoded ) {
+    using namespace apemode;
+
+    assert( elementSize > 0 && elementSize <= kCodecMaxElementSize );
+    assert( 0 == ( flags & eCodecFlag_IndexDelta ) || 2 == elementSize || 4 == elementSize );
+
+    std::vector< uint8_t > deltas;
+    if ( flags & eCodecFlag_IndexDelta ) {
+        deltas.resize( size_t( elementCount ) * elementSize );
+        if ( 2 == elementSize )
+            EncodeIndexDeltas< uint16_t >( src, elementCount, deltas.data( ) );
+        else
+            EncodeIndexDeltas< uint32_t >( src, elementCount, deltas.data( ) );
+        src = deltas.data( );
+    }
+
+    const bool byteDelta = 0 != ( flags & eCodecFlag_ByteDelta );
+
+    encoded.clear( );
+    encoded.reserve( kCodecHeaderSize + size_t( elementCount ) * elementSize );
+    encoded.push_back( kCodecVersion );
+    encoded.push_back( flags );
+    encoded.push_back( uint8_t( elementSize ) );
+    encoded.push_back( uint8_t( elementSize >> 8 ) );
+    encoded.push_back( uint8_t( elementCount ) );
+    encoded.push_back( uint8_t( elementCount >> 8 ) );
+    encoded.push_back( uint8_t( elementCount >> 16 ) );
+    encoded.push_back( uint8_t( elementCount >> 24 ) );
+
+    std::vector< uint8_t > last( elementSize, 0 );
+    uint8_t                plane[ kCodecBlockElements ];
+
+    for ( uint32_t baseElement = 0; baseElement < elementCount; baseElement += kCodecBlockElements ) {
+        const uint32_t blockElements = std::min( elementCount - baseElement, kCodecBlockElements );
+        const uint32_t groupCount    = ( blockElements + kCodecGroupSize - 1 ) / kCodecGroupSize;
+
+        for ( uint32_t k = 0; k < elementSize; ++k ) {
+
+            /* The padding bytes of the last group are zeros (the zero deltas for the byte deltas). */
+            memset( plane, 0, sizeof( plane ) );
+            for ( uint32_t i = 0; i < blockElements; ++i ) {
+                const uint8_t value = src[ size_t( baseElement + i ) * elementSize + k ];
+                plane[ i ]          = byteDelta ? ZigzagEncode( uint8_t( value - last[ k ] ) ) : value;
+                last[ k ]           = value;
+            }
+
+            const size_t codesOffset = encoded.size( );
+            encoded.resize( codesOffset + ( groupCount + 3 ) / 4, 0 );
+
+            for ( uint32_t g = 0; g < groupCount; ++g ) {
+                const uint32_t code = GetCodecGroupCode( plane + g * kCodecGroupSize );
+                encoded[ codesOffset + ( g >> 2 ) ] |= uint8_t( code << ( ( g & 3 ) * 2 ) );
+                EncodeCodecGroup( plane + g * kCodecGroupSize, code, encoded );
+            }
+        }
+    }
+}
+
+/**
+ * Compresses the vertex and index buffers of the mesh (-c option).
+ * Every buffer is decoded back and compared with the original one, the buffer stays uncompressed on mismatch.
+ **/
+void CompressMesh( apemode::Mesh& m, const char* meshName ) {
+    auto& s = apemode::Get( );
+
+    if ( m.submeshes.empty( ) )
+        return;
+
+    std::vector< uint8_t > encoded;
+    std::vector< uint8_t > decoded;
+
+    auto roundTrip = [&]( const std::vector< uint8_t >& buffer ) {
+        decoded.resize( buffer.size( ) );
+        return apemode::DecodeMeshBuffer( decoded.data( ), decoded.size( ), encoded.data( ), encoded.size( ) ) && decoded == buffer;
+    };
+
+    const uint32_t vertexStride = m.submeshes[ 0 ].vertex_stride( );
+    if ( vertexStride && vertexStride <= apemode::kCodecMaxElementSize && false == m.vertices.empty( ) ) {
+        const uint32_t vertexCount = uint32_t( m.vertices.size( ) / vertexStride );
+        EncodeMeshBuffer( m.vertices.data( ), vertexCount, vertexStride, apemode::eCodecFlag_ByteDelta, encoded );
+
+        if ( roundTrip( m.vertices ) ) {
+            s.console->info( "Mesh \"{}\" vertices compressed: {} -> {} bytes.", meshName, m.vertices.size( ), encoded.size( ) );
+            m.vertices.swap( encoded );
+            m.verticesCompressed = true;
+        } else {
+            s.console->error( "Mesh \"{}\" vertices compression failed (round trip mismatch).", meshName );
+        }
+    }
+
+    /* The position indices share the index type, so they are compressed together with the indices. */
+
+    const uint32_t indexSize = apemodefb::EIndexTypeFb_UInt16 == m.indexType ? 2 : 4;
+    if ( false == m.indices.empty( ) ) {
+        const uint32_t indexCount = uint32_t( m.indices.size( ) / indexSize );
+        EncodeMeshBuffer( m.indices.data( ), indexCount, indexSize, apemode::eCodecFlag_IndexDelta, encoded );
+
+        bool                   indicesMatch = roundTrip( m.indices );
+        std::vector< uint8_t > encodedIndices( std::move( encoded ) );
+
+        if ( indicesMatch && false == m.positionIndices.empty( ) ) {
+            EncodeMeshBuffer( m.positionIndices.data( ), indexCount, indexSize, apemode::eCodecFlag_IndexDelta, encoded );
+            indicesMatch = roundTrip( m.positionIndices );
+
+            if ( indicesMatch ) {
+                s.console->info( "Mesh \"{}\" position indices compressed: {} -> {} bytes.", meshName, m.positionIndices.size( ), encoded.size( ) );
+                m.positionIndices.swap( encoded );
+            }
+        }
+
+        if ( indicesMatch ) {
+            s.console->info( "Mesh \"{}\" indices compressed: {} -> {} bytes.", meshName, m.indices.size( ), encodedIndices.size( ) );
+            m.indices.swap( encodedIndices );
+            m.indexType = 2 == indexSize ? apemodefb::EIndexTypeFb_UInt16Compressed : apemodefb::EIndexTypeFb_UInt32Compressed;
+        } else {
+            s.console->error( "Mesh \"{}\" indices compression failed (round trip mismatch).", meshName );
+        }
+    }
+}
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#define FBXP_CODEC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/**
+ * Mesh buffer codec (EIndexTypeFb_UInt16Compressed, EIndexTypeFb_UInt32Compressed and MeshFb.vertices_compressed).
+ * The header has no dependencies, so it can be used in the loaders as is (the encoder is in fbxpcodec.cpp).
+ *
+ * Stream layout:
+ *  - Header: version (1 byte), flags (1 byte), element size (2 bytes), element count (4 bytes), little endian.
+ *  - Blocks of up to 256 elements. The block contains the byte planes (the k-th byte of all the block elements)
+ *    one after another. The plane is a sequence of the groups of 16 bytes, the group bit widths (2 bits per group:
+ *    0, 2, 4 or 8 bits per byte) go first, then the bit-packed group bytes (the lowest bits go first).
+ *  - The plane bytes are:
+ *    - eCodecFlag_ByteDelta: zigzag encoded byte deltas to the same byte of the previous element (vertices).
+ *    - eCodecFlag_IndexDelta: the bytes of zigzag encoded differences of the consecutive 16-bit or 32-bit
+ *      elements (indices).
+ **/
+
+namespace apemode {
+
+    enum ECodecFlags {
+        eCodecFlag_ByteDelta  = 1,
+        eCodecFlag_IndexDelta = 2,
+    };
+
+    static const uint8_t  kCodecVersion        = 1;
+    static const uint32_t kCodecHeaderSize     = 8;
+    static const uint32_t kCodecBlockElements  = 256;
+    static const uint32_t kCodecGroupSize      = 16;
+    static const uint32_t kCodecMaxElementSize = 256;
+
+    struct CodecHeader {
+        uint8_t  version;
+        uint8_t  flags;
+        uint16_t elementSize;
+        uint32_t elementCount;
+    };
+
+    namespace details {
+        inline uint8_t ZigzagDecode( uint8_t v ) {
+            return uint8_t( ( v >> 1 ) ^ ( 0 - ( v & 1 ) ) );
+        }
+
+        inline uint32_t ZigzagDecode( uint32_t v ) {
+            return ( v >> 1 ) ^ ( 0 - ( v & 1 ) );
+        }
+
+        inline uint32_t GetCodecGroupDataSize( uint32_t code ) {
+            return code ? 2u << code : 0u;
+        }
+
+#if FBXP_CODEC_SSE2
+        /**
+         * Decodes the group of 16 plane bytes, updates the last byte for the byte deltas (broadcasted to all the lanes).
+         **/
+        inline void DecodeCodecGroup( const uint8_t* data, uint32_t code, bool byteDelta, __m128i& last, uint8_t* plane ) {
+            __m128i v;
+            switch ( code ) {
+                case 0:
+                    /* The zero deltas repeat the last byte (the constant planes, the high bytes of the indices). */
+                    _mm_storeu_si128( reinterpret_cast< __m128i* >( plane ), byteDelta ? last : _mm_setzero_si128( ) );
+                    return;
+
+                case 1: {
+                    int32_t bits32;
+                    memcpy( &bits32, data, sizeof( bits32 ) );
+
+                    const __m128i bits = _mm_cvtsi32_si128( bits32 );
+                    const __m128i mask = _mm_set1_epi8( 3 );
+                    const __m128i a    = _mm_and_si128( bits, mask );
+                    const __m128i b    = _mm_and_si128( _mm_srli_epi16( bits, 2 ), mask );
+                    const __m128i c    = _mm_and_si128( _mm_srli_epi16( bits, 4 ), mask );
+                    const __m128i d    = _mm_and_si128( _mm_srli_epi16( bits, 6 ), mask );
+                    v                  = _mm_unpacklo_epi16( _mm_unpacklo_epi8( a, b ), _mm_unpacklo_epi8( c, d ) );
+                } break;
+
+                case 2: {
+                    const __m128i bits = _mm_loadl_epi64( reinterpret_cast< const __m128i* >( data ) );
+                    const __m128i mask = _mm_set1_epi8( 15 );
+                    v = _mm_unpacklo_epi8( _mm_and_si128( bits, mask ), _mm_and_si128( _mm_srli_epi16( bits, 4 ), mask ) );
+                } break;
+
+                default:
+                    v = _mm_loadu_si128( reinterpret_cast< const __m128i* >( data ) );
+                    break;
+            }
+
+            if ( byteDelta ) {
+                /* Zigzag decoding: ( v >> 1 ) ^ -( v & 1 ), then the prefix sum of the deltas. */
+                v = _mm_xor_si128( _mm_and_si128( _mm_srli_epi16( v, 1 ), _mm_set1_epi8( 0x7f ) ),
+                                   _mm_sub_epi8( _mm_setzero_si128( ), _mm_and_si128( v, _mm_set1_epi8( 1 ) ) ) );
+
+                v = _mm_add_epi8( v, _mm_slli_si128( v, 1 ) );
+                v = _mm_add_epi8( v, _mm_slli_si128( v, 2 ) );
+                v = _mm_add_epi8( v, _mm_slli_si128( v, 4 ) );
+                v = _mm_add_epi8( v, _mm_slli_si128( v, 8 ) );
+                v = _mm_add_epi8( v, last );
+
+                /* The byte 15 is broadcasted in registers, it is on the critical path of the plane. */
+                const __m128i hi = _mm_unpackhi_epi8( v, v );
+                last             = _mm_shuffle_epi32( _mm_unpackhi_epi16( hi, hi ), 0xff );
+            }
+
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( plane ), v );
+        }
+#else
+        /**
+         * Decodes the group of 16 plane bytes, updates the last byte for the byte deltas.
+         **/
+        inline void DecodeCodecGroup( const uint8_t* data, uint32_t code, bool byteDelta, uint8_t& last, uint8_t* plane ) {
+            const uint32_t bitCount = code ? 1u << code : 0u;
+            const uint32_t mask     = ( 1u << bitCount ) - 1;
+
+            for ( uint32_t i = 0; i < kCodecGroupSize; ++i ) {
+                const uint32_t bitOffset = i * bitCount;
+                const uint8_t  bits      = bitCount ? uint8_t( ( data[ bitOffset >> 3 ] >> ( bitOffset & 7 ) ) & mask ) : 0;
+
+                plane[ i ] = bits;
+                if ( byteDelta ) {
+                    last       = uint8_t( last + ZigzagDecode( bits ) );
+                    plane[ i ] = last;
+                }
+            }
+        }
+#endif
+
+        /**
+         * Decodes the plane of the block (the group codes and the groups), updates the last byte for the byte deltas.
+         * The stream position and the last byte are kept in the locals, the plane stores could alias them otherwise.
+         * @return False if the stream is too short.
+         **/
+        inline bool DecodeCodecPlane( const uint8_t*& src, const uint8_t* srcEnd, uint32_t groupCount, bool byteDelta, uint8_t& last, uint8_t* plane ) {
+            const uint32_t headerSize = ( groupCount + 3 ) / 4;
+            if ( size_t( srcEnd - src ) < headerSize )
+                return false;
+
+            const uint8_t* codes = src;
+            const uint8_t* data  = src + headerSize;
+
+#if FBXP_CODEC_SSE2
+            __m128i lastBytes = _mm_set1_epi8( (char) last );
+#else
+            uint8_t lastBytes = last;
+#endif
+
+            for ( uint32_t g = 0; g < groupCount; ++g ) {
+                const uint32_t code     = ( codes[ g >> 2 ] >> ( ( g & 3 ) * 2 ) ) & 3;
+                const uint32_t dataSize = GetCodecGroupDataSize( code );
+
+                if ( size_t( srcEnd - data ) < dataSize )
+                    return false;
+
+                DecodeCodecGroup( data, code, byteDelta, lastBytes, plane + g * kCodecGroupSize );
+                data += dataSize;
+            }
+
+#if FBXP_CODEC_SSE2
+            last = (uint8_t) _mm_cvtsi128_si32( lastBytes );
+#else
+            last = lastBytes;
+#endif
+            src = data;
+            return true;
+        }
+
+#if FBXP_CODEC_SSE2
+        /**
+         * Transposes the plane pairs of 8 elements (t[ p ] has the 16-bit units of the planes 2p and 2p+1)
+         * to the element rows and stores them (stride bytes apart).
+         **/
+        inline void TransposeCodecHalfGroup( const __m128i ( &t )[ 8 ], uint8_t* dst, size_t stride ) {
+            /* The plane quads of the element quads. */
+            const __m128i q0 = _mm_unpacklo_epi16( t[ 0 ], t[ 1 ] ), q4 = _mm_unpackhi_epi16( t[ 0 ], t[ 1 ] );
+            const __m128i q1 = _mm_unpacklo_epi16( t[ 2 ], t[ 3 ] ), q5 = _mm_unpackhi_epi16( t[ 2 ], t[ 3 ] );
+            const __m128i q2 = _mm_unpacklo_epi16( t[ 4 ], t[ 5 ] ), q6 = _mm_unpackhi_epi16( t[ 4 ], t[ 5 ] );
+            const __m128i q3 = _mm_unpacklo_epi16( t[ 6 ], t[ 7 ] ), q7 = _mm_unpackhi_epi16( t[ 6 ], t[ 7 ] );
+
+            /* The plane halves of the element pairs. */
+            const __m128i o0 = _mm_unpacklo_epi32( q0, q1 ), o2 = _mm_unpackhi_epi32( q0, q1 );
+            const __m128i o1 = _mm_unpacklo_epi32( q2, q3 ), o3 = _mm_unpackhi_epi32( q2, q3 );
+            const __m128i o4 = _mm_unpacklo_epi32( q4, q5 ), o6 = _mm_unpackhi_epi32( q4, q5 );
+            const __m128i o5 = _mm_unpacklo_epi32( q6, q7 ), o7 = _mm_unpackhi_epi32( q6, q7 );
+
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( dst ), _mm_unpacklo_epi64( o0, o1 ) );
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + stride ), _mm_unpackhi_epi64( o0, o1 ) );
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + 2 * stride ), _mm_unpacklo_epi64( o2, o3 ) );
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + 3 * stride ), _mm_unpackhi_epi64( o2, o3 ) );
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + 4 * stride ), _mm_unpacklo_epi64( o4, o5 ) );
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + 5 * stride ), _mm_unpackhi_epi64( o4, o5 ) );
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + 6 * stride ), _mm_unpacklo_epi64( o6, o7 ) );
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + 7 * stride ), _mm_unpackhi_epi64( o6, o7 ) );
+        }
+
+        /**
+         * Transposes 16 planes of the elements i..i+15 (rows[ p ] is the plane p) in registers
+         * and stores the 16 bytes rows of the elements (stride bytes apart).
+         **/
+        inline void TransposeCodecGroup( const uint8_t* const ( &rows )[ kCodecGroupSize ], uint32_t i, uint8_t* dst, size_t stride ) {
+            __m128i lo[ 8 ];
+            __m128i hi[ 8 ];
+
+            /* The plane pairs of the elements 0..7 and 8..15. */
+            const __m128i p0 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 0 ] + i ) );
+            const __m128i p1 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 1 ] + i ) );
+            lo[ 0 ] = _mm_unpacklo_epi8( p0, p1 ), hi[ 0 ] = _mm_unpackhi_epi8( p0, p1 );
+            const __m128i p2 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 2 ] + i ) );
+            const __m128i p3 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 3 ] + i ) );
+            lo[ 1 ] = _mm_unpacklo_epi8( p2, p3 ), hi[ 1 ] = _mm_unpackhi_epi8( p2, p3 );
+            const __m128i p4 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 4 ] + i ) );
+            const __m128i p5 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 5 ] + i ) );
+            lo[ 2 ] = _mm_unpacklo_epi8( p4, p5 ), hi[ 2 ] = _mm_unpackhi_epi8( p4, p5 );
+            const __m128i p6 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 6 ] + i ) );
+            const __m128i p7 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 7 ] + i ) );
+            lo[ 3 ] = _mm_unpacklo_epi8( p6, p7 ), hi[ 3 ] = _mm_unpackhi_epi8( p6, p7 );
+            const __m128i p8 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 8 ] + i ) );
+            const __m128i p9 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 9 ] + i ) );
+            lo[ 4 ] = _mm_unpacklo_epi8( p8, p9 ), hi[ 4 ] = _mm_unpackhi_epi8( p8, p9 );
+            const __m128i p10 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 10 ] + i ) );
+            const __m128i p11 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 11 ] + i ) );
+            lo[ 5 ] = _mm_unpacklo_epi8( p10, p11 ), hi[ 5 ] = _mm_unpackhi_epi8( p10, p11 );
+            const __m128i p12 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 12 ] + i ) );
+            const __m128i p13 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 13 ] + i ) );
+            lo[ 6 ] = _mm_unpacklo_epi8( p12, p13 ), hi[ 6 ] = _mm_unpackhi_epi8( p12, p13 );
+            const __m128i p14 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 14 ] + i ) );
+            const __m128i p15 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rows[ 15 ] + i ) );
+            lo[ 7 ] = _mm_unpacklo_epi8( p14, p15 ), hi[ 7 ] = _mm_unpackhi_epi8( p14, p15 );
+
+            TransposeCodecHalfGroup( lo, dst, stride );
+            TransposeCodecHalfGroup( hi, dst + 8 * stride, stride );
+        }
+#endif
+
+        /**
+         * Writes the decoded planes k..k+planeCount-1 (stored at planes[ plane % 32 ]) to the block elements.
+         * The SSE2 path transposes 16 planes of 16 elements in registers and stores the whole element rows:
+         *  - The elements of 16 bytes and more are written in the windows of 16 bytes, the window of the last
+         *    batch ends at the element end (the bytes of the previous batch are written again with the same values).
+         *  - The smaller elements are written with the 16 bytes stores one after another, every store overwrites
+         *    the spill of the previous one, so the last store of the group needs 16 - elementSize bytes after the group.
+         **/
+        inline void TransposeCodecPlanes( const uint8_t ( *planes )[ kCodecBlockElements ],
+                                          uint32_t       k,
+                                          uint32_t       planeCount,
+                                          uint32_t       blockElements,
+                                          uint32_t       elementSize,
+                                          uint8_t*       dst,
+                                          const uint8_t* dstEnd ) {
+            uint32_t i = 0;
+#if FBXP_CODEC_SSE2
+            /* The planes are padded to the group size, the whole groups are transposed. */
+            if ( 1 == elementSize ) {
+                memcpy( dst, planes[ 0 ], blockElements );
+                return;
+            } else if ( 2 == elementSize ) {
+                for ( ; i + kCodecGroupSize <= blockElements; i += kCodecGroupSize ) {
+                    const __m128i p0 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( planes[ 0 ] + i ) );
+                    const __m128i p1 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( planes[ 1 ] + i ) );
+
+                    uint8_t* elementDst = dst + size_t( i ) * elementSize;
+                    _mm_storeu_si128( reinterpret_cast< __m128i* >( elementDst ), _mm_unpacklo_epi8( p0, p1 ) );
+                    _mm_storeu_si128( reinterpret_cast< __m128i* >( elementDst + 16 ), _mm_unpackhi_epi8( p0, p1 ) );
+                }
+            } else if ( 4 == elementSize ) {
+                for ( ; i + kCodecGroupSize <= blockElements; i += kCodecGroupSize ) {
+                    const __m128i p0   = _mm_loadu_si128( reinterpret_cast< const __m128i* >( planes[ 0 ] + i ) );
+                    const __m128i p1   = _mm_loadu_si128( reinterpret_cast< const __m128i* >( planes[ 1 ] + i ) );
+                    const __m128i p2   = _mm_loadu_si128( reinterpret_cast< const __m128i* >( planes[ 2 ] + i ) );
+                    const __m128i p3   = _mm_loadu_si128( reinterpret_cast< const __m128i* >( planes[ 3 ] + i ) );
+                    const __m128i lo01 = _mm_unpacklo_epi8( p0, p1 );
+                    const __m128i hi01 = _mm_unpackhi_epi8( p0, p1 );
+                    const __m128i lo23 = _mm_unpacklo_epi8( p2, p3 );
+                    const __m128i hi23 = _mm_unpackhi_epi8( p2, p3 );
+
+                    uint8_t* elementDst = dst + size_t( i ) * elementSize;
+                    _mm_storeu_si128( reinterpret_cast< __m128i* >( elementDst ), _mm_unpacklo_epi16( lo01, lo23 ) );
+                    _mm_storeu_si128( reinterpret_cast< __m128i* >( elementDst + 16 ), _mm_unpackhi_epi16( lo01, lo23 ) );
+                    _mm_storeu_si128( reinterpret_cast< __m128i* >( elementDst + 32 ), _mm_unpacklo_epi16( hi01, hi23 ) );
+                    _mm_storeu_si128( reinterpret_cast< __m128i* >( elementDst + 48 ), _mm_unpackhi_epi16( hi01, hi23 ) );
+                }
+            } else {
+                /* The window start, the planes after the element end are replaced with the last plane. */
+                const uint32_t first = elementSize < kCodecGroupSize ? 0 : ( k < elementSize - kCodecGroupSize ? k : elementSize - kCodecGroupSize );
+
+                const uint8_t* rows[ kCodecGroupSize ];
+                for ( uint32_t p = 0; p < kCodecGroupSize; ++p )
+                    rows[ p ] = planes[ ( first + p < elementSize ? first + p : elementSize - 1 ) % ( 2 * kCodecGroupSize ) ];
+
+                for ( ; i + kCodecGroupSize <= blockElements; i += kCodecGroupSize ) {
+                    uint8_t* elementDst = dst + size_t( i ) * elementSize + first;
+                    if ( elementSize < kCodecGroupSize && size_t( dstEnd - elementDst ) < ( kCodecGroupSize - 1 ) * elementSize + 16 )
+                        break;
+
+                    TransposeCodecGroup( rows, i, elementDst, elementSize );
+                }
+            }
+#else
+            (void) dstEnd;
+#endif
+            for ( ; i < blockElements; ++i ) {
+                for ( uint32_t p = 0; p < planeCount; ++p )
+                    dst[ size_t( i ) * elementSize + k + p ] = planes[ ( k + p ) % ( 2 * kCodecGroupSize ) ][ i ];
+            }
+        }
+
+        /**
+         * Replaces the zigzag encoded index deltas with the indices (the prefix sum of the deltas).
+         * @return The last index for the next block.
+         **/
+        template < typename TIndex >
+        inline TIndex DecodeIndexDeltas( uint8_t* dst, uint32_t elementCount, TIndex previous ) {
+            uint32_t i = 0;
+#if FBXP_CODEC_SSE2
+            if ( 4 == sizeof( TIndex ) ) {
+                __m128i last = _mm_set1_epi32( int32_t( previous ) );
+                for ( ; i + 4 <= elementCount; i += 4 ) {
+                    __m128i v = _mm_loadu_si128( reinterpret_cast< const __m128i* >( dst + i * sizeof( TIndex ) ) );
+                    v = _mm_xor_si128( _mm_srli_epi32( v, 1 ), _mm_sub_epi32( _mm_setzero_si128( ), _mm_and_si128( v, _mm_set1_epi32( 1 ) ) ) );
+                    v = _mm_add_epi32( v, _mm_slli_si128( v, 4 ) );
+                    v = _mm_add_epi32( v, _mm_slli_si128( v, 8 ) );
+                    v = _mm_add_epi32( v, last );
+
+                    _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + i * sizeof( TIndex ) ), v );
+                    last = _mm_shuffle_epi32( v, 0xff );
+                }
+
+                previous = TIndex( _mm_cvtsi128_si32( last ) );
+            } else {
+                __m128i last = _mm_set1_epi16( int16_t( previous ) );
+                for ( ; i + 8 <= elementCount; i += 8 ) {
+                    __m128i v = _mm_loadu_si128( reinterpret_cast< const __m128i* >( dst + i * sizeof( TIndex ) ) );
+                    v = _mm_xor_si128( _mm_srli_epi16( v, 1 ), _mm_sub_epi16( _mm_setzero_si128( ), _mm_and_si128( v, _mm_set1_epi16( 1 ) ) ) );
+                    v = _mm_add_epi16( v, _mm_slli_si128( v, 2 ) );
+                    v = _mm_add_epi16( v, _mm_slli_si128( v, 4 ) );
+                    v = _mm_add_epi16( v, _mm_slli_si128( v, 8 ) );
+                    v = _mm_add_epi16( v, last );
+
+                    _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + i * sizeof( TIndex ) ), v );
+                    last = _mm_shuffle_epi32( _mm_shufflehi_epi16( v, 0xff ), 0xff );
+                }
+
+                previous = TIndex( _mm_cvtsi128_si32( last ) );
+            }
+#endif
+            for ( ; i < elementCount; ++i ) {
+                TIndex delta;
+                memcpy( &delta, dst + i * sizeof( TIndex ), sizeof( TIndex ) );
+
+                previous = TIndex( previous + ZigzagDecode( uint32_t( delta ) ) );
+                memcpy( dst + i * sizeof( TIndex ), &previous, sizeof( TIndex ) );
+            }
+
+            return previous;
+        }
+    }
+
+    /**
+     * Reads the stream header.
+     * @return False if the stream is too short or has unsupported version.
+     **/
+    inline bool ReadCodecHeader( const uint8_t* src, size_t srcSize, CodecHeader& header ) {
+        if ( srcSize < kCodecHeaderSize || kCodecVersion != src[ 0 ] )
+            return false;
+
+        header.version      = src[ 0 ];
+        header.flags        = src[ 1 ];
+        header.elementSize  = uint16_t( src[ 2 ] | src[ 3 ] << 8 );
+        header.elementCount = uint32_t( src[ 4 ] | src[ 5 ] << 8 | src[ 6 ] << 16 | uint32_t( src[ 7 ] ) << 24 );
+        return header.elementSize > 0 && header.elementSize <= kCodecMaxElementSize;
+    }
+
+    /**
+     * Decodes the stream into the buffer of elementCount * elementSize bytes (see ReadCodecHeader).
+     * @return False if the stream is corrupted or the buffer size does not match.
+     **/
+    inline bool DecodeMeshBuffer( uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize ) {
+        CodecHeader header;
+        if ( false == ReadCodecHeader( src, srcSize, header ) )
+            return false;
+
+        const uint32_t elementSize  = header.elementSize;
+        const uint32_t elementCount = header.elementCount;
+        const bool     byteDelta    = 0 != ( header.flags & eCodecFlag_ByteDelta );
+        const bool     indexDelta   = 0 != ( header.flags & eCodecFlag_IndexDelta );
+
+        if ( dstSize != size_t( elementCount ) * elementSize )
+            return false;
+
+        if ( indexDelta && 2 != elementSize && 4 != elementSize )
+            return false;
+
+        const uint8_t* srcEnd = src + srcSize;
+        src += kCodecHeaderSize;
+
+        uint8_t last[ kCodecMaxElementSize ];
+        memset( last, 0, sizeof( last ) );
+
+        /* The planes are decoded in the batches of 16 and transposed to the elements while they are in the cache.
+           The plane k is stored at planes[ k % 32 ], so the last two batches are available for the transposition. */
+        uint8_t planes[ 2 * kCodecGroupSize ][ kCodecBlockElements ];
+
+        const uint8_t* dstEnd        = dst + dstSize;
+        uint32_t       previousIndex = 0;
+
+        for ( uint32_t baseElement = 0; baseElement < elementCount; baseElement += kCodecBlockElements ) {
+            const uint32_t blockElements = elementCount - baseElement < kCodecBlockElements ? elementCount - baseElement : kCodecBlockElements;
+            const uint32_t groupCount    = ( blockElements + kCodecGroupSize - 1 ) / kCodecGroupSize;
+            uint8_t*       blockDst      = dst + size_t( baseElement ) * elementSize;
+
+            for ( uint32_t k = 0; k < elementSize; k += kCodecGroupSize ) {
+                const uint32_t planeCount = elementSize - k < kCodecGroupSize ? elementSize - k : kCodecGroupSize;
+
+                for ( uint32_t p = 0; p < planeCount; ++p ) {
+                    uint8_t* plane = planes[ ( k + p ) % ( 2 * kCodecGroupSize ) ];
+                    if ( false == details::DecodeCodecPlane( src, srcEnd, groupCount, byteDelta, last[ k + p ], plane ) )
+                        return false;
+                }
+
+                details::TransposeCodecPlanes( planes, k, planeCount, blockElements, elementSize, blockDst, dstEnd );
+            }
+
+            if ( indexDelta ) {
+                if ( 2 == elementSize )
+                    previousIndex = details::DecodeIndexDeltas< uint16_t >( blockDst, blockElements, uint16_t( previousIndex ) );
+                else
+                    previousIndex = details::DecodeIndexDeltas< uint32_t >( blockDst, blockElements, previousIndex );
+            }
+        }
+
+        return src == srcEnd;
+    }
+}
@@ -0,0 +1,594 @@
+#include <fbxppch.h>
+#include <fbxpstate.h>
+#include <fbxpedgebreaker.h>
+
+/**
+ * Edgebreaker-style mesh encoder, see the blob layout and the decoder in fbxpedgebreaker.h.
+ **/
+
+using apemode::details::EdgebreakerConnectivity;
+using apemode::details::EdgebreakerModels;
+
+/**
+ * Adaptive binary range encoder (the counterpart of apemode::details::RangeDecoder).
+ **/
+class RangeEncoder {
+public:
+    typedef apemode::details::RangeDecoder RangeDecoder;
+
+    std::vector< uint8_t >& encoded;
+
+    explicit RangeEncoder( std::vector< uint8_t >& encoded ) : encoded( encoded ) {
+    }
+
+    void EncodeBit( uint16_t& prob, uint32_t bit ) {
+        const uint32_t bound = ( range >> RangeDecoder::kProbBits ) * prob;
+        if ( 0 == bit ) {
+            range = bound;
+            prob  = uint16_t( prob + ( ( ( 1u << RangeDecoder::kProbBits ) - prob ) >> RangeDecoder::kMoveBits ) );
+        } else {
+            low += bound;
+            range -= bound;
+            prob = uint16_t( prob - ( prob >> RangeDecoder::kMoveBits ) );
+        }
+
+        Normalize( );
+    }
+
+    void EncodeDirect( uint32_t value, uint32_t bitCount ) {
+        for ( uint32_t i = bitCount; i > 0; --i ) {
+            range >>= 1;
+            if ( ( value >> ( i - 1 ) ) & 1 )
+                low += range;
+
+            Normalize( );
+        }
+    }
+
+    void EncodeTree( uint16_t* probs, uint32_t bitCount, uint32_t symbol ) {
+        uint32_t m = 1;
+        for ( uint32_t i = bitCount; i > 0; --i ) {
+            const uint32_t bit = ( symbol >> ( i - 1 ) ) & 1;
+            EncodeBit( probs[ m ], bit );
+            m = ( m << 1 ) | bit;
+        }
+    }
+
+    void Flush( ) {
+        for ( uint32_t i = 0; i < 5; ++i )
+            ShiftLow( );
+    }
+
+private:
+    uint64_t low       = 0;
+    uint32_t range     = 0xffffffffu;
+    uint8_t  cache     = 0;
+    uint64_t cacheSize = 1;
+
+    void Normalize( ) {
+        if ( range < RangeDecoder::kTop ) {
+            range <<= 8;
+            ShiftLow( );
+        }
+    }
+
+    void ShiftLow( ) {
+        if ( uint32_t( low ) < 0xff000000u || ( low >> 32 ) != 0 ) {
+            const uint8_t carry = uint8_t( low >> 32 );
+            uint8_t       temp  = cache;
+            do {
+                encoded.push_back( uint8_t( temp + carry ) );
+                temp = 0xff;
+            } while ( --cacheSize != 0 );
+            cache = uint8_t( low >> 24 );
+        }
+
+        ++cacheSize;
+        low = ( low & 0x00ffffffu ) << 8;
+    }
+};
+
+inline uint32_t ZigzagEncodeResidual( int32_t v ) {
+    return ( uint32_t( v ) << 1 ) ^ uint32_t( v >> 31 );
+}
+
+/**
+ * Returns the signed value of the difference modulo 2^bitCount.
+ **/
+inline int32_t GetSignedResidual( uint32_t difference, uint32_t bitCount ) {
+    const uint32_t mask = apemode::details::GetFieldMask( bitCount );
+    difference &= mask;
+    if ( bitCount >= 32 || difference <= ( mask >> 1 ) )
+        return int32_t( difference );
+    return int32_t( difference ) - int32_t( mask ) - 1;
+}
+
+void EncodeResidual( RangeEncoder& encoder, EdgebreakerModels& models, uint32_t context, uint32_t value ) {
+    uint32_t bitLength = 0;
+    while ( bitLength < 32 && ( value >> bitLength ) ) {
+        ++bitLength;
+    }
+
+    encoder.EncodeTree( models.lengths[ context ], EdgebreakerModels::kLengthBits, bitLength );
+    if ( bitLength > 1 )
+        encoder.EncodeDirect( value, bitLength - 1 );
+}
+
+/**
+ * Encodes the vertex attributes (the counterpart of apemode::details::DecodeEdgebreakerVertex).
+ **/
+void EncodeEdgebreakerVertex( RangeEncoder&                                        encoder,
+                              EdgebreakerModels&                                   models,
+                              const std::vector< apemode::EdgebreakerAttribute >& attributes,
+                              const uint8_t*                                       a,
+                              const uint8_t*                                       b,
+                              const uint8_t*                                       c,
+                              bool                                                 parallelogram,
+                              const uint8_t*                                       v ) {
+    using namespace apemode;
+    using namespace apemode::details;
+
+    uint32_t component = 0;
+    for ( const EdgebreakerAttribute& attribute : attributes ) {
+        const bool usesParallelogram = parallelogram && eEdgebreakerPrediction_Parallelogram == attribute.prediction;
+
+        if ( eEdgebreakerAttributeType_Float == attribute.type ) {
+            for ( uint32_t i = 0; i < attribute.params[ 0 ]; ++i, ++component ) {
+                const uint32_t offset = attribute.offset + i * sizeof( float );
+                float          fa, fb, fc, fv;
+                memcpy( &fa, a + offset, sizeof( float ) );
+                memcpy( &fb, b + offset, sizeof( float ) );
+                memcpy( &fc, c + offset, sizeof( float ) );
+                memcpy( &fv, v + offset, sizeof( float ) );
+
+                const uint32_t prediction = FloatToOrdered( PredictFloat( fa, fb, fc, usesParallelogram ) );
+                const int32_t  residual   = GetSignedResidual( FloatToOrdered( fv ) - prediction, 32 );
+                EncodeResidual( encoder, models, GetResidualContext( component ), ZigzagEncodeResidual( residual ) );
+            }
+        } else {
+            uint32_t       bitCounts[ 5 ];
+            uint32_t       bitOffsets[ 5 ];
+            const uint32_t fieldCount = GetAttributeFields( attribute, bitCounts, bitOffsets );
+
+            uint32_t wa, wb, wc, wv;
+            memcpy( &wa, a + attribute.offset, sizeof( uint32_t ) );
+            memcpy( &wb, b + attribute.offset, sizeof( uint32_t ) );
+            memcpy( &wc, c + attribute.offset, sizeof( uint32_t ) );
+            memcpy( &wv, v + attribute.offset, sizeof( uint32_t ) );
+
+            for ( uint32_t i = 0; i < fieldCount; ++i, ++component ) {
+                const uint32_t mask       = GetFieldMask( bitCounts[ i ] );
+                const uint32_t prediction = PredictField( ( wa >> bitOffsets[ i ] ) & mask,
+                                                          ( wb >> bitOffsets[ i ] ) & mask,
+                                                          ( wc >> bitOffsets[ i ] ) & mask,
+                                                          bitCounts[ i ],
+                                                          usesParallelogram );
+
+                const int32_t residual = GetSignedResidual( ( ( wv >> bitOffsets[ i ] ) & mask ) - prediction, bitCounts[ i ] );
+                EncodeResidual( encoder, models, GetResidualContext( component ), ZigzagEncodeResidual( residual ) );
+            }
+        }
+    }
+}
+
+inline void PushUInt16( std::vector< uint8_t >& encoded, uint32_t value ) {
+    encoded.push_back( uint8_t( value ) );
+    encoded.push_back( uint8_t( value >> 8 ) );
+}
+
+inline void PushUInt32( std::vector< uint8_t >& encoded, uint32_t value ) {
+    PushUInt16( encoded, value );
+    PushUInt16( encoded, value >> 16 );
+}
+
+/**
+ * Encodes the mesh into the blob.
+ * @param indices The indices of the ranges one after another.
+ * @param rangeIndexCounts The index counts of the ranges (the triangles are not moved between the ranges).
+ * @param vertexOrder Filled with the source vertex for every blob vertex.
+ * @param decodedIndices Filled with the indices in the blob order (in the blob vertex order).
+ **/
+void EncodeEdgebreakerMesh( const uint8_t*                                       vertices,
+                            uint32_t                                             vertexCount,
+                            uint32_t                                             vertexStride,
+                            const std::vector< uint32_t >&                       indices,
+                            uint32_t                                             indexSize,
+                            const std::vector< uint32_t >&                       rangeIndexCounts,
+                            const std::vector< apemode::EdgebreakerAttribute >& attributes,
+                            std::vector< uint8_t >&                              encoded,
+                            std::vector< uint32_t >&                             vertexOrder,
+                            std::vector< uint32_t >&                             decodedIndices ) {
+    using namespace apemode;
+
+    encoded.clear( );
+    encoded.push_back( kEdgebreakerVersion );
+    encoded.push_back( 0 );
+    PushUInt16( encoded, vertexStride );
+    PushUInt32( encoded, vertexCount );
+    encoded.push_back( uint8_t( indexSize ) );
+    encoded.push_back( uint8_t( attributes.size( ) ) );
+    PushUInt16( encoded, 0 );
+    PushUInt32( encoded, uint32_t( rangeIndexCounts.size( ) ) );
+
+    for ( uint32_t rangeIndexCount : rangeIndexCounts )
+        PushUInt32( encoded, rangeIndexCount );
+
+    for ( const EdgebreakerAttribute& attribute : attributes ) {
+        PushUInt16( encoded, attribute.offset );
+        encoded.push_back( attribute.type );
+        encoded.push_back( attribute.prediction );
+        encoded.insert( encoded.end( ), attribute.params, attribute.params + 4 );
+    }
+
+    /* The triangles of every half-edge, the gate (from, to) is entered through the half-edge (to, from). */
+
+    const uint32_t triangleCount = uint32_t( indices.size( ) / 3 );
+
+    std::vector< std::pair< uint64_t, uint32_t > > halfEdgeTriangles;
+    halfEdgeTriangles.reserve( indices.size( ) );
+    for ( uint32_t t = 0; t < triangleCount; ++t ) {
+        for ( uint32_t k = 0; k < 3; ++k ) {
+            const uint64_t from = indices[ t * 3 + k ];
+            const uint64_t to   = indices[ t * 3 + ( k + 1 ) % 3 ];
+            halfEdgeTriangles.emplace_back( from << 32 | to, t );
+        }
+    }
+
+    std::sort( halfEdgeTriangles.begin( ), halfEdgeTriangles.end( ) );
+
+    std::vector< bool >     visited( triangleCount, false );
+    std::vector< uint32_t > vertexIds( vertexCount, uint32_t( -1 ) );
+    std::vector< uint8_t >  zeroVertex( vertexStride, 0 );
+
+    vertexOrder.clear( );
+    vertexOrder.reserve( vertexCount );
+    decodedIndices.clear( );
+    decodedIndices.reserve( indices.size( ) );
+
+    RangeEncoder            encoder( encoded );
+    EdgebreakerModels       models;
+    EdgebreakerConnectivity connectivity;
+    connectivity.Reset( vertexCount );
+
+    auto vertexAt = [&]( uint32_t v ) { return vertices + size_t( vertexOrder[ v ] ) * vertexStride; };
+
+    auto encodeStartVertex = [&]( uint32_t sourceVertex ) {
+        const uint8_t* previous = vertexOrder.empty( ) ? zeroVertex.data( ) : vertexAt( uint32_t( vertexOrder.size( ) - 1 ) );
+        EncodeEdgebreakerVertex( encoder, models, attributes, previous, previous, previous, false, vertices + size_t( sourceVertex ) * vertexStride );
+
+        vertexIds[ sourceVertex ] = uint32_t( vertexOrder.size( ) );
+        vertexOrder.push_back( sourceVertex );
+        return vertexIds[ sourceVertex ];
+    };
+
+    auto encodeReference = [&]( uint32_t context, uint32_t v ) {
+        EncodeResidual( encoder, models, context, uint32_t( vertexOrder.size( ) ) - 1 - v );
+    };
+
+    uint32_t rangeFirstTriangle = 0;
+    for ( uint32_t rangeIndexCount : rangeIndexCounts ) {
+        const uint32_t rangeEndTriangle = rangeFirstTriangle + rangeIndexCount / 3;
+        uint32_t       startTriangle    = rangeFirstTriangle;
+
+        connectivity.gates.clear( );
+
+        for ( uint32_t triangle = rangeFirstTriangle; triangle < rangeEndTriangle; ) {
+            if ( connectivity.gates.empty( ) ) {
+                while ( visited[ startTriangle ] )
+                    ++startTriangle;
+
+                uint32_t v[ 3 ];
+                for ( uint32_t i = 0; i < 3; ++i ) {
+                    const uint32_t sourceVertex = indices[ startTriangle * 3 + i ];
+                    if ( uint32_t( -1 ) == vertexIds[ sourceVertex ] ) {
+                        encoder.EncodeBit( models.startNew, 1 );
+                        v[ i ] = encodeStartVertex( sourceVertex );
+                    } else {
+                        encoder.EncodeBit( models.startNew, 0 );
+                        v[ i ] = vertexIds[ sourceVertex ];
+                        encodeReference( EdgebreakerModels::kStartReferenceContext, v[ i ] );
+                    }
+                }
+
+                visited[ startTriangle ] = true;
+                connectivity.AddStartTriangle( v[ 0 ], v[ 1 ], v[ 2 ] );
+                decodedIndices.insert( decodedIndices.end( ), v, v + 3 );
+                ++triangle;
+                continue;
+            }
+
+            const EdgebreakerConnectivity::Gate gate = connectivity.gates.back( );
+            connectivity.gates.pop_back( );
+
+            if ( false == connectivity.IsOpen( gate.from, gate.to ) )
+                continue;
+
+            /* Finds the triangle ( to, from, v ) of the range, that was not visited yet. */
+
+            const uint64_t from = vertexOrder[ gate.from ];
+            const uint64_t to   = vertexOrder[ gate.to ];
+            const auto     key  = std::make_pair( to << 32 | from, uint32_t( 0 ) );
+
+            uint32_t nextTriangle = uint32_t( -1 );
+            uint32_t sourceVertex = uint32_t( -1 );
+            for ( auto it = std::lower_bound( halfEdgeTriangles.begin( ), halfEdgeTriangles.end( ), key );
+                  it != halfEdgeTriangles.end( ) && it->first == key.first;
+                  ++it ) {
+                const uint32_t t = it->second;
+                if ( t >= rangeFirstTriangle && t < rangeEndTriangle && false == visited[ t ] ) {
+                    for ( uint32_t k = 0; k < 3; ++k ) {
+                        if ( indices[ t * 3 + k ] == to && indices[ t * 3 + ( k + 1 ) % 3 ] == from ) {
+                            sourceVertex = indices[ t * 3 + ( k + 2 ) % 3 ];
+                            break;
+                        }
+                    }
+
+                    nextTriangle = t;
+                    break;
+                }
+            }
+
+            uint32_t symbol = eEdgebreakerSymbol_B;
+            uint32_t v      = uint32_t( -1 );
+
+            if ( uint32_t( -1 ) != nextTriangle ) {
+                v = vertexIds[ sourceVertex ];
+                if ( uint32_t( -1 ) == v ) {
+                    symbol = eEdgebreakerSymbol_C;
+                } else {
+                    const bool left  = connectivity.FindLeft( gate.from ) == v;
+                    const bool right = connectivity.FindRight( gate.to ) == v;
+                    symbol           = left && right ? eEdgebreakerSymbol_E
+                                     : left          ? eEdgebreakerSymbol_L
+                                     : right         ? eEdgebreakerSymbol_R
+                                                     : eEdgebreakerSymbol_S;
+                }
+            }
+
+            encoder.EncodeTree( models.symbols[ models.previousSymbol ], EdgebreakerModels::kSymbolBits, symbol );
+            models.previousSymbol = symbol;
+
+            if ( eEdgebreakerSymbol_B == symbol )
+                continue;
+
+            if ( eEdgebreakerSymbol_C == symbol ) {
+                EncodeEdgebreakerVertex( encoder,
+                                         models,
+                                         attributes,
+                                         vertexAt( gate.from ),
+                                         vertexAt( gate.to ),
+                                         vertexAt( gate.opposite ),
+                                         true,
+                                         vertices + size_t( sourceVertex ) * vertexStride );
+
+                v                         = uint32_t( vertexOrder.size( ) );
+                vertexIds[ sourceVertex ] = v;
+                vertexOrder.push_back( sourceVertex );
+            } else if ( eEdgebreakerSymbol_S == symbol ) {
+                encodeReference( EdgebreakerModels::kSReferenceContext, v );
+            }
+
+            visited[ nextTriangle ] = true;
+            connectivity.AddGateTriangle( gate, v );
+            decodedIndices.push_back( gate.to );
+            decodedIndices.push_back( gate.from );
+            decodedIndices.push_back( v );
+            ++triangle;
+        }
+
+        rangeFirstTriangle = rangeEndTriangle;
+    }
+
+    /* The vertices, that are not referenced by the indices. */
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        if ( uint32_t( -1 ) == vertexIds[ i ] )
+            encodeStartVertex( i );
+    }
+
+    encoder.Flush( );
+}
+
+/**
+ * Returns the attributes of the vertex format, they cover the whole vertex.
+ **/
+std::vector< apemode::EdgebreakerAttribute > GetEdgebreakerAttributes( const apemodefb::SubmeshFb& submesh ) {
+    using namespace apemode;
+
+    const uint8_t parallelogram = eEdgebreakerPrediction_Parallelogram;
+    const uint8_t delta         = eEdgebreakerPrediction_Delta;
+
+    auto floats = []( uint16_t offset, uint8_t prediction, uint8_t count ) {
+        return EdgebreakerAttribute{offset, eEdgebreakerAttributeType_Float, prediction, {count, 0, 0, 0}};
+    };
+
+    auto bits = []( uint16_t offset, uint8_t prediction, uint8_t x, uint8_t y, uint8_t z ) {
+        return EdgebreakerAttribute{offset, eEdgebreakerAttributeType_Bits, prediction, {x, y, z, 0}};
+    };
+
+    const auto positionBits = bits( 0, parallelogram, submesh.position_bits_x( ), submesh.position_bits_y( ), submesh.position_bits_z( ) );
+
+    switch ( submesh.vertex_format( ) ) {
+        case apemodefb::EVertexFormat_Static:
+            return {floats( 0, parallelogram, 3 ), floats( 12, delta, 3 ), floats( 24, delta, 4 ), floats( 40, parallelogram, 2 )};
+
+        case apemodefb::EVertexFormat_StaticSkinned:
+            return {floats( 0, parallelogram, 3 ),
+                    floats( 12, delta, 3 ),
+                    floats( 24, delta, 4 ),
+                    floats( 40, parallelogram, 2 ),
+                    floats( 48, delta, 4 ),
+                    floats( 64, delta, 4 )};
+
+        case apemodefb::EVertexFormat_Packed:
+            return {positionBits, bits( 4, delta, 10, 10, 10 ), bits( 8, delta, 10, 10, 10 ), bits( 12, parallelogram, 16, 0, 0 )};
+
+        case apemodefb::EVertexFormat_PackedSkinned:
+            return {positionBits,
+                    bits( 4, delta, 10, 10, 10 ),
+                    bits( 8, delta, 10, 10, 10 ),
+                    bits( 12, parallelogram, 16, 0, 0 ),
+                    bits( 16, delta, 8, 8, 8 ),
+                    bits( 20, delta, 8, 8, 8 )};
+
+        case apemodefb::EVertexFormat_PackedOctahedral:
+            return {positionBits, bits( 4, delta, 11, 11, 9 ), bits( 8, parallelogram, 16, 0, 0 )};
+
+        case apemodefb::EVertexFormat_PackedSkinnedOctahedral:
+            return {positionBits,
+                    bits( 4, delta, 11, 11, 9 ),
+                    bits( 8, parallelogram, 16, 0, 0 ),
+                    bits( 12, delta, 8, 8, 8 ),
+                    bits( 16, delta, 8, 8, 8 )};
+
+        case apemodefb::EVertexFormat_PackedQTangent:
+            return {positionBits, bits( 4, delta, 9, 9, 9 ), bits( 8, parallelogram, 16, 0, 0 )};
+
+        case apemodefb::EVertexFormat_PackedSkinnedQTangent:
+            return {positionBits,
+                    bits( 4, delta, 9, 9, 9 ),
+                    bits( 8, parallelogram, 16, 0, 0 ),
+                    bits( 12, delta, 8, 8, 8 ),
+                    bits( 16, delta, 8, 8, 8 )};
+
+        default:
+            break;
+    }
+
+    /* Unknown format: 32-bit words predicted from the neighbour vertex. */
+    std::vector< EdgebreakerAttribute > attributes;
+    for ( uint16_t offset = 0; offset + 4 <= submesh.vertex_stride( ); offset += 4 )
+        attributes.push_back( bits( offset, delta, 0, 0, 0 ) );
+    return attributes;
+}
+
+/**
+ * Encodes the vertex and index buffers of the mesh into the blob (--edgebreaker option).
+ * The blob is decoded back and compared with the reordered buffers, the mesh stays as it is on mismatch.
+ **/
+void EdgebreakerCompressMesh( apemode::Mesh& m, const char* meshName ) {
+    auto& s = apemode::Get( );
+
+    if ( m.submeshes.empty( ) || m.indices.empty( ) || m.submeshes[ 0 ].vertex_stride( ) % 4 )
+        return;
+
+    const apemodefb::SubmeshFb& submesh      = m.submeshes[ 0 ];
+    const uint32_t              vertexStride = submesh.vertex_stride( );
+    const uint32_t              vertexCount  = uint32_t( m.vertices.size( ) / vertexStride );
+    const uint32_t              indexSize    = apemodefb::EIndexTypeFb_UInt16 == m.indexType ? 2 : 4;
+    const uint32_t              indexCount   = uint32_t( m.indices.size( ) / indexSize );
+
+    if ( apemodefb::EIndexTypeFb_UInt16 != m.indexType && apemodefb::EIndexTypeFb_UInt32 != m.indexType )
+        return;
+
+    /* The vertices are reordered in the blob, the submesh vertex ranges (see SplitMesh) would not survive. */
+    for ( const auto& otherSubmesh : m.submeshes ) {
+        if ( 0 != otherSubmesh.base_vertex( ) ) {
+            s.console->warn( "Mesh \"{}\" has submeshes with base vertices, edgebreaker compression skipped.", meshName );
+            return;
+        }
+    }
+
+    std::vector< uint32_t > indices( indexCount );
+    for ( uint32_t i = 0; i < indexCount; ++i ) {
+        if ( 2 == indexSize ) {
+            uint16_t index;
+            memcpy( &index, m.indices.data( ) + i * 2, 2 );
+            indices[ i ] = index;
+        } else {
+            memcpy( &indices[ i ], m.indices.data( ) + i * 4, 4 );
+        }
+    }
+
+    /* The subset boundaries split the indices into the ranges. */
+
+    std::vector< uint32_t > boundaries = {0, indexCount};
+    for ( const auto& subset : m.subsets ) {
+        boundaries.push_back( subset.base_index( ) );
+        boundaries.push_back( subset.base_index( ) + subset.index_count( ) );
+    }
+
+    std::sort( boundaries.begin( ), boundaries.end( ) );
+    boundaries.erase( std::unique( boundaries.begin( ), boundaries.end( ) ), boundaries.end( ) );
+
+    std::vector< uint32_t > rangeIndexCounts;
+    for ( size_t i = 1; i < boundaries.size( ); ++i ) {
+        if ( boundaries[ i ] > indexCount || boundaries[ i - 1 ] % 3 || boundaries[ i ] % 3 ) {
+            s.console->warn( "Mesh \"{}\" has invalid subset ranges, edgebreaker compression skipped.", meshName );
+            return;
+        }
+        rangeIndexCounts.push_back( boundaries[ i ] - boundaries[ i - 1 ] );
+    }
+
+    for ( uint32_t index : indices ) {
+        if ( index >= vertexCount ) {
+            s.console->warn( "Mesh \"{}\" has invalid indices, edgebreaker compression skipped.", meshName );
+            return;
+        }
+    }
+
+    std::vector< uint8_t >  encoded;
+    std::vector< uint32_t > vertexOrder;
+    std::vector< uint32_t > encodedIndices;
+    EncodeEdgebreakerMesh( m.vertices.data( ),
+                           vertexCount,
+                           vertexStride,
+                           indices,
+                           indexSize,
+                           rangeIndexCounts,
+                           GetEdgebreakerAttributes( submesh ),
+                           encoded,
+                           vertexOrder,
+                           encodedIndices );
+
+    /* The buffers in the blob order to compare with the decoded ones. */
+
+    std::vector< uint8_t > reorderedVertices( m.vertices.size( ) );
+    for ( uint32_t v = 0; v < vertexCount; ++v ) {
+        memcpy( reorderedVertices.data( ) + size_t( v ) * vertexStride, m.vertices.data( ) + size_t( vertexOrder[ v ] ) * vertexStride, vertexStride );
+    }
+
+    std::vector< uint8_t > reorderedIndices( m.indices.size( ) );
+    for ( uint32_t i = 0; i < indexCount; ++i ) {
+        if ( 2 == indexSize ) {
+            const uint16_t index = uint16_t( encodedIndices[ i ] );
+            memcpy( reorderedIndices.data( ) + i * 2, &index, 2 );
+        } else {
+            memcpy( reorderedIndices.data( ) + i * 4, &encodedIndices[ i ], 4 );
+        }
+    }
+
+    std::vector< uint8_t > decodedVertices;
+    std::vector< uint8_t > decodedIndices;
+    if ( false == apemode::DecodeEdgebreakerMesh( encoded.data( ), encoded.size( ), decodedVertices, decodedIndices ) ||
+         decodedVertices != reorderedVertices || decodedIndices != reorderedIndices ) {
+        s.console->error( "Mesh \"{}\" edgebreaker compression failed (round trip mismatch).", meshName );
+        return;
+    }
+
+    /* The meshlets reference the vertices, they are remapped to the blob order. */
+
+    std::vector< uint32_t > vertexRemap( vertexCount );
+    for ( uint32_t v = 0; v < vertexCount; ++v )
+        vertexRemap[ vertexOrder[ v ] ] = v;
+
+    for ( uint32_t& meshletVertex : m.meshletVertices )
+        meshletVertex = vertexRemap[ meshletVertex ];
+
+    /* The raw size is the size of the unpacked vertices with 32-bit indices. */
+    const bool   skinned      = uint32_t( -1 ) != m.skinId;
+    const size_t rawSize      = size_t( vertexCount ) * ( skinned ? sizeof( apemodefb::StaticSkinnedVertexFb ) : sizeof( apemodefb::StaticVertexFb ) ) +
+                                size_t( indexCount ) * sizeof( uint32_t );
+    const size_t exportedSize = m.vertices.size( ) + m.indices.size( );
+
+    s.console->info( "Mesh \"{}\" edgebreaker blob: {} bytes (raw {} bytes, exported {} bytes, {:.2f} bits per triangle).",
+                     meshName,
+                     encoded.size( ),
+                     rawSize,
+                     exportedSize,
+                     indexCount >= 3 ? encoded.size( ) * 8.0 / ( indexCount / 3 ) : 0.0 );
+
+    m.blob.swap( encoded );
+    m.vertices.clear( );
+    m.indices.clear( );
+    m.indexType = apemodefb::EIndexTypeFb_Edgebreaker;
+}
@@ -0,0 +1,648 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * High-ratio mesh codec (EIndexTypeFb_Edgebreaker, MeshFb.blob) for distribution builds.
+ * The decoder has no dependencies, so it can be used in the loaders as is (the encoder is in fbxpedgebreaker.cpp).
+ *
+ * Connectivity is coded Edgebreaker-style: the triangles are traversed depth-first through the gates (the edges
+ * of the decoded triangles, that have no decoded triangle on the other side), and the third vertex of the triangle
+ * behind the gate is coded as one of the symbols:
+ *  - C: new vertex (the vertices are stored in the order of the first use),
+ *  - L: the vertex on the open edge that ends at the left gate vertex,
+ *  - R: the vertex on the open edge that starts at the right gate vertex,
+ *  - E: both L and R (the triangle closes the hole),
+ *  - S: any other decoded vertex (explicit reference),
+ *  - B: no triangle behind the gate (boundary).
+ * Non-manifold and inconsistently oriented parts fall back to S symbols and new traversal components.
+ * Every index range (subset) is traversed separately, so the triangles stay within their ranges.
+ *
+ * The new vertices are predicted with the parallelogram rule from the gate triangle (positions, texcoords)
+ * or from the neighbour vertex (other attributes). The residuals and the symbols are entropy coded with
+ * the adaptive binary range coder.
+ *
+ * Blob layout (little endian):
+ *  - Header: version (1 byte), reserved (1 byte), vertex stride (2 bytes), vertex count (4 bytes),
+ *    index size (1 byte, 2 or 4), attribute count (1 byte), reserved (2 bytes), range count (4 bytes).
+ *  - Range index counts (4 bytes each).
+ *  - Attributes (8 bytes each): offset (2 bytes), type (1 byte), prediction (1 byte), 4 parameter bytes
+ *    (component count for floats, field bit counts for bit fields).
+ *  - Range coded stream.
+ **/
+
+namespace apemode {
+
+    enum EEdgebreakerSymbol {
+        eEdgebreakerSymbol_C,
+        eEdgebreakerSymbol_L,
+        eEdgebreakerSymbol_E,
+        eEdgebreakerSymbol_R,
+        eEdgebreakerSymbol_S,
+        eEdgebreakerSymbol_B,
+    };
+
+    enum EEdgebreakerAttributeType {
+        eEdgebreakerAttributeType_Float, // Parameter 0 is the float count.
+        eEdgebreakerAttributeType_Bits,  // 32-bit word, parameters are the field bit counts (the remaining high bits are the last field).
+    };
+
+    enum EEdgebreakerPrediction {
+        eEdgebreakerPrediction_Parallelogram,
+        eEdgebreakerPrediction_Delta,
+    };
+
+    static const uint8_t  kEdgebreakerVersion             = 1;
+    static const uint32_t kEdgebreakerHeaderSize          = 16;
+    static const uint32_t kEdgebreakerAttributeSize       = 8;
+    static const uint32_t kEdgebreakerMaxResidualContexts = 32;
+
+    struct EdgebreakerAttribute {
+        uint16_t offset;
+        uint8_t  type;
+        uint8_t  prediction;
+        uint8_t  params[ 4 ];
+    };
+
+    struct EdgebreakerHeader {
+        uint8_t                             version;
+        uint16_t                            vertexStride;
+        uint32_t                            vertexCount;
+        uint8_t                             indexSize;
+        std::vector< uint32_t >             rangeIndexCounts;
+        std::vector< EdgebreakerAttribute > attributes;
+        size_t                              streamOffset;
+    };
+
+    namespace details {
+
+        inline uint32_t ReadUInt32( const uint8_t* src ) {
+            return uint32_t( src[ 0 ] | src[ 1 ] << 8 | src[ 2 ] << 16 | uint32_t( src[ 3 ] ) << 24 );
+        }
+
+        /**
+         * Maps the float bits to the unsigned integers in the same order as the floats.
+         **/
+        inline uint32_t FloatToOrdered( float f ) {
+            uint32_t u;
+            memcpy( &u, &f, sizeof( u ) );
+            return ( u & 0x80000000u ) ? ~u : ( u | 0x80000000u );
+        }
+
+        inline float OrderedToFloat( uint32_t o ) {
+            const uint32_t u = ( o & 0x80000000u ) ? ( o & 0x7fffffffu ) : ~o;
+            float          f;
+            memcpy( &f, &u, sizeof( f ) );
+            return f;
+        }
+
+        inline uint32_t GetFieldMask( uint32_t bitCount ) {
+            return bitCount >= 32 ? 0xffffffffu : ( 1u << bitCount ) - 1;
+        }
+
+        /**
+         * Fills the field bit counts and offsets of the bit field attribute, returns the field count.
+         * The remaining high bits of the word are the last field.
+         **/
+        inline uint32_t GetAttributeFields( const EdgebreakerAttribute& attribute, uint32_t bitCounts[ 5 ], uint32_t bitOffsets[ 5 ] ) {
+            uint32_t fieldCount = 0;
+            uint32_t bitOffset  = 0;
+            for ( uint32_t i = 0; i < 4 && attribute.params[ i ] && bitOffset + attribute.params[ i ] <= 32; ++i ) {
+                bitCounts[ fieldCount ]  = attribute.params[ i ];
+                bitOffsets[ fieldCount ] = bitOffset;
+                bitOffset += attribute.params[ i ];
+                ++fieldCount;
+            }
+
+            if ( bitOffset < 32 ) {
+                bitCounts[ fieldCount ]  = 32 - bitOffset;
+                bitOffsets[ fieldCount ] = bitOffset;
+                ++fieldCount;
+            }
+
+            return fieldCount;
+        }
+
+        /**
+         * Returns the prediction of the integer field (clamped to the field range).
+         **/
+        inline uint32_t PredictField( uint32_t a, uint32_t b, uint32_t c, uint32_t bitCount, bool parallelogram ) {
+            if ( false == parallelogram )
+                return a;
+
+            const int64_t prediction = int64_t( a ) + int64_t( b ) - int64_t( c );
+            const int64_t maxValue   = int64_t( GetFieldMask( bitCount ) );
+            return uint32_t( prediction < 0 ? 0 : prediction > maxValue ? maxValue : prediction );
+        }
+
+        inline float PredictFloat( float a, float b, float c, bool parallelogram ) {
+            return parallelogram ? ( a + b ) - c : a;
+        }
+
+        /**
+         * Connectivity state, that is shared by the encoder and the decoder (the encoder replicates the decoder
+         * decisions with it). The half-edge is open if it is decoded, but its twin is not.
+         **/
+        class EdgebreakerConnectivity {
+        public:
+            struct Gate {
+                uint32_t from;
+                uint32_t to;
+                uint32_t opposite;
+            };
+
+            std::vector< Gate > gates;
+
+            void Reset( uint32_t vertexCount ) {
+                incoming.assign( vertexCount, std::vector< uint32_t >( ) );
+                outgoing.assign( vertexCount, std::vector< uint32_t >( ) );
+                halfEdgeCounts.clear( );
+                gates.clear( );
+            }
+
+            bool IsOpen( uint32_t from, uint32_t to ) const {
+                return GetCount( from, to ) > GetCount( to, from );
+            }
+
+            /**
+             * Returns the source vertex of the latest open half-edge, that ends at the vertex (or -1).
+             **/
+            uint32_t FindLeft( uint32_t v ) const {
+                const std::vector< uint32_t >& sources = incoming[ v ];
+                for ( size_t i = sources.size( ); i > 0; --i ) {
+                    if ( IsOpen( sources[ i - 1 ], v ) )
+                        return sources[ i - 1 ];
+                }
+                return uint32_t( -1 );
+            }
+
+            /**
+             * Returns the target vertex of the latest open half-edge, that starts at the vertex (or -1).
+             **/
+            uint32_t FindRight( uint32_t v ) const {
+                const std::vector< uint32_t >& targets = outgoing[ v ];
+                for ( size_t i = targets.size( ); i > 0; --i ) {
+                    if ( IsOpen( v, targets[ i - 1 ] ) )
+                        return targets[ i - 1 ];
+                }
+                return uint32_t( -1 );
+            }
+
+            /**
+             * Adds the triangle, that was entered through the gate (from, to), and pushes its other edges as gates.
+             * The triangle is ( to, from, v ).
+             **/
+            void AddGateTriangle( const Gate& gate, uint32_t v ) {
+                AddHalfEdge( gate.to, gate.from );
+                AddHalfEdge( gate.from, v );
+                AddHalfEdge( v, gate.to );
+                gates.push_back( Gate{gate.from, v, gate.to} );
+                gates.push_back( Gate{v, gate.to, gate.from} );
+            }
+
+            /**
+             * Adds the first triangle of the traversal component.
+             **/
+            void AddStartTriangle( uint32_t v0, uint32_t v1, uint32_t v2 ) {
+                AddHalfEdge( v0, v1 );
+                AddHalfEdge( v1, v2 );
+                AddHalfEdge( v2, v0 );
+                gates.push_back( Gate{v2, v0, v1} );
+                gates.push_back( Gate{v1, v2, v0} );
+                gates.push_back( Gate{v0, v1, v2} );
+            }
+
+        private:
+            std::vector< std::vector< uint32_t > >   incoming;
+            std::vector< std::vector< uint32_t > >   outgoing;
+            std::unordered_map< uint64_t, uint32_t > halfEdgeCounts;
+
+            static uint64_t GetKey( uint32_t from, uint32_t to ) {
+                return uint64_t( from ) << 32 | to;
+            }
+
+            uint32_t GetCount( uint32_t from, uint32_t to ) const {
+                const auto it = halfEdgeCounts.find( GetKey( from, to ) );
+                return it == halfEdgeCounts.end( ) ? 0 : it->second;
+            }
+
+            void AddHalfEdge( uint32_t from, uint32_t to ) {
+                ++halfEdgeCounts[ GetKey( from, to ) ];
+                outgoing[ from ].push_back( to );
+                incoming[ to ].push_back( from );
+            }
+        };
+
+        /**
+         * Adaptive binary range decoder (11-bit probabilities, LZMA style).
+         **/
+        class RangeDecoder {
+        public:
+            static const uint32_t kProbBits = 11;
+            static const uint32_t kProbInit = 1u << ( kProbBits - 1 );
+            static const uint32_t kMoveBits = 5;
+            static const uint32_t kTop      = 1u << 24;
+
+            RangeDecoder( const uint8_t* src, const uint8_t* srcEnd ) : src( src ), srcEnd( srcEnd ) {
+                for ( uint32_t i = 0; i < 5; ++i ) {
+                    code = ( code << 8 ) | NextByte( );
+                }
+            }
+
+            bool IsCorrupted( ) const {
+                return corrupted;
+            }
+
+            uint32_t DecodeBit( uint16_t& prob ) {
+                const uint32_t bound = ( range >> kProbBits ) * prob;
+                uint32_t       bit;
+                if ( code < bound ) {
+                    range = bound;
+                    prob  = uint16_t( prob + ( ( ( 1u << kProbBits ) - prob ) >> kMoveBits ) );
+                    bit   = 0;
+                } else {
+                    code -= bound;
+                    range -= bound;
+                    prob = uint16_t( prob - ( prob >> kMoveBits ) );
+                    bit  = 1;
+                }
+
+                Normalize( );
+                return bit;
+            }
+
+            uint32_t DecodeDirect( uint32_t bitCount ) {
+                uint32_t value = 0;
+                for ( uint32_t i = 0; i < bitCount; ++i ) {
+                    range >>= 1;
+                    uint32_t bit = 0;
+                    if ( code >= range ) {
+                        code -= range;
+                        bit = 1;
+                    }
+
+                    value = ( value << 1 ) | bit;
+                    Normalize( );
+                }
+                return value;
+            }
+
+            /**
+             * Decodes the symbol of bitCount bits with the bit tree of ( 1 << bitCount ) probabilities.
+             **/
+            uint32_t DecodeTree( uint16_t* probs, uint32_t bitCount ) {
+                uint32_t m = 1;
+                for ( uint32_t i = 0; i < bitCount; ++i ) {
+                    m = ( m << 1 ) | DecodeBit( probs[ m ] );
+                }
+                return m - ( 1u << bitCount );
+            }
+
+        private:
+            const uint8_t* src;
+            const uint8_t* srcEnd;
+            uint32_t       range     = 0xffffffffu;
+            uint32_t       code      = 0;
+            bool           corrupted = false;
+
+            uint32_t NextByte( ) {
+                if ( src == srcEnd ) {
+                    corrupted = true;
+                    return 0;
+                }
+                return *src++;
+            }
+
+            void Normalize( ) {
+                if ( range < kTop ) {
+                    range <<= 8;
+                    code = ( code << 8 ) | NextByte( );
+                }
+            }
+        };
+
+        /**
+         * Adaptive models of the stream, the encoder uses the same ones.
+         **/
+        struct EdgebreakerModels {
+            static const uint32_t kSymbolBits = 3;
+            static const uint32_t kLengthBits = 6;
+
+            uint16_t symbols[ 8 ][ 1 << kSymbolBits ];
+            uint16_t startNew;
+            uint16_t lengths[ kEdgebreakerMaxResidualContexts + 2 ][ 1 << kLengthBits ];
+
+            uint32_t previousSymbol = eEdgebreakerSymbol_C;
+
+            static const uint32_t kStartReferenceContext = kEdgebreakerMaxResidualContexts;
+            static const uint32_t kSReferenceContext     = kEdgebreakerMaxResidualContexts + 1;
+
+            EdgebreakerModels( ) {
+                uint16_t* probs    = &symbols[ 0 ][ 0 ];
+                uint16_t* probsEnd = probs + sizeof( symbols ) / sizeof( uint16_t );
+                for ( ; probs != probsEnd; ++probs )
+                    *probs = RangeDecoder::kProbInit;
+
+                startNew = RangeDecoder::kProbInit;
+
+                probs    = &lengths[ 0 ][ 0 ];
+                probsEnd = probs + sizeof( lengths ) / sizeof( uint16_t );
+                for ( ; probs != probsEnd; ++probs )
+                    *probs = RangeDecoder::kProbInit;
+            }
+        };
+
+        inline uint32_t ZigzagDecodeResidual( uint32_t v ) {
+            return ( v >> 1 ) ^ ( 0 - ( v & 1 ) );
+        }
+
+        /**
+         * Decodes the residual: the bit length of the zigzag value, then its bits below the leading one.
+         **/
+        inline uint32_t DecodeResidual( RangeDecoder& decoder, EdgebreakerModels& models, uint32_t context ) {
+            const uint32_t bitLength = decoder.DecodeTree( models.lengths[ context ], EdgebreakerModels::kLengthBits );
+            if ( 0 == bitLength )
+                return 0;
+            if ( bitLength > 32 )
+                return uint32_t( -1 );
+
+            const uint32_t lowBits = decoder.DecodeDirect( bitLength - 1 );
+            return uint32_t( uint64_t( 1 ) << ( bitLength - 1 ) ) | lowBits;
+        }
+
+        /**
+         * Returns the residual context of the attribute component.
+         **/
+        inline uint32_t GetResidualContext( uint32_t component ) {
+            return component < kEdgebreakerMaxResidualContexts ? component : kEdgebreakerMaxResidualContexts - 1;
+        }
+
+        /**
+         * Decodes the vertex attributes. The vertices a, b and c are the parallelogram (a + b - c) vertices,
+         * or a is the neighbour vertex (b and c are ignored) for the delta prediction.
+         **/
+        inline void DecodeEdgebreakerVertex( RangeDecoder&                              decoder,
+                                             EdgebreakerModels&                         models,
+                                             const std::vector< EdgebreakerAttribute >& attributes,
+                                             const uint8_t*                             a,
+                                             const uint8_t*                             b,
+                                             const uint8_t*                             c,
+                                             bool                                       parallelogram,
+                                             uint8_t*                                   v ) {
+            uint32_t component = 0;
+            for ( const EdgebreakerAttribute& attribute : attributes ) {
+                const bool usesParallelogram = parallelogram && eEdgebreakerPrediction_Parallelogram == attribute.prediction;
+
+                if ( eEdgebreakerAttributeType_Float == attribute.type ) {
+                    for ( uint32_t i = 0; i < attribute.params[ 0 ]; ++i, ++component ) {
+                        const uint32_t offset = attribute.offset + i * sizeof( float );
+                        float          fa, fb, fc;
+                        memcpy( &fa, a + offset, sizeof( float ) );
+                        memcpy( &fb, b + offset, sizeof( float ) );
+                        memcpy( &fc, c + offset, sizeof( float ) );
+
+                        const uint32_t prediction = FloatToOrdered( PredictFloat( fa, fb, fc, usesParallelogram ) );
+                        const uint32_t residual   = ZigzagDecodeResidual( DecodeResidual( decoder, models, GetResidualContext( component ) ) );
+                        const float    f          = OrderedToFloat( prediction + residual );
+                        memcpy( v + offset, &f, sizeof( float ) );
+                    }
+                } else {
+                    uint32_t bitCounts[ 5 ];
+                    uint32_t bitOffsets[ 5 ];
+                    const uint32_t fieldCount = GetAttributeFields( attribute, bitCounts, bitOffsets );
+
+                    uint32_t wa, wb, wc;
+                    memcpy( &wa, a + attribute.offset, sizeof( uint32_t ) );
+                    memcpy( &wb, b + attribute.offset, sizeof( uint32_t ) );
+                    memcpy( &wc, c + attribute.offset, sizeof( uint32_t ) );
+
+                    uint32_t word = 0;
+                    for ( uint32_t i = 0; i < fieldCount; ++i, ++component ) {
+                        const uint32_t mask       = GetFieldMask( bitCounts[ i ] );
+                        const uint32_t prediction = PredictField( ( wa >> bitOffsets[ i ] ) & mask,
+                                                                  ( wb >> bitOffsets[ i ] ) & mask,
+                                                                  ( wc >> bitOffsets[ i ] ) & mask,
+                                                                  bitCounts[ i ],
+                                                                  usesParallelogram );
+
+                        const uint32_t residual = ZigzagDecodeResidual( DecodeResidual( decoder, models, GetResidualContext( component ) ) );
+                        word |= ( ( prediction + residual ) & mask ) << bitOffsets[ i ];
+                    }
+
+                    memcpy( v + attribute.offset, &word, sizeof( uint32_t ) );
+                }
+            }
+        }
+    }
+
+    /**
+     * Reads the blob header.
+     * @return False if the blob is too short, has unsupported version or invalid attributes.
+     **/
+    inline bool ReadEdgebreakerHeader( const uint8_t* src, size_t srcSize, EdgebreakerHeader& header ) {
+        if ( srcSize < kEdgebreakerHeaderSize || kEdgebreakerVersion != src[ 0 ] )
+            return false;
+
+        header.version      = src[ 0 ];
+        header.vertexStride = uint16_t( src[ 2 ] | src[ 3 ] << 8 );
+        header.vertexCount  = details::ReadUInt32( src + 4 );
+        header.indexSize    = src[ 8 ];
+
+        const uint32_t attributeCount = src[ 9 ];
+        const uint32_t rangeCount     = details::ReadUInt32( src + 12 );
+
+        if ( 2 != header.indexSize && 4 != header.indexSize )
+            return false;
+
+        const size_t tablesSize = size_t( rangeCount ) * 4 + size_t( attributeCount ) * kEdgebreakerAttributeSize;
+        if ( srcSize - kEdgebreakerHeaderSize < tablesSize )
+            return false;
+
+        const uint8_t* tables = src + kEdgebreakerHeaderSize;
+
+        header.rangeIndexCounts.resize( rangeCount );
+        for ( uint32_t i = 0; i < rangeCount; ++i, tables += 4 ) {
+            header.rangeIndexCounts[ i ] = details::ReadUInt32( tables );
+            if ( header.rangeIndexCounts[ i ] % 3 )
+                return false;
+        }
+
+        header.attributes.resize( attributeCount );
+        for ( uint32_t i = 0; i < attributeCount; ++i, tables += kEdgebreakerAttributeSize ) {
+            EdgebreakerAttribute& attribute = header.attributes[ i ];
+            attribute.offset                = uint16_t( tables[ 0 ] | tables[ 1 ] << 8 );
+            attribute.type                  = tables[ 2 ];
+            attribute.prediction            = tables[ 3 ];
+            memcpy( attribute.params, tables + 4, sizeof( attribute.params ) );
+
+            const uint32_t size = eEdgebreakerAttributeType_Float == attribute.type ? attribute.params[ 0 ] * 4u : 4u;
+            if ( attribute.type > eEdgebreakerAttributeType_Bits || attribute.prediction > eEdgebreakerPrediction_Delta ||
+                 attribute.offset + size > header.vertexStride )
+                return false;
+        }
+
+        header.streamOffset = size_t( tables - src );
+        return true;
+    }
+
+    /**
+     * Decodes the blob into the vertex buffer (vertex count * vertex stride bytes) and the index buffer
+     * (index size bytes per index, the ranges go one after another).
+     * @return False if the blob is corrupted.
+     **/
+    inline bool DecodeEdgebreakerMesh( const uint8_t*          src,
+                                       size_t                  srcSize,
+                                       std::vector< uint8_t >& vertices,
+                                       std::vector< uint8_t >& indices ) {
+        using namespace details;
+
+        EdgebreakerHeader header;
+        if ( false == ReadEdgebreakerHeader( src, srcSize, header ) )
+            return false;
+
+        const uint32_t vertexStride = header.vertexStride;
+        const uint32_t vertexCount  = header.vertexCount;
+
+        size_t indexCount = 0;
+        for ( uint32_t rangeIndexCount : header.rangeIndexCounts )
+            indexCount += rangeIndexCount;
+
+        /* Every vertex and every triangle take at least 0.1 bits (the adaptive probabilities are bounded),
+           the sizes are checked before the allocations. */
+        if ( vertexCount / 64 > srcSize || indexCount / 3 / 64 > srcSize )
+            return false;
+
+        vertices.assign( size_t( vertexCount ) * vertexStride, 0 );
+        indices.assign( indexCount * header.indexSize, 0 );
+
+        std::vector< uint8_t > zeroVertex( vertexStride, 0 );
+
+        RangeDecoder            decoder( src + header.streamOffset, src + srcSize );
+        EdgebreakerModels       models;
+        EdgebreakerConnectivity connectivity;
+        connectivity.Reset( vertexCount );
+
+        uint32_t decodedVertexCount = 0;
+        size_t   index              = 0;
+
+        auto vertexAt = [&]( uint32_t v ) { return vertices.data( ) + size_t( v ) * vertexStride; };
+
+        auto writeIndex = [&]( uint32_t v ) {
+            if ( 2 == header.indexSize ) {
+                const uint16_t v16 = uint16_t( v );
+                memcpy( indices.data( ) + index * 2, &v16, 2 );
+            } else {
+                memcpy( indices.data( ) + index * 4, &v, 4 );
+            }
+            ++index;
+        };
+
+        /* The vertex without the triangle to predict from is predicted from the previous one. */
+        auto decodeStartVertex = [&]( ) {
+            const uint8_t* previous = decodedVertexCount ? vertexAt( decodedVertexCount - 1 ) : zeroVertex.data( );
+            DecodeEdgebreakerVertex( decoder, models, header.attributes, previous, previous, previous, false, vertexAt( decodedVertexCount ) );
+            return decodedVertexCount++;
+        };
+
+        auto decodeReference = [&]( uint32_t context ) {
+            const uint32_t reference = DecodeResidual( decoder, models, context );
+            return reference < decodedVertexCount ? decodedVertexCount - 1 - reference : uint32_t( -1 );
+        };
+
+        for ( uint32_t rangeIndexCount : header.rangeIndexCounts ) {
+            connectivity.gates.clear( );
+
+            for ( uint32_t triangle = 0; triangle < rangeIndexCount / 3; ) {
+                if ( decoder.IsCorrupted( ) )
+                    return false;
+
+                if ( connectivity.gates.empty( ) ) {
+                    uint32_t v[ 3 ];
+                    for ( uint32_t i = 0; i < 3; ++i ) {
+                        if ( decoder.DecodeBit( models.startNew ) ) {
+                            if ( decodedVertexCount == vertexCount )
+                                return false;
+                            v[ i ] = decodeStartVertex( );
+                        } else {
+                            v[ i ] = decodeReference( EdgebreakerModels::kStartReferenceContext );
+                            if ( uint32_t( -1 ) == v[ i ] )
+                                return false;
+                        }
+                    }
+
+                    connectivity.AddStartTriangle( v[ 0 ], v[ 1 ], v[ 2 ] );
+                    writeIndex( v[ 0 ] );
+                    writeIndex( v[ 1 ] );
+                    writeIndex( v[ 2 ] );
+                    ++triangle;
+                    continue;
+                }
+
+                const EdgebreakerConnectivity::Gate gate = connectivity.gates.back( );
+                connectivity.gates.pop_back( );
+
+                if ( false == connectivity.IsOpen( gate.from, gate.to ) )
+                    continue;
+
+                const uint32_t symbol = decoder.DecodeTree( models.symbols[ models.previousSymbol ], EdgebreakerModels::kSymbolBits );
+                models.previousSymbol = symbol;
+
+                uint32_t v = uint32_t( -1 );
+                switch ( symbol ) {
+                    case eEdgebreakerSymbol_B:
+                        continue;
+
+                    case eEdgebreakerSymbol_C:
+                        if ( decodedVertexCount == vertexCount )
+                            return false;
+
+                        DecodeEdgebreakerVertex( decoder,
+                                                 models,
+                                                 header.attributes,
+                                                 vertexAt( gate.from ),
+                                                 vertexAt( gate.to ),
+                                                 vertexAt( gate.opposite ),
+                                                 true,
+                                                 vertexAt( decodedVertexCount ) );
+                        v = decodedVertexCount++;
+                        break;
+
+                    case eEdgebreakerSymbol_L:
+                    case eEdgebreakerSymbol_E:
+                        v = connectivity.FindLeft( gate.from );
+                        break;
+
+                    case eEdgebreakerSymbol_R:
+                        v = connectivity.FindRight( gate.to );
+                        break;
+
+                    case eEdgebreakerSymbol_S:
+                        v = decodeReference( EdgebreakerModels::kSReferenceContext );
+                        break;
+
+                    default:
+                        return false;
+                }
+
+                if ( uint32_t( -1 ) == v )
+                    return false;
+
+                connectivity.AddGateTriangle( gate, v );
+                writeIndex( gate.to );
+                writeIndex( gate.from );
+                writeIndex( v );
+                ++triangle;
+            }
+        }
+
+        /* The vertices, that are not referenced by the indices. */
+        while ( decodedVertexCount < vertexCount && false == decoder.IsCorrupted( ) )
+            decodeStartVertex( );
+
+        return false == decoder.IsCorrupted( );
+    }
+}
@@ -1,98 +1,114 @@
 #include <fbxppch.h>
 #include <fbxpstate.h>
 #include <fbxpnorm.h>
+#include <CityHash.h>
+#include <array>
+#include <atomic>
+#include <functional>
 #include <map>
+#include <thread>
 
 /**
- * Helper function to calculate tangents when the tangent element layer is missing.
+ * Welds duplicate vertices and produces the indices for the welded vertices.
+ * The vertex components are snapped to the epsilon grid before comparison (zero epsilon means exact comparison).
+ * The first occurrence of each vertex is kept, so the welded vertices are ordered by their first use.
  * Can be used in multiple threads.
- * http://gamedev.stackexchange.com/a/68617/39505
+ *
+ * @param vertices The expanded vertices (a vertex per polygon corner), welded in place.
+ * @param vertexCount The expanded vertex count.
+ * @param indices The indices of the welded vertices (an index per polygon corner).
+ * @param epsilon The tolerance for the vertex components.
+ * @param vertexTags The optional vertex tags, the vertices with the different tags are not welded (welded in place).
+ * @return The welded vertex count.
  **/
 template < typename TVertex >
-void CalculateTangents( TVertex* vertices, size_t vertexCount ) {
-    std::vector< mathfu::vec3 > tan;
-    tan.resize( vertexCount * 2 );
-    memset( tan.data( ), 0, sizeof( mathfu::vec3 ) * vertexCount * 2 );
-
-    auto tan1 = tan.data( );
-    auto tan2 = tan1 + vertexCount;
-
-    for ( size_t i = 0; i < vertexCount; i += 3 ) {
-        const TVertex v0 = vertices[ i + 0 ];
-        const TVertex v1 = vertices[ i + 1 ];
-        const TVertex v2 = vertices[ i + 2 ];
-
-        const float x1 = v1.position[ 0 ] - v0.position[ 0 ];
-        const float x2 = v2.position[ 0 ] - v0.position[ 0 ];
-        const float y1 = v1.position[ 1 ] - v0.position[ 1 ];
-        const float y2 = v2.position[ 1 ] - v0.position[ 1 ];
-        const float z1 = v1.position[ 2 ] - v0.position[ 2 ];
-        const float z2 = v2.position[ 2 ] - v0.position[ 2 ];
-
-        const float s1 = v1.texCoords[ 0 ] - v0.texCoords[ 0 ];
-        const float s2 = v2.texCoords[ 0 ] - v0.texCoords[ 0 ];
-        const float t1 = v1.texCoords[ 1 ] - v0.texCoords[ 1 ];
-        const float t2 = v2.texCoords[ 1 ] - v0.texCoords[ 1 ];
-
-        const float r = 1.0f / ( s1 * t2 - s2 * t1 );
-        const mathfu::vec3 sdir( ( t2 * x1 - t1 * x2 ) * r, ( t2 * y1 - t1 * y2 ) * r, ( t2 * z1 - t1 * z2 ) * r );
-        const mathfu::vec3 tdir( ( s1 * x2 - s2 * x1 ) * r, ( s1 * y2 - s2 * y1 ) * r, ( s1 * z2 - s2 * z1 ) * r );
-
-        // assert( !isnan( sdir.x ) && !isnan( sdir.y ) && !isnan( sdir.z ) );
-        // assert( !isnan( tdir.x ) && !isnan( tdir.y ) && !isnan( tdir.z ) );
-
-        tan1[ i + 0 ] += sdir;
-        tan1[ i + 1 ] += sdir;
-        tan1[ i + 2 ] += sdir;
-
-        tan2[ i + 0 ] += tdir;
-        tan2[ i + 1 ] += tdir;
-        tan2[ i + 2 ] += tdir;
+uint32_t WeldVertices( TVertex* vertices, uint32_t vertexCount, std::vector< uint32_t >& indices, float epsilon, uint32_t* vertexTags = nullptr ) {
+    static const uint32_t kComponentCount = sizeof( TVertex ) / sizeof( float );
+    static const uint32_t kEmptySlot      = (uint32_t) -1;
+    static_assert( sizeof( TVertex ) == kComponentCount * sizeof( float ), "Only float components are supported." );
+
+    /* The last key element is the vertex tag. */
+    using VertexKey = std::array< uint64_t, kComponentCount + 1 >;
+
+    const double invEpsilon = epsilon > 0.0f ? 1.0 / (double) epsilon : 0.0;
+    auto getKey = [&]( const TVertex& v, uint32_t tag, VertexKey& key ) {
+        key[ kComponentCount ] = tag;
+
+        const float* components = reinterpret_cast< const float* >( &v );
+        for ( uint32_t i = 0; i < kComponentCount; ++i ) {
+            if ( invEpsilon > 0.0 ) {
+                key[ i ] = (uint64_t) (int64_t) floor( components[ i ] * invEpsilon + 0.5 );
+            } else {
+                /* Make sure positive and negative zeros match. */
+                const float component = components[ i ] == 0.0f ? 0.0f : components[ i ];
+                uint32_t    bits      = 0;
+                memcpy( &bits, &component, sizeof( float ) );
+                key[ i ] = bits;
+            }
+        }
+    };
+
+    /* Open addressing with linear probing, the load factor is kept below 2/3. */
+    uint32_t slotCount = 1;
+    while ( slotCount < vertexCount + vertexCount / 2 ) {
+        slotCount <<= 1;
     }
 
-    for ( size_t i = 0; i < vertexCount; i += 1 ) {
-        TVertex& v = vertices[ i ];
-        const auto n = mathfu::vec3( v.normal[ 0 ], v.normal[ 1 ], v.normal[ 2 ] );
-        const auto t = tan1[ i ];
+    std::vector< uint32_t > slots( slotCount, kEmptySlot );
+    indices.resize( vertexCount );
+
+    VertexKey key;
+    VertexKey weldedKey;
+    uint32_t  weldedVertexCount = 0;
+
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        getKey( vertices[ i ], vertexTags ? vertexTags[ i ] : 0, key );
 
-        mathfu::vec3 tt = mathfu::normalize( t - n * mathfu::dot( n, t ) );
-        // assert( !isnan( tt.x ) && !isnan( tt.y ) && !isnan( tt.z ) );
+        uint32_t slot = (uint32_t) apemode::CityHash64( (const char*) key.data( ), sizeof( key ) ) & ( slotCount - 1 );
+        for ( ;; ) {
+            const uint32_t weldedIndex = slots[ slot ];
 
-        v.tangent[ 0 ]  = tt.x;
-        v.tangent[ 1 ]  = tt.y;
-        v.tangent[ 2 ]  = tt.z;
-        v.tangent[ 3 ]  = ( mathfu::dot( mathfu::cross( n, t ), tan2[ i ] ) < 0 ) ? -1.0f : 1.0f;
+            if ( kEmptySlot == weldedIndex ) {
+                /* The welded vertex is never placed after the vertex being processed. */
+                slots[ slot ]                 = weldedVertexCount;
+                vertices[ weldedVertexCount ] = vertices[ i ];
+                indices[ i ]                  = weldedVertexCount++;
+
+                if ( vertexTags )
+                    vertexTags[ indices[ i ] ] = vertexTags[ i ];
+                break;
+            }
+
+            getKey( vertices[ weldedIndex ], vertexTags ? vertexTags[ weldedIndex ] : 0, weldedKey );
+            if ( key == weldedKey ) {
+                indices[ i ] = weldedIndex;
+                break;
+            }
+
+            slot = ( slot + 1 ) & ( slotCount - 1 );
+        }
     }
+
+    return weldedVertexCount;
 }
 
 /**
- * Calculate normals for the faces (does not weight triangles).
- * Fast and usable results, however incorrect.
- * TODO: Implement vertex normal calculations.
+ * Writes the indices with the requested index type.
  **/
-template < typename TVertex >
-void CalculateFaceNormals( TVertex* vertices, size_t vertexCount ) {
-    for ( size_t i = 0; i < vertexCount; i += 3 ) {
-        TVertex& v0 = vertices[ i + 0 ];
-        TVertex& v1 = vertices[ i + 1 ];
-        TVertex& v2 = vertices[ i + 2 ];
-
-        const mathfu::vec3 p0( v0.position );
-        const mathfu::vec3 p1( v1.position );
-        const mathfu::vec3 p2( v2.position );
-        const mathfu::vec3 n( mathfu::normalize( mathfu::cross( p1 - p0, p2 - p0 ) ) );
-
-        v0.normal[ 0 ] = n.x;
-        v0.normal[ 1 ] = n.y;
-        v0.normal[ 2 ] = n.z;
-
-        v1.normal[ 0 ] = n.x;
-        v1.normal[ 1 ] = n.y;
-        v1.normal[ 2 ] = n.z;
-
-        v2.normal[ 0 ] = n.x;
-        v2.normal[ 1 ] = n.y;
-        v2.normal[ 2 ] = n.z;
+template < typename TIndex >
+void FillIndices( apemode::Mesh& m, const std::vector< uint32_t >& indices ) {
+    m.indices.resize( indices.size( ) * sizeof( TIndex ) );
+    std::transform( indices.begin( ), indices.end( ), reinterpret_cast< TIndex* >( m.indices.data( ) ), [&]( const uint32_t i ) {
+        assert( i <= std::numeric_limits< TIndex >::max( ) );
+        return (TIndex) i;
+    } );
+
+    if ( std::is_same< TIndex, uint16_t >::value ) {
+        m.indexType = apemodefb::EIndexTypeFb_UInt16;
+    } else if ( std::is_same< TIndex, uint32_t >::value ) {
+        m.indexType = apemodefb::EIndexTypeFb_UInt32;
+    } else {
+        assert( false );
     }
 }
 
@@ -105,13 +121,21 @@ void CalculateFaceNormals( TVertex* vertices, size_t vertexCount ) {
  *                     * range is [base index; index count]
  *
  * @param indices The indices of the mesh that will be used to draw the mesh with multiple materials.
+ * @param triangles The triangles of the mesh polygons (the polygon ranges are converted to the index ranges).
  * @param subsets The ranges of the vertex indices for each material of the node.
  * @param subsetPolies A mapping of material indices to polygon ranges (useful for knowing the basic structure).
  * @return True on success.
  **/
 template < typename TIndex >
-bool GetSubsets( FbxMesh* mesh, apemode::Mesh& m, std::vector< apemodefb::SubsetFb >& subsets ) {
+bool GetSubsets( FbxMesh*                            mesh,
+                 const apemode::MeshTriangles&       triangles,
+                 apemode::Mesh&                      m,
+                 std::vector< apemodefb::SubsetFb >& subsets ) {
     auto& s = apemode::Get( );
+
+    /* The polygons are triangulated natively, the polygon ranges are converted with the base triangles. */
+    const uint32_t cornerCount = (uint32_t) triangles.cornerPolygonVertices.size( );
+    auto getBaseIndex = [&]( uint32_t polygonIndex ) { return triangles.polygonBaseTriangles[ polygonIndex ] * 3; };
     s.console->info("Mesh \"{}\" has {} material(s) assigned.", mesh->GetNode( )->GetName( ), mesh->GetNode( )->GetMaterialCount( ) );
 
     subsets.clear( );
@@ -123,7 +147,7 @@ bool GetSubsets( FbxMesh* mesh, apemode::Mesh& m, std::vector< apemodefb::Subset
 
     /* Single submesh */
     if ( mesh->GetNode( )->GetMaterialCount( ) == 1 ) {
-        subsets.emplace_back( 0, 0, mesh->GetPolygonCount( ) * 3 );
+        subsets.emplace_back( 0, 0, cornerCount );
         return true;
     }
 
@@ -160,7 +184,7 @@ bool GetSubsets( FbxMesh* mesh, apemode::Mesh& m, std::vector< apemodefb::Subset
                                 for ( auto k = 0; k < mesh->GetNode( )->GetMaterialCount( ); ++k ) {
                                     if ( mesh->GetNode( )->GetMaterial( k ) == directArray->GetAt( 0 ) ) {
                                         /* Since the mapping mode is eAllSame, return here. */
-                                        subsets.emplace_back( k, 0, mesh->GetPolygonCount( ) * 3 );
+                                        subsets.emplace_back( k, 0, cornerCount );
                                         return true;
                                     }
                                 }
@@ -180,7 +204,7 @@ bool GetSubsets( FbxMesh* mesh, apemode::Mesh& m, std::vector< apemodefb::Subset
                                 }
 
                                 /* Since the mapping mode is eAllSame, return here. */
-                                subsets.emplace_back( indexArray->GetAt( 0 ), 0, mesh->GetPolygonCount( ) * 3 );
+                                subsets.emplace_back( indexArray->GetAt( 0 ), 0, cornerCount );
                                 return true;
                             } break;
 
@@ -323,7 +347,9 @@ bool GetSubsets( FbxMesh* mesh, apemode::Mesh& m, std::vector< apemodefb::Subset
 
             if ( materialIndex != (uint32_t) -1 ) {
                 const auto subsetLength = indexCount - subsetStartIndex;
-                subsets.emplace_back( materialIndex, (uint32_t)subsetStartIndex * 3, (uint32_t)subsetLength * 3 );
+                subsets.emplace_back( materialIndex,
+                                      getBaseIndex( (uint32_t) subsetStartIndex ),
+                                      getBaseIndex( (uint32_t) indexCount ) - getBaseIndex( (uint32_t) subsetStartIndex ) );
 
                 s.console->info( "\tMesh subset #{} for material #{} index range: [{}; {}].",
                                  subsets.size( ) - 1,
@@ -342,7 +368,9 @@ bool GetSubsets( FbxMesh* mesh, apemode::Mesh& m, std::vector< apemodefb::Subset
     if ( !subsetPolies.empty( ) ) {
         const TIndex indexCount = subsetIndexCount; 
         const auto subsetLength = indexCount - subsetStartIndex;
-        subsets.emplace_back( materialIndex, (uint32_t) subsetStartIndex * 3, (uint32_t) subsetLength * 3 );
+        subsets.emplace_back( materialIndex,
+                              getBaseIndex( (uint32_t) subsetStartIndex ),
+                              getBaseIndex( (uint32_t) indexCount ) - getBaseIndex( (uint32_t) subsetStartIndex ) );
 
         s.console->info( "\tMesh subset #{} for material #{} index range: [{}; {}].",
                          subsets.size( ) - 1,
@@ -359,69 +387,6 @@ bool GetSubsets( FbxMesh* mesh, apemode::Mesh& m, std::vector< apemodefb::Subset
     return true;
 }
 
-//
-// Helper function to get values from geometry element layers
-// with their reference and mapping modes.
-//
-
-/**
- * Returns the value from the element layer by index with respect to reference mode.
- **/
-template < typename TElementLayer, typename TElementValue >
-TElementValue GetElementValue( const TElementLayer* pElementLayer, uint32_t i ) {
-    assert( pElementLayer );
-    switch ( const auto referenceMode = pElementLayer->GetReferenceMode( ) ) {
-        case FbxLayerElement::EReferenceMode::eDirect:
-            return pElementLayer->GetDirectArray( ).GetAt( i );
-        case FbxLayerElement::EReferenceMode::eIndex:
-        case FbxLayerElement::EReferenceMode::eIndexToDirect: {
-            const int j = pElementLayer->GetIndexArray( ).GetAt( i );
-            return pElementLayer->GetDirectArray( ).GetAt( j );
-        }
-
-        default:
-            apemode::Get( ).console->error(
-                "Reference mode {} of layer \"{}\" "
-                "is not supported.",
-                referenceMode,
-                pElementLayer->GetName( ) );
-
-            DebugBreak( );
-            return TElementValue( );
-    }
-}
-
-/**
- * Returns the value from the element layer with respect to reference and mapping modes.
- **/
-template < typename TElementLayer, typename TElementValue >
-TElementValue GetElementValue( const TElementLayer* pElementLayer,
-                               uint32_t             controlPointIndex,
-                               uint32_t             vertexIndex,
-                               uint32_t             polygonIndex ) {
-    if ( nullptr == pElementLayer )
-        return TElementValue( );
-
-    switch ( const auto mappingMode = pElementLayer->GetMappingMode( ) ) {
-        case FbxLayerElement::EMappingMode::eByControlPoint:
-            return GetElementValue< TElementLayer, TElementValue >( pElementLayer, controlPointIndex );
-        case FbxLayerElement::EMappingMode::eByPolygon:
-            return GetElementValue< TElementLayer, TElementValue >( pElementLayer, polygonIndex );
-        case FbxLayerElement::EMappingMode::eByPolygonVertex:
-            return GetElementValue< TElementLayer, TElementValue >( pElementLayer, vertexIndex );
-
-        default:
-            apemode::Get( ).console->error(
-                "Mapping mode {} of layer \"{}\" "
-                "is not supported.",
-                mappingMode,
-                pElementLayer->GetName( ) );
-
-            DebugBreak( );
-            return TElementValue( );
-    }
-}
-
 /**
  * Returns nullptr in case element layer has unsupported properties or is null.
  **/
@@ -463,6 +428,89 @@ const TElementLayer* VerifyElementLayer( const TElementLayer* pElementLayer ) {
     return pElementLayer;
 }
 
+/**
+ * Resolves the element layer into the flat array of values per mesh corner (structure of arrays).
+ * The direct and index arrays are read once per mesh, the mapping and reference modes are resolved
+ * into the value indices per corner once, so the values are gathered in the tight loop.
+ * @param pElementLayer The verified element layer (or null, the values are zeroed in this case).
+ * @param triangles The triangles of the mesh polygons (the polygon vertices and polygons of the corners).
+ * @param cornerControlPoints The control point indices per mesh corner.
+ * @param cornerCount The number of mesh corners (3 per triangle).
+ * @param values The output values, TComponentCount floats per corner.
+ **/
+template < uint32_t TComponentCount, typename TElementLayer >
+void ExtractElementLayer( const TElementLayer*          pElementLayer,
+                          const apemode::MeshTriangles& triangles,
+                          const uint32_t*               cornerControlPoints,
+                          uint32_t                      cornerCount,
+                          std::vector< float >&         values ) {
+    values.assign( cornerCount * TComponentCount, 0.0f );
+    if ( nullptr == pElementLayer )
+        return;
+
+    /* Convert the direct array once, the extra zero value is referenced by the out of range indices. */
+
+    const auto&    directArray = pElementLayer->GetDirectArray( );
+    const uint32_t directCount = (uint32_t) directArray.GetCount( );
+
+    std::vector< float > directValues( ( directCount + 1 ) * TComponentCount, 0.0f );
+    for ( uint32_t i = 0; i < directCount; ++i ) {
+        const auto value = directArray.GetAt( (int) i );
+        for ( uint32_t k = 0; k < TComponentCount; ++k ) {
+            directValues[ i * TComponentCount + k ] = (float) value[ k ];
+        }
+    }
+
+    /* Resolve the mapping mode (modes other than listed are rejected in VerifyElementLayer). */
+
+    std::vector< uint32_t > valueIndices( cornerCount );
+    switch ( pElementLayer->GetMappingMode( ) ) {
+        case FbxLayerElement::EMappingMode::eByControlPoint:
+            std::copy( cornerControlPoints, cornerControlPoints + cornerCount, valueIndices.begin( ) );
+            break;
+        case FbxLayerElement::EMappingMode::eByPolygon:
+            for ( uint32_t i = 0; i < cornerCount; ++i ) {
+                valueIndices[ i ] = triangles.trianglePolygons[ i / 3 ];
+            }
+            break;
+        default:
+            for ( uint32_t i = 0; i < cornerCount; ++i ) {
+                valueIndices[ i ] = triangles.cornerPolygonVertices[ i ];
+            }
+            break;
+    }
+
+    /* Resolve the reference mode. */
+
+    if ( FbxLayerElement::EReferenceMode::eDirect != pElementLayer->GetReferenceMode( ) ) {
+        const auto&    indexArray = pElementLayer->GetIndexArray( );
+        const uint32_t indexCount = (uint32_t) indexArray.GetCount( );
+
+        std::vector< uint32_t > indices( indexCount + 1, directCount );
+        for ( uint32_t i = 0; i < indexCount; ++i ) {
+            indices[ i ] = std::min( (uint32_t) indexArray.GetAt( (int) i ), directCount );
+        }
+
+        for ( auto& valueIndex : valueIndices ) {
+            valueIndex = indices[ std::min( valueIndex, indexCount ) ];
+        }
+    } else {
+        for ( auto& valueIndex : valueIndices ) {
+            valueIndex = std::min( valueIndex, directCount );
+        }
+    }
+
+    /* Gather. */
+
+    const float* src = directValues.data( );
+    float*       dst = values.data( );
+    for ( uint32_t i = 0; i < cornerCount; ++i ) {
+        for ( uint32_t k = 0; k < TComponentCount; ++k ) {
+            dst[ i * TComponentCount + k ] = src[ valueIndices[ i ] * TComponentCount + k ];
+        }
+    }
+}
+
 /**
  * Helper structure to assign vertex property values
  **/
@@ -485,6 +533,14 @@ struct StaticSkinnedVertex {
     float indices[ 4 ];
 };
 
+/**
+ * Helper structure to assign the attributes of the custom vertex layouts, that are not in the static vertices.
+ **/
+struct VertexExtras {
+    float texCoords1[ 2 ];
+    float color[ 4 ];
+};
+
 using BoneWeightType = float;
 using BoneIndexType = uint16_t;
 static const BoneIndexType sInvalidIndex = std::numeric_limits< BoneIndexType >::max( );
@@ -576,19 +632,37 @@ struct TPolygonVertexOrder {
     // TIndexType indices[ 3 ]  = {0, 1, 2}; // CW
 };
 
+//
+// See implementation in fbxptangents.cpp.
+//
+
+void GenerateNormals( const float*    controlPoints,
+                      uint32_t        controlPointCount,
+                      const uint32_t* cornerControlPoints,
+                      uint32_t        cornerCount,
+                      float*          normals );
+void GenerateTangents( const float*    controlPoints,
+                       uint32_t        controlPointCount,
+                       const uint32_t* cornerControlPoints,
+                       const float*    normals,
+                       const float*    uvs,
+                       uint32_t        cornerCount,
+                       float*          tangents );
+
 /**
  * Initialize vertices with very basic properties like 'position', 'normal', 'tangent', 'texCoords'.
  * Calculate mesh position and texcoord min max values.
  **/
 template < typename TVertex >
-void InitializeVertices( FbxMesh*       mesh,
-                         apemode::Mesh& m,
-                         TVertex*       vertices,
-                         size_t         vertexCount,
-                         mathfu::vec3&  positionMin,
-                         mathfu::vec3&  positionMax,
-                         mathfu::vec2&  texcoordMin,
-                         mathfu::vec2&  texcoordMax ) {
+void InitializeVertices( FbxMesh*                      mesh,
+                         const apemode::MeshTriangles& triangles,
+                         apemode::Mesh&                m,
+                         TVertex*                      vertices,
+                         size_t                        vertexCount,
+                         mathfu::vec3&                 positionMin,
+                         mathfu::vec3&                 positionMax,
+                         mathfu::vec2&                 texcoordMin,
+                         mathfu::vec2&                 texcoordMax ) {
 
     auto& s = apemode::Get( );
 
@@ -614,81 +688,100 @@ void InitializeVertices( FbxMesh*       mesh,
     const auto ne  = VerifyElementLayer( mesh->GetElementNormal( ) );
     const auto te  = VerifyElementLayer( mesh->GetElementTangent( ) );
 
-    uint32_t vi = 0;
-    for ( uint32_t pi = 0; pi < pc; ++pi ) {
-        assert( 3 == mesh->GetPolygonSize( pi ) );
-
-        // Having this array we can easily control polygon winding order.
-        // Since mesh is triangular we can make it static [3] at compile-time.
-        // for ( const uint32_t pvi : {0, 1, 2} ) {
-        for ( const uint32_t pvi : TPolygonVertexOrder< uint32_t >( ).indices ) {
-            const uint32_t ci = (uint32_t) mesh->GetPolygonVertex( (int) pi, (int) pvi );
-
-            const auto cp = mesh->GetControlPointAt( ci );
-            const auto uv = GetElementValue< FbxGeometryElementUV, FbxVector2 >( uve, ci, vi, pi );
-            const auto n  = GetElementValue< FbxGeometryElementNormal, FbxVector4 >( ne, ci, vi, pi );
-            const auto t  = GetElementValue< FbxGeometryElementTangent, FbxVector4 >( te, ci, vi, pi );
-
-            auto& vvii          = vertices[ vi ];
-            vvii.position[ 0 ]  = (float) cp[ 0 ];
-            vvii.position[ 1 ]  = (float) cp[ 1 ];
-            vvii.position[ 2 ]  = (float) cp[ 2 ];
-            vvii.normal[ 0 ]    = (float) n[ 0 ];
-            vvii.normal[ 1 ]    = (float) n[ 1 ];
-            vvii.normal[ 2 ]    = (float) n[ 2 ];
-            vvii.tangent[ 0 ]   = (float) t[ 0 ];
-            vvii.tangent[ 1 ]   = (float) t[ 1 ];
-            vvii.tangent[ 2 ]   = (float) t[ 2 ];
-            vvii.tangent[ 3 ]   = (float) t[ 3 ];
-            vvii.texCoords[ 0 ] = (float) uv[ 0 ];
-            vvii.texCoords[ 1 ] = (float) uv[ 1 ];
-
-            assert( !isnan( (float) cp[ 0 ] ) && !isnan( (float) cp[ 1 ] ) && !isnan( (float) cp[ 2 ] ) );
-            assert( !isnan( (float) n[ 0 ] ) && !isnan( (float) n[ 1 ] ) && !isnan( (float) n[ 2 ] ) );
-            assert( !isnan( (float) t[ 0 ] ) && !isnan( (float) t[ 1 ] ) && !isnan( (float) t[ 2 ] ) && !isnan( (float) t[ 3 ] ) );
-            assert( !isnan( (float) uv[ 0 ] ) && !isnan( (float) uv[ 1 ] ) );
-
-            positionMin.x = std::min( positionMin.x, (float) cp[ 0 ] );
-            positionMin.y = std::min( positionMin.y, (float) cp[ 1 ] );
-            positionMin.z = std::min( positionMin.z, (float) cp[ 2 ] );
-            positionMax.x = std::max( positionMax.x, (float) cp[ 0 ] );
-            positionMax.y = std::max( positionMax.y, (float) cp[ 1 ] );
-            positionMax.z = std::max( positionMax.z, (float) cp[ 2 ] );
-
-            texcoordMin.x = std::min( texcoordMin.x, (float) uv[ 0 ] );
-            texcoordMin.y = std::min( texcoordMin.y, (float) uv[ 1 ] );
-            texcoordMax.x = std::max( texcoordMax.x, (float) uv[ 0 ] );
-            texcoordMax.y = std::max( texcoordMax.y, (float) uv[ 1 ] );
-
-            ++vi;
-        }
+    /* Control points per mesh corner (in the exported winding order). */
+
+    const uint32_t          cornerCount     = (uint32_t) triangles.cornerPolygonVertices.size( );
+    const int*              polygonVertices = mesh->GetPolygonVertices( );
+    std::vector< uint32_t > cornerControlPoints( cornerCount );
+
+    assert( cornerCount == vertexCount );
+    for ( uint32_t vi = 0; vi < cornerCount; ++vi ) {
+        cornerControlPoints[ vi ] = (uint32_t) polygonVertices[ triangles.cornerPolygonVertices[ vi ] ];
     }
 
-    m.positionMin = apemodefb::vec3( positionMin.x, positionMin.y, positionMin.z );
-    m.positionMax = apemodefb::vec3( positionMax.x, positionMax.y, positionMax.z );
-    m.texcoordMin = apemodefb::vec2( texcoordMin.x, texcoordMin.y );
-    m.texcoordMax = apemodefb::vec2( texcoordMax.x, texcoordMax.y );
+    /* Extract the attributes into the flat arrays. */
 
-    if ( nullptr == uve ) {
-        s.console->error( "Mesh \"{}\" does not have texcoords geometry layer.",
-                          mesh->GetNode( )->GetName( ) );
+    std::vector< float > controlPoints( cc * 3 );
+    const FbxVector4*    pControlPoints = mesh->GetControlPoints( );
+    for ( uint32_t ci = 0; ci < cc; ++ci ) {
+        controlPoints[ ci * 3 + 0 ] = (float) pControlPoints[ ci ][ 0 ];
+        controlPoints[ ci * 3 + 1 ] = (float) pControlPoints[ ci ][ 1 ];
+        controlPoints[ ci * 3 + 2 ] = (float) pControlPoints[ ci ][ 2 ];
     }
 
+    std::vector< float > uvs;
+    std::vector< float > normals;
+    std::vector< float > tangents;
+    ExtractElementLayer< 2 >( uve, triangles, cornerControlPoints.data( ), cornerCount, uvs );
+    ExtractElementLayer< 3 >( ne, triangles, cornerControlPoints.data( ), cornerCount, normals );
+    ExtractElementLayer< 4 >( te, triangles, cornerControlPoints.data( ), cornerCount, tangents );
+
+    /* Generate the missing normals and tangents (the tangents require the texcoords). */
+
     if ( nullptr == ne ) {
-        s.console->warn( "Mesh \"{}\" does not have normal geometry layer.",
-                          mesh->GetNode( )->GetName( ) );
+        s.console->warn( "Mesh \"{}\" does not have normal geometry layer (smooth normals are generated).",
+                         mesh->GetNode( )->GetName( ) );
 
-        // Calculate face normals ourselves.
-        // Usable but incorrect.
-        CalculateFaceNormals( vertices, vertexCount );
+        GenerateNormals( controlPoints.data( ), cc, cornerControlPoints.data( ), cornerCount, normals.data( ) );
     }
 
     if ( nullptr == te && nullptr != uve ) {
-        s.console->warn( "Mesh \"{}\" does not have tangent geometry layer.",
+        s.console->warn( "Mesh \"{}\" does not have tangent geometry layer (MikkTSpace tangents are generated).",
                          mesh->GetNode( )->GetName( ) );
 
-        // Calculate tangents ourselves if UVs are available.
-        CalculateTangents( vertices, vertexCount );
+        GenerateTangents( controlPoints.data( ), cc, cornerControlPoints.data( ), normals.data( ), uvs.data( ), cornerCount, tangents.data( ) );
+    }
+
+    /* Gather the vertices. */
+
+    for ( uint32_t vi = 0; vi < cornerCount; ++vi ) {
+        const float* cp = controlPoints.data( ) + cornerControlPoints[ vi ] * 3;
+        const float* n  = normals.data( ) + vi * 3;
+        const float* t  = tangents.data( ) + vi * 4;
+        const float* uv = uvs.data( ) + vi * 2;
+
+        auto& vvii          = vertices[ vi ];
+        vvii.position[ 0 ]  = cp[ 0 ];
+        vvii.position[ 1 ]  = cp[ 1 ];
+        vvii.position[ 2 ]  = cp[ 2 ];
+        vvii.normal[ 0 ]    = n[ 0 ];
+        vvii.normal[ 1 ]    = n[ 1 ];
+        vvii.normal[ 2 ]    = n[ 2 ];
+        vvii.tangent[ 0 ]   = t[ 0 ];
+        vvii.tangent[ 1 ]   = t[ 1 ];
+        vvii.tangent[ 2 ]   = t[ 2 ];
+        vvii.tangent[ 3 ]   = t[ 3 ];
+        vvii.texCoords[ 0 ] = uv[ 0 ];
+        vvii.texCoords[ 1 ] = uv[ 1 ];
+
+        assert( !isnan( cp[ 0 ] ) && !isnan( cp[ 1 ] ) && !isnan( cp[ 2 ] ) );
+        assert( !isnan( n[ 0 ] ) && !isnan( n[ 1 ] ) && !isnan( n[ 2 ] ) );
+        assert( !isnan( t[ 0 ] ) && !isnan( t[ 1 ] ) && !isnan( t[ 2 ] ) && !isnan( t[ 3 ] ) );
+        assert( !isnan( uv[ 0 ] ) && !isnan( uv[ 1 ] ) );
+
+        /* The bounds are gathered in the same pass from the source arrays (the vertices are not read back). */
+
+        positionMin.x = std::min( positionMin.x, cp[ 0 ] );
+        positionMin.y = std::min( positionMin.y, cp[ 1 ] );
+        positionMin.z = std::min( positionMin.z, cp[ 2 ] );
+        positionMax.x = std::max( positionMax.x, cp[ 0 ] );
+        positionMax.y = std::max( positionMax.y, cp[ 1 ] );
+        positionMax.z = std::max( positionMax.z, cp[ 2 ] );
+
+        texcoordMin.x = std::min( texcoordMin.x, uv[ 0 ] );
+        texcoordMin.y = std::min( texcoordMin.y, uv[ 1 ] );
+        texcoordMax.x = std::max( texcoordMax.x, uv[ 0 ] );
+        texcoordMax.y = std::max( texcoordMax.y, uv[ 1 ] );
+    }
+
+    m.positionMin = apemodefb::vec3( positionMin.x, positionMin.y, positionMin.z );
+    m.positionMax = apemodefb::vec3( positionMax.x, positionMax.y, positionMax.z );
+    m.texcoordMin = apemodefb::vec2( texcoordMin.x, texcoordMin.y );
+    m.texcoordMax = apemodefb::vec2( texcoordMax.x, texcoordMax.y );
+
+    if ( nullptr == uve ) {
+        s.console->error( "Mesh \"{}\" does not have texcoords geometry layer.",
+                          mesh->GetNode( )->GetName( ) );
     }
 }
 
@@ -696,8 +789,50 @@ void InitializeVertices( FbxMesh*       mesh,
 // See implementation in fbxpmeshopt.cpp.
 //
 
-void Optimize32( apemode::Mesh& mesh, apemodefb::StaticVertexFb const* vertices, uint32_t & vertexCount, uint32_t vertexStride );
-void Optimize16( apemode::Mesh& mesh, apemodefb::StaticVertexFb const* vertices, uint32_t & vertexCount, uint32_t vertexStride );
+void OptimizeVertexCache( apemode::Mesh& m, const char* meshName, std::vector< uint32_t >& indices, uint32_t vertexCount );
+void OptimizeOverdraw( apemode::Mesh&           m,
+                       const char*              meshName,
+                       std::vector< uint32_t >& indices,
+                       const uint8_t*           vertices,
+                       uint32_t                 vertexStride,
+                       uint32_t                 vertexCount,
+                       float                    threshold );
+void OptimizeVertexFetch( const char*              meshName,
+                          std::vector< uint8_t >&  vertices,
+                          uint32_t                 vertexStride,
+                          uint32_t&                vertexCount,
+                          std::vector< uint32_t >& indices );
+uint32_t OptimizeVertexFetch( uint8_t* vertices, uint32_t vertexStride, uint32_t vertexCount, uint32_t* indices, uint32_t indexCount );
+
+//
+// See implementation in fbxpmeshsimplify.cpp.
+//
+
+void GenerateLods( apemode::Mesh&           m,
+                   const char*              meshName,
+                   std::vector< uint32_t >& indices,
+                   const uint8_t*           vertices,
+                   uint32_t                 vertexStride,
+                   uint32_t                 vertexCount,
+                   bool                     skinned,
+                   uint32_t                 lodCount,
+                   float                    lodRatio,
+                   std::vector< float >&    lodErrors );
+
+//
+// See implementation in fbxpmeshlets.cpp.
+//
+
+void BuildMeshlets( apemode::Mesh&                 m,
+                    const char*                    meshName,
+                    const std::vector< uint32_t >& indices,
+                    const uint8_t*                 vertices,
+                    uint32_t                       vertexStride,
+                    uint32_t                       vertexCount,
+                    uint32_t                       maxVertices,
+                    uint32_t                       maxTriangles );
+
+void CalculateSubsetBounds( apemode::Mesh& m, const std::vector< uint32_t >& indices, const std::vector< mathfu::vec3 >& positions );
 
 //
 // See implementation in fbxpmeshpacking.cpp.
@@ -721,26 +856,160 @@ void Pack( const apemodefb::StaticSkinnedVertexFb* vertices,
            const mathfu::vec2                      texcoordsMin,
            const mathfu::vec2                      texcoordsMax );
 
-template < typename TIndex >
-void ExportMesh( FbxNode*       pNode,
-                 FbxMesh*       pMesh,
-                 apemode::Node& n,
-                 apemode::Mesh& m,
-                 uint32_t       vertexCount,
-                 bool           pack,
-                 FbxSkin*       pSkin,
-                 bool           optimize ) {
+void Pack( const apemodefb::StaticVertexFb*  vertices,
+           apemodefb::PackedCompactVertexFb* packed,
+           const uint32_t                    vertexCount,
+           const mathfu::vec3                positionMin,
+           const mathfu::vec3                positionMax,
+           const mathfu::vec2                texcoordsMin,
+           const mathfu::vec2                texcoordsMax,
+           const bool                        qtangent,
+           float&                            maxNormalError,
+           float&                            maxTangentError );
+
+void Pack( const apemodefb::StaticSkinnedVertexFb*  vertices,
+           apemodefb::PackedCompactSkinnedVertexFb* packed,
+           const uint32_t                           vertexCount,
+           const mathfu::vec3                       positionMin,
+           const mathfu::vec3                       positionMax,
+           const mathfu::vec2                       texcoordsMin,
+           const mathfu::vec2                       texcoordsMax,
+           const bool                               qtangent,
+           float&                                   maxNormalError,
+           float&                                   maxTangentError );
+
+bool ChoosePositionBits( const mathfu::vec3 positionMin,
+                         const mathfu::vec3 positionMax,
+                         const float        maxError,
+                         uint32_t           positionBits[ 3 ] );
+
+float PackPositions( const uint8_t*     vertices,
+                     const uint32_t     vertexStride,
+                     uint8_t*           packedVertices,
+                     const uint32_t     packedVertexStride,
+                     const uint32_t     vertexCount,
+                     const mathfu::vec3 positionMin,
+                     const mathfu::vec3 positionMax,
+                     const uint32_t     positionBits[ 3 ] );
+
+uint16_t AssignVertexAttributeOffsets( std::vector< apemodefb::VertexAttributeFb >& attributes );
+
+void WriteVertexAttributes( std::vector< apemodefb::VertexAttributeFb >& attributes,
+                            const uint32_t                               layoutStride,
+                            const uint8_t*                               vertices,
+                            const uint32_t                               vertexStride,
+                            const float*                                 texcoords1,
+                            const float*                                 colors,
+                            const uint32_t                               vertexCount,
+                            std::vector< uint8_t >&                      layoutVertices );
+
+mathfu::vec3 GetVertexPositionStep( const std::vector< apemodefb::VertexAttributeFb >& attributes );
+
+//
+// See implementation in fbxpcodec.cpp.
+//
+
+void CompressMesh( apemode::Mesh& m, const char* meshName );
+
+//
+// See implementation in fbxpedgebreaker.cpp.
+//
+
+void EdgebreakerCompressMesh( apemode::Mesh& m, const char* meshName );
+
+//
+// See implementation in fbxpmeshstreams.cpp.
+//
+
+void SplitVertexStreams( apemode::Mesh& m, const char* meshName );
+void BuildPositionIndices( apemode::Mesh& m, const char* meshName, const std::vector< uint32_t >& indices );
+
+//
+// See implementation in fbxpmeshsplit.cpp.
+//
+
+bool SplitMesh( apemode::Mesh&               m,
+                const char*                  meshName,
+                std::vector< uint32_t >&     indices,
+                uint32_t&                    vertexCount,
+                uint32_t                     vertexStride,
+                uint32_t                     maxPartVertices,
+                uint32_t                     maxPartBones,
+                std::vector< mathfu::vec3 >& positions,
+                std::vector< uint32_t >&     vertexTags,
+                std::vector< uint16_t >&     bonePalettes );
+
+//
+// See implementation in fbxpbvh.cpp.
+//
+
+void BuildBvh( apemode::Mesh&                     m,
+               const char*                        meshName,
+               const std::vector< uint32_t >&     indices,
+               uint32_t                           indexCount,
+               const std::vector< mathfu::vec3 >& positions,
+               const mathfu::vec3&                padding );
+
+//
+// See implementation in fbxpblendshapes.cpp.
+//
+
+void ExportBlendShapes( apemode::Mesh&                 m,
+                        FbxMesh*                       pShapeMesh,
+                        const char*                    meshName,
+                        const std::vector< uint32_t >& cornerControlPoints,
+                        const std::vector< uint32_t >& vertexControlPoints );
+
+/**
+ * Returns the attribute of the semantic or nullptr if the layout does not have it.
+ **/
+const apemodefb::VertexAttributeFb* FindVertexAttribute( const std::vector< apemodefb::VertexAttributeFb >& attributes,
+                                                         apemodefb::EVertexSemanticFb                        semantic ) {
+    for ( const auto& attribute : attributes ) {
+        if ( semantic == attribute.semantic( ) )
+            return &attribute;
+    }
+
+    return nullptr;
+}
+
+void ExportMesh( FbxNode*                                           pNode,
+                 FbxMesh*                                           pMesh,
+                 const apemode::MeshTriangles&                      triangles,
+                 apemode::Node&                                     n,
+                 apemode::Mesh&                                     m,
+                 uint32_t                                           vertexCount,
+                 bool                                               pack,
+                 FbxSkin*                                           pSkin,
+                 FbxMesh*                                           pShapeMesh,
+                 bool                                               optimize,
+                 float                                              positionError,
+                 const std::vector< apemodefb::VertexAttributeFb >& vertexLayout ) {
 
     auto& s = apemode::Get( );
 
-    const uint16_t vertexStride                  = (uint16_t) sizeof( apemodefb::StaticVertexFb );
-    const uint32_t vertexBufferSize              = vertexCount * vertexStride;
-    const uint16_t skinnedVertexStride           = (uint16_t) sizeof( apemodefb::StaticSkinnedVertexFb );
-    const uint32_t skinnedVertexBufferSize       = vertexCount * skinnedVertexStride;
-    const uint16_t packedVertexStride            = (uint16_t) sizeof( apemodefb::PackedVertexFb );
-    const uint32_t packedVertexBufferSize        = vertexCount * packedVertexStride;
-    const uint16_t packedSkinnedVertexStride     = (uint16_t) sizeof( apemodefb::PackedSkinnedVertexFb );
-    const uint32_t packedSkinnedVertexBufferSize = vertexCount * packedSkinnedVertexStride;
+    /* The custom vertex layout (--layout option) replaces the fixed vertex formats (the packing is not applied). */
+
+    std::vector< apemodefb::VertexAttributeFb > layoutAttributes( vertexLayout );
+    const uint16_t                              layoutVertexStride = AssignVertexAttributeOffsets( layoutAttributes );
+    const bool                                  customLayout       = false == layoutAttributes.empty( );
+    if ( customLayout )
+        pack = false;
+
+    /* The packed bone indices and the u8x4 bone indices of the custom layout are 8-bit. */
+
+    const auto boneIndicesAttribute = FindVertexAttribute( layoutAttributes, apemodefb::EVertexSemanticFb_BoneIndices );
+    const bool narrowBoneIndices    = pack || ( nullptr != boneIndicesAttribute &&
+                                             apemodefb::EVertexAttributeFormatFb_Uint8x4 == boneIndicesAttribute->format( ) );
+
+    const uint16_t vertexStride                     = (uint16_t) sizeof( apemodefb::StaticVertexFb );
+    const uint32_t vertexBufferSize                 = vertexCount * vertexStride;
+    const uint16_t skinnedVertexStride              = (uint16_t) sizeof( apemodefb::StaticSkinnedVertexFb );
+    const uint32_t skinnedVertexBufferSize          = vertexCount * skinnedVertexStride;
+    const uint16_t packedVertexStride               = (uint16_t) sizeof( apemodefb::PackedVertexFb );
+    const uint16_t packedSkinnedVertexStride        = (uint16_t) sizeof( apemodefb::PackedSkinnedVertexFb );
+    const uint16_t packedCompactVertexStride        = (uint16_t) sizeof( apemodefb::PackedCompactVertexFb );
+    const uint16_t packedCompactSkinnedVertexStride = (uint16_t) sizeof( apemodefb::PackedCompactSkinnedVertexFb );
 
     mathfu::vec3 positionMin;
     mathfu::vec3 positionMax;
@@ -750,6 +1019,7 @@ void ExportMesh( FbxNode*       pNode,
     if ( nullptr == pSkin ) {
         m.vertices.resize( vertexBufferSize );
         InitializeVertices( pMesh,
+                            triangles,
                             m,
                             reinterpret_cast< StaticVertex* >( m.vertices.data( ) ),
                             vertexCount,
@@ -769,19 +1039,17 @@ void ExportMesh( FbxNode*       pNode,
 
         /* Populate skin info for each control point. */
         const int clusterCount = pSkin->GetClusterCount( );
-        const bool packTooManyBones = pack && clusterCount > (int) PackedMaxBoneCount( );
+        const bool packTooManyBones = narrowBoneIndices && clusterCount > (int) PackedMaxBoneCount( );
 
         if ( packTooManyBones ) {
-            s.console->warn( "Mesh \"{}\" has too large skin, {} bones ({} supported for packing).",
+            s.console->info( "Mesh \"{}\" has too large skin, {} bones ({} supported for packing).",
                              pNode->GetName( ),
                              clusterCount,
                              PackedMaxBoneCount( ) );
         }
 
-        m.skinId = (uint32_t) s.skins.size( );
-
-        s.skins.emplace_back( );
-        auto& skin = s.skins.back( );
+        /* The skin slot is allocated in the scene traversal (see ExportMesh below). */
+        auto& skin = s.skins[ m.skinId ];
         skin.nameId = s.PushName( pSkin->GetName( ) );
         skin.linkFbxIds.reserve( clusterCount );
 
@@ -833,7 +1101,7 @@ void ExportMesh( FbxNode*       pNode,
 
         std::set< BoneIndexType > uniqueUsedIndices;
 
-        if ( pack ) {
+        if ( narrowBoneIndices ) {
             for ( auto& skinInfo : skinInfos ) {
                 for ( BoneIndexType bi = 0; bi < ControlPointSkinInfo::kBoneCountPerControlPoint; ++bi ) {
                     uniqueUsedIndices.insert( skinInfo.indices[ bi ] );
@@ -847,17 +1115,13 @@ void ExportMesh( FbxNode*       pNode,
 
         /* Remove invalid index to be 100% the bones cannot be reordered. */
 
-        if ( pack ) {
+        if ( narrowBoneIndices ) {
 
             if ( packTooManyBones && uniqueUsedIndices.size( ) > PackedMaxBoneCount( ) ) {
-                s.console->error( "Mesh \"{}\" is influenced by {} bones (only {} \"active\" bones supported).",
-                                  pNode->GetName( ),
-                                  uniqueUsedIndices.size( ),
-                                  PackedMaxBoneCount( ) );
-
-                s.console->warn( "Mesh \"{}\" will exported as static one.", pNode->GetName( ) );
-
-                return ExportMesh< TIndex >( pNode, pMesh, n, m, vertexCount, pack, nullptr, optimize );
+                s.console->info( "Mesh \"{}\" is influenced by {} bones ({} \"active\" bones supported), it will be split into bone palettes.",
+                                 pNode->GetName( ),
+                                 uniqueUsedIndices.size( ),
+                                 PackedMaxBoneCount( ) );
             }
 
             /*
@@ -898,9 +1162,12 @@ void ExportMesh( FbxNode*       pNode,
                     originalIndexToReorderedIndex[ boneIndex ] = reorderedIndexCounter++;
                 }
 
+                /* The invalid indices stay invalid (they must not add the entries to the map). */
+
                 for ( auto& skinInfo : skinInfos ) {
                     for ( BoneIndexType b = 0; b < ControlPointSkinInfo::kBoneCountPerControlPoint; ++b ) {
-                        skinInfo.indices[ b ] = originalIndexToReorderedIndex[ skinInfo.indices[ b ] ];
+                        if ( sInvalidIndex != skinInfo.indices[ b ] )
+                            skinInfo.indices[ b ] = originalIndexToReorderedIndex[ skinInfo.indices[ b ] ];
                     }
                 }
 
@@ -920,80 +1187,195 @@ void ExportMesh( FbxNode*       pNode,
         }
 
         auto pSkinnedVertices = reinterpret_cast< StaticSkinnedVertex* >( m.vertices.data( ) );
-        InitializeVertices( pMesh, m, pSkinnedVertices, vertexCount, positionMin, positionMax, texcoordMin, texcoordMax );
+        InitializeVertices( pMesh, triangles, m, pSkinnedVertices, vertexCount, positionMin, positionMax, texcoordMin, texcoordMax );
 
         /* Copy bone weights and indices to each skinned vertex. */
 
-        uint32_t vertexIndex = 0;
-        for ( int polygonIndex = 0; polygonIndex < pMesh->GetPolygonCount( ); ++polygonIndex ) {
-            for ( const int polygonVertexIndex : TPolygonVertexOrder< int >( ).indices ) {
-
-                const int controlPointIndex = pMesh->GetPolygonVertex( polygonIndex, polygonVertexIndex );
-                for ( BoneIndexType b = 0; b < ControlPointSkinInfo::kBoneCountPerControlPoint; ++b ) {
-                    pSkinnedVertices[ vertexIndex ].weights[ b ] = (float) skinInfos[ controlPointIndex ].weights[ b ];
-                    pSkinnedVertices[ vertexIndex ].indices[ b ] = (float) skinInfos[ controlPointIndex ].indices[ b ];
-                }
-
-                ++vertexIndex;
+        const int* polygonVertices = pMesh->GetPolygonVertices( );
+        for ( uint32_t vertexIndex = 0; vertexIndex < vertexCount; ++vertexIndex ) {
+            const int controlPointIndex = polygonVertices[ triangles.cornerPolygonVertices[ vertexIndex ] ];
+            for ( BoneIndexType b = 0; b < ControlPointSkinInfo::kBoneCountPerControlPoint; ++b ) {
+                pSkinnedVertices[ vertexIndex ].weights[ b ] = (float) skinInfos[ controlPointIndex ].weights[ b ];
+                pSkinnedVertices[ vertexIndex ].indices[ b ] = (float) skinInfos[ controlPointIndex ].indices[ b ];
             }
         }
     }
 
-    GetSubsets< TIndex >( pMesh, m, m.subsets );
+    GetSubsets< uint32_t >( pMesh, triangles, m, m.subsets );
 
     if ( m.subsets.empty( ) ) {
         /* Independently from GetSubsets implementation make sure there is at least one subset. */
         m.subsets.push_back( apemodefb::SubsetFb( 0, 0, vertexCount ) );
     }
 
-    /* Fill indices. */
+    /* The control points of the vertices are tracked for the blend shapes (the source mesh has the same control points),
+       the corners of the different control points are not welded (they can move apart in the target shapes).
+       The extra attributes of the custom layout (the second texcoords and the colors) are tracked in the same way:
+       the vertex tags are the indices of the unique pairs of the control point and the extra attributes. */
+
+    const bool blendShapes    = nullptr != pShapeMesh && pShapeMesh->GetDeformerCount( FbxDeformer::eBlendShape ) > 0;
+    const bool extraTexcoords = nullptr != FindVertexAttribute( layoutAttributes, apemodefb::EVertexSemanticFb_Texcoord1 );
+    const bool extraColors    = nullptr != FindVertexAttribute( layoutAttributes, apemodefb::EVertexSemanticFb_Color );
+
+    std::vector< uint32_t >     cornerControlPoints;
+    std::vector< uint32_t >     vertexTags;
+    std::vector< VertexExtras > extras;
+    std::vector< uint32_t >     extraControlPoints;
+
+    if ( blendShapes || extraTexcoords || extraColors ) {
+        const int* polygonVertices = pMesh->GetPolygonVertices( );
+        cornerControlPoints.reserve( vertexCount );
+        for ( const uint32_t polygonVertex : triangles.cornerPolygonVertices ) {
+            cornerControlPoints.push_back( (uint32_t) polygonVertices[ polygonVertex ] );
+        }
 
-    TIndex index = 0;
-    m.indices.resize( vertexCount * sizeof( TIndex ) );
-    std::generate( (TIndex*) m.indices.data( ), ( (TIndex*) m.indices.data( ) ) + vertexCount, [&index] { return index++; } );
+        extras.resize( vertexCount );
+        std::vector< float > values;
 
-    if ( std::is_same< TIndex, uint16_t >::value ) {
-        m.indexType = apemodefb::EIndexTypeFb_UInt16;
-    } else if ( std::is_same< TIndex, uint32_t >::value ) {
-        m.indexType = apemodefb::EIndexTypeFb_UInt32;
+        if ( extraTexcoords ) {
+            ExtractElementLayer< 2 >( VerifyElementLayer( pMesh->GetElementUV( 1 ) ), triangles, cornerControlPoints.data( ), vertexCount, values );
+            for ( uint32_t i = 0; i < vertexCount; ++i ) {
+                extras[ i ].texCoords1[ 0 ] = values[ i * 2 + 0 ];
+                extras[ i ].texCoords1[ 1 ] = values[ i * 2 + 1 ];
+            }
+        }
+
+        if ( extraColors ) {
+            ExtractElementLayer< 4 >( VerifyElementLayer( pMesh->GetElementVertexColor( 0 ) ), triangles, cornerControlPoints.data( ), vertexCount, values );
+            for ( uint32_t i = 0; i < vertexCount; ++i ) {
+                for ( uint32_t k = 0; k < 4; ++k ) {
+                    extras[ i ].color[ k ] = values[ i * 4 + k ];
+                }
+            }
+        }
+
+        if ( blendShapes )
+            extraControlPoints = cornerControlPoints;
+
+        const uint32_t extraCount = WeldVertices( extras.data( ), vertexCount, vertexTags, 0.0f, blendShapes ? extraControlPoints.data( ) : nullptr );
+        extras.resize( extraCount );
+        if ( blendShapes )
+            extraControlPoints.resize( extraCount );
+    }
+
+    /* The attributes, that are not in the custom layout, are zeroed, so their seams do not split the welded vertices. */
+
+    if ( customLayout ) {
+        const bool     normals              = nullptr != FindVertexAttribute( layoutAttributes, apemodefb::EVertexSemanticFb_Normal );
+        const bool     tangents             = nullptr != FindVertexAttribute( layoutAttributes, apemodefb::EVertexSemanticFb_Tangent );
+        const bool     texcoords            = nullptr != FindVertexAttribute( layoutAttributes, apemodefb::EVertexSemanticFb_Texcoord0 );
+        const uint32_t expandedVertexStride = nullptr == pSkin ? vertexStride : skinnedVertexStride;
+
+        for ( uint32_t i = 0; i < vertexCount; ++i ) {
+            auto& vertex = *reinterpret_cast< StaticVertex* >( m.vertices.data( ) + size_t( i ) * expandedVertexStride );
+            if ( false == normals )
+                std::fill( vertex.normal, vertex.normal + 3, 0.0f );
+            if ( false == tangents )
+                std::fill( vertex.tangent, vertex.tangent + 4, 0.0f );
+            if ( false == texcoords )
+                std::fill( vertex.texCoords, vertex.texCoords + 2, 0.0f );
+        }
+    }
+
+    /* Weld vertices and fill indices.
+       Subsets remain valid, since welding does not change the order of polygon corners. */
+
+    const uint32_t indexCount = vertexCount;
+    std::vector< uint32_t > indices;
+    uint32_t*               pVertexTags = vertexTags.empty( ) ? nullptr : vertexTags.data( );
+
+    if ( nullptr == pSkin ) {
+        vertexCount = WeldVertices( reinterpret_cast< StaticVertex* >( m.vertices.data( ) ), indexCount, indices, s.weldEpsilon, pVertexTags );
+        m.vertices.resize( vertexCount * vertexStride );
     } else {
-        assert( false );
+        vertexCount = WeldVertices( reinterpret_cast< StaticSkinnedVertex* >( m.vertices.data( ) ), indexCount, indices, s.weldEpsilon, pVertexTags );
+        m.vertices.resize( vertexCount * skinnedVertexStride );
     }
 
-    /*
-    if ( optimize ) {
-        auto initializedVertices = reinterpret_cast< const apemodefb::StaticVertexFb* >( m.vertices.data( ) );
+    if ( pVertexTags )
+        vertexTags.resize( vertexCount );
 
-        if ( std::is_same< TIndex, uint16_t >::value ) {
-            Optimize16( m, initializedVertices, vertexCount, vertexStride );
-        } else if ( std::is_same< TIndex, uint32_t >::value ) {
-            m.subsetIndexType = apemodefb::EIndexTypeFb_UInt32;
-            Optimize32( m, initializedVertices, vertexCount, vertexStride );
-        }
+    s.console->info( "Mesh \"{}\" has {} vertices after welding ({} before).", pNode->GetName( ), vertexCount, indexCount );
+
+    /* Reorder triangles within subsets for the post-transform vertex cache,
+       then reorder triangle clusters to reduce overdraw (requires cache optimized indices). */
+
+    if ( optimize || s.optimizeOverdraw ) {
+        OptimizeVertexCache( m, pNode->GetName( ), indices, vertexCount );
     }
-    */
 
-    if ( pack ) {
-        std::vector< uint8_t > vertices( std::move( m.vertices ) );
-        if ( nullptr == pSkin ) {
-            m.vertices.resize( packedVertexBufferSize );
-            Pack( reinterpret_cast< apemodefb::StaticVertexFb* >( vertices.data( ) ),
-                  reinterpret_cast< apemodefb::PackedVertexFb* >( m.vertices.data( ) ),
-                  vertexCount,
-                  positionMin,
-                  positionMax,
-                  texcoordMin,
-                  texcoordMax );
-        } else {
-            m.vertices.resize( packedSkinnedVertexBufferSize );
-            Pack( reinterpret_cast< apemodefb::StaticSkinnedVertexFb* >( vertices.data( ) ),
-                  reinterpret_cast< apemodefb::PackedSkinnedVertexFb* >( m.vertices.data( ) ),
-                  vertexCount,
-                  positionMin,
-                  positionMax,
-                  texcoordMin,
-                  texcoordMax );
+    if ( s.optimizeOverdraw ) {
+        OptimizeOverdraw( m,
+                          pNode->GetName( ),
+                          indices,
+                          m.vertices.data( ),
+                          nullptr == pSkin ? vertexStride : skinnedVertexStride,
+                          vertexCount,
+                          s.overdrawThreshold );
+    }
+
+    /* Simplified LODs are appended to the indices and subsets, they share the vertices with the original mesh. */
+
+    const uint32_t       subsetCount = (uint32_t) m.subsets.size( );
+    std::vector< float > lodErrors;
+
+    if ( s.lodCount > 0 ) {
+        GenerateLods( m,
+                      pNode->GetName( ),
+                      indices,
+                      m.vertices.data( ),
+                      nullptr == pSkin ? vertexStride : skinnedVertexStride,
+                      vertexCount,
+                      nullptr != pSkin,
+                      s.lodCount,
+                      s.lodRatio,
+                      lodErrors );
+    }
+
+    /* Renumber vertices in the order of their first use in the reordered indices (welding already
+       produces this order for the original indices, so the pass is needed only after reordering). */
+
+    if ( optimize || s.optimizeOverdraw ) {
+        if ( false == vertexTags.empty( ) ) {
+            /* The same renumbering for the vertex tags (it depends on the indices only). */
+            std::vector< uint32_t > tagIndices( indices );
+            OptimizeVertexFetch( reinterpret_cast< uint8_t* >( vertexTags.data( ) ),
+                                 sizeof( uint32_t ),
+                                 vertexCount,
+                                 tagIndices.data( ),
+                                 (uint32_t) tagIndices.size( ) );
         }
+
+        OptimizeVertexFetch( pNode->GetName( ),
+                             m.vertices,
+                             nullptr == pSkin ? vertexStride : skinnedVertexStride,
+                             vertexCount,
+                             indices );
+    }
+
+    /* The index type is chosen for the welded vertices. */
+
+    if ( vertexCount < std::numeric_limits< uint16_t >::max( ) )
+        FillIndices< uint16_t >( m, indices );
+    else
+        FillIndices< uint32_t >( m, indices );
+
+    /* Bits per axis of the packed position word (10/10/10 unless the position error is set). */
+
+    uint32_t positionBits[ 3 ] = {10, 10, 10};
+    if ( pack && positionError > 0.0f && false == ChoosePositionBits( positionMin, positionMax, positionError, positionBits ) ) {
+        s.console->warn( "Mesh \"{}\" position does not fit into 32 bits within {} error (exported as unpacked).",
+                         pNode->GetName( ),
+                         positionError );
+        pack = false;
+    }
+
+    /* The unpacked positions for the culling bounds (the packed vertices are not decoded back). */
+
+    const uint32_t              unpackedVertexStride = nullptr == pSkin ? vertexStride : skinnedVertexStride;
+    std::vector< mathfu::vec3 > positions( vertexCount );
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        positions[ i ] = mathfu::vec3( reinterpret_cast< const float* >( m.vertices.data( ) + i * unpackedVertexStride ) );
     }
 
     apemodefb::vec3 bboxMin( positionMin.x, positionMin.y, positionMin.z );
@@ -1006,8 +1388,21 @@ void ExportMesh( FbxNode*       pNode,
         apemodefb::vec3 const bboxScale( positionScale.x, positionScale.y, positionScale.z );
         apemodefb::vec2 const uvScale( texcoordScale.x, texcoordScale.y );
 
-        const auto submeshVertexStride = nullptr != pSkin ? packedSkinnedVertexStride : packedVertexStride;
-        const auto submeshVertexFormat = nullptr != pSkin ? apemodefb::EVertexFormat_PackedSkinned : apemodefb::EVertexFormat_Packed;
+        auto submeshVertexStride = nullptr != pSkin ? packedSkinnedVertexStride : packedVertexStride;
+        auto submeshVertexFormat = nullptr != pSkin ? apemodefb::EVertexFormat_PackedSkinned : apemodefb::EVertexFormat_Packed;
+
+        switch ( s.tangentFrameEncoding ) {
+            case apemode::eTangentFrameEncoding_Octahedral:
+                submeshVertexStride = nullptr != pSkin ? packedCompactSkinnedVertexStride : packedCompactVertexStride;
+                submeshVertexFormat = nullptr != pSkin ? apemodefb::EVertexFormat_PackedSkinnedOctahedral : apemodefb::EVertexFormat_PackedOctahedral;
+                break;
+            case apemode::eTangentFrameEncoding_QTangent:
+                submeshVertexStride = nullptr != pSkin ? packedCompactSkinnedVertexStride : packedCompactVertexStride;
+                submeshVertexFormat = nullptr != pSkin ? apemodefb::EVertexFormat_PackedSkinnedQTangent : apemodefb::EVertexFormat_PackedQTangent;
+                break;
+            default:
+                break;
+        }
 
         m.submeshes.emplace_back( bboxMin,                      // bbox min
                                   bboxMax,                      // bbox max
@@ -1018,15 +1413,32 @@ void ExportMesh( FbxNode*       pNode,
                                   0,                            // base vertex
                                   vertexCount,                  // vertex count
                                   0,                            // base index
-                                  0,                            // index count
+                                  indexCount,                   // index count
                                   0,                            // base subset
-                                  (uint32_t) m.subsets.size( ), // subset count
+                                  subsetCount,                  // subset count
                                   submeshVertexFormat,          // vertex format
-                                  submeshVertexStride           // vertex stride
+                                  submeshVertexStride,          // vertex stride
+                                  0.0f,                         // lod error
+                                  (uint8_t) positionBits[ 0 ],  // position bits x
+                                  (uint8_t) positionBits[ 1 ],  // position bits y
+                                  (uint8_t) positionBits[ 2 ],  // position bits z
+                                  0,                            // base bone
+                                  0,                            // bone count
+                                  0,                            // position stream offset
+                                  0,                            // attribute stream offset
+                                  0,                            // skin stream offset
+                                  0,                            // position stream stride
+                                  0,                            // attribute stream stride
+                                  0                             // skin stream stride
         );
     } else {
-        const auto submeshVertexStride = nullptr != pSkin ? skinnedVertexStride : vertexStride;
-        const auto submeshVertexFormat = nullptr != pSkin ? apemodefb::EVertexFormat_StaticSkinned : apemodefb::EVertexFormat_Static;
+        auto submeshVertexStride = nullptr != pSkin ? skinnedVertexStride : vertexStride;
+        auto submeshVertexFormat = nullptr != pSkin ? apemodefb::EVertexFormat_StaticSkinned : apemodefb::EVertexFormat_Static;
+
+        if ( customLayout ) {
+            submeshVertexStride = layoutVertexStride;
+            submeshVertexFormat = apemodefb::EVertexFormat_Custom;
+        }
 
         m.submeshes.emplace_back( bboxMin,                             // bbox min
                                   bboxMax,                             // bbox max
@@ -1037,33 +1449,386 @@ void ExportMesh( FbxNode*       pNode,
                                   0,                                   // base vertex
                                   vertexCount,                         // vertex count
                                   0,                                   // base index
-                                  0,                                   // index count
+                                  indexCount,                          // index count
                                   0,                                   // base subset
-                                  (uint32_t) m.subsets.size( ),        // subset count
+                                  subsetCount,                         // subset count
                                   submeshVertexFormat,                 // vertex format
-                                  submeshVertexStride                  // vertex stride
+                                  submeshVertexStride,                 // vertex stride
+                                  0.0f,                                // lod error
+                                  0,                                   // position bits x
+                                  0,                                   // position bits y
+                                  0,                                   // position bits z
+                                  0,                                   // base bone
+                                  0,                                   // bone count
+                                  0,                                   // position stream offset
+                                  0,                                   // attribute stream offset
+                                  0,                                   // skin stream offset
+                                  0,                                   // position stream stride
+                                  0,                                   // attribute stream stride
+                                  0                                    // skin stream stride
         );
     }
+
+    /* Each LOD is an additional submesh with its own index and subset ranges. */
+
+    const apemodefb::SubmeshFb lod0 = m.submeshes.back( );
+    for ( uint32_t lod = 0; lod < lodErrors.size( ); ++lod ) {
+        const uint32_t baseSubset    = ( lod + 1 ) * subsetCount;
+        uint32_t       lodIndexCount = 0;
+        for ( uint32_t ss = baseSubset; ss < baseSubset + subsetCount; ++ss ) {
+            lodIndexCount += m.subsets[ ss ].index_count( );
+        }
+
+        m.submeshes.emplace_back( lod0.bbox_min( ),
+                                  lod0.bbox_max( ),
+                                  lod0.position_offset( ),
+                                  lod0.position_scale( ),
+                                  lod0.uv_offset( ),
+                                  lod0.uv_scale( ),
+                                  lod0.base_vertex( ),
+                                  lod0.vertex_count( ),
+                                  m.subsets[ baseSubset ].base_index( ),
+                                  lodIndexCount,
+                                  baseSubset,
+                                  subsetCount,
+                                  lod0.vertex_format( ),
+                                  lod0.vertex_stride( ),
+                                  lodErrors[ lod ],
+                                  lod0.position_bits_x( ),
+                                  lod0.position_bits_y( ),
+                                  lod0.position_bits_z( ),
+                                  lod0.base_bone( ),
+                                  lod0.bone_count( ),
+                                  lod0.position_stream_offset( ),
+                                  lod0.attribute_stream_offset( ),
+                                  lod0.skin_stream_offset( ),
+                                  lod0.position_stream_stride( ),
+                                  lod0.attribute_stream_stride( ),
+                                  lod0.skin_stream_stride( ) );
+    }
+
+    /* Large meshes are split into the submeshes with their own vertex ranges, the indices become 16-bit.
+       Skinned meshes are split into the submeshes with their own bone palettes, if the skin is larger than the palette
+       (the packed bone indices are 8-bit). The vertices are split before packing (the bone indices are remapped). */
+
+    uint32_t maxPartBones = s.bonePaletteSize;
+    if ( narrowBoneIndices && ( 0 == maxPartBones || maxPartBones > PackedMaxBoneCount( ) ) )
+        maxPartBones = PackedMaxBoneCount( );
+    if ( nullptr == pSkin || s.skins[ m.skinId ].linkFbxIds.size( ) <= maxPartBones )
+        maxPartBones = 0;
+
+    /* 0xffff is the primitive restart index, the local indices are below. */
+    const uint32_t          maxPartVertices = s.splitMeshes16 ? 0xffff : 0xffffffff;
+    std::vector< uint16_t > bonePalettes;
+
+    if ( ( s.splitMeshes16 || maxPartBones ) && SplitMesh( m,
+                                                           pNode->GetName( ),
+                                                           indices,
+                                                           vertexCount,
+                                                           unpackedVertexStride,
+                                                           maxPartVertices,
+                                                           maxPartBones,
+                                                           positions,
+                                                           vertexTags,
+                                                           bonePalettes ) ) {
+        if ( s.splitMeshes16 || vertexCount < std::numeric_limits< uint16_t >::max( ) )
+            FillIndices< uint16_t >( m, indices );
+        else
+            FillIndices< uint32_t >( m, indices );
+
+        if ( maxPartBones )
+            s.skins[ m.skinId ].bonePalettes = std::move( bonePalettes );
+    }
+
+    /* Meshlets are built from the final indices and unpacked vertices (for precise bounds), after the split,
+       so the meshlets reference the subsets and the vertex copies of their parts. */
+
+    if ( s.buildMeshlets ) {
+        BuildMeshlets( m,
+                       pNode->GetName( ),
+                       indices,
+                       m.vertices.data( ),
+                       unpackedVertexStride,
+                       vertexCount,
+                       s.meshletMaxVertices,
+                       s.meshletMaxTriangles );
+    }
+
+    /* The blend shape deltas are gathered for the final vertices (before packing). */
+
+    if ( false == vertexTags.empty( ) )
+        vertexTags.resize( vertexCount );
+
+    if ( blendShapes ) {
+        std::vector< uint32_t > vertexControlPoints( vertexCount );
+        for ( uint32_t i = 0; i < vertexCount; ++i ) {
+            vertexControlPoints[ i ] = extraControlPoints[ vertexTags[ i ] ];
+        }
+
+        ExportBlendShapes( m, pShapeMesh, pNode->GetName( ), cornerControlPoints, vertexControlPoints );
+    }
+
+    /* The custom layout vertices are written from the unpacked vertices and the extra attributes of their tags. */
+
+    if ( customLayout ) {
+        std::vector< uint8_t > vertices( std::move( m.vertices ) );
+        std::vector< float >   texcoords1( extraTexcoords ? vertexCount * 2 : 0 );
+        std::vector< float >   colors( extraColors ? vertexCount * 4 : 0 );
+
+        for ( uint32_t i = 0; i < vertexCount && false == extras.empty( ); ++i ) {
+            const VertexExtras& vertexExtras = extras[ vertexTags[ i ] ];
+            if ( extraTexcoords )
+                std::copy( vertexExtras.texCoords1, vertexExtras.texCoords1 + 2, texcoords1.data( ) + i * 2 );
+            if ( extraColors )
+                std::copy( vertexExtras.color, vertexExtras.color + 4, colors.data( ) + i * 4 );
+        }
+
+        m.vertexAttributes = layoutAttributes;
+        WriteVertexAttributes( m.vertexAttributes,
+                               layoutVertexStride,
+                               vertices.data( ),
+                               unpackedVertexStride,
+                               texcoords1.data( ),
+                               colors.data( ),
+                               vertexCount,
+                               m.vertices );
+
+        s.console->info( "Mesh \"{}\" custom vertex layout: {} attributes, {} bytes per vertex ({} bytes unpacked).",
+                         pNode->GetName( ),
+                         layoutAttributes.size( ),
+                         layoutVertexStride,
+                         unpackedVertexStride );
+    }
+
+    /* The vertices are packed in place (see Pack), so the mesh does not hold the unpacked and packed buffers at once,
+       the positions are packed again from the unpacked positions (the float vertices are gone at this point). */
+
+    if ( pack ) {
+        /* The submeshes have the packed vertex stride (the same for all of them). */
+        uint8_t*       vertices     = m.vertices.data( );
+        const uint32_t packedStride = m.submeshes.front( ).vertex_stride( );
+
+        if ( apemode::eTangentFrameEncoding_10_10_10_2 != s.tangentFrameEncoding ) {
+            const bool qtangent        = apemode::eTangentFrameEncoding_QTangent == s.tangentFrameEncoding;
+            float      maxNormalError  = 0.0f;
+            float      maxTangentError = 0.0f;
+
+            if ( nullptr == pSkin ) {
+                Pack( reinterpret_cast< apemodefb::StaticVertexFb* >( vertices ),
+                      reinterpret_cast< apemodefb::PackedCompactVertexFb* >( vertices ),
+                      vertexCount,
+                      positionMin,
+                      positionMax,
+                      texcoordMin,
+                      texcoordMax,
+                      qtangent,
+                      maxNormalError,
+                      maxTangentError );
+            } else {
+                Pack( reinterpret_cast< apemodefb::StaticSkinnedVertexFb* >( vertices ),
+                      reinterpret_cast< apemodefb::PackedCompactSkinnedVertexFb* >( vertices ),
+                      vertexCount,
+                      positionMin,
+                      positionMax,
+                      texcoordMin,
+                      texcoordMax,
+                      qtangent,
+                      maxNormalError,
+                      maxTangentError );
+            }
+
+            s.console->info( "Mesh \"{}\" {} tangent frame max angular error: normal {} deg, tangent {} deg.",
+                             pNode->GetName( ),
+                             qtangent ? "QTangent" : "octahedral",
+                             maxNormalError,
+                             maxTangentError );
+        } else if ( nullptr == pSkin ) {
+            Pack( reinterpret_cast< apemodefb::StaticVertexFb* >( vertices ),
+                  reinterpret_cast< apemodefb::PackedVertexFb* >( vertices ),
+                  vertexCount,
+                  positionMin,
+                  positionMax,
+                  texcoordMin,
+                  texcoordMax );
+        } else {
+            Pack( reinterpret_cast< apemodefb::StaticSkinnedVertexFb* >( vertices ),
+                  reinterpret_cast< apemodefb::PackedSkinnedVertexFb* >( vertices ),
+                  vertexCount,
+                  positionMin,
+                  positionMax,
+                  texcoordMin,
+                  texcoordMax );
+        }
+
+        m.vertices.resize( vertexCount * packedStride );
+        m.vertices.shrink_to_fit( );
+
+        if ( positionError > 0.0f && vertexCount > 0 ) {
+            const float achievedError = PackPositions( reinterpret_cast< const uint8_t* >( positions.data( ) ),
+                                                       sizeof( mathfu::vec3 ),
+                                                       m.vertices.data( ),
+                                                       packedStride,
+                                                       vertexCount,
+                                                       positionMin,
+                                                       positionMax,
+                                                       positionBits );
+
+            s.console->info( "Mesh \"{}\" position bits {}/{}/{}, max error {} (allowed {}, mesh units).",
+                             pNode->GetName( ),
+                             positionBits[ 0 ],
+                             positionBits[ 1 ],
+                             positionBits[ 2 ],
+                             achievedError,
+                             positionError );
+        }
+    }
+
+    CalculateSubsetBounds( m, indices, positions );
+
+    /* The BVH boxes are extended by the packing step (the runtime intersects the decoded packed positions). */
+
+    if ( s.buildBvh ) {
+        mathfu::vec3 padding( 0.0f );
+        if ( pack ) {
+            for ( uint32_t k = 0; k < 3; ++k ) {
+                padding[ k ] = ( positionMax[ k ] - positionMin[ k ] ) / float( ( 1u << positionBits[ k ] ) - 1 );
+            }
+        } else if ( customLayout ) {
+            padding = GetVertexPositionStep( m.vertexAttributes );
+        }
+
+        BuildBvh( m, pNode->GetName( ), indices, indexCount, positions, padding );
+    }
+
+    /* The position-only welding would join the vertices, that move apart in the target shapes. */
+
+    if ( s.buildPositionIndices && m.blendShapeChannels.empty( ) )
+        BuildPositionIndices( m, pNode->GetName( ), indices );
+
+    if ( s.splitVertexStreams )
+        SplitVertexStreams( m, pNode->GetName( ) );
+
+    /* The Edgebreaker decoder reorders the vertices, so the meshes with the blend shapes use the mesh buffer codec. */
+
+    if ( s.edgebreakerMeshes && false == m.blendShapeChannels.empty( ) ) {
+        s.console->warn( "Mesh \"{}\" has blend shapes (compressed with the mesh buffer codec instead of Edgebreaker).", pNode->GetName( ) );
+        CompressMesh( m, pNode->GetName( ) );
+    } else if ( s.edgebreakerMeshes )
+        EdgebreakerCompressMesh( m, pNode->GetName( ) );
+    else if ( s.compressMeshes )
+        CompressMesh( m, pNode->GetName( ) );
+}
+
+//
+// See implementation in fbxptriangulate.cpp.
+//
+
+bool TriangulateMesh( FbxMesh* pMesh, const int cornerOrder[ 3 ], apemode::MeshTriangles& triangles );
+
+/**
+ * Mesh collected in the scene traversal for the processing.
+ **/
+struct MeshExportTask {
+    FbxNode*               pNode;
+    FbxMesh*               pMesh;
+    FbxSkin*               pSkin;
+    FbxMesh*               pSourceMesh;
+    uint32_t               nodeId;
+    uint32_t               meshId;
+    bool                   pack;
+    bool                   optimize;
+    float                  positionError;
+    bool                   texturedMaterials;
+    bool                   normalMappedMaterials;
+    bool                   triangulated;
+    apemode::MeshTriangles triangles;
+};
+
+static std::vector< MeshExportTask > sMeshExportTasks;
+
+/**
+ * True in the mesh export worker threads (the nested parallel loops run serially in them).
+ **/
+static thread_local bool sMeshExportWorker = false;
+
+bool IsMeshExportWorker( ) {
+    return sMeshExportWorker;
+}
+
+/**
+ * Export task indices of the collected meshes (the nodes that share the FbxMesh are the mesh instances).
+ **/
+static std::map< FbxMesh*, uint32_t > sMeshExportTaskDict;
+
+/**
+ * Converts the maximum position error (--position-error option) to the mesh space of the node:
+ * the error is converted to the scene units and divided by the largest global scaling of the node.
+ * The transform is evaluated in the scene traversal (the FBX SDK evaluation is not thread-safe).
+ * @return Zero if the position error is not set.
+ **/
+float GetMeshPositionError( FbxNode* pNode ) {
+    auto& s = apemode::Get( );
+    if ( s.positionError <= 0.0f )
+        return 0.0f;
+
+    double positionError = s.positionError;
+    if ( s.positionErrorUnit > 0.0f ) {
+        /* The scale factor of the system unit is in centimeters. */
+        positionError *= s.positionErrorUnit / s.scene->GetGlobalSettings( ).GetSystemUnit( ).GetScaleFactor( );
+    }
+
+    const FbxVector4 scaling    = pNode->EvaluateGlobalTransform( ).GetS( );
+    const double     maxScaling = std::max( fabs( scaling[ 0 ] ), std::max( fabs( scaling[ 1 ] ), fabs( scaling[ 2 ] ) ) );
+    return (float) ( maxScaling > 0.0 ? positionError / maxScaling : positionError );
 }
 
+/**
+ * Checks the textures connected to the node materials (the custom vertex layout drops the texcoords of the meshes
+ * without the textures and the tangents of the meshes without the normal or bump maps).
+ * The materials are scanned in the scene traversal (the FBX SDK is not thread-safe).
+ **/
+void GetNodeMaterialUsage( FbxNode* pNode, bool& textured, bool& normalMapped ) {
+    for ( int i = 0; i < pNode->GetMaterialCount( ); ++i ) {
+        FbxSurfaceMaterial* pMaterial = pNode->GetMaterial( i );
+        if ( nullptr == pMaterial )
+            continue;
+
+        for ( FbxProperty property = pMaterial->GetFirstProperty( ); property.IsValid( ); property = pMaterial->GetNextProperty( property ) ) {
+            if ( 0 == property.GetSrcObjectCount< FbxTexture >( ) )
+                continue;
+
+            textured = true;
+            if ( property.GetName( ) == FbxSurfaceMaterial::sNormalMap || property.GetName( ) == FbxSurfaceMaterial::sBump )
+                normalMapped = true;
+        }
+    }
+}
+
+/**
+ * Allocates the mesh (and skin) slot for the node, the mesh is processed later in ExportMeshes.
+ **/
 void ExportMesh( FbxNode* node, apemode::Node& n, bool pack, bool optimize ) {
     auto& s = apemode::Get( );
     if ( auto mesh = node->GetMesh( ) ) {
         s.console->info( "Node \"{}\" has mesh.", node->GetName( ) );
-        if ( !mesh->IsTriangleMesh( ) ) {
-            s.console->warn( "Mesh \"{}\" is not triangular, processing...", node->GetName( ) );
-            FbxGeometryConverter converter( mesh->GetNode( )->GetFbxManager( ) );
-            mesh = (FbxMesh*) converter.Triangulate( mesh, true, s.legacyTriangulationSdk );
-
-            if ( nullptr == mesh ) {
-                s.console->error( "Mesh \"{}\" triangulation failed (mesh will be skipped).", node->GetName( ) );
-                return;
-            }
 
-            s.console->warn( "Mesh \"{}\" was triangulated (success).", node->GetName( ) );
+        /* The mesh is exported once for all the nodes that reference it. */
+        auto taskIt = sMeshExportTaskDict.find( mesh );
+        if ( taskIt != sMeshExportTaskDict.end( ) ) {
+            auto& task = sMeshExportTasks[ taskIt->second ];
+            n.meshId   = task.meshId;
+
+            /* The strictest position error of the instances is used. */
+            task.positionError = std::min( task.positionError, GetMeshPositionError( node ) );
+
+            /* The attributes are kept if any instance needs them. */
+            GetNodeMaterialUsage( node, task.texturedMaterials, task.normalMappedMaterials );
+
+            s.console->info( "Node \"{}\" is an instance of the mesh of node \"{}\".", node->GetName( ), task.pNode->GetName( ) );
+            return;
         }
 
-        if ( const auto deformerCount = mesh->GetDeformerCount( ) - mesh->GetDeformerCount(FbxDeformer::eSkin ) ) {
+        if ( const auto deformerCount = mesh->GetDeformerCount( ) - mesh->GetDeformerCount(FbxDeformer::eSkin ) - mesh->GetDeformerCount(FbxDeformer::eBlendShape ) ) {
             s.console->warn( "Mesh \"{}\" has {} non-skin deformers (will be ignored).", node->GetName( ), deformerCount );
         }
 
@@ -1081,10 +1846,267 @@ void ExportMesh( FbxNode* node, apemode::Node& n, bool pack, bool optimize ) {
                        ? FbxCast< FbxSkin >( mesh->GetDeformer( 0,FbxDeformer::eSkin ) )
                        : nullptr;
 
-        const uint32_t vertexCount = mesh->GetPolygonCount() * 3;
-        if ( vertexCount < std::numeric_limits< uint16_t >::max( ) )
-            ExportMesh< uint16_t >( node, mesh, n, m, vertexCount, pack, pSkin, optimize );
-        else
-            ExportMesh< uint32_t >( node, mesh, n, m, vertexCount, pack, pSkin, optimize );
+        /* Skins are allocated in the traversal order to keep the output independent from the thread count. */
+        if ( nullptr != pSkin ) {
+            m.skinId = (uint32_t) s.skins.size( );
+            s.skins.emplace_back( );
+        }
+
+        bool textured     = false;
+        bool normalMapped = false;
+        GetNodeMaterialUsage( node, textured, normalMapped );
+
+        /* The mesh is triangulated in ExportMeshes (the polygons are not changed in the traversal). */
+        sMeshExportTaskDict[ mesh ] = (uint32_t) sMeshExportTasks.size( );
+        sMeshExportTasks.push_back(
+            {node, mesh, pSkin, mesh, n.id, n.meshId, pack, optimize, GetMeshPositionError( node ), textured, normalMapped, false} );
+    }
+}
+
+/**
+ * Filters the requested vertex layout (--layout option) for the mesh: the attributes, that the mesh does not have
+ * or its materials do not use, are dropped, the skinned meshes always get the bone indices and weights.
+ * @return The mesh attributes (empty for the fixed vertex formats).
+ **/
+std::vector< apemodefb::VertexAttributeFb > GetMeshVertexLayout( FbxMesh* pMesh, bool skinned, bool textured, bool normalMapped ) {
+    auto& s = apemode::Get( );
+
+    std::vector< apemodefb::VertexAttributeFb > attributes;
+    if ( s.vertexLayout.empty( ) )
+        return attributes;
+
+    const int uvCount = pMesh->GetElementUVCount( );
+    for ( const auto& attribute : s.vertexLayout ) {
+        switch ( attribute.semantic( ) ) {
+            case apemodefb::EVertexSemanticFb_Tangent:
+                if ( false == normalMapped || uvCount < 1 )
+                    continue;
+                break;
+            case apemodefb::EVertexSemanticFb_Texcoord0:
+                if ( false == textured || uvCount < 1 )
+                    continue;
+                break;
+            case apemodefb::EVertexSemanticFb_Texcoord1:
+                if ( false == textured || uvCount < 2 )
+                    continue;
+                break;
+            case apemodefb::EVertexSemanticFb_Color:
+                if ( 0 == pMesh->GetElementVertexColorCount( ) )
+                    continue;
+                break;
+            case apemodefb::EVertexSemanticFb_BoneIndices:
+            case apemodefb::EVertexSemanticFb_BoneWeights:
+                if ( false == skinned )
+                    continue;
+                break;
+            default:
+                break;
+        }
+
+        attributes.push_back( attribute );
     }
+
+    /* The skin attributes are the last ones (see ParseVertexLayout). */
+    if ( skinned && nullptr == FindVertexAttribute( attributes, apemodefb::EVertexSemanticFb_BoneIndices ) )
+        attributes.push_back( apemodefb::VertexAttributeFb( apemodefb::EVertexSemanticFb_BoneIndices,
+                                                            apemodefb::EVertexAttributeFormatFb_Uint8x4,
+                                                            0,
+                                                            apemodefb::vec4( 0.0f, 0.0f, 0.0f, 0.0f ),
+                                                            apemodefb::vec4( 1.0f, 1.0f, 1.0f, 1.0f ) ) );
+    if ( skinned && nullptr == FindVertexAttribute( attributes, apemodefb::EVertexSemanticFb_BoneWeights ) )
+        attributes.push_back( apemodefb::VertexAttributeFb( apemodefb::EVertexSemanticFb_BoneWeights,
+                                                            apemodefb::EVertexAttributeFormatFb_Unorm10_10_10_2,
+                                                            0,
+                                                            apemodefb::vec4( 0.0f, 0.0f, 0.0f, 0.0f ),
+                                                            apemodefb::vec4( 1.0f, 1.0f, 1.0f, 1.0f ) ) );
+
+    return attributes;
+}
+
+/**
+ * Processes the meshes collected in the scene traversal.
+ * The meshes are independent, so they are distributed across the worker threads (-j option),
+ * each mesh is written to the slot allocated in the traversal, so the output does not depend on the thread count.
+ * The meshes are triangulated natively in the worker threads, the meshes with the degenerate or self-intersecting
+ * polygons are triangulated with the FBX SDK in the main thread (the SDK is not thread-safe).
+ **/
+void ExportMeshes( ) {
+    auto& s = apemode::Get( );
+
+    std::vector< MeshExportTask > tasks;
+    tasks.swap( sMeshExportTasks );
+    sMeshExportTaskDict.clear( );
+
+    uint32_t jobCount = s.jobCount ? s.jobCount : std::max( 1u, std::thread::hardware_concurrency( ) );
+    jobCount          = std::min( jobCount, (uint32_t) tasks.size( ) );
+
+    auto runTasks = [&]( const std::function< void( MeshExportTask& ) >& taskFn ) {
+        if ( jobCount <= 1 ) {
+            for ( auto& task : tasks ) {
+                taskFn( task );
+            }
+
+            return;
+        }
+
+        std::atomic< uint32_t >    nextTask( 0 );
+        std::vector< std::thread > workers;
+        workers.reserve( jobCount );
+
+        for ( uint32_t i = 0; i < jobCount; ++i ) {
+            workers.emplace_back( [&]( ) {
+                sMeshExportWorker = true;
+                for ( uint32_t t = nextTask++; t < tasks.size( ); t = nextTask++ ) {
+                    taskFn( tasks[ t ] );
+                }
+            } );
+        }
+
+        for ( auto& worker : workers ) {
+            worker.join( );
+        }
+    };
+
+    if ( jobCount > 1 ) {
+        s.console->info( "Exporting {} meshes in {} threads.", tasks.size( ), jobCount );
+    }
+
+    runTasks( [&]( MeshExportTask& task ) {
+        task.triangulated = TriangulateMesh( task.pMesh, TPolygonVertexOrder< int >( ).indices, task.triangles );
+    } );
+
+    for ( auto& task : tasks ) {
+        if ( task.triangulated )
+            continue;
+
+        s.console->warn( "Mesh \"{}\" is triangulated with the FBX SDK.", task.pNode->GetName( ) );
+        FbxGeometryConverter converter( s.manager );
+        auto pMesh = (FbxMesh*) converter.Triangulate( task.pMesh, true, s.legacyTriangulationSdk );
+
+        if ( nullptr == pMesh ) {
+            s.console->error( "Mesh \"{}\" triangulation failed (the failed polygons are fanned).", task.pNode->GetName( ) );
+            continue;
+        }
+
+        /* The triangulated mesh replaces the source mesh in the node (the source mesh is destroyed, the control points
+           and the deformers are moved to the triangulated mesh, so it is also the blend shape source). */
+        task.pMesh       = pMesh;
+        task.pSourceMesh = pMesh;
+        if ( nullptr != task.pSkin && 0 != pMesh->GetDeformerCount( FbxDeformer::eSkin ) ) {
+            task.pSkin = FbxCast< FbxSkin >( pMesh->GetDeformer( 0, FbxDeformer::eSkin ) );
+        }
+
+        TriangulateMesh( task.pMesh, TPolygonVertexOrder< int >( ).indices, task.triangles );
+    }
+
+    runTasks( [&]( MeshExportTask& task ) {
+        ExportMesh( task.pNode,
+                    task.pMesh,
+                    task.triangles,
+                    s.nodes[ task.nodeId ],
+                    s.meshes[ task.meshId ],
+                    (uint32_t) task.triangles.cornerPolygonVertices.size( ),
+                    task.pack,
+                    task.pSkin,
+                    task.pSourceMesh,
+                    task.optimize,
+                    task.positionError,
+                    GetMeshVertexLayout( task.pMesh, nullptr != task.pSkin, task.texturedMaterials, task.normalMappedMaterials ) );
+
+        /* The triangles are not needed anymore. */
+        task.triangles = apemode::MeshTriangles( );
+    } );
+}
+
+/**
+ * Returns true if the arrays of the flatbuffers structs are bytewise equal (the structs have no comparison operators).
+ **/
+template < typename T >
+bool IsSameStructs( const std::vector< T >& a, const std::vector< T >& b ) {
+    return a.size( ) == b.size( ) && ( a.empty( ) || 0 == memcmp( a.data( ), b.data( ), a.size( ) * sizeof( T ) ) );
+}
+
+/**
+ * Returns true if the meshes have the same exported content.
+ **/
+bool IsSameMeshContent( const apemode::Mesh& a, const apemode::Mesh& b ) {
+    return a.skinId == b.skinId && a.indexType == b.indexType && a.verticesCompressed == b.verticesCompressed &&
+           a.vertices == b.vertices && a.indices == b.indices && a.positionIndices == b.positionIndices && a.blob == b.blob &&
+           IsSameStructs( a.submeshes, b.submeshes ) && IsSameStructs( a.subsets, b.subsets ) &&
+           IsSameStructs( a.meshlets, b.meshlets ) && a.meshletVertices == b.meshletVertices &&
+           a.meshletIndices == b.meshletIndices && IsSameStructs( a.subsetBounds, b.subsetBounds ) &&
+           IsSameStructs( a.submeshBounds, b.submeshBounds ) && IsSameStructs( a.bvhNodes, b.bvhNodes ) &&
+           a.bvhTriangles == b.bvhTriangles && IsSameStructs( a.vertexAttributes, b.vertexAttributes );
+}
+
+/**
+ * Merges the meshes with the same content (--instance-by-content option) and collects the mesh instance lists
+ * (the ids of the nodes that reference the mesh), so the runtime can issue the instanced draws.
+ * The meshes are compared after the export, so the copies of the FbxMesh (duplicated in the DCC tool) are merged too.
+ * The skinned meshes are not merged (each one references its own skin), as well as the meshes with the blend shapes
+ * (their weights are animated with the curves of their nodes).
+ **/
+void InstanceMeshes( ) {
+    auto& s = apemode::Get( );
+
+    if ( s.instanceByContent && s.meshes.size( ) > 1 ) {
+        std::vector< uint32_t >                       meshRemap( s.meshes.size( ) );
+        std::map< uint64_t, std::vector< uint32_t > > meshDict;
+        uint32_t                                      meshCount = 0;
+
+        for ( uint32_t i = 0; i < s.meshes.size( ); ++i ) {
+            apemode::Mesh& m = s.meshes[ i ];
+
+            std::vector< uint32_t >* sameHashMeshIds = nullptr;
+            if ( (uint32_t) -1 == m.skinId && m.blendShapeChannels.empty( ) ) {
+                apemode::CityHash64Wrapper hash;
+                hash.CombineWithBuffer( m.vertices.data( ), m.vertices.size( ) );
+                hash.CombineWithBuffer( m.indices.data( ), m.indices.size( ) );
+                hash.CombineWithBuffer( m.blob.data( ), m.blob.size( ) );
+                hash.CombineWithArray( m.submeshes.data( ), m.submeshes.size( ) );
+                hash.CombineWithArray( m.subsets.data( ), m.subsets.size( ) );
+
+                sameHashMeshIds = &meshDict[ hash.Value ];
+                auto sameMeshIt = std::find_if( sameHashMeshIds->begin( ), sameHashMeshIds->end( ), [&]( uint32_t meshId ) {
+                    return IsSameMeshContent( s.meshes[ meshId ], m );
+                } );
+
+                if ( sameMeshIt != sameHashMeshIds->end( ) ) {
+                    meshRemap[ i ] = *sameMeshIt;
+                    continue;
+                }
+            }
+
+            if ( meshCount != i )
+                s.meshes[ meshCount ] = std::move( m );
+
+            if ( nullptr != sameHashMeshIds )
+                sameHashMeshIds->push_back( meshCount );
+
+            meshRemap[ i ] = meshCount++;
+        }
+
+        if ( meshCount != s.meshes.size( ) ) {
+            s.console->info( "Merged {} meshes with the same content ({} meshes left).", s.meshes.size( ) - meshCount, meshCount );
+            s.meshes.resize( meshCount );
+
+            for ( auto& node : s.nodes ) {
+                if ( (uint32_t) -1 != node.meshId )
+                    node.meshId = meshRemap[ node.meshId ];
+            }
+        }
+    }
+
+    for ( const auto& node : s.nodes ) {
+        if ( (uint32_t) -1 != node.meshId )
+            s.meshes[ node.meshId ].instanceNodeIds.push_back( node.id );
+    }
+
+    uint32_t instancedMeshCount = 0;
+    for ( const auto& m : s.meshes ) {
+        instancedMeshCount += m.instanceNodeIds.size( ) > 1 ? 1 : 0;
+    }
+
+    if ( instancedMeshCount )
+        s.console->info( "{} meshes are instanced ({} meshes, {} nodes).", instancedMeshCount, s.meshes.size( ), s.nodes.size( ) );
 }
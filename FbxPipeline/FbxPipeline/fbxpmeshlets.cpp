@@ -0,0 +1,341 @@
+#include <fbxppch.h>
+#include <fbxpstate.h>
+
+/**
+ * Meshlet (cluster) generation and the subset culling bounds.
+ * Each subset is partitioned into meshlets with the limited vertex and triangle counts, so that the meshlet
+ * triangles can reference the meshlet vertices with 8-bit local indices. Every meshlet carries the bounds
+ * for cluster culling at runtime (no processing on loading is required):
+ *  - Bounding sphere for frustum and occlusion culling.
+ *  - Normal cone for backface culling, the whole meshlet is backfacing when
+ *    dot( normalize( cone_apex - camera_position ), cone_axis ) >= cone_cutoff.
+ * The normal cone calculations follow meshoptimizer (https://github.com/zeux/meshoptimizer).
+ **/
+
+static const uint8_t kNoLocalIndex = 0xff;
+
+/**
+ * Calculates the bounding sphere for the points (Ritter's algorithm).
+ **/
+template < typename TGetPosition >
+void CalculateBoundingSphere( const uint32_t* points, uint32_t pointCount, TGetPosition getPosition, mathfu::vec3& center, float& radius ) {
+    assert( pointCount > 0 );
+
+    /* Find the points with the minimum and maximum coordinates along each axis. */
+
+    uint32_t pmin[ 3 ] = {0, 0, 0};
+    uint32_t pmax[ 3 ] = {0, 0, 0};
+
+    for ( uint32_t i = 0; i < pointCount; ++i ) {
+        const mathfu::vec3 p = getPosition( points[ i ] );
+        for ( int axis = 0; axis < 3; ++axis ) {
+            pmin[ axis ] = p[ axis ] < getPosition( points[ pmin[ axis ] ] )[ axis ] ? i : pmin[ axis ];
+            pmax[ axis ] = p[ axis ] > getPosition( points[ pmax[ axis ] ] )[ axis ] ? i : pmax[ axis ];
+        }
+    }
+
+    /* Start with the sphere for the most distant pair. */
+
+    float paxisDistanceSq = -1.0f;
+    int   paxis           = 0;
+
+    for ( int axis = 0; axis < 3; ++axis ) {
+        const float distanceSq = ( getPosition( points[ pmax[ axis ] ] ) - getPosition( points[ pmin[ axis ] ] ) ).LengthSquared( );
+        if ( distanceSq > paxisDistanceSq ) {
+            paxisDistanceSq = distanceSq;
+            paxis           = axis;
+        }
+    }
+
+    center = ( getPosition( points[ pmin[ paxis ] ] ) + getPosition( points[ pmax[ paxis ] ] ) ) * 0.5f;
+    radius = sqrtf( paxisDistanceSq ) * 0.5f;
+
+    /* Grow the sphere to include all the points. */
+
+    for ( uint32_t i = 0; i < pointCount; ++i ) {
+        const mathfu::vec3 p        = getPosition( points[ i ] );
+        const float        distance = ( p - center ).Length( );
+
+        if ( distance > radius ) {
+            const float k = 0.5f - radius / ( 2.0f * distance );
+            center += ( p - center ) * k;
+            radius = ( radius + distance ) * 0.5f;
+        }
+    }
+}
+
+/**
+ * Calculates the bounds of the meshlet.
+ * The triangle normals are oriented with the vertex normals to be independent from the winding order.
+ **/
+template < typename TGetPosition, typename TGetNormal >
+apemodefb::MeshletFb CalculateMeshletBounds( const uint32_t* meshletVertices,
+                                             uint32_t        vertexCount,
+                                             const uint8_t*  meshletIndices,
+                                             uint32_t        triangleCount,
+                                             uint32_t        baseVertex,
+                                             uint32_t        baseIndex,
+                                             uint32_t        subsetId,
+                                             TGetPosition    getPosition,
+                                             TGetNormal      getNormal ) {
+    mathfu::vec3 center;
+    float        radius = 0.0f;
+    CalculateBoundingSphere( meshletVertices, vertexCount, getPosition, center, radius );
+
+    std::vector< mathfu::vec3 > normals;
+    std::vector< mathfu::vec3 > corners;
+    normals.reserve( triangleCount );
+    corners.reserve( triangleCount );
+
+    mathfu::vec3 axis( 0.0f, 0.0f, 0.0f );
+    for ( uint32_t t = 0; t < triangleCount; ++t ) {
+        const uint32_t i0 = meshletVertices[ meshletIndices[ t * 3 + 0 ] ];
+        const uint32_t i1 = meshletVertices[ meshletIndices[ t * 3 + 1 ] ];
+        const uint32_t i2 = meshletVertices[ meshletIndices[ t * 3 + 2 ] ];
+
+        const mathfu::vec3 p0 = getPosition( i0 );
+        mathfu::vec3       n  = mathfu::cross( getPosition( i1 ) - p0, getPosition( i2 ) - p0 );
+
+        const float area = n.Length( );
+        if ( area <= 0.0f ) {
+            /* Degenerate triangles do not affect the cone. */
+            continue;
+        }
+
+        n /= area;
+        if ( mathfu::dot( n, getNormal( i0 ) + getNormal( i1 ) + getNormal( i2 ) ) < 0.0f ) {
+            n = -n;
+        }
+
+        axis += n;
+        normals.push_back( n );
+        corners.push_back( p0 );
+    }
+
+    const float axisLength = axis.Length( );
+
+    /* Cone that never culls the meshlet. */
+    mathfu::vec3 coneApex   = center;
+    mathfu::vec3 coneAxis   = mathfu::vec3( 0.0f, 0.0f, 0.0f );
+    float        coneCutoff = 1.0f;
+
+    if ( axisLength > 0.0f ) {
+        axis /= axisLength;
+
+        float minDot = 1.0f;
+        for ( auto& n : normals ) {
+            minDot = std::min( minDot, mathfu::dot( axis, n ) );
+        }
+
+        /* Wide cones (more than ~84 degrees) are not useful for culling. */
+        if ( minDot > 0.1f ) {
+            /* Find the point on the center - t * axis ray that lies in the negative half-space of all the triangles. */
+            float maxT = 0.0f;
+            for ( size_t i = 0; i < normals.size( ); ++i ) {
+                const float dc = mathfu::dot( center - corners[ i ], normals[ i ] );
+                const float dn = mathfu::dot( axis, normals[ i ] );
+                assert( dn > 0.0f );
+                maxT = std::max( maxT, dc / dn );
+            }
+
+            coneApex   = center - axis * maxT;
+            coneAxis   = axis;
+            coneCutoff = sqrtf( 1.0f - minDot * minDot );
+        }
+    }
+
+    return apemodefb::MeshletFb( apemodefb::vec3( center.x, center.y, center.z ),
+                                 radius,
+                                 apemodefb::vec3( coneApex.x, coneApex.y, coneApex.z ),
+                                 coneCutoff,
+                                 apemodefb::vec3( coneAxis.x, coneAxis.y, coneAxis.z ),
+                                 baseVertex,
+                                 baseIndex,
+                                 (uint8_t) vertexCount,
+                                 (uint8_t) triangleCount,
+                                 (uint16_t) subsetId );
+}
+
+/**
+ * Partitions each subset into meshlets, the triangles are scanned in the index buffer order
+ * (the vertex cache optimization is highly recommended for better meshlet filling).
+ * @param m The mesh to take the subsets from and to store the meshlets in.
+ * @param meshName The mesh name for logging.
+ * @param indices The final mesh indices (relative to the submesh base vertices, the meshlet vertices are absolute).
+ * @param vertices The vertices with 3 float position and 3 float normal components at the beginning of the vertex.
+ * @param vertexStride The vertex stride in bytes.
+ * @param vertexCount The number of vertices.
+ * @param maxVertices Maximum vertex count per meshlet (up to 255).
+ * @param maxTriangles Maximum triangle count per meshlet (up to 255).
+ **/
+void BuildMeshlets( apemode::Mesh&                 m,
+                    const char*                    meshName,
+                    const std::vector< uint32_t >& indices,
+                    const uint8_t*                 vertices,
+                    uint32_t                       vertexStride,
+                    uint32_t                       vertexCount,
+                    uint32_t                       maxVertices,
+                    uint32_t                       maxTriangles ) {
+    auto& s = apemode::Get( );
+
+    maxVertices  = std::min< uint32_t >( std::max< uint32_t >( maxVertices, 3 ), kNoLocalIndex );
+    maxTriangles = std::min< uint32_t >( std::max< uint32_t >( maxTriangles, 1 ), 0xff );
+
+    auto getPosition = [&]( uint32_t i ) {
+        return mathfu::vec3( reinterpret_cast< const float* >( vertices + i * vertexStride ) );
+    };
+
+    auto getNormal = [&]( uint32_t i ) {
+        return mathfu::vec3( reinterpret_cast< const float* >( vertices + i * vertexStride ) + 3 );
+    };
+
+    m.meshlets.clear( );
+    m.meshletVertices.clear( );
+    m.meshletIndices.clear( );
+
+    std::vector< uint8_t > localIndices( vertexCount, kNoLocalIndex );
+
+    /* The subsets do not cross the submeshes (the split parts and the LODs). */
+    std::vector< uint32_t > subsetBaseVertices( m.subsets.size( ), 0 );
+    for ( const auto& submesh : m.submeshes ) {
+        for ( uint32_t ss = submesh.base_subset( ); ss < submesh.base_subset( ) + submesh.subset_count( ); ++ss ) {
+            subsetBaseVertices[ ss ] = submesh.base_vertex( );
+        }
+    }
+
+    for ( uint32_t ss = 0; ss < m.subsets.size( ); ++ss ) {
+        const auto&    subset           = m.subsets[ ss ];
+        const uint32_t subsetBaseVertex = subsetBaseVertices[ ss ];
+
+        uint32_t baseVertex           = 0;
+        uint32_t baseIndex            = 0;
+        uint32_t meshletVertexCount   = 0;
+        uint32_t meshletTriangleCount = 0;
+
+        auto flushMeshlet = [&]( ) {
+            if ( 0 == meshletTriangleCount )
+                return;
+
+            m.meshlets.push_back( CalculateMeshletBounds( m.meshletVertices.data( ) + baseVertex,
+                                                          meshletVertexCount,
+                                                          m.meshletIndices.data( ) + baseIndex,
+                                                          meshletTriangleCount,
+                                                          baseVertex,
+                                                          baseIndex,
+                                                          ss,
+                                                          getPosition,
+                                                          getNormal ) );
+
+            for ( uint32_t v = baseVertex; v < m.meshletVertices.size( ); ++v ) {
+                localIndices[ m.meshletVertices[ v ] ] = kNoLocalIndex;
+            }
+
+            baseVertex           = (uint32_t) m.meshletVertices.size( );
+            baseIndex            = (uint32_t) m.meshletIndices.size( );
+            meshletVertexCount   = 0;
+            meshletTriangleCount = 0;
+        };
+
+        baseVertex = (uint32_t) m.meshletVertices.size( );
+        baseIndex  = (uint32_t) m.meshletIndices.size( );
+
+        for ( uint32_t i = subset.base_index( ); i < subset.base_index( ) + subset.index_count( ); i += 3 ) {
+            const uint32_t a = subsetBaseVertex + indices[ i + 0 ];
+            const uint32_t b = subsetBaseVertex + indices[ i + 1 ];
+            const uint32_t c = subsetBaseVertex + indices[ i + 2 ];
+
+            const uint32_t newVertexCount = uint32_t( kNoLocalIndex == localIndices[ a ] ) +
+                                            uint32_t( kNoLocalIndex == localIndices[ b ] && b != a ) +
+                                            uint32_t( kNoLocalIndex == localIndices[ c ] && c != a && c != b );
+
+            if ( meshletVertexCount + newVertexCount > maxVertices || meshletTriangleCount + 1 > maxTriangles ) {
+                flushMeshlet( );
+            }
+
+            for ( const uint32_t v : {a, b, c} ) {
+                if ( kNoLocalIndex == localIndices[ v ] ) {
+                    localIndices[ v ] = (uint8_t) meshletVertexCount++;
+                    m.meshletVertices.push_back( v );
+                }
+
+                m.meshletIndices.push_back( localIndices[ v ] );
+            }
+
+            ++meshletTriangleCount;
+        }
+
+        flushMeshlet( );
+    }
+
+    s.console->info( "Mesh \"{}\" has {} meshlets ({} vertex references for {} vertices, limits {}/{}).",
+                     meshName,
+                     m.meshlets.size( ),
+                     m.meshletVertices.size( ),
+                     vertexCount,
+                     maxVertices,
+                     maxTriangles );
+}
+
+/**
+ * Calculates the culling bounds (box and sphere) of every subset and every submesh, so that the subset draws
+ * of the large multi-material meshes can be culled individually. The submesh boxes are replaced with the tight ones
+ * (the split submeshes and the LODs get their own boxes).
+ * @param m The mesh to take the submeshes and subsets from and to store the bounds in.
+ * @param indices The final mesh indices (relative to the submesh base vertices).
+ * @param positions The unpacked vertex positions.
+ **/
+void CalculateSubsetBounds( apemode::Mesh& m, const std::vector< uint32_t >& indices, const std::vector< mathfu::vec3 >& positions ) {
+    auto getPosition = [&]( uint32_t i ) { return positions[ i ]; };
+
+    std::vector< uint32_t > stamps( positions.size( ), 0 );
+    std::vector< uint32_t > points;
+    uint32_t                stamp = 0;
+
+    auto calculateBounds = [&]( uint32_t baseVertex, uint32_t baseIndex, uint32_t indexCount ) {
+        ++stamp;
+        points.clear( );
+        for ( uint32_t i = baseIndex; i < baseIndex + indexCount; ++i ) {
+            const uint32_t v = baseVertex + indices[ i ];
+            if ( stamp != stamps[ v ] ) {
+                stamps[ v ] = stamp;
+                points.push_back( v );
+            }
+        }
+
+        if ( points.empty( ) ) {
+            return apemodefb::BoundsFb( apemodefb::vec3( 0.0f, 0.0f, 0.0f ), apemodefb::vec3( 0.0f, 0.0f, 0.0f ), apemodefb::vec3( 0.0f, 0.0f, 0.0f ), 0.0f );
+        }
+
+        mathfu::vec3 bboxMin = positions[ points[ 0 ] ];
+        mathfu::vec3 bboxMax = bboxMin;
+        for ( const uint32_t v : points ) {
+            bboxMin = mathfu::vec3::Min( bboxMin, positions[ v ] );
+            bboxMax = mathfu::vec3::Max( bboxMax, positions[ v ] );
+        }
+
+        mathfu::vec3 center;
+        float        radius = 0.0f;
+        CalculateBoundingSphere( points.data( ), (uint32_t) points.size( ), getPosition, center, radius );
+
+        return apemodefb::BoundsFb( apemodefb::vec3( bboxMin.x, bboxMin.y, bboxMin.z ),
+                                    apemodefb::vec3( bboxMax.x, bboxMax.y, bboxMax.z ),
+                                    apemodefb::vec3( center.x, center.y, center.z ),
+                                    radius );
+    };
+
+    m.subsetBounds.assign( m.subsets.size( ), apemodefb::BoundsFb( ) );
+    m.submeshBounds.clear( );
+    m.submeshBounds.reserve( m.submeshes.size( ) );
+
+    for ( auto& submesh : m.submeshes ) {
+        for ( uint32_t ss = submesh.base_subset( ); ss < submesh.base_subset( ) + submesh.subset_count( ); ++ss ) {
+            m.subsetBounds[ ss ] = calculateBounds( submesh.base_vertex( ), m.subsets[ ss ].base_index( ), m.subsets[ ss ].index_count( ) );
+        }
+
+        m.submeshBounds.push_back( calculateBounds( submesh.base_vertex( ), submesh.base_index( ), submesh.index_count( ) ) );
+        if ( submesh.index_count( ) ) {
+            apemode::Mutable( submesh.mutable_bbox_min( ) ) = m.submeshBounds.back( ).bbox_min( );
+            apemode::Mutable( submesh.mutable_bbox_max( ) ) = m.submeshBounds.back( ).bbox_max( );
+        }
+    }
+}
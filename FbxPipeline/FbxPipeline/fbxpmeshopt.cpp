@@ -1,255 +1,570 @@
-// #include <fbxppch.h>
-// #include <fbxpstate.h>
-
-// #pragma warning( push )
-// #pragma warning( disable : 4244 ) // int64 to int32 conversion
-// #include <vcache_optimizer.hpp>
-// #pragma warning( pop )
-
-// #include <meshoptimizer.hpp>
-
-// using namespace apemode;
-// using namespace apemodefb;
-
-// template < typename TIndex >
-// struct VcacheTriangle {
-//     TIndex indices[ 3 ];
-
-//     inline VcacheTriangle( ) {
-//     }
-
-//     inline VcacheTriangle( TIndex const i1, TIndex const i2, TIndex const i3 ) {
-//         indices[ 0 ] = i1;
-//         indices[ 1 ] = i2;
-//         indices[ 2 ] = i3;
-//     }
-
-//     inline TIndex operator[]( uint32_t const index ) const {
-//         assert( index < 3 );
-//         return indices[ index ];
-//     }
-// };
-
-// using Vertex = apemodefb::StaticVertexFb;
-
-// template < typename TIndex >
-// struct VcacheMesh {
-//     apemode::Mesh* m = nullptr;
-// };
-
-// namespace vcache_optimizer {
-//     template < typename TIndex >
-//     struct mesh_traits< VcacheMesh< TIndex > > {
-//         typedef uint32_t                 submesh_id_t;
-//         typedef TIndex                   vertex_index_t;
-//         typedef TIndex                   triangle_index_t;
-//         typedef Vertex                   vertex_t;
-//         typedef VcacheTriangle< TIndex > triangle_t;
-//     };
-// }
-
-// #pragma region Optimization
-
-// VcacheTriangle< uint16_t > create_new_triangle( VcacheMesh< uint16_t >& m, uint16_t const i1, uint16_t const i2, uint16_t const i3 ) {
-//     return VcacheTriangle< uint16_t >( i1, i2, i3 );
-// }
-
-// std::size_t get_num_triangles( VcacheMesh< uint16_t > const& m, uint32_t const& sm ) {
-//     return m.m->subsets[ sm ].index_count( ) / 3;
-// }
-
-// std::size_t get_num_vertices( VcacheMesh< uint16_t > const& m, uint32_t const& sm ) {
-//     return m.m->vertices.size( ) / sizeof( Vertex );
-// }
-
-// VcacheTriangle< uint16_t > get_triangle( VcacheMesh< uint16_t > const& m, uint32_t const& sm, uint16_t& index ) {
-//     uint16_t* indices = reinterpret_cast< uint16_t* >( m.m->indices.data( ) );
-//     const uint32_t i1 = indices[ m.m->subsets[ sm ].base_index( ) + index * 3 + 0 ];
-//     const uint32_t i2 = indices[ m.m->subsets[ sm ].base_index( ) + index * 3 + 1 ];
-//     const uint32_t i3 = indices[ m.m->subsets[ sm ].base_index( ) + index * 3 + 2 ];
-//     return VcacheTriangle< uint16_t >( i1, i2, i3 );
-// }
-
-// Vertex get_vertex( VcacheMesh< uint16_t > const& m, uint32_t const& sm, uint16_t& index ) {
-//     // uint16_t* indices = reinterpret_cast< uint16_t* >( m.m->indices.data( ) );
-//     // const uint16_t i = indices[ index ];
-//     // const uint16_t i = indices[ m.m->subsets[ sm ].base_index( ) + index ];
-//     // return *(Vertex*) ( m.m->vertices.data( ) + i * sizeof( Vertex ) );
-//     return *(Vertex*) ( m.m->vertices.data( ) + index * sizeof( Vertex ) );
-// }
-
-// void set_triangle( VcacheMesh< uint16_t >& m, uint32_t const& sm, uint16_t& index, VcacheTriangle< uint16_t > const& new_triangle ) {
-//     uint16_t* indices = reinterpret_cast< uint16_t* >( m.m->indices.data( ) );
-//     indices[ m.m->subsets[ sm ].base_index( ) + index * 3 + 0 ] = new_triangle[ 0 ];
-//     indices[ m.m->subsets[ sm ].base_index( ) + index * 3 + 1 ] = new_triangle[ 1 ];
-//     indices[ m.m->subsets[ sm ].base_index( ) + index * 3 + 2 ] = new_triangle[ 2 ];
-// }
-
-// void set_vertex( VcacheMesh< uint16_t >& m, uint32_t const& sm, uint16_t& index, Vertex const& new_vertex ) {
-//     // uint16_t* indices = reinterpret_cast< uint16_t* >( m.m->indices.data( ) );
-//     // const uint16_t i = indices[ index ];
-//     // const uint16_t i = indices[ m.m->subsets[ sm ].base_index( ) + index ];
-//     // *(Vertex*) ( m.m->vertices.data( ) + i * sizeof( Vertex ) ) = new_vertex;
-//     *(Vertex*) ( m.m->vertices.data( ) + index * sizeof( Vertex ) ) = new_vertex;
-// }
-
-// VcacheTriangle< uint32_t > create_new_triangle( VcacheMesh< uint32_t >& m, uint32_t const i1, uint32_t const i2, uint32_t const i3 ) {
-//     return VcacheTriangle< uint32_t >( i1, i2, i3 );
-// }
-
-// std::size_t get_num_triangles( VcacheMesh< uint32_t > const& m, uint32_t const& sm ) {
-//     return m.m->subsets[ sm ].index_count( ) / 3;
-// }
-
-// std::size_t get_num_vertices( VcacheMesh< uint32_t > const& m, uint32_t const& sm ) {
-//     return m.m->vertices.size( ) / sizeof( Vertex );
-//     // return m.m->subsets[ sm ].index_count( );
-// }
-
-// VcacheTriangle< uint32_t > get_triangle( VcacheMesh< uint32_t > const& m, uint32_t const& sm, uint32_t& index ) {
-//     uint32_t* indices = reinterpret_cast< uint32_t* >( m.m->indices.data( ) );
-//     const uint32_t i1 = indices[ m.m->subsets[ sm ].base_index( ) + index * 3 + 0 ];
-//     const uint32_t i2 = indices[ m.m->subsets[ sm ].base_index( ) + index * 3 + 1 ];
-//     const uint32_t i3 = indices[ m.m->subsets[ sm ].base_index( ) + index * 3 + 2 ];
-//     return VcacheTriangle< uint32_t >( i1, i2, i3 );
-// }
-
-// Vertex get_vertex( VcacheMesh< uint32_t > const& m, uint32_t const& sm, uint32_t& index ) {
-//     // uint32_t* indices = reinterpret_cast< uint32_t* >( m.m->indices.data( ) );
-//     // const uint32_t i = indices[ index ];
-//     // const uint32_t i = indices[ m.m->subsets[ sm ].base_index( ) + index ];
-//     // return *(Vertex*) ( m.m->vertices.data( ) + i * sizeof( Vertex ) );
-//     return *(Vertex*) ( m.m->vertices.data( ) + index * sizeof( Vertex ) );
-// }
-
-// void set_triangle( VcacheMesh< uint32_t >& m, uint32_t const& sm, uint32_t& index, VcacheTriangle< uint32_t > const& new_triangle ) {
-//     uint32_t* indices = reinterpret_cast< uint32_t* >( m.m->indices.data( ) );
-//     indices[ m.m->subsets[ sm ].base_index( ) + index * 3 + 0 ] = new_triangle[ 0 ];
-//     indices[ m.m->subsets[ sm ].base_index( ) + index * 3 + 1 ] = new_triangle[ 1 ];
-//     indices[ m.m->subsets[ sm ].base_index( ) + index * 3 + 2 ] = new_triangle[ 2 ];
-// }
-
-// void set_vertex( VcacheMesh< uint32_t >& m, uint32_t const& sm, uint32_t& index, Vertex const& new_vertex ) {
-//     // uint32_t* indices = reinterpret_cast< uint32_t* >( m.m->indices.data( ) );
-//     // const uint32_t i = m.m->indices[ index ];
-//     // const uint32_t i = m.m->indices[ m.m->subsets[ sm ].base_index( ) + index ];
-//     // *(Vertex*) ( m.m->vertices.data( ) + i * sizeof( Vertex ) ) = new_vertex;
-//     *(Vertex*) ( m.m->vertices.data( ) + index * sizeof( Vertex ) ) = new_vertex;
-// }
-
-// #pragma endregion
-
-// const bool bUseVcacheOptimizer = false;
-
-// template < typename TIndex >
-// void GenerateSubset( apemode::Mesh& m, uint32_t& vertexCount, uint32_t vertexStride ) {
-//     if ( false == m.subsets.empty( ) )
-//         return;
-
-//     std::vector< uint32_t > indexBuffer;
-//     indexBuffer.resize( vertexCount );
-
-//     const uint32_t vc = (uint32_t) generateIndexBuffer( indexBuffer.data( ), m.vertices.data( ), vertexCount, vertexStride );
-
-//     std::vector< uint8_t > vertexBuffer;
-//     vertexBuffer.resize( vc * vertexStride );
-//     generateVertexBuffer( vertexBuffer.data( ), indexBuffer.data( ), m.vertices.data( ), vertexCount, vertexStride );
-
-//     m.vertices.swap( vertexBuffer );
-//     vertexCount = vc;
-
-//     m.indices.resize( sizeof( TIndex ) * vertexCount );
-//     auto indices = reinterpret_cast< TIndex* >( m.indices.data( ) );
-//     for ( uint32_t i = 0; i < vc; ++i ) {
-//         indices[ i ] = (TIndex) indexBuffer[ i ];
-//     }
-
-//     m.subsets.emplace_back( (uint32_t) 0, (uint32_t) 0, (uint32_t) vc );
-// }
-
-// template < typename TIndex >
-// void OptimizeSubsetVcache( apemode::Mesh& mesh, uint32_t subsetIndex ) {
-//     VcacheMesh< TIndex > meshWrapper;
-//     meshWrapper.m = &mesh;
-
-//     vcache_optimizer::vcache_optimizer< VcacheMesh< TIndex > > optimizer;
-//     optimizer( meshWrapper, subsetIndex, mesh.subsets.size( ) == 1 );
-// }
-
-// template < typename TIndex >
-// void OptimizeSubset(apemode::Mesh& m, const Vertex * vertices, uint32_t& vertexCount, uint32_t vertexStride, uint32_t ss ) {
-//     const uint32_t kCacheSize = 16;
-
-//     std::vector< uint8_t > indexBuffer;
-//     indexBuffer.resize( m.subsets[ ss ].index_count( ) * sizeof( TIndex ) );
-
-// #if 0
-
-//     std::vector< uint32_t > clusters;
-//     optimizePostTransform( reinterpret_cast< TIndex* >( indexBuffer.data( ) ),
-//                            reinterpret_cast< TIndex* >( m.indices.data( ) ) + m.subsets[ ss ].base_index( ),
-//                            m.subsets[ ss ].index_count( ),
-//                            vertexCount,
-//                            kCacheSize,
-//                            &clusters );
-
-//     memcpy( reinterpret_cast< TIndex* >( m.indices.data( ) ) + m.subsets[ ss ].base_index( ),
-//             indexBuffer.data( ),
-//             m.subsets[ ss ].index_count( ) * sizeof( TIndex ) );
-
-//     optimizeOverdraw( reinterpret_cast< TIndex* >( indexBuffer.data( ) ),
-//                       reinterpret_cast< TIndex* >( m.indices.data( ) ) + m.subsets[ ss ].base_index( ),
-//                       m.subsets[ ss ].index_count( ),
-//                       vertices,
-//                       vertexStride,
-//                       vertexCount,
-//                       clusters,
-//                       kCacheSize,
-//                       1.05f );
-
-//     memcpy( reinterpret_cast< TIndex* >( m.indices.data( ) ) + m.subsets[ ss ].base_index( ),
-//             indexBuffer.data( ),
-//             m.subsets[ ss ].index_count( ) * sizeof( TIndex ) );
-
-// #else
-
-//     optimizePostTransform( reinterpret_cast< TIndex* >( indexBuffer.data( ) ),
-//                            reinterpret_cast< TIndex* >( m.indices.data( ) ) + m.subsets[ ss ].base_index( ),
-//                            m.subsets[ ss ].index_count( ),
-//                            vertexCount,
-//                            kCacheSize );
-
-// #endif
-// }
-
-// template < typename TIndex >
-// void Optimize( apemode::Mesh& m, const Vertex * vertices, uint32_t& vertexCount, uint32_t vertexStride ) {
-
-//     auto& s = apemode::Get( );
-
-//     VcacheMesh< TIndex > mm;
-//     mm.m = &m;
-
-//     if ( m.subsets.empty( ) ) {
-//         GenerateSubset< TIndex >( m, vertexCount, vertexStride );
-//         // OptimizeSubset< TIndex >( m, vertices, vertexCount, vertexStride, 0 );
-//     }
-
-//     for ( uint32_t ss = 0; ss < m.subsets.size( ); ++ss ) {
-//         // OptimizeSubset< TIndex >( m, vertices, vertexCount, vertexStride, ss );
-//         OptimizeSubsetVcache< TIndex >( m, ss );
-//     }
-// }
-
-// // F:\Dev\Projects\ProjectFbxPipeline\ThirdParty\meshoptimizer\demo\bunny.obj
-// // E:\Media\Models\Mercedes+Benz+A45+AMG.FBX
-// // E:\Media\Models\m4a1-sopmod-overkill\source\M4A1 SOPMOD Overkill HIGH POLY.obj
-// // E:\Media\Models\mech-m-6k\source\93d43cf18ad5406ba0176c9fae7d4927.fbx
-
-// void Optimize32( apemode::Mesh& mesh, const Vertex* vertices, uint32_t& vertexCount, uint32_t vertexStride ) {
-//     Optimize< uint32_t >( mesh, vertices, vertexCount, vertexStride );
-// }
-
-// void Optimize16( apemode::Mesh& mesh, const Vertex* vertices, uint32_t& vertexCount, uint32_t vertexStride ) {
-//     Optimize< uint16_t >( mesh, vertices, vertexCount, vertexStride );
-// }
\ No newline at end of file
+#include <fbxppch.h>
+#include <fbxpstate.h>
+
+/**
+ * Post-transform vertex cache optimization.
+ * The implementation follows Tom Forsyth's "Linear-Speed Vertex Cache Optimisation":
+ * https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+ *
+ * Overdraw optimization.
+ * The implementation follows Sander, Nehab, Barczak "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw":
+ * http://gfx.cs.princeton.edu/pubs/Sander_2007_%3ETR/tipsy.pdf
+ *
+ * Vertex fetch optimization.
+ * The vertices are renumbered in the order of their first use in the index buffer (pre-transform cache locality).
+ *
+ * No third party libraries are involved, the passes work on 32-bit indices before the final index type is chosen.
+ **/
+
+static const uint32_t kVertexCacheSize         = 32; /* Modelled LRU cache size for vertex scoring. */
+static const uint32_t kVertexCacheSizeForACMR  = 16; /* FIFO cache size for ACMR reporting. */
+static const uint32_t kMaxValenceForScoreTable = 64;
+static const uint32_t kFetchCacheLineSize      = 64; /* Modelled vertex fetch cache line size in bytes. */
+static const uint32_t kFetchCacheLineCount     = 64; /* Modelled vertex fetch cache size in lines (FIFO). */
+static const float    kCacheDecayPower         = 1.5f;
+static const float    kLastTriangleScore       = 0.75f;
+static const float    kValenceBoostScale       = 2.0f;
+static const float    kValenceBoostPower       = 0.5f;
+
+/**
+ * Pre-calculated vertex scores for the cache positions and the remaining triangle counts (valences).
+ **/
+struct VertexScoreTable {
+    float cacheScores[ kVertexCacheSize ];
+    float valenceScores[ kMaxValenceForScoreTable ];
+
+    VertexScoreTable( ) {
+        for ( uint32_t i = 0; i < kVertexCacheSize; ++i ) {
+            if ( i < 3 ) {
+                /* The vertices of the last triangle get the fixed score to avoid
+                   the cases where the same triangle is produced again. */
+                cacheScores[ i ] = kLastTriangleScore;
+            } else {
+                const float scaler = 1.0f / float( kVertexCacheSize - 3 );
+                cacheScores[ i ]   = powf( 1.0f - float( i - 3 ) * scaler, kCacheDecayPower );
+            }
+        }
+
+        valenceScores[ 0 ] = 0.0f;
+        for ( uint32_t i = 1; i < kMaxValenceForScoreTable; ++i ) {
+            valenceScores[ i ] = kValenceBoostScale * powf( float( i ), -kValenceBoostPower );
+        }
+    }
+
+    /**
+     * @param cachePosition Position in the modelled cache (-1 if the vertex is not cached).
+     * @param remainingTriangles Number of the triangles that are not emitted yet.
+     * @return Vertex score, -1 for the vertices that are not used by the remaining triangles.
+     **/
+    float Get( int32_t cachePosition, uint32_t remainingTriangles ) const {
+        if ( 0 == remainingTriangles )
+            return -1.0f;
+
+        float score = cachePosition >= 0 ? cacheScores[ cachePosition ] : 0.0f;
+        if ( remainingTriangles < kMaxValenceForScoreTable )
+            score += valenceScores[ remainingTriangles ];
+        else
+            score += kValenceBoostScale * powf( float( remainingTriangles ), -kValenceBoostPower );
+
+        return score;
+    }
+};
+
+/**
+ * Simulates FIFO vertex cache.
+ * @return Average cache miss ratio (transformed vertices per triangle).
+ **/
+float CalculateACMR( const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize ) {
+    if ( indexCount < 3 )
+        return 0.0f;
+
+    /* Vertex is in cache if it was added less than cacheSize misses ago. */
+    std::vector< uint32_t > timestamps( vertexCount, 0 );
+    uint32_t                timestamp = cacheSize + 1;
+    uint32_t                misses    = 0;
+
+    for ( uint32_t i = 0; i < indexCount; ++i ) {
+        const uint32_t vertexIndex = indices[ i ];
+        assert( vertexIndex < vertexCount );
+
+        if ( timestamp - timestamps[ vertexIndex ] > cacheSize ) {
+            timestamps[ vertexIndex ] = timestamp++;
+            ++misses;
+        }
+    }
+
+    return float( misses ) / float( indexCount / 3 );
+}
+
+/**
+ * Reorders the triangles to maximize the post-transform vertex cache hits.
+ * Can be used in multiple threads.
+ * @param indices The triangle list to reorder (in place).
+ * @param indexCount The number of indices (multiple of 3).
+ * @param vertexCount The number of vertices referenced by the indices.
+ **/
+void OptimizeVertexCache( uint32_t* indices, uint32_t indexCount, uint32_t vertexCount ) {
+    static const VertexScoreTable scoreTable;
+
+    const uint32_t triangleCount = indexCount / 3;
+    if ( triangleCount < 2 )
+        return;
+
+    /* Build vertex to triangle adjacency. */
+
+    std::vector< uint32_t > remainingTriangles( vertexCount, 0 );
+    for ( uint32_t i = 0; i < indexCount; ++i ) {
+        ++remainingTriangles[ indices[ i ] ];
+    }
+
+    std::vector< uint32_t > adjacencyOffsets( vertexCount + 1, 0 );
+    for ( uint32_t v = 0; v < vertexCount; ++v ) {
+        adjacencyOffsets[ v + 1 ] = adjacencyOffsets[ v ] + remainingTriangles[ v ];
+    }
+
+    std::vector< uint32_t > adjacency( indexCount );
+    std::vector< uint32_t > adjacencyCounts( vertexCount, 0 );
+    for ( uint32_t t = 0; t < triangleCount; ++t ) {
+        for ( uint32_t k = 0; k < 3; ++k ) {
+            const uint32_t v = indices[ t * 3 + k ];
+            adjacency[ adjacencyOffsets[ v ] + adjacencyCounts[ v ]++ ] = t;
+        }
+    }
+
+    /* Initialize scores. */
+
+    std::vector< int32_t > cachePositions( vertexCount, -1 );
+    std::vector< float >   vertexScores( vertexCount );
+    for ( uint32_t v = 0; v < vertexCount; ++v ) {
+        vertexScores[ v ] = scoreTable.Get( -1, remainingTriangles[ v ] );
+    }
+
+    std::vector< float > triangleScores( triangleCount );
+    std::vector< bool >  emitted( triangleCount, false );
+    for ( uint32_t t = 0; t < triangleCount; ++t ) {
+        triangleScores[ t ] = vertexScores[ indices[ t * 3 + 0 ] ] + vertexScores[ indices[ t * 3 + 1 ] ] +
+                              vertexScores[ indices[ t * 3 + 2 ] ];
+    }
+
+    std::vector< uint32_t > optimizedIndices;
+    optimizedIndices.reserve( indexCount );
+
+    uint32_t cache[ kVertexCacheSize + 3 ];
+    uint32_t cacheCount = 0;
+
+    uint32_t bestTriangle = (uint32_t) std::distance( triangleScores.begin( ),
+                                                      std::max_element( triangleScores.begin( ), triangleScores.end( ) ) );
+    uint32_t nextTriangleToScan = 0;
+
+    for ( uint32_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount ) {
+        if ( bestTriangle == (uint32_t) -1 ) {
+            /* Nothing in cache is connected to the remaining triangles,
+               take the first triangle that was not emitted yet. */
+            while ( emitted[ nextTriangleToScan ] ) {
+                ++nextTriangleToScan;
+            }
+
+            bestTriangle = nextTriangleToScan;
+        }
+
+        assert( !emitted[ bestTriangle ] );
+        emitted[ bestTriangle ] = true;
+
+        const uint32_t* triangle = indices + bestTriangle * 3;
+        optimizedIndices.insert( optimizedIndices.end( ), triangle, triangle + 3 );
+
+        /* Remove the triangle from the adjacency of its vertices. */
+
+        for ( uint32_t k = 0; k < 3; ++k ) {
+            const uint32_t v     = triangle[ k ];
+            uint32_t*      begin = adjacency.data( ) + adjacencyOffsets[ v ];
+            uint32_t*      end   = begin + remainingTriangles[ v ];
+            uint32_t*      it    = std::find( begin, end, bestTriangle );
+
+            assert( it != end );
+            std::swap( *it, *( end - 1 ) );
+            --remainingTriangles[ v ];
+        }
+
+        /* Move the triangle vertices to the top of the LRU cache. */
+
+        uint32_t newCache[ kVertexCacheSize + 3 ];
+        uint32_t newCacheCount = 0;
+
+        for ( uint32_t k = 0; k < 3; ++k ) {
+            newCache[ newCacheCount++ ] = triangle[ k ];
+        }
+
+        for ( uint32_t c = 0; c < cacheCount; ++c ) {
+            const uint32_t v = cache[ c ];
+            if ( v != triangle[ 0 ] && v != triangle[ 1 ] && v != triangle[ 2 ] ) {
+                newCache[ newCacheCount++ ] = v;
+            }
+        }
+
+        /* Update scores of the cached and evicted vertices and their triangles. */
+
+        bestTriangle       = (uint32_t) -1;
+        float bestScore    = -1.0f;
+        cacheCount         = std::min( newCacheCount, kVertexCacheSize );
+
+        for ( uint32_t c = 0; c < newCacheCount; ++c ) {
+            const uint32_t v = newCache[ c ];
+
+            cachePositions[ v ]    = c < kVertexCacheSize ? (int32_t) c : -1;
+            const float newScore   = scoreTable.Get( cachePositions[ v ], remainingTriangles[ v ] );
+            const float scoreDelta = newScore - vertexScores[ v ];
+            vertexScores[ v ]      = newScore;
+
+            const uint32_t* begin = adjacency.data( ) + adjacencyOffsets[ v ];
+            const uint32_t* end   = begin + remainingTriangles[ v ];
+            for ( const uint32_t* it = begin; it != end; ++it ) {
+                triangleScores[ *it ] += scoreDelta;
+            }
+        }
+
+        for ( uint32_t c = 0; c < cacheCount; ++c ) {
+            const uint32_t v = newCache[ c ];
+            cache[ c ]       = v;
+
+            const uint32_t* begin = adjacency.data( ) + adjacencyOffsets[ v ];
+            const uint32_t* end   = begin + remainingTriangles[ v ];
+            for ( const uint32_t* it = begin; it != end; ++it ) {
+                if ( triangleScores[ *it ] > bestScore ) {
+                    bestScore    = triangleScores[ *it ];
+                    bestTriangle = *it;
+                }
+            }
+        }
+    }
+
+    assert( optimizedIndices.size( ) == indexCount );
+    std::copy( optimizedIndices.begin( ), optimizedIndices.end( ), indices );
+}
+
+/**
+ * Optimizes the triangle order of each subset independently (the subset ranges are preserved).
+ * Reports ACMR before and after optimization.
+ * @param m The mesh to take the subsets from.
+ * @param meshName The mesh name for logging.
+ * @param indices The mesh indices, reordered in place.
+ * @param vertexCount The number of welded vertices.
+ **/
+void OptimizeVertexCache( apemode::Mesh& m, const char* meshName, std::vector< uint32_t >& indices, uint32_t vertexCount ) {
+    auto& s = apemode::Get( );
+
+    const uint32_t indexCount = (uint32_t) indices.size( );
+    const float    acmrBefore = CalculateACMR( indices.data( ), indexCount, vertexCount, kVertexCacheSizeForACMR );
+
+    for ( uint32_t ss = 0; ss < m.subsets.size( ); ++ss ) {
+        const auto& subset = m.subsets[ ss ];
+        assert( subset.base_index( ) + subset.index_count( ) <= indexCount );
+
+        uint32_t* subsetIndices = indices.data( ) + subset.base_index( );
+        const float subsetBefore = CalculateACMR( subsetIndices, subset.index_count( ), vertexCount, kVertexCacheSizeForACMR );
+        OptimizeVertexCache( subsetIndices, subset.index_count( ), vertexCount );
+        const float subsetAfter = CalculateACMR( subsetIndices, subset.index_count( ), vertexCount, kVertexCacheSizeForACMR );
+
+        s.console->debug( "Mesh \"{}\" subset #{}: ACMR {} -> {}.", meshName, ss, subsetBefore, subsetAfter );
+    }
+
+    const float acmrAfter = CalculateACMR( indices.data( ), indexCount, vertexCount, kVertexCacheSizeForACMR );
+    s.console->info( "Mesh \"{}\": ACMR {} -> {} (FIFO cache size {}).", meshName, acmrBefore, acmrAfter, kVertexCacheSizeForACMR );
+}
+
+/**
+ * Simulates FIFO vertex cache for a single triangle.
+ * @return Number of cache misses for the triangle.
+ **/
+inline uint32_t UpdateFifoCache( const uint32_t* triangle, uint32_t* timestamps, uint32_t& timestamp, uint32_t cacheSize ) {
+    uint32_t misses = 0;
+    for ( uint32_t k = 0; k < 3; ++k ) {
+        if ( timestamp - timestamps[ triangle[ k ] ] > cacheSize ) {
+            timestamps[ triangle[ k ] ] = timestamp++;
+            ++misses;
+        }
+    }
+
+    return misses;
+}
+
+/**
+ * Splits the cache optimized triangle list into clusters, which can be reordered without
+ * increasing ACMR more than the threshold times (within each cluster).
+ * @return The triangle offsets where the clusters start.
+ **/
+std::vector< uint32_t > GenerateOverdrawClusters( const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, float threshold ) {
+    const uint32_t triangleCount = indexCount / 3;
+
+    std::vector< uint32_t > timestamps( vertexCount, 0 );
+    uint32_t                timestamp = kVertexCacheSizeForACMR + 1;
+
+    /* Hard boundaries: the triangles that miss all their vertices usually start disjoint patches. */
+
+    std::vector< uint32_t > hardBoundaries;
+    for ( uint32_t t = 0; t < triangleCount; ++t ) {
+        const uint32_t misses = UpdateFifoCache( indices + t * 3, timestamps.data( ), timestamp, kVertexCacheSizeForACMR );
+        if ( 0 == t || 3 == misses ) {
+            hardBoundaries.push_back( t );
+        }
+    }
+
+    hardBoundaries.push_back( triangleCount );
+
+    /* Soft boundaries: split hard clusters at the points where the running ACMR
+       gets within the threshold of the cluster ACMR. */
+
+    std::vector< uint32_t > clusters;
+    for ( uint32_t h = 0; h + 1 < hardBoundaries.size( ); ++h ) {
+        const uint32_t start = hardBoundaries[ h ];
+        const uint32_t end   = hardBoundaries[ h + 1 ];
+
+        /* Flush the cache. */
+        timestamp += kVertexCacheSizeForACMR + 1;
+
+        uint32_t clusterMisses = 0;
+        for ( uint32_t t = start; t < end; ++t ) {
+            clusterMisses += UpdateFifoCache( indices + t * 3, timestamps.data( ), timestamp, kVertexCacheSizeForACMR );
+        }
+
+        const float clusterThreshold = threshold * float( clusterMisses ) / float( end - start );
+
+        clusters.push_back( start );
+        timestamp += kVertexCacheSizeForACMR + 1;
+
+        uint32_t runningMisses    = 0;
+        uint32_t runningTriangles = 0;
+        for ( uint32_t t = start; t < end; ++t ) {
+            runningMisses += UpdateFifoCache( indices + t * 3, timestamps.data( ), timestamp, kVertexCacheSizeForACMR );
+            ++runningTriangles;
+
+            if ( float( runningMisses ) / float( runningTriangles ) <= clusterThreshold ) {
+                /* The target ACMR is reached, start the next cluster on the next triangle. */
+                clusters.push_back( t + 1 );
+                timestamp += kVertexCacheSizeForACMR + 1;
+                runningMisses    = 0;
+                runningTriangles = 0;
+            }
+        }
+
+        /* The last cluster can be empty (the target ACMR was reached on the last triangle). */
+        if ( clusters.back( ) == end ) {
+            clusters.pop_back( );
+        }
+    }
+
+    return clusters;
+}
+
+/**
+ * Reorders the triangle clusters of the cache optimized triangle list to reduce overdraw.
+ * The clusters that are facing outwards and are far from the mesh center are more likely to occlude
+ * other clusters, so they are placed first (view-independent sorting).
+ * Can be used in multiple threads.
+ * @param indices The cache optimized triangle list to reorder (in place).
+ * @param indexCount The number of indices (multiple of 3).
+ * @param vertices The vertices with 3 float position components at the beginning of the vertex.
+ * @param vertexStride The vertex stride in bytes.
+ * @param vertexCount The number of vertices referenced by the indices.
+ * @param threshold The maximum ACMR degradation (1.05 allows ACMR to get 5% worse).
+ **/
+void OptimizeOverdraw( uint32_t*      indices,
+                       uint32_t       indexCount,
+                       const uint8_t* vertices,
+                       uint32_t       vertexStride,
+                       uint32_t       vertexCount,
+                       float          threshold ) {
+    const uint32_t triangleCount = indexCount / 3;
+    if ( triangleCount < 2 )
+        return;
+
+    auto getPosition = [&]( uint32_t i ) {
+        const float* position = reinterpret_cast< const float* >( vertices + i * vertexStride );
+        return mathfu::vec3( position[ 0 ], position[ 1 ], position[ 2 ] );
+    };
+
+    const std::vector< uint32_t > clusters = GenerateOverdrawClusters( indices, indexCount, vertexCount, threshold );
+    const uint32_t clusterCount = (uint32_t) clusters.size( );
+    if ( clusterCount < 2 )
+        return;
+
+    mathfu::vec3 meshCentroid( 0.0f, 0.0f, 0.0f );
+    for ( uint32_t i = 0; i < indexCount; ++i ) {
+        meshCentroid += getPosition( indices[ i ] );
+    }
+
+    meshCentroid /= float( indexCount );
+
+    /* Occlusion potential: the distance from the mesh centroid to the cluster centroid along the cluster normal. */
+
+    std::vector< float > sortKeys( clusterCount );
+    for ( uint32_t c = 0; c < clusterCount; ++c ) {
+        const uint32_t start = clusters[ c ];
+        const uint32_t end   = c + 1 < clusterCount ? clusters[ c + 1 ] : triangleCount;
+
+        float        clusterArea = 0.0f;
+        mathfu::vec3 clusterNormal( 0.0f, 0.0f, 0.0f );
+        mathfu::vec3 clusterCentroid( 0.0f, 0.0f, 0.0f );
+
+        for ( uint32_t t = start; t < end; ++t ) {
+            const mathfu::vec3 p0 = getPosition( indices[ t * 3 + 0 ] );
+            const mathfu::vec3 p1 = getPosition( indices[ t * 3 + 1 ] );
+            const mathfu::vec3 p2 = getPosition( indices[ t * 3 + 2 ] );
+
+            /* Area weighted normal and centroid. */
+            const mathfu::vec3 normal = mathfu::cross( p1 - p0, p2 - p0 );
+            const float        area   = normal.Length( );
+
+            clusterNormal += normal;
+            clusterCentroid += ( p0 + p1 + p2 ) * ( area / 3.0f );
+            clusterArea += area;
+        }
+
+        const float clusterNormalLength = clusterNormal.Length( );
+        clusterNormal   = clusterNormalLength > 0.0f ? clusterNormal / clusterNormalLength : clusterNormal;
+        clusterCentroid = clusterArea > 0.0f ? clusterCentroid / clusterArea : clusterCentroid;
+
+        sortKeys[ c ] = mathfu::dot( clusterCentroid - meshCentroid, clusterNormal );
+    }
+
+    std::vector< uint32_t > clusterOrder( clusterCount );
+    for ( uint32_t c = 0; c < clusterCount; ++c ) {
+        clusterOrder[ c ] = c;
+    }
+
+    std::stable_sort( clusterOrder.begin( ), clusterOrder.end( ), [&]( uint32_t a, uint32_t b ) {
+        return sortKeys[ a ] > sortKeys[ b ];
+    } );
+
+    std::vector< uint32_t > reorderedIndices;
+    reorderedIndices.reserve( indexCount );
+
+    for ( const uint32_t c : clusterOrder ) {
+        const uint32_t start = clusters[ c ];
+        const uint32_t end   = c + 1 < clusterCount ? clusters[ c + 1 ] : triangleCount;
+        reorderedIndices.insert( reorderedIndices.end( ), indices + start * 3, indices + end * 3 );
+    }
+
+    assert( reorderedIndices.size( ) == indexCount );
+    std::copy( reorderedIndices.begin( ), reorderedIndices.end( ), indices );
+}
+
+/**
+ * Reorders the triangle clusters of each subset independently (the subset ranges are preserved).
+ * Expects the indices to be optimized for the vertex cache. Reports ACMR after optimization.
+ * @param m The mesh to take the subsets from.
+ * @param meshName The mesh name for logging.
+ * @param indices The mesh indices, reordered in place.
+ * @param vertices The vertices with 3 float position components at the beginning of the vertex.
+ * @param vertexStride The vertex stride in bytes.
+ * @param vertexCount The number of welded vertices.
+ * @param threshold The maximum ACMR degradation.
+ **/
+void OptimizeOverdraw( apemode::Mesh&           m,
+                       const char*              meshName,
+                       std::vector< uint32_t >& indices,
+                       const uint8_t*           vertices,
+                       uint32_t                 vertexStride,
+                       uint32_t                 vertexCount,
+                       float                    threshold ) {
+    auto& s = apemode::Get( );
+
+    for ( auto& subset : m.subsets ) {
+        OptimizeOverdraw( indices.data( ) + subset.base_index( ), subset.index_count( ), vertices, vertexStride, vertexCount, threshold );
+    }
+
+    const float acmr = CalculateACMR( indices.data( ), (uint32_t) indices.size( ), vertexCount, kVertexCacheSizeForACMR );
+    s.console->info( "Mesh \"{}\": ACMR {} after overdraw optimization (threshold {}).", meshName, acmr, threshold );
+}
+
+/**
+ * Simulates FIFO vertex fetch cache.
+ * @return Overfetch ratio (fetched bytes per vertex buffer byte), 1 is the best possible value.
+ **/
+float CalculateOverfetch( const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t vertexStride ) {
+    if ( 0 == indexCount || 0 == vertexCount )
+        return 0.0f;
+
+    const uint32_t lineCount = ( vertexCount * vertexStride + kFetchCacheLineSize - 1 ) / kFetchCacheLineSize;
+
+    std::vector< uint32_t > timestamps( lineCount, 0 );
+    uint32_t                timestamp = kFetchCacheLineCount + 1;
+    uint64_t                fetchedBytes = 0;
+
+    for ( uint32_t i = 0; i < indexCount; ++i ) {
+        const uint32_t startLine = ( indices[ i ] * vertexStride ) / kFetchCacheLineSize;
+        const uint32_t endLine   = ( indices[ i ] * vertexStride + vertexStride - 1 ) / kFetchCacheLineSize;
+
+        for ( uint32_t line = startLine; line <= endLine; ++line ) {
+            if ( timestamp - timestamps[ line ] > kFetchCacheLineCount ) {
+                timestamps[ line ] = timestamp++;
+                fetchedBytes += kFetchCacheLineSize;
+            }
+        }
+    }
+
+    return float( double( fetchedBytes ) / double( vertexCount * vertexStride ) );
+}
+
+/**
+ * Renumbers the vertices in the order of their first use in the index buffer.
+ * The vertices that are not referenced by the indices are removed.
+ * Can be used in multiple threads.
+ * @param vertices The vertices to reorder (in place).
+ * @param vertexStride The vertex stride in bytes.
+ * @param vertexCount The number of vertices.
+ * @param indices The indices to remap (in place).
+ * @param indexCount The number of indices.
+ * @return The number of the vertices after reordering.
+ **/
+uint32_t OptimizeVertexFetch( uint8_t* vertices, uint32_t vertexStride, uint32_t vertexCount, uint32_t* indices, uint32_t indexCount ) {
+    static const uint32_t kUnused = (uint32_t) -1;
+
+    std::vector< uint32_t > remap( vertexCount, kUnused );
+    uint32_t                reorderedVertexCount = 0;
+
+    for ( uint32_t i = 0; i < indexCount; ++i ) {
+        uint32_t& reorderedIndex = remap[ indices[ i ] ];
+        if ( kUnused == reorderedIndex ) {
+            reorderedIndex = reorderedVertexCount++;
+        }
+
+        indices[ i ] = reorderedIndex;
+    }
+
+    std::vector< uint8_t > reorderedVertices( reorderedVertexCount * vertexStride );
+    for ( uint32_t v = 0; v < vertexCount; ++v ) {
+        if ( kUnused != remap[ v ] ) {
+            memcpy( reorderedVertices.data( ) + remap[ v ] * vertexStride, vertices + v * vertexStride, vertexStride );
+        }
+    }
+
+    memcpy( vertices, reorderedVertices.data( ), reorderedVertices.size( ) );
+    return reorderedVertexCount;
+}
+
+/**
+ * Renumbers the vertices of the mesh in the order of their first use across the whole index buffer.
+ * Reports overfetch before and after optimization.
+ * @param meshName The mesh name for logging.
+ * @param vertices The mesh vertices, reordered (and shrunk if some vertices are unused) in place.
+ * @param vertexStride The vertex stride in bytes.
+ * @param vertexCount The number of vertices, updated.
+ * @param indices The mesh indices, remapped in place.
+ **/
+void OptimizeVertexFetch( const char*              meshName,
+                          std::vector< uint8_t >&  vertices,
+                          uint32_t                 vertexStride,
+                          uint32_t&                vertexCount,
+                          std::vector< uint32_t >& indices ) {
+    auto& s = apemode::Get( );
+
+    const uint32_t indexCount       = (uint32_t) indices.size( );
+    const float    overfetchBefore  = CalculateOverfetch( indices.data( ), indexCount, vertexCount, vertexStride );
+
+    vertexCount = OptimizeVertexFetch( vertices.data( ), vertexStride, vertexCount, indices.data( ), indexCount );
+    vertices.resize( vertexCount * vertexStride );
+
+    const float overfetchAfter = CalculateOverfetch( indices.data( ), indexCount, vertexCount, vertexStride );
+    s.console->info( "Mesh \"{}\": overfetch {} -> {} (vertex stride {}).", meshName, overfetchBefore, overfetchAfter, vertexStride );
+}
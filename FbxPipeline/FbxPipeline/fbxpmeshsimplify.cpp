@@ -0,0 +1,676 @@
+#include <fbxppch.h>
+#include <fbxpstate.h>
+#include <unordered_map>
+
+/**
+ * LOD generation with the quadric error metrics.
+ * The implementation follows Garland, Heckbert "Surface Simplification Using Quadric Error Metrics":
+ * https://www.cs.cmu.edu/~./garland/Papers/quadrics.pdf
+ *
+ * The vertices are collapsed to their neighbours (half-edge collapses), so all the LODs share the vertex buffer
+ * of the mesh and differ only in their index ranges. The vertices on the open borders, on the attribute seams
+ * (the same position with different normals, texcoords or skin weights) and on the subset boundaries are never
+ * moved, and the collapse costs are penalized by the attribute differences (normals, texcoords, skin weights).
+ * The quadrics of the original triangles are kept across the whole LOD chain, and the LOD error is measured against
+ * the original mesh (not against the previous LOD), see MeasureLodError.
+ **/
+
+static const uint32_t kInvalidIndex     = 0xffffffff;
+static const double   kNormalWeight     = 0.01; /* Attribute penalties, relative to the squared mesh extent. */
+static const double   kTexcoordWeight   = 0.01;
+static const double   kBoneWeightWeight = 0.01;
+static const float    kMinFlipDot       = 0.25f; /* Maximum allowed triangle normal deviation after the collapse. */
+static const float    kMinLodReduction  = 0.95f; /* LODs with less than 5% of the triangles removed are not emitted. */
+
+/**
+ * Symmetric matrix of the summed plane equations with the summed weights.
+ **/
+struct Quadric {
+    double xx = 0, xy = 0, xz = 0, xd = 0;
+    double yy = 0, yz = 0, yd = 0;
+    double zz = 0, zd = 0;
+    double dd = 0;
+    double w  = 0;
+
+    void AddPlane( const mathfu::vec3& n, double d, double weight ) {
+        xx += weight * n.x * n.x;
+        xy += weight * n.x * n.y;
+        xz += weight * n.x * n.z;
+        xd += weight * n.x * d;
+        yy += weight * n.y * n.y;
+        yz += weight * n.y * n.z;
+        yd += weight * n.y * d;
+        zz += weight * n.z * n.z;
+        zd += weight * n.z * d;
+        dd += weight * d * d;
+        w += weight;
+    }
+
+    void Add( const Quadric& q ) {
+        xx += q.xx;
+        xy += q.xy;
+        xz += q.xz;
+        xd += q.xd;
+        yy += q.yy;
+        yz += q.yz;
+        yd += q.yd;
+        zz += q.zz;
+        zd += q.zd;
+        dd += q.dd;
+        w += q.w;
+    }
+
+    /**
+     * @return Weighted average squared distance from the point to the planes.
+     **/
+    double Error( const mathfu::vec3& p ) const {
+        if ( w <= 0 )
+            return 0;
+
+        const double x = p.x;
+        const double y = p.y;
+        const double z = p.z;
+
+        const double e = x * x * xx + y * y * yy + z * z * zz + 2 * ( x * y * xy + x * z * xz + y * z * yz ) +
+                         2 * ( x * xd + y * yd + z * zd ) + dd;
+
+        return std::max( e, 0.0 ) / w;
+    }
+};
+
+/**
+ * Vertex data the simplification works with.
+ **/
+struct SimplificationVertices {
+    std::vector< mathfu::vec3 > positions;
+    std::vector< mathfu::vec3 > normals;
+    std::vector< mathfu::vec2 > texcoords;
+    std::vector< float >        boneWeights;     /* 4 per vertex, empty for static meshes. */
+    std::vector< float >        boneIndices;     /* 4 per vertex, empty for static meshes. */
+    std::vector< uint32_t >     positionIds;     /* The first vertex with the same position. */
+    std::vector< bool >         sharedPositions; /* The positions used by more than one subset. */
+    double                      attributeScale = 1;
+
+    /**
+     * @return Squared difference of the sparse bone weight sets.
+     **/
+    double BoneWeightDifference( uint32_t a, uint32_t b ) const {
+        if ( boneWeights.empty( ) )
+            return 0;
+
+        double difference = 0;
+        for ( uint32_t i = 0; i < 4; ++i ) {
+            float otherWeight = 0;
+            for ( uint32_t j = 0; j < 4; ++j ) {
+                if ( boneIndices[ b * 4 + j ] == boneIndices[ a * 4 + i ] ) {
+                    otherWeight = boneWeights[ b * 4 + j ];
+                    break;
+                }
+            }
+
+            difference += ( boneWeights[ a * 4 + i ] - otherWeight ) * ( boneWeights[ a * 4 + i ] - otherWeight );
+        }
+
+        for ( uint32_t j = 0; j < 4; ++j ) {
+            bool found = false;
+            for ( uint32_t i = 0; i < 4 && !found; ++i ) {
+                found = boneIndices[ b * 4 + j ] == boneIndices[ a * 4 + i ];
+            }
+
+            if ( false == found ) {
+                difference += boneWeights[ b * 4 + j ] * boneWeights[ b * 4 + j ];
+            }
+        }
+
+        return difference;
+    }
+
+    double AttributePenalty( uint32_t a, uint32_t b ) const {
+        return attributeScale * ( kNormalWeight * ( normals[ a ] - normals[ b ] ).LengthSquared( ) +
+                                  kTexcoordWeight * ( texcoords[ a ] - texcoords[ b ] ).LengthSquared( ) +
+                                  kBoneWeightWeight * BoneWeightDifference( a, b ) );
+    }
+};
+
+/**
+ * Accumulates the area weighted plane quadrics of the triangles.
+ **/
+void AccumulateQuadrics( const uint32_t* indices, uint32_t indexCount, const SimplificationVertices& v, std::vector< Quadric >& quadrics ) {
+    for ( uint32_t i = 0; i < indexCount; i += 3 ) {
+        const mathfu::vec3& p0 = v.positions[ indices[ i + 0 ] ];
+        const mathfu::vec3& p1 = v.positions[ indices[ i + 1 ] ];
+        const mathfu::vec3& p2 = v.positions[ indices[ i + 2 ] ];
+
+        mathfu::vec3 n    = mathfu::cross( p1 - p0, p2 - p0 );
+        const float  area = n.Length( );
+        if ( area <= 0.0f )
+            continue;
+
+        n /= area;
+        const double d = -mathfu::dot( n, p0 );
+        for ( uint32_t k = 0; k < 3; ++k ) {
+            quadrics[ indices[ i + k ] ].AddPlane( n, d, area * 0.5 );
+        }
+    }
+}
+
+/**
+ * Simplifies the triangle list in place.
+ * @param indices The triangle list to simplify.
+ * @param indexCount The number of indices.
+ * @param targetIndexCount The index count to reduce the list to (if possible).
+ * @param v The vertex data.
+ * @param quadrics The quadrics of the original triangles per vertex, the quadrics of the collapsed vertices
+ *                 are added to their targets (kept across the LOD chain).
+ * @param collapseTargets The vertex of the simplified triangles, that replaces the original vertex,
+ *                        updated with the performed collapses (kept across the LOD chain).
+ * @return The resulting index count.
+ **/
+uint32_t SimplifyTriangles( uint32_t*                     indices,
+                            uint32_t                      indexCount,
+                            uint32_t                      targetIndexCount,
+                            const SimplificationVertices& v,
+                            std::vector< Quadric >&       quadrics,
+                            std::vector< uint32_t >&      collapseTargets ) {
+    const uint32_t vertexCount = (uint32_t) v.positions.size( );
+
+    /* Lock the vertices on the subset boundaries and on the attribute seams
+       (the vertices that share the position with the other used vertices). */
+
+    std::vector< bool >     locked( vertexCount, false );
+    std::vector< uint32_t > positionOwners( vertexCount, kInvalidIndex );
+    for ( uint32_t i = 0; i < indexCount; ++i ) {
+        const uint32_t vertex = indices[ i ];
+        uint32_t&      owner  = positionOwners[ v.positionIds[ vertex ] ];
+        if ( v.sharedPositions[ v.positionIds[ vertex ] ] ) {
+            locked[ vertex ] = true;
+        }
+
+        if ( kInvalidIndex == owner ) {
+            owner = vertex;
+        } else if ( owner != vertex ) {
+            locked[ owner ]  = true;
+            locked[ vertex ] = true;
+        }
+    }
+
+    for ( uint32_t i = 0; i < indexCount; ++i ) {
+        if ( locked[ positionOwners[ v.positionIds[ indices[ i ] ] ] ] ) {
+            locked[ indices[ i ] ] = true;
+        }
+    }
+
+    /* Lock the vertices on the open and non-manifold edges (in the position topology). */
+
+    std::unordered_map< uint64_t, uint32_t > edgeCounts;
+    edgeCounts.reserve( indexCount );
+    for ( uint32_t i = 0; i < indexCount; i += 3 ) {
+        for ( uint32_t e = 0; e < 3; ++e ) {
+            const uint64_t a = v.positionIds[ indices[ i + e ] ];
+            const uint64_t b = v.positionIds[ indices[ i + ( e + 1 ) % 3 ] ];
+            ++edgeCounts[ std::min( a, b ) << 32 | std::max( a, b ) ];
+        }
+    }
+
+    for ( uint32_t i = 0; i < indexCount; i += 3 ) {
+        for ( uint32_t e = 0; e < 3; ++e ) {
+            const uint64_t a = v.positionIds[ indices[ i + e ] ];
+            const uint64_t b = v.positionIds[ indices[ i + ( e + 1 ) % 3 ] ];
+            if ( 2 != edgeCounts[ std::min( a, b ) << 32 | std::max( a, b ) ] ) {
+                locked[ indices[ i + e ] ]             = true;
+                locked[ indices[ i + ( e + 1 ) % 3 ] ] = true;
+            }
+        }
+    }
+
+    std::vector< uint32_t > adjacencyOffsets( vertexCount + 1 );
+    std::vector< uint32_t > adjacency;
+    std::vector< uint32_t > bestTargets( vertexCount );
+    std::vector< double >   bestCosts( vertexCount );
+    std::vector< uint32_t > candidates;
+    std::vector< uint32_t > collapseRemap( vertexCount );
+    std::vector< bool >     dirty( vertexCount );
+
+    while ( indexCount > targetIndexCount ) {
+
+        /* Build vertex to triangle adjacency. */
+
+        std::fill( adjacencyOffsets.begin( ), adjacencyOffsets.end( ), 0 );
+        for ( uint32_t i = 0; i < indexCount; ++i ) {
+            ++adjacencyOffsets[ indices[ i ] + 1 ];
+        }
+
+        for ( uint32_t i = 0; i < vertexCount; ++i ) {
+            adjacencyOffsets[ i + 1 ] += adjacencyOffsets[ i ];
+        }
+
+        adjacency.resize( indexCount );
+        std::vector< uint32_t > adjacencyFill( adjacencyOffsets.begin( ), adjacencyOffsets.end( ) - 1 );
+        for ( uint32_t i = 0; i < indexCount; ++i ) {
+            adjacency[ adjacencyFill[ indices[ i ] ]++ ] = i / 3;
+        }
+
+        /* Find the cheapest collapse for each unlocked vertex. */
+
+        std::fill( bestTargets.begin( ), bestTargets.end( ), kInvalidIndex );
+        for ( uint32_t i = 0; i < indexCount; i += 3 ) {
+            for ( uint32_t e = 0; e < 3; ++e ) {
+                for ( uint32_t dir = 0; dir < 2; ++dir ) {
+                    const uint32_t from = indices[ i + ( dir ? e : ( e + 1 ) % 3 ) ];
+                    const uint32_t to   = indices[ i + ( dir ? ( e + 1 ) % 3 : e ) ];
+                    if ( locked[ from ] || from == to )
+                        continue;
+
+                    const double cost = quadrics[ from ].Error( v.positions[ to ] ) + v.AttributePenalty( from, to );
+                    if ( kInvalidIndex == bestTargets[ from ] || cost < bestCosts[ from ] ) {
+                        bestTargets[ from ] = to;
+                        bestCosts[ from ]   = cost;
+                    }
+                }
+            }
+        }
+
+        candidates.clear( );
+        for ( uint32_t i = 0; i < vertexCount; ++i ) {
+            if ( kInvalidIndex != bestTargets[ i ] ) {
+                candidates.push_back( i );
+            }
+        }
+
+        std::stable_sort( candidates.begin( ), candidates.end( ), [&]( uint32_t a, uint32_t b ) {
+            return bestCosts[ a ] < bestCosts[ b ];
+        } );
+
+        /* Perform the independent collapses (the triangles around the collapsed vertices do not overlap)
+           in the order of their costs until the target triangle count is reached. */
+
+        for ( uint32_t i = 0; i < vertexCount; ++i ) {
+            collapseRemap[ i ] = i;
+        }
+
+        std::fill( dirty.begin( ), dirty.end( ), false );
+
+        const uint32_t trianglesToRemove = ( indexCount - targetIndexCount ) / 3;
+        uint32_t       removedTriangles  = 0;
+        uint32_t       collapseCount     = 0;
+
+        for ( const uint32_t from : candidates ) {
+            if ( removedTriangles >= trianglesToRemove )
+                break;
+
+            const uint32_t to = bestTargets[ from ];
+            if ( dirty[ from ] || dirty[ to ] )
+                continue;
+
+            /* Reject the collapses that flip or degenerate the remaining triangles. */
+
+            bool     flips     = false;
+            uint32_t collapsed = 0;
+            for ( uint32_t a = adjacencyOffsets[ from ]; a < adjacencyOffsets[ from + 1 ] && !flips; ++a ) {
+                const uint32_t* triangle = indices + adjacency[ a ] * 3;
+                if ( triangle[ 0 ] == to || triangle[ 1 ] == to || triangle[ 2 ] == to ) {
+                    ++collapsed;
+                    continue;
+                }
+
+                const uint32_t k  = triangle[ 0 ] == from ? 0 : triangle[ 1 ] == from ? 1 : 2;
+                const auto&    p1 = v.positions[ triangle[ ( k + 1 ) % 3 ] ];
+                const auto&    p2 = v.positions[ triangle[ ( k + 2 ) % 3 ] ];
+
+                const mathfu::vec3 n0 = mathfu::cross( p1 - v.positions[ from ], p2 - v.positions[ from ] );
+                const mathfu::vec3 n1 = mathfu::cross( p1 - v.positions[ to ], p2 - v.positions[ to ] );
+                flips = mathfu::dot( n0, n1 ) <= kMinFlipDot * n0.Length( ) * n1.Length( );
+            }
+
+            if ( flips )
+                continue;
+
+            for ( uint32_t a = adjacencyOffsets[ from ]; a < adjacencyOffsets[ from + 1 ]; ++a ) {
+                const uint32_t* triangle = indices + adjacency[ a ] * 3;
+                dirty[ triangle[ 0 ] ]   = true;
+                dirty[ triangle[ 1 ] ]   = true;
+                dirty[ triangle[ 2 ] ]   = true;
+            }
+
+            quadrics[ to ].Add( quadrics[ from ] );
+            collapseRemap[ from ] = to;
+            removedTriangles += collapsed;
+            ++collapseCount;
+        }
+
+        if ( 0 == collapseCount )
+            break;
+
+        /* The targets are never collapsed in the same pass (they are dirty), so one remap step is enough. */
+
+        for ( uint32_t& target : collapseTargets ) {
+            target = collapseRemap[ target ];
+        }
+
+        /* Apply the collapses and remove the degenerate triangles. */
+
+        uint32_t writeIndex = 0;
+        for ( uint32_t i = 0; i < indexCount; i += 3 ) {
+            const uint32_t a = collapseRemap[ indices[ i + 0 ] ];
+            const uint32_t b = collapseRemap[ indices[ i + 1 ] ];
+            const uint32_t c = collapseRemap[ indices[ i + 2 ] ];
+            if ( a != b && b != c && c != a ) {
+                indices[ writeIndex++ ] = a;
+                indices[ writeIndex++ ] = b;
+                indices[ writeIndex++ ] = c;
+            }
+        }
+
+        indexCount = writeIndex;
+    }
+
+    return indexCount;
+}
+
+/**
+ * @return The distance from the point to the triangle (Ericson, "Real-Time Collision Detection", 5.1.5).
+ **/
+float PointTriangleDistance( const mathfu::vec3& p, const mathfu::vec3& a, const mathfu::vec3& b, const mathfu::vec3& c ) {
+    const mathfu::vec3 ab = b - a;
+    const mathfu::vec3 ac = c - a;
+    const mathfu::vec3 ap = p - a;
+
+    const float d1 = mathfu::dot( ab, ap );
+    const float d2 = mathfu::dot( ac, ap );
+    if ( d1 <= 0.0f && d2 <= 0.0f )
+        return ap.Length( );
+
+    const mathfu::vec3 bp = p - b;
+    const float        d3 = mathfu::dot( ab, bp );
+    const float        d4 = mathfu::dot( ac, bp );
+    if ( d3 >= 0.0f && d4 <= d3 )
+        return bp.Length( );
+
+    const float vc = d1 * d4 - d3 * d2;
+    if ( vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f )
+        return ( ap - ab * ( d1 / ( d1 - d3 ) ) ).Length( );
+
+    const mathfu::vec3 cp = p - c;
+    const float        d5 = mathfu::dot( ab, cp );
+    const float        d6 = mathfu::dot( ac, cp );
+    if ( d6 >= 0.0f && d5 <= d6 )
+        return cp.Length( );
+
+    const float vb = d5 * d2 - d1 * d6;
+    if ( vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f )
+        return ( ap - ac * ( d2 / ( d2 - d6 ) ) ).Length( );
+
+    const float va = d3 * d6 - d5 * d4;
+    if ( va <= 0.0f && ( d4 - d3 ) >= 0.0f && ( d5 - d6 ) >= 0.0f )
+        return ( bp - ( c - b ) * ( ( d4 - d3 ) / ( ( d4 - d3 ) + ( d5 - d6 ) ) ) ).Length( );
+
+    const float denom = va + vb + vc;
+    if ( denom <= 0.0f )
+        return std::min( ap.Length( ), std::min( bp.Length( ), cp.Length( ) ) );
+
+    const float v = vb / denom;
+    const float w = vc / denom;
+    return ( ap - ab * v - ac * w ).Length( );
+}
+
+/**
+ * Measures the distance error of the LOD against the original mesh (in mesh units), the larger one of:
+ *  - The maximum distance from the collapse targets to the planes of the original triangles they replace
+ *    (the maximum instead of the weighted average of the quadric error).
+ *  - The maximum distance from the original vertices to the LOD triangles around their collapse targets
+ *    (the LOD surface is not farther than that).
+ * @param originalIndices The triangles of the original mesh.
+ * @param lodIndices The triangles of the LOD.
+ * @param collapseTargets The vertex of the LOD, that replaces the original vertex.
+ **/
+float MeasureLodError( const std::vector< uint32_t >& originalIndices,
+                       const std::vector< uint32_t >& lodIndices,
+                       const SimplificationVertices&  v,
+                       const std::vector< uint32_t >& collapseTargets ) {
+    const uint32_t vertexCount = (uint32_t) v.positions.size( );
+
+    float maxError = 0.0f;
+    for ( uint32_t i = 0; i < originalIndices.size( ); i += 3 ) {
+        const mathfu::vec3& p0 = v.positions[ originalIndices[ i + 0 ] ];
+        const mathfu::vec3& p1 = v.positions[ originalIndices[ i + 1 ] ];
+        const mathfu::vec3& p2 = v.positions[ originalIndices[ i + 2 ] ];
+
+        mathfu::vec3 n    = mathfu::cross( p1 - p0, p2 - p0 );
+        const float  area = n.Length( );
+        if ( area <= 0.0f )
+            continue;
+
+        n /= area;
+        for ( uint32_t k = 0; k < 3; ++k ) {
+            const mathfu::vec3& target = v.positions[ collapseTargets[ originalIndices[ i + k ] ] ];
+            maxError                   = std::max( maxError, fabsf( mathfu::dot( n, target - p0 ) ) );
+        }
+    }
+
+    /* LOD triangles around the vertices. */
+
+    std::vector< uint32_t > adjacencyOffsets( vertexCount + 1, 0 );
+    for ( const uint32_t index : lodIndices ) {
+        ++adjacencyOffsets[ index + 1 ];
+    }
+
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        adjacencyOffsets[ i + 1 ] += adjacencyOffsets[ i ];
+    }
+
+    std::vector< uint32_t > adjacency( lodIndices.size( ) );
+    std::vector< uint32_t > adjacencyFill( adjacencyOffsets.begin( ), adjacencyOffsets.end( ) - 1 );
+    for ( uint32_t i = 0; i < lodIndices.size( ); ++i ) {
+        adjacency[ adjacencyFill[ lodIndices[ i ] ]++ ] = i / 3;
+    }
+
+    std::vector< bool > measured( vertexCount, false );
+    for ( const uint32_t vertex : originalIndices ) {
+        const uint32_t target = collapseTargets[ vertex ];
+        if ( measured[ vertex ] || vertex == target || adjacencyOffsets[ target ] == adjacencyOffsets[ target + 1 ] )
+            continue;
+
+        measured[ vertex ] = true;
+
+        float distance = std::numeric_limits< float >::max( );
+        for ( uint32_t a = adjacencyOffsets[ target ]; a < adjacencyOffsets[ target + 1 ]; ++a ) {
+            const uint32_t* triangle = lodIndices.data( ) + adjacency[ a ] * 3;
+            distance                 = std::min( distance,
+                                 PointTriangleDistance( v.positions[ vertex ],
+                                                        v.positions[ triangle[ 0 ] ],
+                                                        v.positions[ triangle[ 1 ] ],
+                                                        v.positions[ triangle[ 2 ] ] ) );
+        }
+
+        maxError = std::max( maxError, distance );
+    }
+
+    return maxError;
+}
+
+//
+// See implementation in fbxpmeshopt.cpp.
+//
+
+void OptimizeVertexCache( uint32_t* indices, uint32_t indexCount, uint32_t vertexCount );
+
+/**
+ * Generates the LOD chain, the LOD index ranges are appended to the indices,
+ * the LOD subsets are appended to the mesh subsets (each LOD has the same number of subsets as the original mesh).
+ * @param m The mesh to take the subsets from.
+ * @param meshName The mesh name for logging.
+ * @param indices The mesh indices.
+ * @param vertices The unpacked vertices (StaticVertex or StaticSkinnedVertex layout).
+ * @param vertexStride The vertex stride in bytes.
+ * @param vertexCount The number of vertices.
+ * @param skinned True for the StaticSkinnedVertex layout.
+ * @param lodCount Maximum number of the LODs to generate (excluding the original mesh).
+ * @param lodRatio Triangle count ratio between the neighbouring LODs.
+ * @param lodErrors The distance error (in mesh units) of each generated LOD against the original mesh (see MeasureLodError).
+ **/
+void GenerateLods( apemode::Mesh&           m,
+                   const char*              meshName,
+                   std::vector< uint32_t >& indices,
+                   const uint8_t*           vertices,
+                   uint32_t                 vertexStride,
+                   uint32_t                 vertexCount,
+                   bool                     skinned,
+                   uint32_t                 lodCount,
+                   float                    lodRatio,
+                   std::vector< float >&    lodErrors ) {
+    auto& s = apemode::Get( );
+
+    lodErrors.clear( );
+    if ( 0 == lodCount || lodRatio <= 0.0f || lodRatio >= 1.0f ) {
+        return;
+    }
+
+    SimplificationVertices v;
+    v.positions.reserve( vertexCount );
+    v.normals.reserve( vertexCount );
+    v.texcoords.reserve( vertexCount );
+
+    mathfu::vec3 positionMin( std::numeric_limits< float >::max( ) );
+    mathfu::vec3 positionMax( std::numeric_limits< float >::lowest( ) );
+
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        const float* vertex = reinterpret_cast< const float* >( vertices + i * vertexStride );
+        v.positions.emplace_back( vertex );
+        v.normals.emplace_back( vertex + 3 );
+        v.texcoords.emplace_back( vertex + 10 );
+        positionMin = mathfu::min( positionMin, v.positions.back( ) );
+        positionMax = mathfu::max( positionMax, v.positions.back( ) );
+
+        if ( skinned ) {
+            v.boneWeights.insert( v.boneWeights.end( ), vertex + 12, vertex + 16 );
+            v.boneIndices.insert( v.boneIndices.end( ), vertex + 16, vertex + 20 );
+        }
+    }
+
+    /* The attribute penalties are relative to the mesh extent. */
+
+    v.attributeScale = vertexCount ? ( positionMax - positionMin ).LengthSquared( ) : 1.0;
+
+    /* Vertices with the same position are identified by the first one of them. */
+
+    std::vector< uint32_t > sortedVertices( vertexCount );
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        sortedVertices[ i ] = i;
+    }
+
+    std::sort( sortedVertices.begin( ), sortedVertices.end( ), [&]( uint32_t a, uint32_t b ) {
+        const mathfu::vec3& pa = v.positions[ a ];
+        const mathfu::vec3& pb = v.positions[ b ];
+        return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z != pb.z ? pa.z < pb.z : a < b;
+    } );
+
+    v.positionIds.resize( vertexCount );
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        const uint32_t vertex = sortedVertices[ i ];
+        const uint32_t prev   = i ? sortedVertices[ i - 1 ] : vertex;
+        const bool     same   = i && v.positions[ vertex ].x == v.positions[ prev ].x &&
+                          v.positions[ vertex ].y == v.positions[ prev ].y && v.positions[ vertex ].z == v.positions[ prev ].z;
+        v.positionIds[ vertex ] = same ? v.positionIds[ prev ] : vertex;
+    }
+
+    /* Vertices on the subset boundaries are locked to avoid cracks between the subsets. */
+
+    const uint32_t subsetCount    = (uint32_t) m.subsets.size( );
+    uint32_t       prevIndexCount = 0;
+
+    std::vector< uint32_t > positionSubsets( vertexCount, kInvalidIndex );
+    v.sharedPositions.resize( vertexCount, false );
+
+    for ( uint32_t ss = 0; ss < subsetCount; ++ss ) {
+        const auto& subset = m.subsets[ ss ];
+        for ( uint32_t i = subset.base_index( ); i < subset.base_index( ) + subset.index_count( ); ++i ) {
+            uint32_t& positionSubset = positionSubsets[ v.positionIds[ indices[ i ] ] ];
+            if ( kInvalidIndex == positionSubset ) {
+                positionSubset = ss;
+            } else if ( positionSubset != ss ) {
+                v.sharedPositions[ v.positionIds[ indices[ i ] ] ] = true;
+            }
+        }
+
+        prevIndexCount += subset.index_count( );
+    }
+
+    const uint32_t originalIndexCount = prevIndexCount;
+    float          targetRatio        = 1.0f;
+
+    /* The quadrics of the original triangles and the collapse targets of the original vertices are kept across
+       the chain, so every LOD is simplified and measured against the original mesh. */
+
+    std::vector< uint32_t > originalIndices;
+    originalIndices.reserve( originalIndexCount );
+    for ( uint32_t ss = 0; ss < subsetCount; ++ss ) {
+        const auto& subset = m.subsets[ ss ];
+        originalIndices.insert( originalIndices.end( ),
+                                indices.begin( ) + subset.base_index( ),
+                                indices.begin( ) + subset.base_index( ) + subset.index_count( ) );
+    }
+
+    std::vector< Quadric > quadrics( vertexCount );
+    AccumulateQuadrics( originalIndices.data( ), (uint32_t) originalIndices.size( ), v, quadrics );
+
+    std::vector< uint32_t > collapseTargets( vertexCount );
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        collapseTargets[ i ] = i;
+    }
+
+    for ( uint32_t lod = 1; lod <= lodCount; ++lod ) {
+        targetRatio *= lodRatio;
+
+        const uint32_t prevBaseSubset = ( lod - 1 ) * subsetCount;
+        uint32_t       lodIndexCount  = 0;
+
+        std::vector< uint32_t > lodIndices;
+        std::vector< uint32_t > lodSubsetCounts( subsetCount );
+
+        for ( uint32_t ss = 0; ss < subsetCount; ++ss ) {
+            const auto& prevSubset = m.subsets[ prevBaseSubset + ss ];
+
+            const uint32_t originalCount = m.subsets[ ss ].index_count( );
+            const uint32_t targetCount   = std::max< uint32_t >( 3, uint32_t( originalCount * targetRatio ) / 3 * 3 );
+
+            lodIndices.insert( lodIndices.end( ),
+                               indices.begin( ) + prevSubset.base_index( ),
+                               indices.begin( ) + prevSubset.base_index( ) + prevSubset.index_count( ) );
+
+            uint32_t* subsetIndices = lodIndices.data( ) + lodIndexCount;
+            lodSubsetCounts[ ss ]   = SimplifyTriangles( subsetIndices, prevSubset.index_count( ), targetCount, v, quadrics, collapseTargets );
+
+            OptimizeVertexCache( subsetIndices, lodSubsetCounts[ ss ], vertexCount );
+
+            lodIndexCount += lodSubsetCounts[ ss ];
+            lodIndices.resize( lodIndexCount );
+        }
+
+        if ( lodIndexCount > prevIndexCount * kMinLodReduction ) {
+            s.console->info( "Mesh \"{}\" cannot be simplified further than LOD {} ({} triangles).",
+                             meshName,
+                             lod - 1,
+                             prevIndexCount / 3 );
+            break;
+        }
+
+        uint32_t baseIndex = (uint32_t) indices.size( );
+        indices.insert( indices.end( ), lodIndices.begin( ), lodIndices.end( ) );
+
+        for ( uint32_t ss = 0; ss < subsetCount; ++ss ) {
+            m.subsets.push_back( apemodefb::SubsetFb( m.subsets[ ss ].material_id( ), baseIndex, lodSubsetCounts[ ss ] ) );
+            baseIndex += lodSubsetCounts[ ss ];
+        }
+
+        const float lodError = MeasureLodError( originalIndices, lodIndices, v, collapseTargets );
+        lodErrors.push_back( std::max( lodError, lodErrors.empty( ) ? 0.0f : lodErrors.back( ) ) );
+        prevIndexCount = lodIndexCount;
+
+        s.console->info( "Mesh \"{}\" LOD {}: {} triangles ({:.1f}%), error {}.",
+                         meshName,
+                         lod,
+                         lodIndexCount / 3,
+                         100.0f * lodIndexCount / std::max< uint32_t >( originalIndexCount, 1 ),
+                         lodErrors.back( ) );
+    }
+}
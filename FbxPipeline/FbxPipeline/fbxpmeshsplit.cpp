@@ -0,0 +1,251 @@
+#include <fbxppch.h>
+#include <fbxpstate.h>
+
+/**
+ * Splitting of the meshes into the submeshes with 16-bit indices and/or the limited bone palettes.
+ * The triangles of every submesh (the original mesh and each LOD) are partitioned in their order (so the vertex
+ * cache and overdraw optimizations are preserved) into the parts, that reference at most maxPartVertices vertices
+ * and at most maxPartBones bones. Every part gets its own vertex range (the vertices shared between the parts are
+ * duplicated) and the indices relative to its base vertex. The subsets, that cross the part boundaries, are split
+ * between the parts. The bone indices of the part vertices are the indices in its bone palette.
+ * The meshlets are built after the split within the parts, so every meshlet uses the palette of its part.
+ **/
+
+static const uint32_t kInvalidIndex = 0xffffffff;
+
+/**
+ * Returns the bones (the indices in the skin links) that influence the unpacked skinned vertex.
+ **/
+uint32_t GetVertexBones( const apemodefb::StaticSkinnedVertexFb& vertex, uint32_t bones[ 4 ] ) {
+    const float weights[ 4 ] = {vertex.weights( ).x( ), vertex.weights( ).y( ), vertex.weights( ).z( ), vertex.weights( ).w( )};
+    const float indices[ 4 ] = {vertex.indices( ).x( ), vertex.indices( ).y( ), vertex.indices( ).z( ), vertex.indices( ).w( )};
+
+    uint32_t boneCount = 0;
+    for ( uint32_t b = 0; b < 4; ++b ) {
+        if ( weights[ b ] > 0.0f )
+            bones[ boneCount++ ] = (uint32_t) indices[ b ];
+    }
+
+    return boneCount;
+}
+
+/**
+ * Splits the submeshes of the mesh into the parts within the vertex and bone limits.
+ * @param indices The mesh indices (the submesh indices are relative to the base vertex), the indices of the parts
+ *                are written relative to their base vertices.
+ * @param vertexCount The vertex count, updated with the duplicated vertices.
+ * @param vertexStride The stride of the unpacked vertices (the bone palettes require the skinned ones).
+ * @param maxPartVertices The maximum vertex count of the part (0xffff for the 16-bit indices).
+ * @param maxPartBones The maximum bone palette size of the part, 0 to keep the skin bone indices.
+ * @param positions The unpacked vertex positions, updated with the duplicated vertices.
+ * @param vertexTags The tags of the vertices (empty without the blend shapes and the extra layout attributes),
+ *                   updated with the duplicated vertices.
+ * @param bonePalettes The concatenated bone palettes of the skin, the palettes of the parts are appended.
+ * @return True if the mesh was split.
+ **/
+bool SplitMesh( apemode::Mesh&               m,
+                const char*                  meshName,
+                std::vector< uint32_t >&     indices,
+                uint32_t&                    vertexCount,
+                uint32_t                     vertexStride,
+                uint32_t                     maxPartVertices,
+                uint32_t                     maxPartBones,
+                std::vector< mathfu::vec3 >& positions,
+                std::vector< uint32_t >&     vertexTags,
+                std::vector< uint16_t >&     bonePalettes ) {
+    auto& s = apemode::Get( );
+
+    if ( ( vertexCount < maxPartVertices && 0 == maxPartBones ) || m.submeshes.empty( ) )
+        return false;
+
+    assert( 0 == maxPartBones || sizeof( apemodefb::StaticSkinnedVertexFb ) == vertexStride );
+    auto getVertex = [&]( uint32_t v ) -> const apemodefb::StaticSkinnedVertexFb& {
+        return reinterpret_cast< const apemodefb::StaticSkinnedVertexFb* >( m.vertices.data( ) )[ v ];
+    };
+
+    std::vector< apemodefb::SubmeshFb > submeshes;
+    std::vector< apemodefb::SubsetFb >  subsets;
+    std::vector< uint8_t >              vertices;
+    std::vector< mathfu::vec3 >         partPositions;
+    std::vector< uint32_t >             partTags;
+    std::vector< uint32_t >             partIndices( indices );
+
+    /* The local index of the vertex in the current part. */
+    std::vector< uint32_t > localIndices( vertexCount, kInvalidIndex );
+    std::vector< uint32_t > partVertices;
+
+    /* The local index of the bone in the current part palette. */
+    std::vector< uint32_t > localBones;
+    std::vector< uint32_t > partBones;
+
+    for ( const auto& submesh : m.submeshes ) {
+        const uint32_t submeshBaseVertex = submesh.base_vertex( );
+        const uint32_t submeshEndIndex   = submesh.base_index( ) + submesh.index_count( );
+
+        const uint32_t subset            = submesh.base_subset( );
+        const uint32_t subsetEnd         = submesh.base_subset( ) + submesh.subset_count( );
+        uint32_t       partBaseIndex     = submesh.base_index( );
+
+        while ( partBaseIndex < submeshEndIndex || submeshEndIndex == submesh.base_index( ) ) {
+
+            /* Adds the triangles, while their vertices and bones fit into the part. */
+
+            uint32_t partEndIndex = partBaseIndex;
+            for ( ; partEndIndex < submeshEndIndex; partEndIndex += 3 ) {
+                uint32_t newVertexCount = 0;
+                uint32_t newBones[ 12 ];
+                uint32_t newBoneCount = 0;
+
+                for ( uint32_t k = 0; k < 3; ++k ) {
+                    const uint32_t v = submeshBaseVertex + indices[ partEndIndex + k ];
+                    if ( kInvalidIndex == localIndices[ v ] ) {
+                        bool repeated = false;
+                        for ( uint32_t j = 0; j < k; ++j )
+                            repeated |= indices[ partEndIndex + j ] == indices[ partEndIndex + k ];
+                        newVertexCount += repeated ? 0 : 1;
+                    }
+
+                    uint32_t vertexBones[ 4 ];
+                    const uint32_t vertexBoneCount = maxPartBones ? GetVertexBones( getVertex( v ), vertexBones ) : 0;
+                    for ( uint32_t b = 0; b < vertexBoneCount; ++b ) {
+                        if ( localBones.size( ) > vertexBones[ b ] && kInvalidIndex != localBones[ vertexBones[ b ] ] )
+                            continue;
+                        if ( std::find( newBones, newBones + newBoneCount, vertexBones[ b ] ) == newBones + newBoneCount )
+                            newBones[ newBoneCount++ ] = vertexBones[ b ];
+                    }
+                }
+
+                if ( partVertices.size( ) + newVertexCount > maxPartVertices )
+                    break;
+                if ( maxPartBones && partBones.size( ) + newBoneCount > maxPartBones )
+                    break;
+
+                for ( uint32_t b = 0; b < newBoneCount; ++b ) {
+                    if ( localBones.size( ) <= newBones[ b ] )
+                        localBones.resize( newBones[ b ] + 1, kInvalidIndex );
+                    localBones[ newBones[ b ] ] = (uint32_t) partBones.size( );
+                    partBones.push_back( newBones[ b ] );
+                }
+
+                for ( uint32_t k = 0; k < 3; ++k ) {
+                    const uint32_t v = submeshBaseVertex + indices[ partEndIndex + k ];
+                    if ( kInvalidIndex == localIndices[ v ] ) {
+                        localIndices[ v ] = (uint32_t) partVertices.size( );
+                        partVertices.push_back( v );
+                    }
+
+                    partIndices[ partEndIndex + k ] = localIndices[ v ];
+                }
+            }
+
+            /* The part vertices go one after another in the order of their first use. */
+
+            const uint32_t partBaseVertex = (uint32_t) ( vertices.size( ) / vertexStride );
+            vertices.resize( vertices.size( ) + partVertices.size( ) * vertexStride );
+            for ( uint32_t i = 0; i < partVertices.size( ); ++i ) {
+                const uint32_t v = partVertices[ i ];
+                memcpy( vertices.data( ) + size_t( partBaseVertex + i ) * vertexStride, m.vertices.data( ) + size_t( v ) * vertexStride, vertexStride );
+
+                if ( maxPartBones ) {
+                    /* The bones without influence get the first palette bone. */
+                    auto& vertex = reinterpret_cast< apemodefb::StaticSkinnedVertexFb* >( vertices.data( ) )[ partBaseVertex + i ];
+                    const auto& w = vertex.weights( );
+                    const auto& b = vertex.indices( );
+                    apemode::Mutable( vertex.mutable_indices( ) ) =
+                        apemodefb::vec4( w.x( ) > 0.0f ? (float) localBones[ (uint32_t) b.x( ) ] : 0.0f,
+                                         w.y( ) > 0.0f ? (float) localBones[ (uint32_t) b.y( ) ] : 0.0f,
+                                         w.z( ) > 0.0f ? (float) localBones[ (uint32_t) b.z( ) ] : 0.0f,
+                                         w.w( ) > 0.0f ? (float) localBones[ (uint32_t) b.w( ) ] : 0.0f );
+                }
+
+                partPositions.push_back( positions[ v ] );
+                if ( false == vertexTags.empty( ) )
+                    partTags.push_back( vertexTags[ v ] );
+
+                localIndices[ v ] = kInvalidIndex;
+            }
+
+            /* The subsets, that intersect the part, are clipped to it. */
+
+            const uint32_t partBaseSubset = (uint32_t) subsets.size( );
+            for ( uint32_t ss = subset; ss < subsetEnd; ++ss ) {
+                const uint32_t subsetBaseIndex = std::max( m.subsets[ ss ].base_index( ), partBaseIndex );
+                const uint32_t subsetEndIndex  = std::min( m.subsets[ ss ].base_index( ) + m.subsets[ ss ].index_count( ), partEndIndex );
+                if ( subsetBaseIndex < subsetEndIndex )
+                    subsets.emplace_back( m.subsets[ ss ].material_id( ), subsetBaseIndex, subsetEndIndex - subsetBaseIndex );
+                else if ( partBaseIndex == partEndIndex )
+                    subsets.emplace_back( m.subsets[ ss ].material_id( ), partBaseIndex, 0 );
+            }
+
+            /* The part bone palette is appended to the skin palettes. */
+
+            const uint32_t partBaseBone = (uint32_t) bonePalettes.size( );
+            for ( const uint32_t bone : partBones ) {
+                bonePalettes.push_back( (uint16_t) bone );
+                localBones[ bone ] = kInvalidIndex;
+            }
+
+            submeshes.emplace_back( submesh.bbox_min( ),
+                                    submesh.bbox_max( ),
+                                    submesh.position_offset( ),
+                                    submesh.position_scale( ),
+                                    submesh.uv_offset( ),
+                                    submesh.uv_scale( ),
+                                    partBaseVertex,
+                                    (uint32_t) partVertices.size( ),
+                                    partBaseIndex,
+                                    partEndIndex - partBaseIndex,
+                                    (uint16_t) partBaseSubset,
+                                    (uint16_t) ( subsets.size( ) - partBaseSubset ),
+                                    submesh.vertex_format( ),
+                                    submesh.vertex_stride( ),
+                                    submesh.lod_error( ),
+                                    submesh.position_bits_x( ),
+                                    submesh.position_bits_y( ),
+                                    submesh.position_bits_z( ),
+                                    maxPartBones ? partBaseBone : submesh.base_bone( ),
+                                    maxPartBones ? (uint16_t) partBones.size( ) : submesh.bone_count( ),
+                                    submesh.position_stream_offset( ),
+                                    submesh.attribute_stream_offset( ),
+                                    submesh.skin_stream_offset( ),
+                                    submesh.position_stream_stride( ),
+                                    submesh.attribute_stream_stride( ),
+                                    submesh.skin_stream_stride( ) );
+
+            partVertices.clear( );
+            partBones.clear( );
+            if ( partEndIndex == partBaseIndex )
+                break;
+
+            partBaseIndex = partEndIndex;
+        }
+    }
+
+    /* The submesh subset ranges are 16-bit. */
+
+    if ( subsets.size( ) > std::numeric_limits< uint16_t >::max( ) ) {
+        s.console->error( "Mesh \"{}\" cannot be split, {} subsets (the limits are too small).", meshName, subsets.size( ) );
+        return false;
+    }
+
+    /* The meshlets are built after the split (see ExportMesh). */
+    assert( m.meshlets.empty( ) );
+
+    s.console->info( "Mesh \"{}\" is split into {} submeshes ({} submeshes, {} vertices before, {} after, {} palette bones).",
+                     meshName,
+                     submeshes.size( ),
+                     m.submeshes.size( ),
+                     vertexCount,
+                     vertices.size( ) / vertexStride,
+                     maxPartBones );
+
+    vertexCount = (uint32_t) ( vertices.size( ) / vertexStride );
+    indices.swap( partIndices );
+    m.vertices.swap( vertices );
+    positions.swap( partPositions );
+    if ( false == vertexTags.empty( ) )
+        vertexTags.swap( partTags );
+    m.submeshes.swap( submeshes );
+    m.subsets.swap( subsets );
+    return true;
+}
@@ -0,0 +1,206 @@
+#include <fbxppch.h>
+#include <fbxpstate.h>
+#include <CityHash.h>
+#include <array>
+
+/**
+ * Splitting of the interleaved vertices into the streams (--split-streams option).
+ * The vertex buffer becomes the concatenation of the position stream (the tightly packed positions for the depth
+ * and shadow passes), the attribute stream (the normals, tangents and texcoords) and the skin stream (the bone
+ * weights and indices, skinned formats only). All the vertex formats start with the position and end with the skin
+ * components, so the streams are the byte ranges of the interleaved vertex.
+ * The depth passes can also use the position-only index buffer, that ignores the normal and texcoord seams.
+ **/
+
+/**
+ * Returns the position and skin component sizes of the mesh vertex format.
+ **/
+void GetVertexStreamSizes( const apemode::Mesh& m, uint32_t& positionSize, uint32_t& skinSize ) {
+    switch ( m.submeshes[ 0 ].vertex_format( ) ) {
+        case apemodefb::EVertexFormat_Static:
+            positionSize = sizeof( apemodefb::vec3 );
+            skinSize     = 0;
+            break;
+        case apemodefb::EVertexFormat_StaticSkinned:
+            positionSize = sizeof( apemodefb::vec3 );
+            skinSize     = sizeof( apemodefb::vec4 ) * 2;
+            break;
+        case apemodefb::EVertexFormat_PackedSkinned:
+        case apemodefb::EVertexFormat_PackedSkinnedOctahedral:
+        case apemodefb::EVertexFormat_PackedSkinnedQTangent:
+            positionSize = sizeof( uint32_t );
+            skinSize     = sizeof( uint32_t ) * 2;
+            break;
+        case apemodefb::EVertexFormat_Custom: {
+            /* The position is the first attribute, the bone indices and weights are the last ones. */
+            const uint32_t vertexStride = m.submeshes[ 0 ].vertex_stride( );
+            uint32_t       skinOffset   = vertexStride;
+            positionSize                = vertexStride;
+            for ( const auto& attribute : m.vertexAttributes ) {
+                if ( apemodefb::EVertexSemanticFb_Position != attribute.semantic( ) )
+                    positionSize = std::min< uint32_t >( positionSize, attribute.offset( ) );
+                if ( apemodefb::EVertexSemanticFb_BoneIndices == attribute.semantic( ) ||
+                     apemodefb::EVertexSemanticFb_BoneWeights == attribute.semantic( ) )
+                    skinOffset = std::min< uint32_t >( skinOffset, attribute.offset( ) );
+            }
+            skinSize = vertexStride - skinOffset;
+        } break;
+        default:
+            positionSize = sizeof( uint32_t );
+            skinSize     = 0;
+            break;
+    }
+}
+
+/**
+ * Splits the interleaved vertices of the mesh into the streams.
+ * The stream offsets and strides are written to all the submeshes (they share the vertex buffer).
+ **/
+void SplitVertexStreams( apemode::Mesh& m, const char* meshName ) {
+    auto& s = apemode::Get( );
+
+    if ( m.submeshes.empty( ) || m.vertices.empty( ) )
+        return;
+
+    uint32_t positionSize = 0;
+    uint32_t skinSize     = 0;
+    GetVertexStreamSizes( m, positionSize, skinSize );
+
+    const uint32_t vertexStride  = m.submeshes[ 0 ].vertex_stride( );
+    const uint32_t attributeSize = vertexStride - positionSize - skinSize;
+    const uint32_t vertexCount   = uint32_t( m.vertices.size( ) / vertexStride );
+
+    const uint32_t positionOffset  = 0;
+    const uint32_t attributeOffset = positionOffset + vertexCount * positionSize;
+    const uint32_t skinOffset      = attributeOffset + vertexCount * attributeSize;
+
+    std::vector< uint8_t > streams( m.vertices.size( ) );
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        const uint8_t* vertex = m.vertices.data( ) + size_t( i ) * vertexStride;
+        memcpy( streams.data( ) + positionOffset + size_t( i ) * positionSize, vertex, positionSize );
+        memcpy( streams.data( ) + attributeOffset + size_t( i ) * attributeSize, vertex + positionSize, attributeSize );
+        memcpy( streams.data( ) + skinOffset + size_t( i ) * skinSize, vertex + positionSize + attributeSize, skinSize );
+    }
+
+    m.vertices.swap( streams );
+
+    for ( auto& submesh : m.submeshes ) {
+        assert( vertexStride == submesh.vertex_stride( ) );
+        submesh.mutate_position_stream_offset( positionOffset );
+        submesh.mutate_attribute_stream_offset( attributeOffset );
+        submesh.mutate_skin_stream_offset( skinSize ? skinOffset : 0 );
+        submesh.mutate_position_stream_stride( (uint16_t) positionSize );
+        submesh.mutate_attribute_stream_stride( (uint16_t) attributeSize );
+        submesh.mutate_skin_stream_stride( (uint16_t) skinSize );
+    }
+
+    s.console->info( "Mesh \"{}\" vertex streams: position {} bytes, attributes {} bytes, skin {} bytes per vertex.",
+                     meshName,
+                     positionSize,
+                     attributeSize,
+                     skinSize );
+}
+
+/**
+ * Builds the position-only index buffer (--position-indices option) for the depth and shadow passes.
+ * The vertices of every submesh vertex range are welded by their position components (and skin components for the
+ * skinned formats, the bone palettes are per submesh), so the normal and texcoord seams do not split the geometry.
+ * The position indices reference the first vertex with the same components, they are relative to the submesh base
+ * vertex and have the same index type as the main indices.
+ * @param indices The final indices (relative to the submesh base vertices).
+ **/
+void BuildPositionIndices( apemode::Mesh& m, const char* meshName, const std::vector< uint32_t >& indices ) {
+    static const uint32_t kInvalidIndex = 0xffffffff;
+
+    auto& s = apemode::Get( );
+
+    if ( m.submeshes.empty( ) || m.vertices.empty( ) || indices.empty( ) )
+        return;
+
+    uint32_t positionSize = 0;
+    uint32_t skinSize     = 0;
+    GetVertexStreamSizes( m, positionSize, skinSize );
+
+    const uint32_t vertexStride = m.submeshes[ 0 ].vertex_stride( );
+    const uint32_t vertexCount  = uint32_t( m.vertices.size( ) / vertexStride );
+
+    auto getKey = [&]( uint32_t v, std::array< uint8_t, 64 >& key ) {
+        const uint8_t* vertex = m.vertices.data( ) + size_t( v ) * vertexStride;
+        memcpy( key.data( ), vertex, positionSize );
+        memcpy( key.data( ) + positionSize, vertex + vertexStride - skinSize, skinSize );
+    };
+
+    /* The submeshes share the vertex ranges (the LODs) or have the disjoint ones (the split meshes). */
+
+    std::vector< uint32_t > remap( vertexCount, kInvalidIndex );
+    std::vector< uint32_t > slots;
+    std::array< uint8_t, 64 > key;
+    std::array< uint8_t, 64 > weldedKey;
+    key.fill( 0 );
+    weldedKey.fill( 0 );
+
+    /* The largest key is 48 bytes, the f32x4 position, bone indices and weights of the custom layout (see GetVertexStreamSizes). */
+    assert( positionSize + skinSize <= key.size( ) );
+
+    uint32_t weldedVertexCount = 0;
+    for ( const auto& submesh : m.submeshes ) {
+        const uint32_t baseVertex = submesh.base_vertex( );
+        const uint32_t rangeCount = submesh.vertex_count( );
+        if ( 0 == rangeCount || kInvalidIndex != remap[ baseVertex ] )
+            continue;
+
+        /* Open addressing with linear probing, the load factor is kept below 2/3 (see WeldVertices). */
+        uint32_t slotCount = 1;
+        while ( slotCount < rangeCount + rangeCount / 2 ) {
+            slotCount <<= 1;
+        }
+
+        slots.assign( slotCount, kInvalidIndex );
+        for ( uint32_t v = baseVertex; v < baseVertex + rangeCount; ++v ) {
+            getKey( v, key );
+
+            uint32_t slot = (uint32_t) apemode::CityHash64( (const char*) key.data( ), positionSize + skinSize ) & ( slotCount - 1 );
+            for ( ;; ) {
+                const uint32_t weldedIndex = slots[ slot ];
+
+                if ( kInvalidIndex == weldedIndex ) {
+                    slots[ slot ] = v;
+                    remap[ v ]    = v;
+                    ++weldedVertexCount;
+                    break;
+                }
+
+                getKey( weldedIndex, weldedKey );
+                if ( 0 == memcmp( key.data( ), weldedKey.data( ), positionSize + skinSize ) ) {
+                    remap[ v ] = weldedIndex;
+                    break;
+                }
+
+                slot = ( slot + 1 ) & ( slotCount - 1 );
+            }
+        }
+    }
+
+    /* The position indices of the submesh index ranges (the indices outside the submeshes are copied). */
+
+    std::vector< uint32_t > positionIndices( indices );
+    for ( const auto& submesh : m.submeshes ) {
+        const uint32_t baseVertex = submesh.base_vertex( );
+        for ( uint32_t i = submesh.base_index( ); i < submesh.base_index( ) + submesh.index_count( ); ++i ) {
+            positionIndices[ i ] = remap[ baseVertex + indices[ i ] ] - baseVertex;
+        }
+    }
+
+    const uint32_t indexSize = apemodefb::EIndexTypeFb_UInt16 == m.indexType ? 2 : 4;
+    m.positionIndices.resize( positionIndices.size( ) * indexSize );
+    for ( size_t i = 0; i < positionIndices.size( ); ++i ) {
+        if ( 2 == indexSize ) {
+            const uint16_t index = (uint16_t) positionIndices[ i ];
+            memcpy( m.positionIndices.data( ) + i * 2, &index, 2 );
+        } else {
+            memcpy( m.positionIndices.data( ) + i * 4, &positionIndices[ i ], 4 );
+        }
+    }
+
+    s.console->info( "Mesh \"{}\" position indices reference {} vertices ({} vertices).", meshName, weldedVertexCount, vertexCount );
+}
@@ -4,6 +4,8 @@
 
 void InitializeSeachLocations( );
 void ExportMesh( FbxNode* node, apemode::Node& n, bool pack, bool optimize );
+void ExportMeshes( );
+void InstanceMeshes( );
 void ExportMaterials( FbxScene* scene );
 void ExportMaterials( FbxNode* node, apemode::Node& n );
 void ExportTransform( FbxNode* node, apemode::Node& n );
@@ -53,7 +55,7 @@ uint32_t ExportNode( FbxNode* node ) {
 /**
  * Preprocess scene with Fbx tools:
  * FbxGeometryConverter > Remove bad polygons
- *                      > Triangulate
+ *                      > Triangulate (--sdk-triangulation option, the meshes are triangulated in ExportMeshes otherwise)
  *                      > Split meshes per material
  **/
 void PreprocessMeshes( FbxScene* scene ) {
@@ -61,12 +63,14 @@ void PreprocessMeshes( FbxScene* scene ) {
 
     FbxGeometryConverter geometryConverter( s.manager );
 
-    s.console->info( "Triangulating..." );
-    if ( false == geometryConverter.Triangulate( s.scene, true ) ) {
-        s.console->warn( "Triangulation failed for some nodes." );
-        s.console->warn( "Nodes that failed triangulation will be detected in mesh exporting stage." );
-    } else {
-        s.console->info( "Triangulation succeeded for all nodes." );
+    if ( s.sdkTriangulation ) {
+        s.console->info( "Triangulating..." );
+        if ( false == geometryConverter.Triangulate( s.scene, true ) ) {
+            s.console->warn( "Triangulation failed for some nodes." );
+            s.console->warn( "Nodes that failed triangulation will be detected in mesh exporting stage." );
+        } else {
+            s.console->info( "Triangulation succeeded for all nodes." );
+        }
     }
 
     // FbxArray< FbxNode* > affectedNodes;
@@ -174,4 +178,10 @@ void ExportScene( FbxScene* scene ) {
 
     // Export nodes recursively.
     ExportNode( scene->GetRootNode( ) );
+
+    // Process the collected meshes (in parallel if requested).
+    ExportMeshes( );
+
+    // Merge the same meshes and collect the mesh instances.
+    InstanceMeshes( );
 }
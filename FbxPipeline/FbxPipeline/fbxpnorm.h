@@ -27,6 +27,11 @@ namespace apemode {
         typedef uint8_t type;
     };
 
+    template <>
+    struct ChooseUint< 9 > {
+        typedef uint16_t type;
+    };
+
     template <>
     struct ChooseUint< 10 > {
         typedef uint16_t type;
@@ -112,11 +112,41 @@ static_assert( sizeof( UIntPack_8_8_8_8 ) == sizeof( uint32_t ), "Must match" );
 static_assert( sizeof( UIntPack_10_10_10_2 ) == sizeof( uint32_t ), "Must match" );
 static_assert( sizeof( UIntPack_16_16 ) == sizeof( uint32_t ), "Must match" );
 
+/**
+ * Maps the position to [0; 1] range within the bounds.
+ **/
+inline mathfu::vec3 PositionToUnit( const mathfu::vec3 position, const mathfu::vec3 positionMin, const mathfu::vec3 positionMax ) {
+    const mathfu::vec3 positionSize = positionMax - positionMin;
+    return ( position - positionMin ) / positionSize;
+}
+
+/**
+ * Maps the texcoords to [0; 1] range within the bounds.
+ **/
+inline mathfu::vec2 TexcoordToUnit( const mathfu::vec2 texcoord, const mathfu::vec2 texcoordMin, const mathfu::vec2 texcoordMax ) {
+    const mathfu::vec2 texcoordSize = texcoordMax - texcoordMin;
+    return ( texcoord - texcoordMin ) / texcoordSize;
+}
+
+/**
+ * Maps the normal components to [0; 1] range.
+ **/
+inline mathfu::vec3 NormalToUnit( const mathfu::vec3 normal ) {
+    return normal * 0.5f + 0.5f;
+}
+
+/**
+ * Maps the bone indices to [0; 1] range.
+ **/
+inline mathfu::vec4 BoneIndicesToUnit( const mathfu::vec4 boneIndices ) {
+    const auto maxIndex = (float) Unorm< 8 >::sMax;
+    return boneIndices / maxIndex;
+}
+
 uint32_t PackPosition_10_10_10_2( const mathfu::vec3 position,
                                   const mathfu::vec3 positionMin,
                                   const mathfu::vec3 positionMax ) {
-    const mathfu::vec3 positionSize  = positionMax - positionMin;
-    const mathfu::vec3 positionScale = ( position - positionMin ) / positionSize;
+    const mathfu::vec3 positionScale = PositionToUnit( position, positionMin, positionMax );
     AssertInRange( positionScale );
 
     UIntPack_10_10_10_2 packed;
@@ -160,8 +190,7 @@ uint32_t PackPosition_10_10_10_2( const mathfu::vec3 position,
 uint32_t PackTexcoord_16_16_fixed( const mathfu::vec2 texcoord,
                                    const mathfu::vec2 texcoordMin,
                                    const mathfu::vec2 texcoordMax ) {
-    const mathfu::vec2 texcoordSize  = texcoordMax - texcoordMin;
-    const mathfu::vec2 texcoordScale = ( texcoord - texcoordMin ) / texcoordSize;
+    const mathfu::vec2 texcoordScale = TexcoordToUnit( texcoord, texcoordMin, texcoordMax );
     AssertInRange( texcoordScale );
 
     UIntPack_16_16 packed;
@@ -187,7 +216,7 @@ uint32_t PackTexcoord_16_16_half( const mathfu::vec2 texcoord,
 uint32_t PackNormal_10_10_10_2( const mathfu::vec3 normal ) {
     AssertInRange( normal.Length( ) );
 
-    const mathfu::vec3 n = normal * 0.5f + 0.5f;
+    const mathfu::vec3 n = NormalToUnit( normal );
     AssertInRange( n );
 
     UIntPack_10_10_10_2 packed;
@@ -253,11 +282,9 @@ mathfu::vec4 UnpackBoneWeights_10_10_10_2( const uint32_t boneWeights ) {
 
 
 uint32_t PackBoneIndices_8_8_8_8( const mathfu::vec4 boneIndices ) {
-    const auto maxIndex = (float)Unorm< 8 >::sMax;
-
     UIntPack_8_8_8_8 packedPosition;
 
-    const auto normIndices = boneIndices / maxIndex;
+    const auto normIndices = BoneIndicesToUnit( boneIndices );
 
     packedPosition.q.x = Unorm< 8 >( normIndices.x ).Bits( );
     packedPosition.q.y = Unorm< 8 >( normIndices.y ).Bits( );
@@ -291,6 +318,524 @@ uint32_t PackTangent_8_8_8_8( const mathfu::vec4 tangent ) {
     return packed.u;
 }
 
+//
+// Compact tangent frames.
+// The normal, the tangent and the bitangent sign are encoded in a single 32-bit word (see EVertexFormat).
+//
+
+union UIntPack_11_11_9_1 {
+    uint32_t u;
+    struct {
+        uint32_t x : 11;
+        uint32_t y : 11;
+        uint32_t z : 9;
+        uint32_t w : 1;
+    } q;
+};
+
+union UIntPack_9_9_9_2_1_2 {
+    uint32_t u;
+    struct {
+        uint32_t x : 9;
+        uint32_t y : 9;
+        uint32_t z : 9;
+        uint32_t reserved : 2;
+        uint32_t sign : 1;
+        uint32_t index : 2;
+    } q;
+};
+
+static_assert( sizeof( UIntPack_11_11_9_1 ) == sizeof( uint32_t ), "Must match" );
+static_assert( sizeof( UIntPack_9_9_9_2_1_2 ) == sizeof( uint32_t ), "Must match" );
+
+static const float kPi    = 3.14159265358979f;
+static const float kSqrt2 = 1.41421356237310f;
+
+inline float SignNotZero( const float v ) {
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+/**
+ * Projects the unit vector onto the octahedron and unfolds the lower hemisphere, the result is in [-1; 1] square.
+ **/
+inline mathfu::vec2 OctahedronEncode( const mathfu::vec3 n ) {
+    const float l1 = fabsf( n.x ) + fabsf( n.y ) + fabsf( n.z );
+    const float x  = n.x / l1;
+    const float y  = n.y / l1;
+
+    if ( n.z >= 0.0f )
+        return mathfu::vec2( x, y );
+
+    return mathfu::vec2( ( 1.0f - fabsf( y ) ) * SignNotZero( x ), ( 1.0f - fabsf( x ) ) * SignNotZero( y ) );
+}
+
+inline mathfu::vec3 OctahedronDecode( const float x, const float y ) {
+    const float z = 1.0f - fabsf( x ) - fabsf( y );
+
+    if ( z >= 0.0f )
+        return mathfu::vec3( x, y, z ).Normalized( );
+
+    return mathfu::vec3( ( 1.0f - fabsf( y ) ) * SignNotZero( x ), ( 1.0f - fabsf( x ) ) * SignNotZero( y ), z ).Normalized( );
+}
+
+/**
+ * Builds the orthonormal tangent plane axes for the unit normal
+ * (Duff et al., "Building an Orthonormal Basis, Revisited").
+ * The decoders must repeat it for the decoded normal (including the sign comparison).
+ **/
+inline void BuildTangentPlane( const mathfu::vec3 n, mathfu::vec3& b1, mathfu::vec3& b2 ) {
+    const float sign = SignNotZero( n.z );
+    const float a    = -1.0f / ( sign + n.z );
+    const float b    = n.x * n.y * a;
+
+    b1 = mathfu::vec3( 1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x );
+    b2 = mathfu::vec3( b, sign + n.y * n.y * a, -n.y );
+}
+
+/**
+ * Normalizes the normal and makes the tangent orthogonal to it (Gram-Schmidt), the degenerate vectors are replaced
+ * (the normal with +Z axis, the tangent with the reference axis of the tangent plane).
+ **/
+inline void OrthonormalizeTangentFrame( const mathfu::vec3 normal, const mathfu::vec4 tangent, mathfu::vec3& n, mathfu::vec3& t ) {
+    const float normalLength = normal.Length( );
+    n = normalLength > 0.0f ? normal / normalLength : mathfu::vec3( 0.0f, 0.0f, 1.0f );
+
+    t = mathfu::vec3( tangent.x, tangent.y, tangent.z );
+    t -= n * mathfu::dot( n, t );
+
+    const float tangentLength = t.Length( );
+    if ( tangentLength > 1e-6f ) {
+        t /= tangentLength;
+    } else {
+        mathfu::vec3 b2;
+        BuildTangentPlane( n, t, b2 );
+    }
+}
+
+mathfu::vec3 UnpackNormal_Octahedral_11_11( const uint32_t normal ) {
+    UIntPack_11_11_9_1 packed;
+    packed.u = normal;
+    return OctahedronDecode( Snorm< 11 >::FromBits( packed.q.x ), Snorm< 11 >::FromBits( packed.q.y ) );
+}
+
+/**
+ * Packs the unit normal into the lower 22 bits.
+ * All the neighbour quantized values are tried, the one that decodes to the closest normal is taken.
+ **/
+uint32_t PackNormal_Octahedral_11_11( const mathfu::vec3 normal ) {
+    const mathfu::vec2 p = OctahedronEncode( normal );
+
+    const uint32_t maxBits = ( 1 << 11 ) - 1;
+    const uint32_t x0      = Snorm< 11 >::FlooredSnorms( p.x ).Bits( );
+    const uint32_t y0      = Snorm< 11 >::FlooredSnorms( p.y ).Bits( );
+
+    UIntPack_11_11_9_1 packed;
+    packed.u = 0;
+
+    float bestDot = -2.0f;
+    for ( uint32_t dy = 0; dy < 2; ++dy ) {
+        for ( uint32_t dx = 0; dx < 2; ++dx ) {
+            UIntPack_11_11_9_1 candidate;
+            candidate.u   = 0;
+            candidate.q.x = std::min( x0 + dx, maxBits );
+            candidate.q.y = std::min( y0 + dy, maxBits );
+
+            const float d = mathfu::dot( normal, UnpackNormal_Octahedral_11_11( candidate.u ) );
+            if ( d > bestDot ) {
+                bestDot  = d;
+                packed.u = candidate.u;
+            }
+        }
+    }
+
+    return packed.u;
+}
+
+uint32_t PackTangentFrame_Octahedral( const mathfu::vec3 normal, const mathfu::vec4 tangent ) {
+    mathfu::vec3 n;
+    mathfu::vec3 t;
+    OrthonormalizeTangentFrame( normal, tangent, n, t );
+
+    UIntPack_11_11_9_1 packed;
+    packed.u = PackNormal_Octahedral_11_11( n );
+
+    /* The tangent angle is measured in the tangent plane of the decoded normal (the decoder has only this one). */
+
+    mathfu::vec3 b1;
+    mathfu::vec3 b2;
+    BuildTangentPlane( UnpackNormal_Octahedral_11_11( packed.u ), b1, b2 );
+
+    const float angle = atan2f( mathfu::dot( t, b2 ), mathfu::dot( t, b1 ) );
+    packed.q.z = Unorm< 9 >( angle / ( 2.0f * kPi ) + 0.5f ).Bits( );
+    packed.q.w = tangent.w < 0.0f ? 1 : 0;
+
+    return packed.u;
+}
+
+void UnpackTangentFrame_Octahedral( const uint32_t tangentFrame, mathfu::vec3& normal, mathfu::vec4& tangent ) {
+    UIntPack_11_11_9_1 packed;
+    packed.u = tangentFrame;
+
+    normal = UnpackNormal_Octahedral_11_11( tangentFrame );
+
+    mathfu::vec3 b1;
+    mathfu::vec3 b2;
+    BuildTangentPlane( normal, b1, b2 );
+
+    const float        angle = ( float( Unorm< 9 >::FromBits( packed.q.z ) ) - 0.5f ) * 2.0f * kPi;
+    const mathfu::vec3 t     = b1 * cosf( angle ) + b2 * sinf( angle );
+    tangent                  = mathfu::vec4( t.x, t.y, t.z, packed.q.w ? -1.0f : 1.0f );
+}
+
+/**
+ * Packs the rotation of the orthonormal tangent frame (tangent, cross( normal, tangent ), normal) as the quaternion,
+ * the largest component is omitted and reconstructed from the unit length (the quaternion is negated to make it
+ * positive), so the other components are within [-1/sqrt(2); 1/sqrt(2)] range.
+ **/
+uint32_t PackTangentFrame_QTangent( const mathfu::vec3 normal, const mathfu::vec4 tangent ) {
+    mathfu::vec3 n;
+    mathfu::vec3 t;
+    OrthonormalizeTangentFrame( normal, tangent, n, t );
+    const mathfu::vec3 b = mathfu::cross( n, t );
+
+    /* Rotation matrix to quaternion (x, y, z, w), the columns are t, b and n. */
+
+    float       q[ 4 ];
+    const float trace = t.x + b.y + n.z;
+    if ( trace > 0.0f ) {
+        const float s = sqrtf( trace + 1.0f ) * 2.0f;
+        q[ 0 ]        = ( b.z - n.y ) / s;
+        q[ 1 ]        = ( n.x - t.z ) / s;
+        q[ 2 ]        = ( t.y - b.x ) / s;
+        q[ 3 ]        = 0.25f * s;
+    } else if ( t.x > b.y && t.x > n.z ) {
+        const float s = sqrtf( 1.0f + t.x - b.y - n.z ) * 2.0f;
+        q[ 0 ]        = 0.25f * s;
+        q[ 1 ]        = ( b.x + t.y ) / s;
+        q[ 2 ]        = ( n.x + t.z ) / s;
+        q[ 3 ]        = ( b.z - n.y ) / s;
+    } else if ( b.y > n.z ) {
+        const float s = sqrtf( 1.0f + b.y - t.x - n.z ) * 2.0f;
+        q[ 0 ]        = ( b.x + t.y ) / s;
+        q[ 1 ]        = 0.25f * s;
+        q[ 2 ]        = ( n.y + b.z ) / s;
+        q[ 3 ]        = ( n.x - t.z ) / s;
+    } else {
+        const float s = sqrtf( 1.0f + n.z - t.x - b.y ) * 2.0f;
+        q[ 0 ]        = ( n.x + t.z ) / s;
+        q[ 1 ]        = ( n.y + b.z ) / s;
+        q[ 2 ]        = 0.25f * s;
+        q[ 3 ]        = ( t.y - b.x ) / s;
+    }
+
+    uint32_t largest = 0;
+    for ( uint32_t i = 1; i < 4; ++i ) {
+        largest = fabsf( q[ i ] ) > fabsf( q[ largest ] ) ? i : largest;
+    }
+
+    const float sign = SignNotZero( q[ largest ] ) / sqrtf( q[ 0 ] * q[ 0 ] + q[ 1 ] * q[ 1 ] + q[ 2 ] * q[ 2 ] + q[ 3 ] * q[ 3 ] );
+
+    float    smallest[ 3 ];
+    uint32_t smallestCount = 0;
+    for ( uint32_t i = 0; i < 4; ++i ) {
+        if ( i != largest ) {
+            smallest[ smallestCount++ ] = q[ i ] * sign * kSqrt2;
+        }
+    }
+
+    UIntPack_9_9_9_2_1_2 packed;
+    packed.q.x        = Snorm< 9 >( smallest[ 0 ] ).Bits( );
+    packed.q.y        = Snorm< 9 >( smallest[ 1 ] ).Bits( );
+    packed.q.z        = Snorm< 9 >( smallest[ 2 ] ).Bits( );
+    packed.q.reserved = 0;
+    packed.q.sign     = tangent.w < 0.0f ? 1 : 0;
+    packed.q.index    = largest;
+
+    return packed.u;
+}
+
+void UnpackTangentFrame_QTangent( const uint32_t tangentFrame, mathfu::vec3& normal, mathfu::vec4& tangent ) {
+    UIntPack_9_9_9_2_1_2 packed;
+    packed.u = tangentFrame;
+
+    const float smallest[ 3 ] = {float( Snorm< 9 >::FromBits( packed.q.x ) ) / kSqrt2,
+                                 float( Snorm< 9 >::FromBits( packed.q.y ) ) / kSqrt2,
+                                 float( Snorm< 9 >::FromBits( packed.q.z ) ) / kSqrt2};
+
+    float    q[ 4 ];
+    uint32_t smallestCount = 0;
+    for ( uint32_t i = 0; i < 4; ++i ) {
+        if ( i != packed.q.index ) {
+            q[ i ] = smallest[ smallestCount++ ];
+        }
+    }
+
+    const float lengthSq = smallest[ 0 ] * smallest[ 0 ] + smallest[ 1 ] * smallest[ 1 ] + smallest[ 2 ] * smallest[ 2 ];
+    q[ packed.q.index ]  = sqrtf( std::max( 0.0f, 1.0f - lengthSq ) );
+
+    const float x = q[ 0 ];
+    const float y = q[ 1 ];
+    const float z = q[ 2 ];
+    const float w = q[ 3 ];
+
+    const mathfu::vec3 t( 1.0f - 2.0f * ( y * y + z * z ), 2.0f * ( x * y + w * z ), 2.0f * ( x * z - w * y ) );
+    normal  = mathfu::vec3( 2.0f * ( x * z + w * y ), 2.0f * ( y * z - w * x ), 1.0f - 2.0f * ( x * x + y * y ) );
+    tangent = mathfu::vec4( t.x, t.y, t.z, packed.q.sign ? -1.0f : 1.0f );
+}
+
+/**
+ * Packs the tangent frame and updates the maximum angular errors (in degrees) of the decoded normal and tangent
+ * (the tangent is compared with the one that is orthogonalized to the normal).
+ **/
+uint32_t PackTangentFrame( const mathfu::vec3 normal,
+                           const mathfu::vec4 tangent,
+                           const bool         qtangent,
+                           float&             maxNormalError,
+                           float&             maxTangentError ) {
+    const uint32_t packed = qtangent ? PackTangentFrame_QTangent( normal, tangent ) : PackTangentFrame_Octahedral( normal, tangent );
+
+    mathfu::vec3 decodedNormal;
+    mathfu::vec4 decodedTangent;
+    if ( qtangent )
+        UnpackTangentFrame_QTangent( packed, decodedNormal, decodedTangent );
+    else
+        UnpackTangentFrame_Octahedral( packed, decodedNormal, decodedTangent );
+
+    mathfu::vec3 n;
+    mathfu::vec3 t;
+    OrthonormalizeTangentFrame( normal, tangent, n, t );
+
+    const auto angle = []( const mathfu::vec3 a, const mathfu::vec3 b ) {
+        return acosf( std::min( 1.0f, std::max( -1.0f, mathfu::dot( a, b ) ) ) ) * 180.0f / kPi;
+    };
+
+    maxNormalError  = std::max( maxNormalError, angle( n, decodedNormal ) );
+    maxTangentError = std::max( maxTangentError, angle( t, mathfu::vec3( decodedTangent.x, decodedTangent.y, decodedTangent.z ) ) );
+    return packed;
+}
+
+//
+// SIMD quantization kernels.
+// The vertices are packed in blocks: the values are mapped to [0; 1] range with the same helpers the scalar
+// encoders use (so the normalization and the mapping match bit to bit whatever mathfu configuration is used),
+// then all the Unorm< N > conversions and the bit packing of the block are done with SSE4.1 or AVX2 kernels.
+// Unorm< N >( f ) is floor( clamp( f, 0, 1 ) * max + 0.5 ), the kernels repeat the same float operations
+// (max is applied before min, so NaNs are quantized to zero like the truncated scalar conversions on x86).
+//
+
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __x86_64__ ) || defined( __i386__ )
+#define FBXP_PACKING_SIMD 1
+#include <immintrin.h>
+#if defined( _MSC_VER )
+#include <intrin.h>
+#define FBXP_TARGET( isa )
+#else
+#define FBXP_TARGET( isa ) __attribute__( ( target( isa ) ) )
+#endif
+#else
+#define FBXP_PACKING_SIMD 0
+#endif
+
+/**
+ * Unit range values of the vertex block (structure of arrays).
+ **/
+enum EPackingLane {
+    ePackingLane_PositionX,
+    ePackingLane_PositionY,
+    ePackingLane_PositionZ,
+    ePackingLane_NormalX,
+    ePackingLane_NormalY,
+    ePackingLane_NormalZ,
+    ePackingLane_TangentX,
+    ePackingLane_TangentY,
+    ePackingLane_TangentZ,
+    ePackingLane_TangentW,
+    ePackingLane_TexcoordX,
+    ePackingLane_TexcoordY,
+    ePackingLane_WeightX,
+    ePackingLane_WeightY,
+    ePackingLane_WeightZ,
+    ePackingLane_IndexX,
+    ePackingLane_IndexY,
+    ePackingLane_IndexZ,
+    ePackingLane_IndexW,
+    ePackingLane_Count
+};
+
+static const uint32_t kPackingBlockSize = 8;
+
+struct PackingBlock {
+    float    lanes[ ePackingLane_Count ][ kPackingBlockSize ];
+    uint32_t words[ 6 ][ kPackingBlockSize ];
+};
+
+/**
+ * Component of the packed word: Unorm< N > of the lane value shifted to its bit offset.
+ **/
+struct PackedComponent {
+    uint32_t lane;
+    float    max;
+    uint32_t shift;
+};
+
+struct PackedWord {
+    uint32_t        componentCount;
+    PackedComponent components[ 4 ];
+};
+
+/**
+ * The words of PackedVertexFb and PackedSkinnedVertexFb (see the scalar encoders above).
+ **/
+static const PackedWord kPackedWords[ 6 ] = {
+    {3, {{ePackingLane_PositionX, 1023.0f, 0}, {ePackingLane_PositionY, 1023.0f, 10}, {ePackingLane_PositionZ, 1023.0f, 20}}},
+    {3, {{ePackingLane_NormalX, 1023.0f, 0}, {ePackingLane_NormalY, 1023.0f, 10}, {ePackingLane_NormalZ, 1023.0f, 20}}},
+    {4,
+     {{ePackingLane_TangentX, 1023.0f, 0},
+      {ePackingLane_TangentY, 1023.0f, 10},
+      {ePackingLane_TangentZ, 1023.0f, 20},
+      {ePackingLane_TangentW, 3.0f, 30}}},
+    {2, {{ePackingLane_TexcoordX, 65535.0f, 0}, {ePackingLane_TexcoordY, 65535.0f, 16}}},
+    {3, {{ePackingLane_WeightX, 1023.0f, 0}, {ePackingLane_WeightY, 1023.0f, 10}, {ePackingLane_WeightZ, 1023.0f, 20}}},
+    {4,
+     {{ePackingLane_IndexX, 255.0f, 0},
+      {ePackingLane_IndexY, 255.0f, 8},
+      {ePackingLane_IndexZ, 255.0f, 16},
+      {ePackingLane_IndexW, 255.0f, 24}}},
+};
+
+typedef void ( *QuantizeBlockFn )( PackingBlock& block, uint32_t wordCount );
+
+#if FBXP_PACKING_SIMD
+
+FBXP_TARGET( "sse4.1" )
+void QuantizeBlock_SSE41( PackingBlock& block, uint32_t wordCount ) {
+    const __m128 zero = _mm_setzero_ps( );
+    const __m128 one  = _mm_set1_ps( 1.0f );
+    const __m128 half = _mm_set1_ps( 0.5f );
+
+    for ( uint32_t w = 0; w < wordCount; ++w ) {
+        for ( uint32_t i = 0; i < kPackingBlockSize; i += 4 ) {
+            __m128i word = _mm_setzero_si128( );
+            for ( uint32_t c = 0; c < kPackedWords[ w ].componentCount; ++c ) {
+                const PackedComponent& component = kPackedWords[ w ].components[ c ];
+
+                __m128 v = _mm_loadu_ps( block.lanes[ component.lane ] + i );
+                v        = _mm_min_ps( _mm_max_ps( v, zero ), one );
+                v        = _mm_floor_ps( _mm_add_ps( _mm_mul_ps( v, _mm_set1_ps( component.max ) ), half ) );
+                word     = _mm_or_si128( word, _mm_sll_epi32( _mm_cvttps_epi32( v ), _mm_cvtsi32_si128( component.shift ) ) );
+            }
+
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( block.words[ w ] + i ), word );
+        }
+    }
+}
+
+FBXP_TARGET( "avx2" )
+void QuantizeBlock_AVX2( PackingBlock& block, uint32_t wordCount ) {
+    const __m256 zero = _mm256_setzero_ps( );
+    const __m256 one  = _mm256_set1_ps( 1.0f );
+    const __m256 half = _mm256_set1_ps( 0.5f );
+
+    for ( uint32_t w = 0; w < wordCount; ++w ) {
+        __m256i word = _mm256_setzero_si256( );
+        for ( uint32_t c = 0; c < kPackedWords[ w ].componentCount; ++c ) {
+            const PackedComponent& component = kPackedWords[ w ].components[ c ];
+
+            __m256 v = _mm256_loadu_ps( block.lanes[ component.lane ] );
+            v        = _mm256_min_ps( _mm256_max_ps( v, zero ), one );
+            v        = _mm256_floor_ps( _mm256_add_ps( _mm256_mul_ps( v, _mm256_set1_ps( component.max ) ), half ) );
+            word     = _mm256_or_si256( word, _mm256_sll_epi32( _mm256_cvttps_epi32( v ), _mm_cvtsi32_si128( component.shift ) ) );
+        }
+
+        _mm256_storeu_si256( reinterpret_cast< __m256i* >( block.words[ w ] ), word );
+    }
+}
+
+bool IsAVX2Supported( ) {
+#if defined( _MSC_VER )
+    int info[ 4 ];
+    __cpuid( info, 0 );
+    if ( info[ 0 ] < 7 )
+        return false;
+
+    /* AVX with the OS support of YMM registers. */
+    __cpuid( info, 1 );
+    if ( 0 == ( info[ 2 ] & ( 1 << 27 ) ) || 0 == ( info[ 2 ] & ( 1 << 28 ) ) || 6 != ( _xgetbv( 0 ) & 6 ) )
+        return false;
+
+    __cpuidex( info, 7, 0 );
+    return 0 != ( info[ 1 ] & ( 1 << 5 ) );
+#else
+    return 0 != __builtin_cpu_supports( "avx2" );
+#endif
+}
+
+bool IsSSE41Supported( ) {
+#if defined( _MSC_VER )
+    int info[ 4 ];
+    __cpuid( info, 1 );
+    return 0 != ( info[ 2 ] & ( 1 << 19 ) );
+#else
+    return 0 != __builtin_cpu_supports( "sse4.1" );
+#endif
+}
+
+#endif
+
+/**
+ * Chooses the quantization kernel for the current CPU.
+ * @return nullptr if only the scalar encoders are available.
+ **/
+QuantizeBlockFn GetQuantizeBlockFn( ) {
+#if FBXP_PACKING_SIMD
+    static const QuantizeBlockFn fn = IsAVX2Supported( )
+                                          ? QuantizeBlock_AVX2
+                                          : IsSSE41Supported( ) ? QuantizeBlock_SSE41 : (QuantizeBlockFn) nullptr;
+    return fn;
+#else
+    return nullptr;
+#endif
+}
+
+/**
+ * Fills the block lanes for the j-th vertex with the same helpers the scalar encoders use.
+ **/
+template < typename TVertex >
+inline void PrepareStaticLanes( PackingBlock&      block,
+                                uint32_t           j,
+                                const TVertex&     vertex,
+                                const mathfu::vec3 positionMin,
+                                const mathfu::vec3 positionMax,
+                                const mathfu::vec2 texcoordsMin,
+                                const mathfu::vec2 texcoordsMax ) {
+    const auto position  = Cast< mathfu::vec3 >( vertex.position( ) );
+    const auto texcoords = Cast< mathfu::vec2 >( vertex.uv( ) );
+    const auto normal    = Cast< mathfu::vec3 >( vertex.normal( ) );
+    const auto tangent   = Cast< mathfu::vec4 >( vertex.tangent( ) );
+
+    const auto p  = PositionToUnit( position, positionMin, positionMax );
+    const auto n  = NormalToUnit( normal.Normalized( ) );
+    const auto t  = NormalToUnit( mathfu::vec3( tangent.x, tangent.y, tangent.z ).Normalized( ) );
+    const auto uv = TexcoordToUnit( texcoords, texcoordsMin, texcoordsMax );
+
+    block.lanes[ ePackingLane_PositionX ][ j ] = p.x;
+    block.lanes[ ePackingLane_PositionY ][ j ] = p.y;
+    block.lanes[ ePackingLane_PositionZ ][ j ] = p.z;
+    block.lanes[ ePackingLane_NormalX ][ j ]   = n.x;
+    block.lanes[ ePackingLane_NormalY ][ j ]   = n.y;
+    block.lanes[ ePackingLane_NormalZ ][ j ]   = n.z;
+    block.lanes[ ePackingLane_TangentX ][ j ]  = t.x;
+    block.lanes[ ePackingLane_TangentY ][ j ]  = t.y;
+    block.lanes[ ePackingLane_TangentZ ][ j ]  = t.z;
+    block.lanes[ ePackingLane_TangentW ][ j ]  = tangent.w * 0.5f + 0.5f;
+    block.lanes[ ePackingLane_TexcoordX ][ j ] = uv.x;
+    block.lanes[ ePackingLane_TexcoordY ][ j ] = uv.y;
+}
+
+/**
+ * Packs the unpacked vertices. The packed vertices can be written over the unpacked ones (the mesh is packed in place):
+ * the packed vertex is smaller, and the vertex (or the block of vertices) is read before its packed vertex is written.
+ **/
 void Pack( const StaticVertexFb* vertices,
            PackedVertexFb*       packed,
            const uint32_t        vertexCount,
@@ -299,7 +844,26 @@ void Pack( const StaticVertexFb* vertices,
            const mathfu::vec2    texcoordsMin,
            const mathfu::vec2    texcoordsMax ) {
 
-    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+    uint32_t i = 0;
+
+    if ( const QuantizeBlockFn quantizeBlock = GetQuantizeBlockFn( ) ) {
+        PackingBlock block;
+        for ( ; i + kPackingBlockSize <= vertexCount; i += kPackingBlockSize ) {
+            for ( uint32_t j = 0; j < kPackingBlockSize; ++j ) {
+                PrepareStaticLanes( block, j, vertices[ i + j ], positionMin, positionMax, texcoordsMin, texcoordsMax );
+            }
+
+            quantizeBlock( block, 4 );
+
+            for ( uint32_t j = 0; j < kPackingBlockSize; ++j ) {
+                packed[ i + j ] = PackedVertexFb( block.words[ 0 ][ j ], block.words[ 1 ][ j ], block.words[ 2 ][ j ], block.words[ 3 ][ j ] );
+            }
+        }
+    }
+
+    /* The remaining vertices (or all of them if SIMD is not available). */
+
+    for ( ; i < vertexCount; ++i ) {
 
         const auto position  = Cast< mathfu::vec3 >( vertices[ i ].position( ) );
         const auto texcoords = Cast< mathfu::vec2 >( vertices[ i ].uv( ) );
@@ -325,7 +889,43 @@ void Pack( const apemodefb::StaticSkinnedVertexFb* vertices,
            const mathfu::vec2                      texcoordsMin,
            const mathfu::vec2                      texcoordsMax ) {
 
-    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+    uint32_t i = 0;
+
+    if ( const QuantizeBlockFn quantizeBlock = GetQuantizeBlockFn( ) ) {
+        PackingBlock block;
+        for ( ; i + kPackingBlockSize <= vertexCount; i += kPackingBlockSize ) {
+            for ( uint32_t j = 0; j < kPackingBlockSize; ++j ) {
+                const auto& vertex = vertices[ i + j ];
+                PrepareStaticLanes( block, j, vertex, positionMin, positionMax, texcoordsMin, texcoordsMax );
+
+                const auto weights = Cast< mathfu::vec4 >( vertex.weights( ) );
+                const auto indices = BoneIndicesToUnit( Cast< mathfu::vec4 >( vertex.indices( ) ) );
+
+                block.lanes[ ePackingLane_WeightX ][ j ] = weights.x;
+                block.lanes[ ePackingLane_WeightY ][ j ] = weights.y;
+                block.lanes[ ePackingLane_WeightZ ][ j ] = weights.z;
+                block.lanes[ ePackingLane_IndexX ][ j ]  = indices.x;
+                block.lanes[ ePackingLane_IndexY ][ j ]  = indices.y;
+                block.lanes[ ePackingLane_IndexZ ][ j ]  = indices.z;
+                block.lanes[ ePackingLane_IndexW ][ j ]  = indices.w;
+            }
+
+            quantizeBlock( block, 6 );
+
+            for ( uint32_t j = 0; j < kPackingBlockSize; ++j ) {
+                packed[ i + j ] = PackedSkinnedVertexFb( block.words[ 0 ][ j ],
+                                                         block.words[ 1 ][ j ],
+                                                         block.words[ 2 ][ j ],
+                                                         block.words[ 3 ][ j ],
+                                                         block.words[ 4 ][ j ],
+                                                         block.words[ 5 ][ j ] );
+            }
+        }
+    }
+
+    /* The remaining vertices (or all of them if SIMD is not available). */
+
+    for ( ; i < vertexCount; ++i ) {
         const auto position  = Cast< mathfu::vec3 >( vertices[ i ].position( ) );
         const auto texcoords = Cast< mathfu::vec2 >( vertices[ i ].uv( ) );
         const auto normal    = Cast< mathfu::vec3 >( vertices[ i ].normal( ) );
@@ -356,4 +956,870 @@ void Pack( const apemodefb::StaticSkinnedVertexFb* vertices,
 #endif
 
     }
-}
\ No newline at end of file
+}
+
+void Pack( const apemodefb::StaticVertexFb*  vertices,
+           apemodefb::PackedCompactVertexFb* packed,
+           const uint32_t                    vertexCount,
+           const mathfu::vec3                positionMin,
+           const mathfu::vec3                positionMax,
+           const mathfu::vec2                texcoordsMin,
+           const mathfu::vec2                texcoordsMax,
+           const bool                        qtangent,
+           float&                            maxNormalError,
+           float&                            maxTangentError ) {
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        const auto position  = Cast< mathfu::vec3 >( vertices[ i ].position( ) );
+        const auto texcoords = Cast< mathfu::vec2 >( vertices[ i ].uv( ) );
+        const auto normal    = Cast< mathfu::vec3 >( vertices[ i ].normal( ) );
+        const auto tangent   = Cast< mathfu::vec4 >( vertices[ i ].tangent( ) );
+
+        packed[ i ] = PackedCompactVertexFb( PackPosition_10_10_10_2( position, positionMin, positionMax ),
+                                             PackTangentFrame( normal, tangent, qtangent, maxNormalError, maxTangentError ),
+                                             PackTexcoord_16_16_fixed( texcoords, texcoordsMin, texcoordsMax ) );
+    }
+}
+
+void Pack( const apemodefb::StaticSkinnedVertexFb*  vertices,
+           apemodefb::PackedCompactSkinnedVertexFb* packed,
+           const uint32_t                           vertexCount,
+           const mathfu::vec3                       positionMin,
+           const mathfu::vec3                       positionMax,
+           const mathfu::vec2                       texcoordsMin,
+           const mathfu::vec2                       texcoordsMax,
+           const bool                               qtangent,
+           float&                                   maxNormalError,
+           float&                                   maxTangentError ) {
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        const auto position  = Cast< mathfu::vec3 >( vertices[ i ].position( ) );
+        const auto texcoords = Cast< mathfu::vec2 >( vertices[ i ].uv( ) );
+        const auto normal    = Cast< mathfu::vec3 >( vertices[ i ].normal( ) );
+        const auto tangent   = Cast< mathfu::vec4 >( vertices[ i ].tangent( ) );
+        const auto weights   = Cast< mathfu::vec4 >( vertices[ i ].weights( ) );
+        const auto indices   = Cast< mathfu::vec4 >( vertices[ i ].indices( ) );
+
+        packed[ i ] = PackedCompactSkinnedVertexFb( PackPosition_10_10_10_2( position, positionMin, positionMax ),
+                                                    PackTangentFrame( normal, tangent, qtangent, maxNormalError, maxTangentError ),
+                                                    PackTexcoord_16_16_fixed( texcoords, texcoordsMin, texcoordsMax ),
+                                                    PackBoneWeights_10_10_10_2( weights ),
+                                                    PackBoneIndices_8_8_8_8( indices ) );
+    }
+}
+
+/**
+ * Same as Unorm< N >, but the bit count is a runtime value (up to 16 bits).
+ **/
+inline uint32_t QuantizeUnorm( const float f, const uint32_t bitCount ) {
+    if ( 0 == bitCount || std::isnan( f ) )
+        return 0;
+
+    const float maxValue = float( ( 1u << bitCount ) - 1 );
+    return (uint32_t) details::round( details::clamp( f, 0.0f, 1.0f ) * maxValue );
+}
+
+inline float DequantizeUnorm( const uint32_t bits, const uint32_t bitCount ) {
+    return float( bits ) / float( ( 1u << bitCount ) - 1 );
+}
+
+/**
+ * Chooses the bit counts per axis for the packed position word (x in the lowest bits, then y and z), so that
+ * the quantization error (the distance to the decoded position) does not exceed the maximum error.
+ * The bits that are left in the word are given to the axes with the largest quantization steps.
+ * @return False if the position does not fit into 32 bits with up to 16 bits per axis.
+ **/
+bool ChoosePositionBits( const mathfu::vec3 positionMin,
+                         const mathfu::vec3 positionMax,
+                         const float        maxError,
+                         uint32_t           positionBits[ 3 ] ) {
+    const uint32_t kMaxWordBits = 32;
+    const uint32_t kMaxAxisBits = 16;
+
+    const mathfu::vec3 extent = positionMax - positionMin;
+
+    /* The error per axis is the half of the quantization step, the distance error is up to sqrt( 3 ) times larger. */
+    const double maxAxisError = double( maxError ) / sqrt( 3.0 );
+
+    auto step = [&]( uint32_t axis, uint32_t bitCount ) {
+        return bitCount ? double( extent[ axis ] ) / double( ( 1u << bitCount ) - 1 ) : double( extent[ axis ] );
+    };
+
+    uint32_t totalBits = 0;
+    for ( uint32_t axis = 0; axis < 3; ++axis ) {
+        positionBits[ axis ] = 0;
+        while ( step( axis, positionBits[ axis ] ) * 0.5 > maxAxisError ) {
+            if ( ++positionBits[ axis ] > kMaxAxisBits )
+                return false;
+        }
+
+        totalBits += positionBits[ axis ];
+    }
+
+    if ( totalBits > kMaxWordBits )
+        return false;
+
+    for ( ; totalBits < kMaxWordBits; ++totalBits ) {
+        uint32_t worstAxis = 3;
+        for ( uint32_t axis = 0; axis < 3; ++axis ) {
+            if ( positionBits[ axis ] < kMaxAxisBits && extent[ axis ] > 0.0f &&
+                 ( 3 == worstAxis || step( axis, positionBits[ axis ] ) > step( worstAxis, positionBits[ worstAxis ] ) ) ) {
+                worstAxis = axis;
+            }
+        }
+
+        if ( 3 == worstAxis )
+            break;
+
+        ++positionBits[ worstAxis ];
+    }
+
+    return true;
+}
+
+uint32_t PackPosition( const mathfu::vec3 position,
+                       const mathfu::vec3 positionMin,
+                       const mathfu::vec3 positionMax,
+                       const uint32_t     positionBits[ 3 ] ) {
+    const mathfu::vec3 positionScale = PositionToUnit( position, positionMin, positionMax );
+
+    uint32_t packed = 0;
+    uint32_t shift  = 0;
+    for ( uint32_t axis = 0; axis < 3; ++axis ) {
+        if ( positionBits[ axis ] ) {
+            packed |= QuantizeUnorm( positionScale[ axis ], positionBits[ axis ] ) << shift;
+            shift += positionBits[ axis ];
+        }
+    }
+
+    return packed;
+}
+
+mathfu::vec3 UnpackPosition( const uint32_t     position,
+                             const mathfu::vec3 positionMin,
+                             const mathfu::vec3 positionMax,
+                             const uint32_t     positionBits[ 3 ] ) {
+    mathfu::vec3 positionScale;
+
+    uint32_t shift = 0;
+    for ( uint32_t axis = 0; axis < 3; ++axis ) {
+        positionScale[ axis ] = 0.0f;
+        if ( positionBits[ axis ] ) {
+            const uint32_t mask   = ( 1u << positionBits[ axis ] ) - 1;
+            positionScale[ axis ] = DequantizeUnorm( ( position >> shift ) & mask, positionBits[ axis ] );
+            shift += positionBits[ axis ];
+        }
+    }
+
+    return positionMin + ( positionMax - positionMin ) * positionScale;
+}
+
+/**
+ * Packs the positions with the chosen bit counts per axis into the first word of the packed vertices
+ * (all the packed vertex formats start with the position word).
+ * @param vertices The vertices with 3 float position components at the beginning of the vertex.
+ * @return The maximum distance between the original and the decoded positions.
+ **/
+float PackPositions( const uint8_t*     vertices,
+                     const uint32_t     vertexStride,
+                     uint8_t*           packedVertices,
+                     const uint32_t     packedVertexStride,
+                     const uint32_t     vertexCount,
+                     const mathfu::vec3 positionMin,
+                     const mathfu::vec3 positionMax,
+                     const uint32_t     positionBits[ 3 ] ) {
+    float maxError = 0.0f;
+
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        const mathfu::vec3 position( reinterpret_cast< const float* >( vertices + i * vertexStride ) );
+        const uint32_t     packed = PackPosition( position, positionMin, positionMax, positionBits );
+        memcpy( packedVertices + i * packedVertexStride, &packed, sizeof( packed ) );
+
+        const mathfu::vec3 decoded = UnpackPosition( packed, positionMin, positionMax, positionBits );
+        maxError                   = std::max( maxError, ( decoded - position ).Length( ) );
+    }
+
+    return maxError;
+}
+
+//
+// Configurable vertex layouts (--layout option).
+// Every supported pair of the semantic and the format has its own encoder specialization (the fixed format encoders
+// above are reused where they match), the column loop is instantiated per pair, so the format is resolved once per
+// attribute and mesh instead of once per vertex component.
+//
+
+/**
+ * Values of the attribute: the components of the unpacked vertices (the static vertex is the prefix of the static
+ * skinned vertex) or of the gathered extra attributes (the second texcoords and the colors).
+ * The bounds are used by the unorm formats of the positions and texcoords (the empty extents are widened to one).
+ **/
+struct VertexAttributeSource {
+    const uint8_t* values;
+    uint32_t       stride;
+    float          boundsMin[ 4 ];
+    float          boundsMax[ 4 ];
+};
+
+inline void StoreWord( const uint32_t word, uint8_t* dst ) {
+    memcpy( dst, &word, sizeof( word ) );
+}
+
+inline void StoreFloats( const float* v, const uint32_t count, uint8_t* dst ) {
+    memcpy( dst, v, count * sizeof( float ) );
+}
+
+inline void StoreHalfs( const float* v, const uint32_t count, uint8_t* dst ) {
+    for ( uint32_t k = 0; k < count; ++k ) {
+        const uint16_t bits = Half< true >( v[ k ] ).Bits( );
+        memcpy( dst + k * sizeof( uint16_t ), &bits, sizeof( uint16_t ) );
+    }
+}
+
+inline void StoreUnorms16( const float* unit, const uint32_t count, uint8_t* dst ) {
+    for ( uint32_t k = 0; k < count; ++k ) {
+        const uint16_t bits = (uint16_t) QuantizeUnorm( unit[ k ], 16 );
+        memcpy( dst + k * sizeof( uint16_t ), &bits, sizeof( uint16_t ) );
+    }
+}
+
+inline void StoreUnorms8( const float* unit, const uint32_t count, uint8_t* dst ) {
+    for ( uint32_t k = 0; k < count; ++k ) {
+        dst[ k ] = (uint8_t) QuantizeUnorm( unit[ k ], 8 );
+    }
+}
+
+inline void SetDecodeOffsetScale( apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale, const mathfu::vec4 offset, const mathfu::vec4 scale ) {
+    decodeOffset = Cast< apemodefb::vec4 >( offset );
+    decodeScale  = Cast< apemodefb::vec4 >( scale );
+}
+
+inline void SetIdentityDecode( apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+    SetDecodeOffsetScale( decodeOffset, decodeScale, mathfu::vec4( 0.0f, 0.0f, 0.0f, 0.0f ), mathfu::vec4( 1.0f, 1.0f, 1.0f, 1.0f ) );
+}
+
+inline void SetBoundsDecode( const VertexAttributeSource& source, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+    const mathfu::vec4 boundsMin( source.boundsMin[ 0 ], source.boundsMin[ 1 ], source.boundsMin[ 2 ], source.boundsMin[ 3 ] );
+    const mathfu::vec4 boundsMax( source.boundsMax[ 0 ], source.boundsMax[ 1 ], source.boundsMax[ 2 ], source.boundsMax[ 3 ] );
+    SetDecodeOffsetScale( decodeOffset, decodeScale, boundsMin, boundsMax - boundsMin );
+}
+
+inline mathfu::vec3 GetBoundsMin3( const VertexAttributeSource& source ) {
+    return mathfu::vec3( source.boundsMin[ 0 ], source.boundsMin[ 1 ], source.boundsMin[ 2 ] );
+}
+
+inline mathfu::vec3 GetBoundsMax3( const VertexAttributeSource& source ) {
+    return mathfu::vec3( source.boundsMax[ 0 ], source.boundsMax[ 1 ], source.boundsMax[ 2 ] );
+}
+
+/**
+ * Encoder of the semantic values into the format (specialized for the supported pairs only).
+ * kSize is the byte size of the attribute, Encode writes the attribute of a single vertex, SetDecode fills the decode
+ * offset and scale of VertexAttributeFb (value = decode offset + decode scale * stored value).
+ **/
+template < EVertexSemanticFb TSemantic, EVertexAttributeFormatFb TFormat >
+struct VertexAttributeEncoder;
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Position, EVertexAttributeFormatFb_Float3 > {
+    static const uint32_t kSize = 12;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreFloats( v, 3, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Position, EVertexAttributeFormatFb_Unorm16x4 > {
+    static const uint32_t kSize = 8;
+    static void Encode( const float* v, const VertexAttributeSource& source, uint8_t* dst ) {
+        const mathfu::vec3 p = PositionToUnit( mathfu::vec3( v[ 0 ], v[ 1 ], v[ 2 ] ), GetBoundsMin3( source ), GetBoundsMax3( source ) );
+        const float        unit[ 4 ] = {p.x, p.y, p.z, 0.0f};
+        StoreUnorms16( unit, 4, dst );
+    }
+    static void SetDecode( const VertexAttributeSource& source, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetBoundsDecode( source, decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Position, EVertexAttributeFormatFb_Unorm10_10_10_2 > {
+    static const uint32_t kSize = 4;
+    static void Encode( const float* v, const VertexAttributeSource& source, uint8_t* dst ) {
+        StoreWord( PackPosition_10_10_10_2( mathfu::vec3( v[ 0 ], v[ 1 ], v[ 2 ] ), GetBoundsMin3( source ), GetBoundsMax3( source ) ), dst );
+    }
+    static void SetDecode( const VertexAttributeSource& source, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetBoundsDecode( source, decodeOffset, decodeScale );
+    }
+};
+
+/**
+ * The unit vectors are decoded from [0; 1] to [-1; 1] (the w component is 0 for the normals).
+ **/
+inline void SetSignedDecode( const bool w, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+    SetDecodeOffsetScale( decodeOffset, decodeScale, mathfu::vec4( -1.0f, -1.0f, -1.0f, w ? -1.0f : 0.0f ), mathfu::vec4( 2.0f, 2.0f, 2.0f, w ? 2.0f : 1.0f ) );
+}
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Normal, EVertexAttributeFormatFb_Float3 > {
+    static const uint32_t kSize = 12;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        const mathfu::vec3 n = mathfu::vec3( v[ 0 ], v[ 1 ], v[ 2 ] ).Normalized( );
+        const float        values[ 3 ] = {n.x, n.y, n.z};
+        StoreFloats( values, 3, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Normal, EVertexAttributeFormatFb_Half4 > {
+    static const uint32_t kSize = 8;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        const mathfu::vec3 n = mathfu::vec3( v[ 0 ], v[ 1 ], v[ 2 ] ).Normalized( );
+        const float        values[ 4 ] = {n.x, n.y, n.z, 0.0f};
+        StoreHalfs( values, 4, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Normal, EVertexAttributeFormatFb_Octahedral16 > {
+    static const uint32_t kSize = 4;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        const mathfu::vec2 e = OctahedronEncode( mathfu::vec3( v[ 0 ], v[ 1 ], v[ 2 ] ).Normalized( ) );
+        const float        unit[ 2 ] = {e.x * 0.5f + 0.5f, e.y * 0.5f + 0.5f};
+        StoreUnorms16( unit, 2, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetDecodeOffsetScale( decodeOffset, decodeScale, mathfu::vec4( -1.0f, -1.0f, 0.0f, 0.0f ), mathfu::vec4( 2.0f, 2.0f, 1.0f, 1.0f ) );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Normal, EVertexAttributeFormatFb_Unorm8x4 > {
+    static const uint32_t kSize = 4;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreWord( PackNormal_8_8_8_8( mathfu::vec3( v[ 0 ], v[ 1 ], v[ 2 ] ).Normalized( ) ), dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetSignedDecode( false, decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Normal, EVertexAttributeFormatFb_Unorm10_10_10_2 > {
+    static const uint32_t kSize = 4;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreWord( PackNormal_10_10_10_2( mathfu::vec3( v[ 0 ], v[ 1 ], v[ 2 ] ).Normalized( ) ), dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetSignedDecode( false, decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Tangent, EVertexAttributeFormatFb_Float4 > {
+    static const uint32_t kSize = 16;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreFloats( v, 4, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Tangent, EVertexAttributeFormatFb_Half4 > {
+    static const uint32_t kSize = 8;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreHalfs( v, 4, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Tangent, EVertexAttributeFormatFb_Unorm8x4 > {
+    static const uint32_t kSize = 4;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreWord( PackTangent_8_8_8_8( mathfu::vec4( v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ] ) ), dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetSignedDecode( true, decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Tangent, EVertexAttributeFormatFb_Unorm10_10_10_2 > {
+    static const uint32_t kSize = 4;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreWord( PackTangent_10_10_10_2( mathfu::vec4( v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ] ) ), dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetSignedDecode( true, decodeOffset, decodeScale );
+    }
+};
+
+/**
+ * The texcoord encoders are the same for both texcoord sets.
+ **/
+template < EVertexAttributeFormatFb TFormat >
+struct TexcoordEncoder;
+
+template <>
+struct TexcoordEncoder< EVertexAttributeFormatFb_Float2 > {
+    static const uint32_t kSize = 8;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreFloats( v, 2, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct TexcoordEncoder< EVertexAttributeFormatFb_Half2 > {
+    static const uint32_t kSize = 4;
+    static void Encode( const float* v, const VertexAttributeSource& source, uint8_t* dst ) {
+        const mathfu::vec2 boundsMin( source.boundsMin[ 0 ], source.boundsMin[ 1 ] );
+        const mathfu::vec2 boundsMax( source.boundsMax[ 0 ], source.boundsMax[ 1 ] );
+        StoreWord( PackTexcoord_16_16_half( mathfu::vec2( v[ 0 ], v[ 1 ] ), boundsMin, boundsMax ), dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct TexcoordEncoder< EVertexAttributeFormatFb_Unorm16x2 > {
+    static const uint32_t kSize = 4;
+    static void Encode( const float* v, const VertexAttributeSource& source, uint8_t* dst ) {
+        const mathfu::vec2 boundsMin( source.boundsMin[ 0 ], source.boundsMin[ 1 ] );
+        const mathfu::vec2 boundsMax( source.boundsMax[ 0 ], source.boundsMax[ 1 ] );
+        StoreWord( PackTexcoord_16_16_fixed( mathfu::vec2( v[ 0 ], v[ 1 ] ), boundsMin, boundsMax ), dst );
+    }
+    static void SetDecode( const VertexAttributeSource& source, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetBoundsDecode( source, decodeOffset, decodeScale );
+    }
+};
+
+template < EVertexAttributeFormatFb TFormat >
+struct VertexAttributeEncoder< EVertexSemanticFb_Texcoord0, TFormat > : TexcoordEncoder< TFormat > {};
+
+template < EVertexAttributeFormatFb TFormat >
+struct VertexAttributeEncoder< EVertexSemanticFb_Texcoord1, TFormat > : TexcoordEncoder< TFormat > {};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Color, EVertexAttributeFormatFb_Float4 > {
+    static const uint32_t kSize = 16;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreFloats( v, 4, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Color, EVertexAttributeFormatFb_Half4 > {
+    static const uint32_t kSize = 8;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreHalfs( v, 4, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Color, EVertexAttributeFormatFb_Unorm8x4 > {
+    static const uint32_t kSize = 4;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreUnorms8( v, 4, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_Color, EVertexAttributeFormatFb_Unorm16x4 > {
+    static const uint32_t kSize = 8;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreUnorms16( v, 4, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_BoneIndices, EVertexAttributeFormatFb_Float4 > {
+    static const uint32_t kSize = 16;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreFloats( v, 4, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_BoneIndices, EVertexAttributeFormatFb_Uint8x4 > {
+    static const uint32_t kSize = 4;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreWord( PackBoneIndices_8_8_8_8( mathfu::vec4( v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ] ) ), dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_BoneWeights, EVertexAttributeFormatFb_Float4 > {
+    static const uint32_t kSize = 16;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreFloats( v, 4, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_BoneWeights, EVertexAttributeFormatFb_Unorm8x4 > {
+    static const uint32_t kSize = 4;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreUnorms8( v, 4, dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+template <>
+struct VertexAttributeEncoder< EVertexSemanticFb_BoneWeights, EVertexAttributeFormatFb_Unorm10_10_10_2 > {
+    static const uint32_t kSize = 4;
+    static void Encode( const float* v, const VertexAttributeSource&, uint8_t* dst ) {
+        StoreWord( PackBoneWeights_10_10_10_2( mathfu::vec4( v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ] ) ), dst );
+    }
+    static void SetDecode( const VertexAttributeSource&, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale ) {
+        SetIdentityDecode( decodeOffset, decodeScale );
+    }
+};
+
+/**
+ * Writes the attribute column of the vertices with the encoder of the semantic and format.
+ **/
+template < EVertexSemanticFb TSemantic, EVertexAttributeFormatFb TFormat >
+void WriteVertexAttribute( const VertexAttributeSource& source, uint8_t* vertices, const uint32_t vertexStride, const uint32_t vertexCount ) {
+    for ( uint32_t i = 0; i < vertexCount; ++i ) {
+        const float* values = reinterpret_cast< const float* >( source.values + size_t( i ) * source.stride );
+        VertexAttributeEncoder< TSemantic, TFormat >::Encode( values, source, vertices + size_t( i ) * vertexStride );
+    }
+}
+
+typedef void ( *WriteVertexAttributeFn )( const VertexAttributeSource& source, uint8_t* vertices, uint32_t vertexStride, uint32_t vertexCount );
+typedef void ( *SetVertexAttributeDecodeFn )( const VertexAttributeSource& source, apemodefb::vec4& decodeOffset, apemodefb::vec4& decodeScale );
+
+struct VertexAttributeWriter {
+    EVertexSemanticFb          semantic;
+    EVertexAttributeFormatFb   format;
+    uint32_t                   size;
+    WriteVertexAttributeFn     write;
+    SetVertexAttributeDecodeFn setDecode;
+};
+
+template < EVertexSemanticFb TSemantic, EVertexAttributeFormatFb TFormat >
+VertexAttributeWriter MakeVertexAttributeWriter( ) {
+    using Encoder = VertexAttributeEncoder< TSemantic, TFormat >;
+    return {TSemantic, TFormat, Encoder::kSize, &WriteVertexAttribute< TSemantic, TFormat >, &Encoder::SetDecode};
+}
+
+/**
+ * Returns the writer of the semantic and format or nullptr if the pair is not supported.
+ **/
+const VertexAttributeWriter* FindVertexAttributeWriter( const EVertexSemanticFb semantic, const EVertexAttributeFormatFb format ) {
+    static const VertexAttributeWriter kWriters[] = {
+        MakeVertexAttributeWriter< EVertexSemanticFb_Position, EVertexAttributeFormatFb_Float3 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Position, EVertexAttributeFormatFb_Unorm16x4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Position, EVertexAttributeFormatFb_Unorm10_10_10_2 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Normal, EVertexAttributeFormatFb_Float3 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Normal, EVertexAttributeFormatFb_Half4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Normal, EVertexAttributeFormatFb_Octahedral16 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Normal, EVertexAttributeFormatFb_Unorm8x4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Normal, EVertexAttributeFormatFb_Unorm10_10_10_2 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Tangent, EVertexAttributeFormatFb_Float4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Tangent, EVertexAttributeFormatFb_Half4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Tangent, EVertexAttributeFormatFb_Unorm8x4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Tangent, EVertexAttributeFormatFb_Unorm10_10_10_2 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Texcoord0, EVertexAttributeFormatFb_Float2 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Texcoord0, EVertexAttributeFormatFb_Half2 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Texcoord0, EVertexAttributeFormatFb_Unorm16x2 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Texcoord1, EVertexAttributeFormatFb_Float2 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Texcoord1, EVertexAttributeFormatFb_Half2 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Texcoord1, EVertexAttributeFormatFb_Unorm16x2 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Color, EVertexAttributeFormatFb_Float4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Color, EVertexAttributeFormatFb_Half4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Color, EVertexAttributeFormatFb_Unorm8x4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_Color, EVertexAttributeFormatFb_Unorm16x4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_BoneIndices, EVertexAttributeFormatFb_Float4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_BoneIndices, EVertexAttributeFormatFb_Uint8x4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_BoneWeights, EVertexAttributeFormatFb_Float4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_BoneWeights, EVertexAttributeFormatFb_Unorm8x4 >( ),
+        MakeVertexAttributeWriter< EVertexSemanticFb_BoneWeights, EVertexAttributeFormatFb_Unorm10_10_10_2 >( ),
+    };
+
+    for ( const auto& writer : kWriters ) {
+        if ( writer.semantic == semantic && writer.format == format )
+            return &writer;
+    }
+
+    return nullptr;
+}
+
+struct VertexLayoutName {
+    const char* name;
+    uint32_t    value;
+};
+
+static const VertexLayoutName kVertexSemanticNames[] = {
+    {"pos", EVertexSemanticFb_Position},
+    {"nrm", EVertexSemanticFb_Normal},
+    {"tan", EVertexSemanticFb_Tangent},
+    {"uv0", EVertexSemanticFb_Texcoord0},
+    {"uv1", EVertexSemanticFb_Texcoord1},
+    {"col", EVertexSemanticFb_Color},
+    {"bones", EVertexSemanticFb_BoneIndices},
+    {"weights", EVertexSemanticFb_BoneWeights},
+};
+
+static const VertexLayoutName kVertexAttributeFormatNames[] = {
+    {"f32x2", EVertexAttributeFormatFb_Float2},
+    {"f32x3", EVertexAttributeFormatFb_Float3},
+    {"f32x4", EVertexAttributeFormatFb_Float4},
+    {"half2", EVertexAttributeFormatFb_Half2},
+    {"half4", EVertexAttributeFormatFb_Half4},
+    {"rgba8", EVertexAttributeFormatFb_Unorm8x4},
+    {"unorm8x4", EVertexAttributeFormatFb_Unorm8x4},
+    {"unorm16x2", EVertexAttributeFormatFb_Unorm16x2},
+    {"unorm16x4", EVertexAttributeFormatFb_Unorm16x4},
+    {"rgb10a2", EVertexAttributeFormatFb_Unorm10_10_10_2},
+    {"oct16", EVertexAttributeFormatFb_Octahedral16},
+    {"u8x4", EVertexAttributeFormatFb_Uint8x4},
+};
+
+template < size_t TNameCount >
+bool FindVertexLayoutName( const VertexLayoutName ( &names )[ TNameCount ], const std::string& name, uint32_t& value ) {
+    for ( const auto& n : names ) {
+        if ( name == n.name ) {
+            value = n.value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * The position is the first attribute, the bone indices and weights are the last ones (see SplitVertexStreams).
+ **/
+inline uint32_t GetVertexSemanticRank( const EVertexSemanticFb semantic ) {
+    switch ( semantic ) {
+        case EVertexSemanticFb_Position:
+            return 0;
+        case EVertexSemanticFb_BoneIndices:
+        case EVertexSemanticFb_BoneWeights:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+/**
+ * Parses the vertex layout (--layout option), for example "pos:f32x3,nrm:oct16,uv0:unorm16x2,uv1:half2,col:rgba8".
+ * The attributes are reordered: the position is the first one (f32x3 if omitted), the bone indices and weights are
+ * the last ones, the other ones keep their order. The offsets are assigned per mesh (the unused attributes are dropped).
+ * @return False if the layout has unknown or duplicate semantics or unsupported formats.
+ **/
+bool ParseVertexLayout( const std::string& layout, std::vector< apemodefb::VertexAttributeFb >& attributes ) {
+    auto& s = apemode::Get( );
+
+    attributes.clear( );
+
+    size_t begin = 0;
+    while ( begin <= layout.size( ) ) {
+        size_t end = layout.find( ',', begin );
+        if ( std::string::npos == end )
+            end = layout.size( );
+
+        const std::string attribute = layout.substr( begin, end - begin );
+        const size_t      colon     = attribute.find( ':' );
+        begin                       = end + 1;
+
+        uint32_t semantic = 0;
+        uint32_t format   = 0;
+        if ( std::string::npos == colon || false == FindVertexLayoutName( kVertexSemanticNames, attribute.substr( 0, colon ), semantic ) ||
+             false == FindVertexLayoutName( kVertexAttributeFormatNames, attribute.substr( colon + 1 ), format ) ) {
+            s.console->error( "Vertex attribute \"{}\" is not semantic:format (pos, nrm, tan, uv0, uv1, col, bones, weights : "
+                              "f32x2, f32x3, f32x4, half2, half4, rgba8, unorm8x4, unorm16x2, unorm16x4, rgb10a2, oct16, u8x4).",
+                              attribute );
+            return false;
+        }
+
+        if ( nullptr == FindVertexAttributeWriter( EVertexSemanticFb( semantic ), EVertexAttributeFormatFb( format ) ) ) {
+            s.console->error( "Vertex attribute \"{}\" has unsupported format for its semantic.", attribute );
+            return false;
+        }
+
+        for ( const auto& a : attributes ) {
+            if ( a.semantic( ) == EVertexSemanticFb( semantic ) ) {
+                s.console->error( "Vertex attribute \"{}\" is duplicated.", attribute );
+                return false;
+            }
+        }
+
+        attributes.emplace_back( EVertexSemanticFb( semantic ), EVertexAttributeFormatFb( format ), 0, apemodefb::vec4( ), apemodefb::vec4( ) );
+    }
+
+    if ( attributes.end( ) == std::find_if( attributes.begin( ), attributes.end( ), []( const apemodefb::VertexAttributeFb& a ) {
+             return EVertexSemanticFb_Position == a.semantic( );
+         } ) ) {
+        attributes.emplace_back( EVertexSemanticFb_Position, EVertexAttributeFormatFb_Float3, 0, apemodefb::vec4( ), apemodefb::vec4( ) );
+    }
+
+    std::stable_sort( attributes.begin( ), attributes.end( ), []( const apemodefb::VertexAttributeFb& a, const apemodefb::VertexAttributeFb& b ) {
+        return GetVertexSemanticRank( a.semantic( ) ) < GetVertexSemanticRank( b.semantic( ) );
+    } );
+
+    return true;
+}
+
+/**
+ * Assigns the attribute offsets (the attribute sizes are multiples of 4 bytes).
+ * @return The vertex stride.
+ **/
+uint16_t AssignVertexAttributeOffsets( std::vector< apemodefb::VertexAttributeFb >& attributes ) {
+    uint32_t offset = 0;
+    for ( auto& attribute : attributes ) {
+        const VertexAttributeWriter* writer = FindVertexAttributeWriter( attribute.semantic( ), attribute.format( ) );
+        assert( nullptr != writer );
+
+        attribute.mutate_offset( (uint16_t) offset );
+        offset += writer->size;
+    }
+
+    return (uint16_t) offset;
+}
+
+/**
+ * Writes the vertices of the custom layout and fills the decode offsets and scales of the attributes.
+ * @param attributes The attributes with the assigned offsets.
+ * @param vertices The unpacked vertices (StaticVertexFb or StaticSkinnedVertexFb).
+ * @param texcoords1 The second texcoords per vertex (2 floats, null if the layout does not have them).
+ * @param colors The colors per vertex (4 floats, null if the layout does not have them).
+ * @param layoutVertices The output vertices.
+ **/
+void WriteVertexAttributes( std::vector< apemodefb::VertexAttributeFb >& attributes,
+                            const uint32_t                               layoutStride,
+                            const uint8_t*                               vertices,
+                            const uint32_t                               vertexStride,
+                            const float*                                 texcoords1,
+                            const float*                                 colors,
+                            const uint32_t                               vertexCount,
+                            std::vector< uint8_t >&                      layoutVertices ) {
+    layoutVertices.assign( size_t( vertexCount ) * layoutStride, 0 );
+
+    for ( auto& attribute : attributes ) {
+        const VertexAttributeWriter* writer = FindVertexAttributeWriter( attribute.semantic( ), attribute.format( ) );
+        assert( nullptr != writer );
+
+        /* The component offsets of StaticSkinnedVertexFb: position, normal, tangent, uv, weights and indices. */
+
+        VertexAttributeSource source;
+        source.values = vertices;
+        source.stride = vertexStride;
+        uint32_t boundsComponentCount = 0;
+
+        switch ( attribute.semantic( ) ) {
+            case EVertexSemanticFb_Position:
+                boundsComponentCount = 3;
+                break;
+            case EVertexSemanticFb_Normal:
+                source.values = vertices + 12;
+                break;
+            case EVertexSemanticFb_Tangent:
+                source.values = vertices + 24;
+                break;
+            case EVertexSemanticFb_Texcoord0:
+                source.values        = vertices + 40;
+                boundsComponentCount = 2;
+                break;
+            case EVertexSemanticFb_BoneWeights:
+                source.values = vertices + 48;
+                break;
+            case EVertexSemanticFb_BoneIndices:
+                source.values = vertices + 64;
+                break;
+            case EVertexSemanticFb_Texcoord1:
+                source.values        = reinterpret_cast< const uint8_t* >( texcoords1 );
+                source.stride        = sizeof( float ) * 2;
+                boundsComponentCount = 2;
+                break;
+            case EVertexSemanticFb_Color:
+                source.values = reinterpret_cast< const uint8_t* >( colors );
+                source.stride = sizeof( float ) * 4;
+                break;
+        }
+
+        for ( uint32_t k = 0; k < 4; ++k ) {
+            source.boundsMin[ k ] = k < boundsComponentCount ? std::numeric_limits< float >::max( ) : 0.0f;
+            source.boundsMax[ k ] = k < boundsComponentCount ? -std::numeric_limits< float >::max( ) : 1.0f;
+        }
+
+        for ( uint32_t i = 0; i < vertexCount; ++i ) {
+            const float* values = reinterpret_cast< const float* >( source.values + size_t( i ) * source.stride );
+            for ( uint32_t k = 0; k < boundsComponentCount; ++k ) {
+                source.boundsMin[ k ] = std::min( source.boundsMin[ k ], values[ k ] );
+                source.boundsMax[ k ] = std::max( source.boundsMax[ k ], values[ k ] );
+            }
+        }
+
+        for ( uint32_t k = 0; k < boundsComponentCount; ++k ) {
+            if ( false == ( source.boundsMax[ k ] > source.boundsMin[ k ] ) ) {
+                source.boundsMin[ k ] = vertexCount ? source.boundsMin[ k ] : 0.0f;
+                source.boundsMax[ k ] = source.boundsMin[ k ] + 1.0f;
+            }
+        }
+
+        writer->write( source, layoutVertices.data( ) + attribute.offset( ), layoutStride, vertexCount );
+        writer->setDecode( source, apemode::Mutable( attribute.mutable_decode_offset( ) ), apemode::Mutable( attribute.mutable_decode_scale( ) ) );
+    }
+}
+
+/**
+ * Returns the quantization step of the position attribute (zero for the float positions) for the BVH box padding.
+ **/
+mathfu::vec3 GetVertexPositionStep( const std::vector< apemodefb::VertexAttributeFb >& attributes ) {
+    for ( const auto& attribute : attributes ) {
+        if ( EVertexSemanticFb_Position != attribute.semantic( ) )
+            continue;
+
+        const mathfu::vec4 scale = Cast< mathfu::vec4 >( attribute.decode_scale( ) );
+        switch ( attribute.format( ) ) {
+            case EVertexAttributeFormatFb_Unorm16x4:
+                return mathfu::vec3( scale.x, scale.y, scale.z ) / 65535.0f;
+            case EVertexAttributeFormatFb_Unorm10_10_10_2:
+                return mathfu::vec3( scale.x, scale.y, scale.z ) / 1023.0f;
+            default:
+                break;
+        }
+    }
+
+    return mathfu::vec3( 0.0f );
+}
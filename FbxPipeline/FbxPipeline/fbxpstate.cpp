@@ -19,6 +19,7 @@ void SplitFilename( const std::string& filePath, std::string& parentFolderName,
 bool InitializeSdkObjects( FbxManager*& pManager, FbxScene*& pScene );
 void DestroySdkObjects( FbxManager* pManager );
 bool LoadScene( FbxManager* pManager, FbxDocument* pScene, const char* pFilename );
+bool ParseVertexLayout( const std::string& layout, std::vector< apemodefb::VertexAttributeFb >& attributes );
 
 apemode::State  s;
 apemode::State& apemode::Get( ) {
@@ -82,6 +83,105 @@ apemode::State& apemode::Main( int argc, char** argv ) {
             lvl = (spdlog::level::level_enum) s.options[ "log-level" ].as< int >( );
 
         s.console = CreateLogger( lvl, s.options[ "l" ].as< std::string >( ) );
+
+        if ( s.options[ "weld-epsilon" ].count( ) > 0 )
+            s.weldEpsilon = s.options[ "weld-epsilon" ].as< float >( );
+
+        s.optimizeOverdraw = s.options[ "optimize-overdraw" ].as< bool >( );
+        if ( s.options[ "overdraw-threshold" ].count( ) > 0 )
+            s.overdrawThreshold = s.options[ "overdraw-threshold" ].as< float >( );
+
+        s.buildMeshlets = s.options[ "meshlets" ].as< bool >( );
+        if ( s.options[ "meshlet-max-vertices" ].count( ) > 0 )
+            s.meshletMaxVertices = s.options[ "meshlet-max-vertices" ].as< uint32_t >( );
+        if ( s.options[ "meshlet-max-triangles" ].count( ) > 0 )
+            s.meshletMaxTriangles = s.options[ "meshlet-max-triangles" ].as< uint32_t >( );
+
+        if ( s.options[ "lods" ].count( ) > 0 )
+            s.lodCount = s.options[ "lods" ].as< uint32_t >( );
+        if ( s.options[ "lod-ratio" ].count( ) > 0 )
+            s.lodRatio = s.options[ "lod-ratio" ].as< float >( );
+
+        s.compressMeshes    = s.options[ "c" ].as< bool >( );
+        s.edgebreakerMeshes = s.options[ "edgebreaker" ].as< bool >( );
+        s.splitMeshes16     = s.options[ "split-16bit" ].as< bool >( );
+
+        s.splitVertexStreams = s.options[ "split-streams" ].as< bool >( );
+        if ( s.splitVertexStreams && s.edgebreakerMeshes ) {
+            s.console->warn( "Vertex streams are not split for the Edgebreaker blobs (interleaved vertices only)." );
+            s.splitVertexStreams = false;
+        }
+
+        s.buildPositionIndices = s.options[ "position-indices" ].as< bool >( );
+        if ( s.buildPositionIndices && s.edgebreakerMeshes ) {
+            s.console->warn( "Position indices are not built for the Edgebreaker blobs (the vertices are reordered)." );
+            s.buildPositionIndices = false;
+        }
+
+        s.buildBvh = s.options[ "bvh" ].as< bool >( );
+        if ( s.buildBvh && s.edgebreakerMeshes ) {
+            s.console->warn( "BVH is not built for the Edgebreaker blobs (the triangles are reordered)." );
+            s.buildBvh = false;
+        }
+
+        s.benchmarkBvh = s.options[ "bvh-benchmark" ].as< bool >( );
+        if ( s.benchmarkBvh && false == s.buildBvh ) {
+            s.console->warn( "BVH benchmark is skipped, the BVH is not built (--bvh)." );
+            s.benchmarkBvh = false;
+        }
+
+        s.instanceByContent = s.options[ "instance-by-content" ].as< bool >( );
+        s.sdkTriangulation  = s.options[ "sdk-triangulation" ].as< bool >( );
+
+        if ( s.options[ "bone-palette" ].count( ) > 0 ) {
+            /* Every triangle must fit into the palette (4 bones per each of 3 vertices). */
+            s.bonePaletteSize = s.options[ "bone-palette" ].as< uint32_t >( );
+            if ( s.bonePaletteSize && s.bonePaletteSize < 12 ) {
+                s.console->warn( "Bone palette size {} is too small, 12 is used.", s.bonePaletteSize );
+                s.bonePaletteSize = 12;
+            }
+        }
+
+        if ( s.options[ "j" ].count( ) > 0 )
+            s.jobCount = s.options[ "j" ].as< uint32_t >( );
+
+        if ( s.options[ "tangent-frame" ].count( ) > 0 ) {
+            const std::string tangentFrame = s.options[ "tangent-frame" ].as< std::string >( );
+            if ( "octahedral" == tangentFrame )
+                s.tangentFrameEncoding = eTangentFrameEncoding_Octahedral;
+            else if ( "qtangent" == tangentFrame )
+                s.tangentFrameEncoding = eTangentFrameEncoding_QTangent;
+            else if ( "10-10-10-2" != tangentFrame )
+                s.console->warn( "Unknown tangent frame encoding \"{}\", the default one is used.", tangentFrame );
+        }
+
+        if ( s.options[ "position-error" ].count( ) > 0 ) {
+            const std::string positionError = s.options[ "position-error" ].as< std::string >( );
+
+            char* unitPtr   = nullptr;
+            s.positionError = strtof( positionError.c_str( ), &unitPtr );
+
+            const std::string unit = unitPtr;
+            if ( s.positionError <= 0.0f )
+                s.console->warn( "Position error \"{}\" is not positive (ignored).", positionError );
+            else if ( "mm" == unit )
+                s.positionErrorUnit = 0.1f;
+            else if ( "cm" == unit )
+                s.positionErrorUnit = 1.0f;
+            else if ( "m" == unit )
+                s.positionErrorUnit = 100.0f;
+            else if ( false == unit.empty( ) )
+                s.console->warn( "Unknown position error unit \"{}\", scene units are used.", unit );
+        }
+
+        if ( s.options[ "layout" ].count( ) > 0 ) {
+            if ( false == ParseVertexLayout( s.options[ "layout" ].as< std::string >( ), s.vertexLayout ) ) {
+                s.console->warn( "Vertex layout is ignored (the fixed vertex formats are used)." );
+                s.vertexLayout.clear( );
+            } else if ( s.options[ "p" ].as< bool >( ) ) {
+                s.console->warn( "Vertex layout overrides mesh packing (-p, --tangent-frame and --position-error are ignored)." );
+            }
+        }
     } catch ( const cxxopts::OptionException& e ) {
         std::cerr << s.options.help( {"main"} ) << std::endl;
         std::cerr << "Error parsing options:" << e.what( ) << std::endl;
@@ -96,10 +196,11 @@ apemode::State::State( ) : options( GetExecutable( ) ) {
     options.add_options( "main" )( "o,output-file", "Output", cxxopts::value< std::string >( ) );
     options.add_options( "main" )( "password", "Password", cxxopts::value< std::string >( ) );
     options.add_options( "main" )( "k,convert", "Convert", cxxopts::value< bool >( ) );
-    options.add_options( "main" )( "c,compress", "Compress", cxxopts::value< bool >( ) );
+    options.add_options( "main" )( "c,compress", "Compress mesh vertex and index buffers (see fbxpcodec.h)", cxxopts::value< bool >( ) );
     options.add_options( "main" )( "p,pack-meshes", "Pack meshes", cxxopts::value< bool >( ) );
     options.add_options( "main" )( "s,split-meshes-per-material", "Split meshes per material", cxxopts::value< bool >( ) );
     options.add_options( "main" )( "t,optimize-meshes", "Optimize meshes", cxxopts::value< bool >( ) );
+    options.add_options( "main" )( "j,jobs", "Number of mesh export threads (1 - default, 0 - hardware concurrency)", cxxopts::value< uint32_t >( ) );
     options.add_options( "main" )( "e,search-location", "Add search location", cxxopts::value< std::vector< std::string > >( ) );
     options.add_options( "main" )( "m,embed-file", "Embed file", cxxopts::value< std::vector< std::string > >( ) );
     options.add_options( "main" )( "l,log-file", "Log file (relative or absolute path)", cxxopts::value< std::string >( ) );
@@ -107,6 +208,26 @@ apemode::State::State( ) : options( GetExecutable( ) ) {
     options.add_options( "main" )( "sync-keys", "Synchronize curve keys for properties", cxxopts::value< bool >( ) );
     options.add_options( "main" )( "reduce-keys", "Reduce the keys in the animation curves.", cxxopts::value< bool >( ) );
     options.add_options( "main" )( "reduce-const-keys", "Reduce constant keys in the animation curves.", cxxopts::value< bool >( ) );
+    options.add_options( "main" )( "weld-epsilon", "Tolerance for welding vertex components (0 - default, exact match).", cxxopts::value< float >( ) );
+    options.add_options( "main" )( "optimize-overdraw", "Reorder mesh triangle clusters to reduce overdraw (implies vertex cache optimization).", cxxopts::value< bool >( ) );
+    options.add_options( "main" )( "overdraw-threshold", "Maximum ACMR degradation for overdraw optimization (1.05 - default).", cxxopts::value< float >( ) );
+    options.add_options( "main" )( "meshlets", "Partition meshes into meshlets with culling bounds.", cxxopts::value< bool >( ) );
+    options.add_options( "main" )( "meshlet-max-vertices", "Maximum vertex count per meshlet (64 - default, up to 255).", cxxopts::value< uint32_t >( ) );
+    options.add_options( "main" )( "meshlet-max-triangles", "Maximum triangle count per meshlet (124 - default, up to 255).", cxxopts::value< uint32_t >( ) );
+    options.add_options( "main" )( "lods", "Number of simplified LODs to generate per mesh (0 - default).", cxxopts::value< uint32_t >( ) );
+    options.add_options( "main" )( "lod-ratio", "Triangle count ratio between the neighbouring LODs (0.5 - default).", cxxopts::value< float >( ) );
+    options.add_options( "main" )( "tangent-frame", "Tangent frame encoding for packed meshes: 10-10-10-2 (default), octahedral, qtangent.", cxxopts::value< std::string >( ) );
+    options.add_options( "main" )( "position-error", "Maximum world space position error for packed meshes, e.g. 0.1mm (mm, cm, m or scene units if omitted), bits per position axis are chosen per mesh.", cxxopts::value< std::string >( ) );
+    options.add_options( "main" )( "layout", "Vertex layout, e.g. pos:f32x3,nrm:oct16,uv0:unorm16x2,uv1:half2,col:rgba8 (the attributes, that the mesh or its materials do not use, are dropped per mesh).", cxxopts::value< std::string >( ) );
+    options.add_options( "main" )( "split-16bit", "Split meshes with 65535 or more vertices into submeshes with 16-bit indices.", cxxopts::value< bool >( ) );
+    options.add_options( "main" )( "bone-palette", "Maximum bones per skinned submesh, larger meshes are split into bone palettes (0 - default, unlimited, packed meshes are limited to 255), the meshlets are built per submesh.", cxxopts::value< uint32_t >( ) );
+    options.add_options( "main" )( "split-streams", "Split vertices into position, attribute and skin streams (for the depth and shadow passes).", cxxopts::value< bool >( ) );
+    options.add_options( "main" )( "position-indices", "Build the additional index buffer welded by position only (for the depth and shadow passes).", cxxopts::value< bool >( ) );
+    options.add_options( "main" )( "instance-by-content", "Merge the meshes with the same vertices and indices (the nodes that share the FbxMesh are always instanced).", cxxopts::value< bool >( ) );
+    options.add_options( "main" )( "bvh", "Build the triangle BVH of every mesh for the CPU raycasting and picking.", cxxopts::value< bool >( ) );
+    options.add_options( "main" )( "bvh-benchmark", "Measure the BVH ray throughput and verify the BVH against the brute force intersection per mesh (slow).", cxxopts::value< bool >( ) );
+    options.add_options( "main" )( "sdk-triangulation", "Triangulate the whole scene with the FBX SDK before the export (the meshes are triangulated natively in the export threads by default).", cxxopts::value< bool >( ) );
+    options.add_options( "main" )( "edgebreaker", "Encode meshes into the high-ratio Edgebreaker blobs for distribution builds (slow decoding, overrides -c).", cxxopts::value< bool >( ) );
     options.add_options( "main" )( "resample-framerate", "Frame rate at which animation curves will be resampled (60 - default, 0 - disable).", cxxopts::value< float >( ) );
 }
 
@@ -256,6 +377,7 @@ bool apemode::State::Finish( ) {
         curveBuilder.add_property( curve.property );
         curveBuilder.add_name_id( curve.nameId );
         curveBuilder.add_keys( keysOffset );
+        curveBuilder.add_blend_shape_channel_id( curve.blendShapeChannelId );
         curveOffsets.push_back( curveBuilder.Finish( ) );
     }
 
@@ -307,8 +429,12 @@ bool apemode::State::Finish( ) {
                         } );
 
         console->info( "+ link ids {} ", skin.linkFbxIds.size( ) );
+        console->info( "+ bone palettes {} ", skin.bonePalettes.size( ) );
 
-        return apemodefb::CreateSkinFb( builder, skin.nameId, builder.CreateVector( tempLinkIndices ) );
+        return apemodefb::CreateSkinFb( builder,
+                                        skin.nameId,
+                                        builder.CreateVector( tempLinkIndices ),
+                                        builder.CreateVector( skin.bonePalettes ) );
     } );
 
     auto skinsOffset = builder.CreateVector( skinOffsets );
@@ -332,12 +458,92 @@ bool apemode::State::Finish( ) {
         auto ssOffset = builder.CreateVectorOfStructs( mesh.subsets );
         auto siOffset = builder.CreateVector( mesh.indices );
 
+        flatbuffers::Offset< flatbuffers::Vector< uint8_t > > piOffset;
+        if ( false == mesh.positionIndices.empty( ) )
+            piOffset = builder.CreateVector( mesh.positionIndices );
+
+        flatbuffers::Offset< flatbuffers::Vector< uint8_t > > blOffset;
+        if ( false == mesh.blob.empty( ) )
+            blOffset = builder.CreateVector( mesh.blob );
+
+        auto inOffset = builder.CreateVector( mesh.instanceNodeIds );
+
+        flatbuffers::Offset< flatbuffers::Vector< flatbuffers::Offset< apemodefb::BlendShapeChannelFb > > > bcOffset;
+        if ( false == mesh.blendShapeChannels.empty( ) ) {
+            std::vector< flatbuffers::Offset< apemodefb::BlendShapeChannelFb > > channelOffsets;
+            channelOffsets.reserve( mesh.blendShapeChannels.size( ) );
+
+            for ( auto& channel : mesh.blendShapeChannels ) {
+                std::vector< flatbuffers::Offset< apemodefb::BlendShapeTargetFb > > targetOffsets;
+                targetOffsets.reserve( channel.targets.size( ) );
+
+                for ( auto& target : channel.targets ) {
+                    auto deltasOffset = builder.CreateVectorOfStructs( target.deltas );
+
+                    apemodefb::BlendShapeTargetFbBuilder targetBuilder( builder );
+                    targetBuilder.add_full_weight( target.fullWeight );
+                    targetBuilder.add_deltas( deltasOffset );
+                    targetOffsets.push_back( targetBuilder.Finish( ) );
+                }
+
+                auto targetsOffset = builder.CreateVector( targetOffsets );
+
+                apemodefb::BlendShapeChannelFbBuilder channelBuilder( builder );
+                channelBuilder.add_name_id( channel.nameId );
+                channelBuilder.add_default_weight( channel.defaultWeight );
+                channelBuilder.add_position_offset( &channel.positionOffset );
+                channelBuilder.add_position_scale( &channel.positionScale );
+                channelBuilder.add_normal_offset( &channel.normalOffset );
+                channelBuilder.add_normal_scale( &channel.normalScale );
+                channelBuilder.add_targets( targetsOffset );
+                channelOffsets.push_back( channelBuilder.Finish( ) );
+            }
+
+            bcOffset = builder.CreateVector( channelOffsets );
+        }
+
+        flatbuffers::Offset< flatbuffers::Vector< const apemodefb::BvhNodeFb* > > bnOffset;
+        flatbuffers::Offset< flatbuffers::Vector< uint32_t > >                    btOffset;
+        if ( false == mesh.bvhNodes.empty( ) ) {
+            bnOffset = builder.CreateVectorOfStructs( mesh.bvhNodes );
+            btOffset = builder.CreateVector( mesh.bvhTriangles );
+        }
+
+        flatbuffers::Offset< flatbuffers::Vector< const apemodefb::VertexAttributeFb* > > vaOffset;
+        if ( false == mesh.vertexAttributes.empty( ) )
+            vaOffset = builder.CreateVectorOfStructs( mesh.vertexAttributes );
+
+        auto sbOffset = builder.CreateVectorOfStructs( mesh.subsetBounds );
+        auto mbOffset = builder.CreateVectorOfStructs( mesh.submeshBounds );
+
+        flatbuffers::Offset< flatbuffers::Vector< const apemodefb::MeshletFb* > > mlOffset;
+        flatbuffers::Offset< flatbuffers::Vector< uint32_t > >                    mvOffset;
+        flatbuffers::Offset< flatbuffers::Vector< uint8_t > >                     miOffset;
+        if ( false == mesh.meshlets.empty( ) ) {
+            mlOffset = builder.CreateVectorOfStructs( mesh.meshlets );
+            mvOffset = builder.CreateVector( mesh.meshletVertices );
+            miOffset = builder.CreateVector( mesh.meshletIndices );
+        }
+
         apemodefb::MeshFbBuilder meshBuilder( builder );
         meshBuilder.add_vertices( vsOffset );
         meshBuilder.add_submeshes( smOffset );
         meshBuilder.add_subsets( ssOffset );
         meshBuilder.add_indices( siOffset );
+        meshBuilder.add_meshlets( mlOffset );
+        meshBuilder.add_meshlet_vertices( mvOffset );
+        meshBuilder.add_meshlet_indices( miOffset );
         meshBuilder.add_index_type( mesh.indexType );
+        meshBuilder.add_vertices_compressed( mesh.verticesCompressed );
+        meshBuilder.add_blob( blOffset );
+        meshBuilder.add_subset_bounds( sbOffset );
+        meshBuilder.add_submesh_bounds( mbOffset );
+        meshBuilder.add_position_indices( piOffset );
+        meshBuilder.add_instance_node_ids( inOffset );
+        meshBuilder.add_blend_shape_channels( bcOffset );
+        meshBuilder.add_bvh_nodes( bnOffset );
+        meshBuilder.add_bvh_triangles( btOffset );
+        meshBuilder.add_vertex_attributes( vaOffset );
         meshBuilder.add_skin_id( mesh.skinId );
         meshOffsets.push_back( meshBuilder.Finish( ) );
     }
@@ -449,6 +655,9 @@ bool apemode::State::Finish( ) {
 uint64_t apemode::State::PushName( std::string const& name ) {
     const uint64_t hash = CityHash64( name.data( ), name.size( ) );
 
+    /* Names can be pushed from the mesh export threads. */
+    std::lock_guard< std::mutex > lock( namesMutex );
+
 #if _DEBUG
     auto it = names.find( hash );
     if ( it == names.end( ) ) {
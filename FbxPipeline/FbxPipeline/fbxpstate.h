@@ -20,6 +20,33 @@ namespace apemode {
     struct Skin {
         uint64_t                nameId = (uint64_t) 0;
         std::vector< uint64_t > linkFbxIds;
+        std::vector< uint16_t > bonePalettes;
+    };
+
+    struct BlendShapeTarget {
+        float                                       fullWeight = 100.0f;
+        std::vector< apemodefb::BlendShapeDeltaFb > deltas;
+    };
+
+    struct BlendShapeChannel {
+        uint64_t                        nameId        = (uint64_t) 0;
+        float                           defaultWeight = 0.0f;
+        apemodefb::vec3                 positionOffset;
+        apemodefb::vec3                 positionScale;
+        apemodefb::vec3                 normalOffset;
+        apemodefb::vec3                 normalScale;
+        std::vector< BlendShapeTarget > targets;
+    };
+
+    /**
+     * Triangles of the mesh polygons (see TriangulateMesh in fbxptriangulate.cpp), 3 corners per triangle.
+     * The corners reference the polygon vertices (FbxMesh::GetPolygonVertices), so the attributes mapped by polygon
+     * vertex or by polygon are extracted without the triangulated copy of the mesh.
+     **/
+    struct MeshTriangles {
+        std::vector< uint32_t > cornerPolygonVertices; // Polygon vertex index per corner (in the exported winding order).
+        std::vector< uint32_t > trianglePolygons;      // Polygon index per triangle.
+        std::vector< uint32_t > polygonBaseTriangles;  // First triangle per polygon (polygon count + 1 entries).
     };
 
     struct Mesh {
@@ -35,9 +62,22 @@ namespace apemode {
         std::vector< apemodefb::SubmeshFb > submeshes;
         std::vector< apemodefb::SubsetFb >  subsets;
         std::vector< uint8_t >              indices;
+        std::vector< uint8_t >              positionIndices;
         std::vector< uint8_t >              vertices;
+        std::vector< apemodefb::MeshletFb > meshlets;
+        std::vector< uint32_t >             meshletVertices;
+        std::vector< uint8_t >              meshletIndices;
+        std::vector< uint8_t >              blob;
+        std::vector< apemodefb::BoundsFb >  subsetBounds;
+        std::vector< apemodefb::BoundsFb >  submeshBounds;
         std::vector< uint32_t >             animCurveIds;
+        std::vector< uint32_t >             instanceNodeIds;
+        std::vector< BlendShapeChannel >    blendShapeChannels;
+        std::vector< apemodefb::BvhNodeFb > bvhNodes;
+        std::vector< uint32_t >             bvhTriangles;
+        std::vector< apemodefb::VertexAttributeFb > vertexAttributes;
         apemodefb::EIndexTypeFb             indexType;
+        bool                                verticesCompressed = false;
         uint32_t                            skinId = -1;
     };
 
@@ -80,6 +120,7 @@ namespace apemode {
         uint64_t                      nameId;
         apemodefb::EAnimCurveProperty property;
         apemodefb::EAnimCurveChannel  channel;
+        uint32_t                      blendShapeChannelId = 0;
         std::vector< AnimCurveKey >   keys;
     };
 
@@ -89,6 +130,15 @@ namespace apemode {
         std::vector< apemodefb::MaterialPropFb > props;
     };
 
+    /**
+     * The tangent frame encoding for the packed vertices.
+     **/
+    enum ETangentFrameEncoding {
+        eTangentFrameEncoding_10_10_10_2, // Separate normal and tangent words (Packed, PackedSkinned).
+        eTangentFrameEncoding_Octahedral, // Octahedral normal and tangent angle in a single word.
+        eTangentFrameEncoding_QTangent,   // Tangent frame quaternion in a single word.
+    };
+
     using TupleUintUint = std::tuple< uint32_t, uint32_t >;
 
     struct State;
@@ -113,6 +163,7 @@ namespace apemode {
         std::map< uint64_t, uint32_t >        animStackDict;
         std::map< uint64_t, uint32_t >        animLayerDict;
         std::map< uint64_t, std::string >     names;
+        std::mutex                            namesMutex;
         std::vector< apemodefb::TransformFb > transforms;
         std::vector< apemodefb::TextureFb >   textures;
         std::vector< apemodefb::CameraFb >    cameras;
@@ -125,10 +176,33 @@ namespace apemode {
         std::vector< std::string >            searchLocations;
         std::set< std::string >               embedQueue;
         std::set< std::string >               missingQueue;
-        float                                 resampleFPS       = 24.0f;
-        bool                                  reduceKeys        = false;
-        bool                                  reduceConstKeys   = false;
-        bool                                  propertyCurveSync = true;
+        float                                 resampleFPS          = 24.0f;
+        bool                                  reduceKeys           = false;
+        bool                                  reduceConstKeys      = false;
+        bool                                  propertyCurveSync    = true;
+        float                                 weldEpsilon          = 0.0f;
+        bool                                  optimizeOverdraw     = false;
+        float                                 overdrawThreshold    = 1.05f;
+        bool                                  buildMeshlets        = false;
+        uint32_t                              meshletMaxVertices   = 64;
+        uint32_t                              meshletMaxTriangles  = 124;
+        uint32_t                              lodCount             = 0;
+        float                                 lodRatio             = 0.5f;
+        uint32_t                              jobCount             = 1;
+        ETangentFrameEncoding                 tangentFrameEncoding = eTangentFrameEncoding_10_10_10_2;
+        float                                 positionError        = 0.0f;
+        float                                 positionErrorUnit    = 0.0f; // Centimeters per error unit, 0 - scene units.
+        bool                                  compressMeshes       = false;
+        bool                                  edgebreakerMeshes    = false;
+        bool                                  splitMeshes16        = false;
+        uint32_t                              bonePaletteSize      = 0; // Maximum bones per submesh, 0 - unlimited.
+        bool                                  splitVertexStreams   = false;
+        bool                                  buildPositionIndices = false;
+        bool                                  instanceByContent    = false;
+        bool                                  sdkTriangulation     = false;
+        bool                                  buildBvh             = false;
+        bool                                  benchmarkBvh         = false;
+        std::vector< apemodefb::VertexAttributeFb > vertexLayout; // Requested attributes (--layout), empty - fixed formats.
 
         State( );
         ~State( );
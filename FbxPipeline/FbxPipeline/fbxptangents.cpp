@@ -0,0 +1,276 @@
+#include <fbxppch.h>
+#include <fbxpstate.h>
+#include <thread>
+
+/**
+ * Normal and tangent generation for the meshes without the normal or tangent layers.
+ * The generators work on the polygon corners (3 per triangle), but the corners are connected like the welded
+ * vertices: the normals are smoothed across the corners of the same control point, the tangents are shared by the
+ * corners with the same control point, normal, texcoords and texture space orientation (the groups are found in the
+ * corner lists of the control points, so no global vertex hashing is needed).
+ * The tangents follow MikkTSpace (the angle weighted texture space directions projected to the vertex normals,
+ * the bitangent sign from the texture space orientation), so the normal maps baked against MikkTSpace match.
+ * The triangles are processed in parallel ranges writing the per corner contributions, then the vertices gather
+ * their contributions in parallel ranges, so there are no atomics and the results do not depend on the thread count.
+ **/
+
+static const uint32_t kParallelRangeSize = 16384;
+
+//
+// See implementation in fbxpmesh.cpp.
+//
+
+bool IsMeshExportWorker( );
+
+/**
+ * Runs the function for the ranges of [0; count) in the worker threads (-j option).
+ * The small counts are processed in the calling thread, as well as all the counts on the mesh export workers
+ * (the meshes are already processed in parallel, so the threads are not multiplied).
+ **/
+template < typename TFunction >
+void ParallelRanges( uint32_t count, TFunction function ) {
+    auto& s = apemode::Get( );
+
+    uint32_t jobCount = s.jobCount ? s.jobCount : std::max( 1u, std::thread::hardware_concurrency( ) );
+    jobCount          = std::min( jobCount, ( count + kParallelRangeSize - 1 ) / kParallelRangeSize );
+    if ( IsMeshExportWorker( ) )
+        jobCount = 1;
+
+    if ( jobCount <= 1 ) {
+        function( 0, count );
+        return;
+    }
+
+    const uint32_t             rangeSize = ( count + jobCount - 1 ) / jobCount;
+    std::vector< std::thread > workers;
+    workers.reserve( jobCount );
+
+    for ( uint32_t i = 0; i < jobCount; ++i ) {
+        const uint32_t begin = std::min( i * rangeSize, count );
+        const uint32_t end   = std::min( begin + rangeSize, count );
+        workers.emplace_back( [&function, begin, end]( ) { function( begin, end ); } );
+    }
+
+    for ( auto& worker : workers ) {
+        worker.join( );
+    }
+}
+
+/**
+ * Builds the corner lists of the vertices (the counting sort of the corners by their vertices).
+ * The corners of the vertex v are corners[ offsets[ v ] ], ..., corners[ offsets[ v + 1 ] - 1 ].
+ **/
+void BuildVertexCorners( const uint32_t*          cornerVertices,
+                         uint32_t                 cornerCount,
+                         uint32_t                 vertexCount,
+                         std::vector< uint32_t >& offsets,
+                         std::vector< uint32_t >& corners ) {
+    offsets.assign( vertexCount + 1, 0 );
+    for ( uint32_t c = 0; c < cornerCount; ++c ) {
+        ++offsets[ cornerVertices[ c ] + 1 ];
+    }
+
+    for ( uint32_t v = 0; v < vertexCount; ++v ) {
+        offsets[ v + 1 ] += offsets[ v ];
+    }
+
+    std::vector< uint32_t > cursors( offsets.begin( ), offsets.end( ) - 1 );
+    corners.resize( cornerCount );
+    for ( uint32_t c = 0; c < cornerCount; ++c ) {
+        corners[ cursors[ cornerVertices[ c ] ]++ ] = c;
+    }
+}
+
+/**
+ * Returns the angle between the (projected) triangle edges at the corner.
+ **/
+inline float GetCornerAngle( mathfu::vec3 e1, mathfu::vec3 e2 ) {
+    const float l1 = e1.Length( );
+    const float l2 = e2.Length( );
+    if ( l1 <= 0.0f || l2 <= 0.0f )
+        return 0.0f;
+
+    return acosf( std::max( -1.0f, std::min( 1.0f, mathfu::dot( e1, e2 ) / ( l1 * l2 ) ) ) );
+}
+
+inline mathfu::vec3 GetPosition( const float* controlPoints, const uint32_t* cornerControlPoints, uint32_t c ) {
+    return mathfu::vec3( controlPoints + cornerControlPoints[ c ] * 3 );
+}
+
+/**
+ * Generates the angle weighted smooth normals.
+ * @param controlPoints The control point positions (3 floats per control point).
+ * @param cornerControlPoints The control points of the corners (3 corners per triangle).
+ * @param normals The corner normals (3 floats per corner).
+ **/
+void GenerateNormals( const float*    controlPoints,
+                      uint32_t        controlPointCount,
+                      const uint32_t* cornerControlPoints,
+                      uint32_t        cornerCount,
+                      float*          normals ) {
+    std::vector< mathfu::vec3 > contributions( cornerCount );
+
+    ParallelRanges( cornerCount / 3, [&]( uint32_t begin, uint32_t end ) {
+        for ( uint32_t t = begin; t < end; ++t ) {
+            const mathfu::vec3 p[ 3 ] = {GetPosition( controlPoints, cornerControlPoints, t * 3 + 0 ),
+                                         GetPosition( controlPoints, cornerControlPoints, t * 3 + 1 ),
+                                         GetPosition( controlPoints, cornerControlPoints, t * 3 + 2 )};
+
+            mathfu::vec3 n      = mathfu::cross( p[ 1 ] - p[ 0 ], p[ 2 ] - p[ 0 ] );
+            const float  length = n.Length( );
+            n                   = length > 0.0f ? n / length : mathfu::vec3( 0.0f );
+
+            for ( uint32_t k = 0; k < 3; ++k ) {
+                const mathfu::vec3 e1 = p[ ( k + 1 ) % 3 ] - p[ k ];
+                const mathfu::vec3 e2 = p[ ( k + 2 ) % 3 ] - p[ k ];
+                contributions[ t * 3 + k ] = n * GetCornerAngle( e1, e2 );
+            }
+        }
+    } );
+
+    std::vector< uint32_t > offsets;
+    std::vector< uint32_t > corners;
+    BuildVertexCorners( cornerControlPoints, cornerCount, controlPointCount, offsets, corners );
+
+    ParallelRanges( controlPointCount, [&]( uint32_t begin, uint32_t end ) {
+        for ( uint32_t v = begin; v < end; ++v ) {
+            mathfu::vec3 n( 0.0f );
+            for ( uint32_t i = offsets[ v ]; i < offsets[ v + 1 ]; ++i ) {
+                n += contributions[ corners[ i ] ];
+            }
+
+            /* The vertices of the degenerate triangles only get the default normal. */
+            const float length = n.Length( );
+            n                  = length > 0.0f ? n / length : mathfu::vec3( 0.0f, 0.0f, 1.0f );
+
+            for ( uint32_t i = offsets[ v ]; i < offsets[ v + 1 ]; ++i ) {
+                float* dst = normals + corners[ i ] * 3;
+                dst[ 0 ]   = n.x;
+                dst[ 1 ]   = n.y;
+                dst[ 2 ]   = n.z;
+            }
+        }
+    } );
+}
+
+/**
+ * Generates MikkTSpace tangents.
+ * The triangles without the texture space area do not contribute to the tangents (their corners get the tangents of
+ * the neighbouring corners in their group, or the tangent perpendicular to the normal).
+ * @param controlPoints The control point positions (3 floats per control point).
+ * @param cornerControlPoints The control points of the corners (3 corners per triangle).
+ * @param normals The corner normals (3 floats per corner).
+ * @param uvs The corner texcoords (2 floats per corner).
+ * @param tangents The corner tangents (4 floats per corner, w is the bitangent sign).
+ **/
+void GenerateTangents( const float*    controlPoints,
+                       uint32_t        controlPointCount,
+                       const uint32_t* cornerControlPoints,
+                       const float*    normals,
+                       const float*    uvs,
+                       uint32_t        cornerCount,
+                       float*          tangents ) {
+    std::vector< mathfu::vec3 > contributions( cornerCount );
+    std::vector< uint8_t >      orientations( cornerCount / 3 );
+
+    ParallelRanges( cornerCount / 3, [&]( uint32_t begin, uint32_t end ) {
+        for ( uint32_t t = begin; t < end; ++t ) {
+            const uint32_t     c0     = t * 3;
+            const mathfu::vec3 p[ 3 ] = {GetPosition( controlPoints, cornerControlPoints, c0 + 0 ),
+                                         GetPosition( controlPoints, cornerControlPoints, c0 + 1 ),
+                                         GetPosition( controlPoints, cornerControlPoints, c0 + 2 )};
+
+            const mathfu::vec3 d1  = p[ 1 ] - p[ 0 ];
+            const mathfu::vec3 d2  = p[ 2 ] - p[ 0 ];
+            const float        t21x = uvs[ c0 * 2 + 2 ] - uvs[ c0 * 2 + 0 ];
+            const float        t21y = uvs[ c0 * 2 + 3 ] - uvs[ c0 * 2 + 1 ];
+            const float        t31x = uvs[ c0 * 2 + 4 ] - uvs[ c0 * 2 + 0 ];
+            const float        t31y = uvs[ c0 * 2 + 5 ] - uvs[ c0 * 2 + 1 ];
+
+            /* The texture space orientation, the direction of increasing u (flipped for the mirrored triangles). */
+            const float  signedArea = t21x * t31y - t21y * t31x;
+            const bool   orient     = signedArea >= 0.0f;
+            mathfu::vec3 os         = d1 * t31y - d2 * t21y;
+            const float  osLength   = os.Length( );
+            os                      = signedArea != 0.0f && osLength > 0.0f ? os * ( ( orient ? 1.0f : -1.0f ) / osLength ) : mathfu::vec3( 0.0f );
+
+            orientations[ t ] = orient ? 1 : 0;
+
+            for ( uint32_t k = 0; k < 3; ++k ) {
+                const mathfu::vec3 n( normals + ( c0 + k ) * 3 );
+
+                /* The direction and the edges are projected to the tangent plane of the corner normal. */
+                mathfu::vec3 cornerOs = os - n * mathfu::dot( n, os );
+                const float  length   = cornerOs.Length( );
+                cornerOs              = length > 0.0f ? cornerOs / length : mathfu::vec3( 0.0f );
+
+                mathfu::vec3 e1 = p[ ( k + 1 ) % 3 ] - p[ k ];
+                mathfu::vec3 e2 = p[ ( k + 2 ) % 3 ] - p[ k ];
+                e1 -= n * mathfu::dot( n, e1 );
+                e2 -= n * mathfu::dot( n, e2 );
+
+                contributions[ c0 + k ] = cornerOs * GetCornerAngle( e1, e2 );
+            }
+        }
+    } );
+
+    /* The corners of the control point with the same normal, texcoords and orientation (the group) share the tangent,
+       the group is represented by its first corner in the control point list. */
+
+    std::vector< uint32_t > offsets;
+    std::vector< uint32_t > corners;
+    BuildVertexCorners( cornerControlPoints, cornerCount, controlPointCount, offsets, corners );
+
+    auto isSameGroup = [&]( uint32_t c0, uint32_t c1 ) {
+        return orientations[ c0 / 3 ] == orientations[ c1 / 3 ] && uvs[ c0 * 2 + 0 ] == uvs[ c1 * 2 + 0 ] &&
+               uvs[ c0 * 2 + 1 ] == uvs[ c1 * 2 + 1 ] && normals[ c0 * 3 + 0 ] == normals[ c1 * 3 + 0 ] &&
+               normals[ c0 * 3 + 1 ] == normals[ c1 * 3 + 1 ] && normals[ c0 * 3 + 2 ] == normals[ c1 * 3 + 2 ];
+    };
+
+    ParallelRanges( controlPointCount, [&]( uint32_t begin, uint32_t end ) {
+        std::vector< uint32_t >     groups;
+        std::vector< mathfu::vec3 > groupTangents;
+
+        for ( uint32_t v = begin; v < end; ++v ) {
+            const uint32_t cornerBegin = offsets[ v ];
+            const uint32_t cornerEnd   = offsets[ v + 1 ];
+
+            groups.resize( cornerEnd - cornerBegin );
+            groupTangents.assign( cornerEnd - cornerBegin, mathfu::vec3( 0.0f ) );
+
+            for ( uint32_t i = cornerBegin; i < cornerEnd; ++i ) {
+                uint32_t group = i - cornerBegin;
+                for ( uint32_t j = cornerBegin; j < i; ++j ) {
+                    if ( isSameGroup( corners[ j ], corners[ i ] ) ) {
+                        group = groups[ j - cornerBegin ];
+                        break;
+                    }
+                }
+
+                groups[ i - cornerBegin ] = group;
+                groupTangents[ group ] += contributions[ corners[ i ] ];
+            }
+
+            for ( uint32_t i = cornerBegin; i < cornerEnd; ++i ) {
+                const uint32_t     c = corners[ i ];
+                const mathfu::vec3 n( normals + c * 3 );
+
+                mathfu::vec3 tangent = groupTangents[ groups[ i - cornerBegin ] ];
+                float        length  = tangent.Length( );
+                if ( length <= 0.0f ) {
+                    /* Any direction perpendicular to the normal. */
+                    tangent = mathfu::cross( n, fabsf( n.x ) < 0.9f ? mathfu::vec3( 1.0f, 0.0f, 0.0f ) : mathfu::vec3( 0.0f, 1.0f, 0.0f ) );
+                    length  = tangent.Length( );
+                }
+
+                tangent = length > 0.0f ? tangent / length : mathfu::vec3( 1.0f, 0.0f, 0.0f );
+
+                float* dst = tangents + c * 4;
+                dst[ 0 ]   = tangent.x;
+                dst[ 1 ]   = tangent.y;
+                dst[ 2 ]   = tangent.z;
+                dst[ 3 ]   = orientations[ c / 3 ] ? 1.0f : -1.0f;
+            }
+        }
+    } );
+}
@@ -0,0 +1,277 @@
+#include <fbxppch.h>
+#include <fbxpstate.h>
+
+/**
+ * Native triangulation of the mesh polygons.
+ * The polygons are triangulated on their polygon vertex arrays, so the FBX scene is not changed and the meshes are
+ * triangulated in the mesh export threads (the FbxGeometryConverter triangulates the copies of the meshes in the
+ * main thread). The convex quads are split, the other polygons are ear clipped in the plane of the polygon.
+ * The degenerate and self-intersecting polygons are reported, the mesh is triangulated with the FBX SDK in this case.
+ **/
+
+/**
+ * Polygon vertex projected onto the plane of the polygon.
+ **/
+struct PolygonPoint {
+    double x;
+    double y;
+};
+
+/**
+ * Doubled signed area of the triangle (positive for the counter-clockwise triangles).
+ **/
+inline double GetDoubledArea( const PolygonPoint& a, const PolygonPoint& b, const PolygonPoint& c ) {
+    return ( b.x - a.x ) * ( c.y - a.y ) - ( b.y - a.y ) * ( c.x - a.x );
+}
+
+inline bool IsSamePoint( const PolygonPoint& a, const PolygonPoint& b ) {
+    return a.x == b.x && a.y == b.y;
+}
+
+/**
+ * Returns true if the point is inside or on the border of the counter-clockwise triangle.
+ **/
+inline bool IsInsideTriangle( const PolygonPoint& p, const PolygonPoint& a, const PolygonPoint& b, const PolygonPoint& c ) {
+    return GetDoubledArea( a, b, p ) >= 0.0 && GetDoubledArea( b, c, p ) >= 0.0 && GetDoubledArea( c, a, p ) >= 0.0;
+}
+
+/**
+ * Returns true if the segments cross each other (the touching and overlapping segments do not cross).
+ **/
+inline bool IsCrossing( const PolygonPoint& a, const PolygonPoint& b, const PolygonPoint& c, const PolygonPoint& d, double epsilon ) {
+    const double abc = GetDoubledArea( a, b, c );
+    const double abd = GetDoubledArea( a, b, d );
+    const double cda = GetDoubledArea( c, d, a );
+    const double cdb = GetDoubledArea( c, d, b );
+    return ( ( abc > epsilon && abd < -epsilon ) || ( abc < -epsilon && abd > epsilon ) ) &&
+           ( ( cda > epsilon && cdb < -epsilon ) || ( cda < -epsilon && cdb > epsilon ) );
+}
+
+/**
+ * Returns true if any two non-adjacent edges of the polygon cross each other.
+ **/
+bool IsSelfIntersecting( const std::vector< PolygonPoint >& points, double epsilon ) {
+    const uint32_t n = (uint32_t) points.size( );
+    for ( uint32_t i = 0; i < n; ++i ) {
+        const uint32_t ii = ( i + 1 ) % n;
+        for ( uint32_t j = i + 2; j < n; ++j ) {
+            const uint32_t jj = ( j + 1 ) % n;
+            if ( jj != i && IsCrossing( points[ i ], points[ ii ], points[ j ], points[ jj ], epsilon ) ) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Ear clipping of the counter-clockwise polygon, the triangles keep the orientation of the polygon.
+ * The collinear vertices are clipped without triangles, if there are no ears left.
+ * @param epsilon The doubled area of the degenerate triangles.
+ * @return False if the polygon has no ears (the triangles are incomplete in this case).
+ **/
+bool ClipEars( const std::vector< PolygonPoint >& points, double epsilon, std::vector< uint32_t >& triangles ) {
+    const uint32_t n = (uint32_t) points.size( );
+
+    std::vector< uint32_t > prev( n );
+    std::vector< uint32_t > next( n );
+    for ( uint32_t i = 0; i < n; ++i ) {
+        prev[ i ] = ( i + n - 1 ) % n;
+        next[ i ] = ( i + 1 ) % n;
+    }
+
+    auto isEar = [&]( uint32_t b ) {
+        const uint32_t a = prev[ b ];
+        const uint32_t c = next[ b ];
+        if ( GetDoubledArea( points[ a ], points[ b ], points[ c ] ) <= epsilon )
+            return false;
+
+        /* The duplicated points (bridges of the polygons with holes) do not block the ear. */
+        for ( uint32_t r = next[ c ]; r != a; r = next[ r ] ) {
+            if ( IsSamePoint( points[ r ], points[ a ] ) || IsSamePoint( points[ r ], points[ b ] ) ||
+                 IsSamePoint( points[ r ], points[ c ] ) )
+                continue;
+            if ( IsInsideTriangle( points[ r ], points[ a ], points[ b ], points[ c ] ) )
+                return false;
+        }
+
+        return true;
+    };
+
+    auto clip = [&]( uint32_t b ) {
+        next[ prev[ b ] ] = next[ b ];
+        prev[ next[ b ] ] = prev[ b ];
+    };
+
+    uint32_t remaining     = n;
+    uint32_t b             = 0;
+    uint32_t stall         = 0; // Vertices visited since the last clip.
+    bool     clipCollinear = false;
+
+    while ( remaining > 3 ) {
+        if ( isEar( b ) ) {
+            triangles.push_back( prev[ b ] );
+            triangles.push_back( b );
+            triangles.push_back( next[ b ] );
+        } else if ( false == clipCollinear ||
+                    fabs( GetDoubledArea( points[ prev[ b ] ], points[ b ], points[ next[ b ] ] ) ) > epsilon ) {
+            b = next[ b ];
+            if ( ++stall >= remaining ) {
+                if ( clipCollinear )
+                    return false;
+                clipCollinear = true;
+                stall         = 0;
+            }
+            continue;
+        }
+
+        clip( b );
+        b             = prev[ b ];
+        stall         = 0;
+        clipCollinear = false;
+        --remaining;
+    }
+
+    if ( GetDoubledArea( points[ prev[ b ] ], points[ b ], points[ next[ b ] ] ) > epsilon ) {
+        triangles.push_back( prev[ b ] );
+        triangles.push_back( b );
+        triangles.push_back( next[ b ] );
+    }
+
+    return true;
+}
+
+/**
+ * Triangulates the polygon with more than 3 vertices.
+ * @param polygonVertices The control points of the polygon vertices.
+ * @param triangles The local polygon vertex indices, 3 per triangle (in the polygon orientation).
+ * @return False for the degenerate and self-intersecting polygons.
+ **/
+bool TriangulatePolygon( const FbxVector4*            pControlPoints,
+                         const int*                   polygonVertices,
+                         uint32_t                     polygonSize,
+                         std::vector< PolygonPoint >& points,
+                         std::vector< uint32_t >&     triangles ) {
+    /* Newell normal is robust for the non-planar polygons. */
+
+    double normal[ 3 ] = {0.0, 0.0, 0.0};
+    double extent      = 0.0;
+    for ( uint32_t i = 0; i < polygonSize; ++i ) {
+        const FbxVector4& p = pControlPoints[ polygonVertices[ i ] ];
+        const FbxVector4& q = pControlPoints[ polygonVertices[ ( i + 1 ) % polygonSize ] ];
+        normal[ 0 ] += ( p[ 1 ] - q[ 1 ] ) * ( p[ 2 ] + q[ 2 ] );
+        normal[ 1 ] += ( p[ 2 ] - q[ 2 ] ) * ( p[ 0 ] + q[ 0 ] );
+        normal[ 2 ] += ( p[ 0 ] - q[ 0 ] ) * ( p[ 1 ] + q[ 1 ] );
+        extent = std::max( extent, std::max( fabs( p[ 0 ] - q[ 0 ] ), std::max( fabs( p[ 1 ] - q[ 1 ] ), fabs( p[ 2 ] - q[ 2 ] ) ) ) );
+    }
+
+    /* The polygon is projected onto the plane of the dominant normal axis (the Newell normal component is the doubled
+       area of the projected polygon), the projection is flipped to keep the polygon counter-clockwise. */
+
+    const uint32_t axis = fabs( normal[ 0 ] ) > fabs( normal[ 1 ] ) ? ( fabs( normal[ 0 ] ) > fabs( normal[ 2 ] ) ? 0 : 2 )
+                                                                    : ( fabs( normal[ 1 ] ) > fabs( normal[ 2 ] ) ? 1 : 2 );
+    const uint32_t u       = ( axis + 1 ) % 3;
+    const uint32_t v       = ( axis + 2 ) % 3;
+    const double   flip    = normal[ axis ] < 0.0 ? -1.0 : 1.0;
+    const double   epsilon = extent * extent * 1e-10;
+
+    if ( fabs( normal[ axis ] ) <= epsilon ) {
+        return false;
+    }
+
+    points.resize( polygonSize );
+    for ( uint32_t i = 0; i < polygonSize; ++i ) {
+        const FbxVector4& p = pControlPoints[ polygonVertices[ i ] ];
+        points[ i ].x       = p[ u ];
+        points[ i ].y       = p[ v ] * flip;
+    }
+
+    /* Convex quads are split along the first diagonal. */
+
+    if ( 4 == polygonSize && GetDoubledArea( points[ 3 ], points[ 0 ], points[ 1 ] ) > epsilon &&
+         GetDoubledArea( points[ 0 ], points[ 1 ], points[ 2 ] ) > epsilon &&
+         GetDoubledArea( points[ 1 ], points[ 2 ], points[ 3 ] ) > epsilon &&
+         GetDoubledArea( points[ 2 ], points[ 3 ], points[ 0 ] ) > epsilon ) {
+        triangles.insert( triangles.end( ), {0, 1, 2, 0, 2, 3} );
+        return true;
+    }
+
+    if ( IsSelfIntersecting( points, epsilon ) ) {
+        return false;
+    }
+
+    return ClipEars( points, epsilon, triangles );
+}
+
+/**
+ * Triangulates the polygons of the mesh.
+ * The failed polygons are fanned, so the triangles are complete, but the mesh should be triangulated with the SDK.
+ * @param cornerOrder The order of the triangle corners (the exported winding order).
+ * @param triangles The triangles of the polygons in the polygon order.
+ * @return False if the mesh has the degenerate or self-intersecting polygons.
+ **/
+bool TriangulateMesh( FbxMesh* pMesh, const int cornerOrder[ 3 ], apemode::MeshTriangles& triangles ) {
+    auto& s = apemode::Get( );
+
+    const uint32_t    polygonCount    = (uint32_t) pMesh->GetPolygonCount( );
+    const int*        polygonVertices = pMesh->GetPolygonVertices( );
+    const FbxVector4* pControlPoints  = pMesh->GetControlPoints( );
+
+    triangles.cornerPolygonVertices.clear( );
+    triangles.trianglePolygons.clear( );
+    triangles.polygonBaseTriangles.clear( );
+    triangles.cornerPolygonVertices.reserve( polygonCount * 3 );
+    triangles.trianglePolygons.reserve( polygonCount );
+    triangles.polygonBaseTriangles.reserve( polygonCount + 1 );
+
+    std::vector< PolygonPoint > points;
+    std::vector< uint32_t >     polygonTriangles;
+
+    uint32_t polygonCountNgons  = 0;
+    uint32_t polygonCountFailed = 0;
+    for ( uint32_t pi = 0; pi < polygonCount; ++pi ) {
+        triangles.polygonBaseTriangles.push_back( (uint32_t) triangles.trianglePolygons.size( ) );
+
+        const int polygonStart = pMesh->GetPolygonVertexIndex( (int) pi );
+        const int polygonSize  = pMesh->GetPolygonSize( (int) pi );
+
+        /* The lines and points are skipped (the SDK removes them too). */
+        polygonTriangles.clear( );
+        if ( 3 == polygonSize ) {
+            polygonTriangles.insert( polygonTriangles.end( ), {0, 1, 2} );
+        } else if ( polygonSize > 3 ) {
+            ++polygonCountNgons;
+            if ( false == TriangulatePolygon( pControlPoints, polygonVertices + polygonStart, (uint32_t) polygonSize, points, polygonTriangles ) ) {
+                ++polygonCountFailed;
+                polygonTriangles.clear( );
+                for ( int i = 1; i + 1 < polygonSize; ++i ) {
+                    polygonTriangles.insert( polygonTriangles.end( ), {0u, (uint32_t) i, (uint32_t) i + 1} );
+                }
+            }
+        }
+
+        for ( size_t t = 0; t < polygonTriangles.size( ); t += 3 ) {
+            for ( uint32_t k = 0; k < 3; ++k ) {
+                triangles.cornerPolygonVertices.push_back( (uint32_t) polygonStart + polygonTriangles[ t + cornerOrder[ k ] ] );
+            }
+
+            triangles.trianglePolygons.push_back( pi );
+        }
+    }
+
+    triangles.polygonBaseTriangles.push_back( (uint32_t) triangles.trianglePolygons.size( ) );
+
+    if ( polygonCountNgons ) {
+        s.console->info( "Mesh \"{}\" has {} polygons with more than 3 vertices ({} triangles).",
+                         pMesh->GetNode( )->GetName( ),
+                         polygonCountNgons,
+                         triangles.trianglePolygons.size( ) );
+    }
+
+    if ( polygonCountFailed ) {
+        s.console->warn( "Mesh \"{}\" has {} degenerate or self-intersecting polygons.", pMesh->GetNode( )->GetName( ), polygonCountFailed );
+    }
+
+    return 0 == polygonCountFailed;
+}